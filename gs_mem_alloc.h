@@ -21,10 +21,39 @@
 // This is a single-header C99/C++ library that implements a set of simple allocators: 
 //  - GSStack:    a stack allocator with push and pop operations, which must be
 //                performed in reverse order 
+//  - GSCompactStack: a stack allocator storing 32-bit footers instead of 
+//                pointers, for many small allocations
+//  - GSDoubleStack: two stacks sharing a buffer, one growing from its beginning
+//                (front) and the other from its end (back)
 //  - GSScratch:  a linear allocator (AKA arena) with a push operation that appends 
-//                the newly allocated memory block after the last one.
+//                the newly allocated memory block after the last one. It can
+//                optionally grow by chaining chunks acquired from a backing.
+//  - GSFrameScratch: a set of 2 to 4 scratches rotated every frame, so that 
+//                allocations live for as many frames as scratches
 //  - GSPool:     a pool allocator with alloc and free operations to allocate
-//                blocks of fixed size
+//                blocks of fixed size. It optionally keeps an occupancy bitmap
+//                to iterate its live blocks in address order
+//  - GSTypedPool: a pool of blocks of a type known at compile time, whose
+//                stride is a constant. Generated per type with 
+//                GS_TYPED_POOL_DEFINE in C, or a template in C++
+//  - GSHandlePool: a GSPool whose blocks are referenced through generational
+//                handles, which detect stale references
+//  - GSAtomicPool: a lock-free version of GSPool that can be used concurrently 
+//                from multiple threads
+//  - GSAtomicScratch: a lock-free version of GSScratch that can be pushed to
+//                concurrently from multiple threads, which can also claim
+//                private sub-blocks
+//  - GSPoolCache: a per-thread cache of GSPool blocks (magazines) backed by a
+//                shared depot (GSPoolDepot) 
+//  - GSSlabPool: a pool of fixed size blocks that grows by acquiring slabs
+//                from a backing, with cache coloring of the slabs
+//  - GSSizeClassAllocator: a general purpose allocator for small objects built
+//                from a table of pools, one per size class
+//  - GSTlsf:     a Two-Level Segregated Fit allocator with constant time alloc
+//                and free of blocks of arbitrary size, freed in any order
+//  - GSNodeSet:  a scratch and an atomic pool per NUMA node, backed by memory
+//                bound to the node and selected by the node of the calling 
+//                thread
 //
 //
 // DEPENDENCIES:
@@ -32,6 +61,15 @@
 // - stdio.h and signal.h when compiled GS_MEM_ALLOC_DISABLE_ASSERTS or
 //   GS_MEM_ALLOC_DISABLE_CHECKS are not defined, 
 // - string.h when GS_MEM_ALLOC_INITIALIZE_TO_ZERO is defined
+// - stdio.h when GS_MEM_ALLOC_ENABLE_TRACE is defined
+// - sys/mman.h and unistd.h (Linux) or windows.h (Windows) for the virtual
+//   memory and huge page backed allocators. Explicit huge pages must be
+//   reserved by the system (vm.nr_hugepages on Linux, the "Lock pages in
+//   memory" privilege on Windows), otherwise normal pages are used
+// - sys/syscall.h (Linux) for binding memory to NUMA nodes, which is done 
+//   through the mbind/set_mempolicy system calls without libnuma
+// - A compiler supporting the __atomic builtins (GCC/Clang/Clang-CL) for the 
+//   thread safe allocators
 //
 // USAGE:
 //
@@ -39,6 +77,10 @@
 // #define GS_MEM_ALLOC_IMPLEMENTATION
 // #include "gs_mem_alloc.h"
 //
+// When compiling in a strict mode such as -std=c99, include the implementation
+// before any system header, so that the extensions it requests (mmap flags,
+// madvise, syscall) are declared.
+//
 // To create an allocator (e.g. a stack) use the "init" method as follows,
 // where ptr is a pointer to a buffer (either allocated with malloc, new, 
 // or another allocator) and size is the size of that buffer:
@@ -108,12 +150,44 @@
 //                                      addresses. Default: unsigned long long
 // - GS_MEM_ALLOC_PTR_ALIGNMENT                 : Alignment used when storing pointers in
 //                                      memory. Default: sizeof(void*)
+// - GS_MEM_ALLOC_CACHE_LINE_SIZE     : Size of a cache line, used to avoid false
+//                                      sharing in thread safe allocators. Default: 64
+// - GS_MEM_ALLOC_FRAME_SCRATCH_MAX_FRAMES: Maximum number of frames of a
+//                                      GSFrameScratch. Default: 4
+// - GS_MEM_ALLOC_32BIT_HANDLES      : If defined, GSHandle is 32 bits instead
+//                                      of 64 bits
+// - GS_MEM_ALLOC_HANDLE_INDEX_BITS   : Number of bits of a GSHandle used for the
+//                                      block index, the rest are used for the 
+//                                      generation. Default: 20 for 32-bit 
+//                                      handles, 32 otherwise
+// - GS_MEM_ALLOC_SIZE_CLASS_PAGE_SIZE: Size of the pages assigned to each size
+//                                      class of GSSizeClassAllocator. Default: 65536
+// - GS_MEM_ALLOC_MAX_NUMA_NODES      : Maximum number of NUMA nodes of a 
+//                                      GSNodeSet. Default: 8
 // - GS_MEM_ALLOC_DISABLE_ASSERTS     : If defined, disables asserts
 // - GS_MEM_ALLOC_DISABLE_CHECKS      : If defined, disables asserts in "CHECKED"
 //                                      allocation operations
 // - GS_MEM_ALLOC_INITIALIZE_TO_ZERO  : If defined, all allocations are zero
 //                                      initialized
+// - GS_MEM_ALLOC_LAZY_PURGE         : If defined, the pages released by the trim
+//                                      methods are reclaimed lazily by the 
+//                                      system (MADV_FREE instead of 
+//                                      MADV_DONTNEED on Linux)
 // - GS_MEM_ALLOC_STATIC              : Makes the methods static
+// - GS_MEM_ALLOC_DISABLE_INLINE      : If defined, the fast paths of the stack,
+//                                      scratch and pool are not inlined (see 
+//                                      FAST PATHS). They are never inlined when
+//                                      stats, trace or zero initialization are
+//                                      enabled
+// - GS_MEM_ALLOC_ENABLE_STATS        : If defined, GSStack, GSScratch and GSPool
+//                                      track usage statistics, queried with the
+//                                      gs_*_get_stats methods
+// - GS_MEM_ALLOC_ENABLE_TRACE        : If defined, the operations on GSStack,
+//                                      GSScratch and GSPool are recorded into the
+//                                      GSTrace set with gs_trace_begin
+// - GS_MEM_ALLOC_ENABLE_CPP          : If defined and compiled as C++, declares
+//                                      the STL allocators and (C++17) the 
+//                                      std::pmr::memory_resource adapters
 //
 ////////////////////////////////////////////////
 /////////////////// LICENSE ////////////////////
@@ -154,6 +228,17 @@ extern "C" {
 #define GS_MEM_ALLOC_VISIBILITY
 #endif
 
+#if !defined(GS_MEM_ALLOC_DISABLE_INLINE) && !defined(GS_MEM_ALLOC_ENABLE_STATS) && \
+    !defined(GS_MEM_ALLOC_ENABLE_TRACE) && !defined(GS_MEM_ALLOC_INITIALIZE_TO_ZERO)
+#define GS_MEM_ALLOC_INLINE_FAST_PATHS
+#endif
+
+#ifdef GS_MEM_ALLOC_INLINE_FAST_PATHS
+#define GS_MEM_ALLOC_FAST_PATH static inline
+#else
+#define GS_MEM_ALLOC_FAST_PATH GS_MEM_ALLOC_VISIBILITY
+#endif
+
 
 
 #ifndef GS_MEM_ALLOC_MIN_ALIGNMENT
@@ -168,19 +253,64 @@ extern "C" {
 #define GS_MEM_ALLOC_PTR_ALIGNMENT          sizeof(void*)
 #endif
 
+#ifndef GS_MEM_ALLOC_CACHE_LINE_SIZE
+#define GS_MEM_ALLOC_CACHE_LINE_SIZE        64
+#endif
+
+#ifndef GS_MEM_ALLOC_FRAME_SCRATCH_MAX_FRAMES
+#define GS_MEM_ALLOC_FRAME_SCRATCH_MAX_FRAMES 4
+#endif
+
+#ifndef GS_MEM_ALLOC_HANDLE_INDEX_BITS
+#ifdef GS_MEM_ALLOC_32BIT_HANDLES
+#define GS_MEM_ALLOC_HANDLE_INDEX_BITS      20
+#else
+#define GS_MEM_ALLOC_HANDLE_INDEX_BITS      32
+#endif
+#endif
+
+#ifndef GS_MEM_ALLOC_SIZE_CLASS_PAGE_SIZE
+#define GS_MEM_ALLOC_SIZE_CLASS_PAGE_SIZE   65536
+#endif
+
+#ifndef GS_MEM_ALLOC_MAX_NUMA_NODES
+#define GS_MEM_ALLOC_MAX_NUMA_NODES         8
+#endif
+
 #define GS_PTR_DIFF(ptr1, ptr2)\
             ((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ptr1) - ((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ptr2)
 
+#define GS_LIKELY(_cond)\
+            __builtin_expect(!!(_cond), 1)
+
+#define GS_UNLIKELY(_cond)\
+            __builtin_expect(!!(_cond), 0)
+
+
+// Casts a numeric address back to the pointer type of ptr, which C++ does not
+// convert implicitly from void*
+#ifdef __cplusplus
+#define GS_PTR_CAST(ptr, address)\
+            ((decltype(ptr))(address))
+#else
+#define GS_PTR_CAST(ptr, address)\
+            ((void*)(address))
+#endif
 
 #define GS_ALIGN_PTR(ptr, alignment)\
                     {\
                       int modulo = ((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ptr & (alignment-1));/* this only works for power of two alignments*/\
                       if(modulo != 0)\
                       {\
-                        ptr = (void*)((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ptr + (alignment-modulo));\
+                        ptr = GS_PTR_CAST(ptr, (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ptr + (alignment-modulo));\
                       }\
                     }
 
+// Branchless counterpart of GS_ALIGN_PTR, evaluating to the aligned address. 
+// Only works for power of two alignments
+#define GS_ALIGN_ADDRESS(ptr, alignment)\
+            (((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)(ptr) + ((alignment)-1)) & ~((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)(alignment)-1))
+
 ////////////////////////////////////////////////
 ////////////////// ALLOC ///////////////////////
 ////////////////////////////////////////////////
@@ -193,15 +323,325 @@ typedef struct GSAlloc
 } GSAlloc;
 
 // Checks if the allocation is NULL and sets the alloc as checked
-GS_MEM_ALLOC_VISIBILITY
+GS_MEM_ALLOC_FAST_PATH
 bool
 gs_alloc_is_null(GSAlloc* alloc); // The alloc to check NULL for
 
 // Gets the pointer of an alloc. Throws an assert if not checked
-GS_MEM_ALLOC_VISIBILITY
+GS_MEM_ALLOC_FAST_PATH
 void* 
 gs_alloc_ptr(GSAlloc* alloc);     // The alloc to get the ptr from
 
+#if !defined(GS_MEM_ALLOC_DISABLE_ASSERTS) || !defined(GS_MEM_ALLOC_DISABLE_CHECKS)
+// Prints a failed assert of the inline fast paths and raises SIGABRT. It is 
+// out of line so that the header does not need stdio.h and signal.h
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_assert_fail(const char* condition); // The text of the failed condition
+#endif
+
+// Copy and zero memory without string.h, which is only a dependency when
+// GS_MEM_ALLOC_INITIALIZE_TO_ZERO is defined. Compilers turn these loops into
+// the equivalent library calls when optimizing
+static inline
+void
+gs_mem_copy(void* dst,                                                          // The destination of the copy
+            const void* src,                                                    // The source of the copy, which cannot overlap dst
+            unsigned long long size)                                            // The number of bytes to copy
+{
+  char* d = (char*)dst;
+  const char* s = (const char*)src;
+  for(unsigned long long i = 0; i < size; ++i)
+  {
+    d[i] = s[i];
+  }
+}
+
+static inline
+void
+gs_mem_zero(void* dst,                                                          // The memory to zero
+            unsigned long long size)                                            // The number of bytes to zero
+{
+  char* d = (char*)dst;
+  for(unsigned long long i = 0; i < size; ++i)
+  {
+    d[i] = 0;
+  }
+}
+
+#ifdef GS_MEM_ALLOC_ENABLE_STATS
+////////////////////////////////////////////////
+////////////////// STATS ///////////////////////
+////////////////////////////////////////////////
+
+// Usage statistics of an allocator. Counters are accumulated since the
+// allocator initialization and are preserved by checkpoint restores, while
+// bytes_in_use, live_blocks and free_list_length reflect the current state
+typedef struct GSAllocStats
+{
+  unsigned long long  bytes_in_use;                                             // The bytes currently consumed, including padding and overhead
+  unsigned long long  high_water_mark;                                          // The maximum value of bytes_in_use
+  unsigned long long  num_allocs;                                               // The number of successful allocations
+  unsigned long long  num_frees;                                                // The number of frees (pops for stacks)
+  unsigned long long  num_failed_allocs;                                        // The number of allocations that returned NULL
+  unsigned long long  padding_bytes;                                            // The bytes lost to alignment padding
+  unsigned long long  overhead_bytes;                                           // The bytes used by stack footers
+  unsigned long long  live_blocks;                                              // The number of allocated blocks (pools only)
+  unsigned long long  free_list_length;                                         // The number of blocks in the free list (pools only)
+} GSAllocStats;
+#endif
+
+////////////////////////////////////////////////
+////////////////// TRACE ///////////////////////
+////////////////////////////////////////////////
+
+// The trace events and file format are always declared so that tools can read
+// traces, but operations are only recorded when GS_MEM_ALLOC_ENABLE_TRACE is
+// defined
+
+// Allocator types recorded in trace events
+#define GS_TRACE_STACK                      0
+#define GS_TRACE_SCRATCH                    1
+#define GS_TRACE_POOL                       2
+
+// Operations recorded in trace events
+#define GS_TRACE_OP_INIT                    0                                   // size is the region size. For pools ptr is the block size, for chained scratches the chunk size
+#define GS_TRACE_OP_ALLOC                   1                                   // push or alloc. ptr is NULL if the allocation failed
+#define GS_TRACE_OP_ALLOC_ALL               2                                   // push_all. size is the allocated size
+#define GS_TRACE_OP_FREE                    3                                   // pop or free
+#define GS_TRACE_OP_FLUSH                   4
+#define GS_TRACE_OP_CHECKPOINT              5                                   // ptr is the current pointer of the allocator
+#define GS_TRACE_OP_RESTORE                 6                                   // ptr is the current pointer of the checkpoint restored
+#define GS_TRACE_OP_RESIZE                  7                                   // resize_top or resize_last in place. size is the new size
+
+#define GS_TRACE_FILE_MAGIC                 0x52545347                          // "GSTR"
+#define GS_TRACE_FILE_VERSION               1
+
+// A trace event. Allocators are identified by an id assigned on init
+typedef struct GSTraceEvent
+{
+  unsigned long long  ptr;
+  unsigned long long  size;
+  unsigned int        alignment;
+  unsigned int        id;
+  unsigned char       allocator;
+  unsigned char       op;
+  unsigned char       reserved[6];
+} GSTraceEvent;
+
+// Header of a trace file, followed by num_events GSTraceEvent in the order
+// they were recorded
+typedef struct GSTraceFileHeader
+{
+  unsigned int        magic;
+  unsigned int        version;
+  unsigned int        event_size;
+  unsigned int        reserved;
+  unsigned long long  num_events;
+  unsigned long long  num_dropped;                                              // The oldest events overwritten in the ring buffer
+} GSTraceFileHeader;
+
+#ifdef GS_MEM_ALLOC_ENABLE_TRACE
+// A ring buffer of trace events. When full, the oldest events are overwritten
+typedef struct GSTrace
+{
+  bool                valid;
+  GSTraceEvent*       p_events;
+  unsigned long long  capacity;                                                 // A power of two
+  unsigned long long  count;                                                    // The number of events recorded, including overwritten ones
+} GSTrace;
+
+// Returns a new initialized trace stored in the given memory region. The
+// trace is marked valid if the region can hold at least one event
+GS_MEM_ALLOC_VISIBILITY
+GSTrace
+gs_trace_init(void* mem_ptr,                                                    // The pointer to the memory region for the events
+              unsigned long long size);                                         // The size of the memory region
+
+
+
+// Starts recording the operations of all allocators into the trace. Events can
+// be recorded concurrently from multiple threads
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_trace_begin(GSTrace* trace);                                                 // The trace to record to
+
+
+
+// Stops recording operations
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_trace_end(void);
+
+
+
+// Writes the trace to a file. Must not be called while events are being
+// recorded into the trace. Returns false if the file cannot be written
+GS_MEM_ALLOC_VISIBILITY
+bool
+gs_trace_dump(GSTrace* trace,                                                   // The trace to dump
+              const char* path);                                                // The path of the file to write
+#endif
+
+////////////////////////////////////////////////
+////////////////// VIRTUAL MEMORY //////////////
+////////////////////////////////////////////////
+
+// Value of the decommit watermark that disables decommitting memory on flush
+#define GS_MEM_ALLOC_NO_DECOMMIT            0xffffffffffffffffull
+
+// Header stored at the beginning of a reserved virtual memory range backing an
+// allocator. It lives in the range itself so that checkpoints, which copy the
+// allocator by value, do not hold stale copies of the committed size.
+typedef struct GSVirtualRegion
+{
+  void*                 p_committed;                                            // The end of the committed memory
+  unsigned long long    reserve_size;                                           // The size of the reserved range
+  unsigned long long    commit_granularity;                                     // The granularity memory is committed with (a power of two)
+  unsigned long long    decommit_watermark;                                     // The committed bytes kept on flush 
+} GSVirtualRegion;
+
+// Returns the size of a page of virtual memory
+GS_MEM_ALLOC_VISIBILITY
+unsigned long long
+gs_vm_page_size(void);
+
+
+
+// Reserves a range of virtual memory without committing it. Returns NULL if
+// the operation fails
+GS_MEM_ALLOC_VISIBILITY
+void*
+gs_vm_reserve(unsigned long long size);                                         // The size of the range to reserve
+
+
+
+// Commits a page aligned range of previously reserved memory. Returns false if
+// the operation fails
+GS_MEM_ALLOC_VISIBILITY
+bool
+gs_vm_commit(void* ptr,                                                         // The start address of the range to commit
+             unsigned long long size);                                          // The size of the range to commit
+
+
+
+// Decommits a page aligned range of committed memory, returning its physical
+// pages to the OS. The range stays reserved
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_vm_decommit(void* ptr,                                                       // The start address of the range to decommit
+               unsigned long long size);                                        // The size of the range to decommit
+
+
+
+// Returns the physical pages of a page aligned range of committed memory to
+// the OS. The range stays committed and accessible, but its contents are 
+// undefined afterwards (see GS_MEM_ALLOC_LAZY_PURGE)
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_vm_purge(void* ptr,                                                          // The start address of the range to purge
+            unsigned long long size);                                           // The size of the range to purge
+
+
+
+// Releases a range of virtual memory previously reserved with gs_vm_reserve
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_vm_release(void* ptr,                                                        // The start address of the reserved range
+              unsigned long long size);                                         // The size of the reserved range
+
+
+
+// Huge page sizes accepted by gs_vm_map_pages
+#define GS_VM_PAGE_SIZE_2MB                 (2ull*1024*1024)
+#define GS_VM_PAGE_SIZE_1GB                 (1024ull*1024*1024)
+
+// The kinds of pages a mapping can be backed with
+#define GS_VM_PAGES_NORMAL                  0                                   // Regular pages of gs_vm_page_size() bytes
+#define GS_VM_PAGES_TRANSPARENT             1                                   // Regular pages the kernel is advised to promote to huge pages (Linux THP)
+#define GS_VM_PAGES_HUGETLB                 2                                   // Explicit huge pages (MAP_HUGETLB or MEM_LARGE_PAGES)
+
+// Header stored at the beginning of a committed mapping created with
+// gs_vm_map_pages, recording the pages it was obtained with
+typedef struct GSVmMapping
+{
+  unsigned long long    size;                                                   // The size of the mapping, header included
+  unsigned long long    page_size;                                              // The size of the pages backing the mapping
+  unsigned int          kind;                                                   // One of the GS_VM_PAGES_* kinds
+} GSVmMapping;
+
+// The header size is rounded up to keep the mapped data aligned
+#define GS_VM_MAPPING_HEADER_SIZE\
+  ((sizeof(GSVmMapping) + GS_MEM_ALLOC_MIN_ALIGNMENT - 1) & ~(GS_MEM_ALLOC_MIN_ALIGNMENT - 1))
+
+#define GS_VM_MAPPING_BEGIN(_mapping)\
+  ((char*)(_mapping) + GS_VM_MAPPING_HEADER_SIZE)
+
+#define GS_VM_MAPPING_END(_mapping)\
+  ((char*)(_mapping) + (_mapping)->size)
+
+// Maps a committed, read-write range of at least size bytes backed by pages of
+// page_size bytes (e.g. GS_VM_PAGE_SIZE_2MB). On Linux explicit huge pages
+// (MAP_HUGETLB) are tried first, then transparent huge pages
+// (madvise(MADV_HUGEPAGE), at most 2MB) on an aligned range, and finally
+// normal pages. On Windows large pages (MEM_LARGE_PAGES) are tried before
+// normal pages. The pages obtained are reported in the returned header, which
+// lives at the beginning of the range. Transparent huge pages are only
+// advised, so the kernel may still back parts of the range with normal pages.
+// Returns NULL if the operation fails
+GS_MEM_ALLOC_VISIBILITY
+GSVmMapping*
+gs_vm_map_pages(unsigned long long size,                                        // The minimum size of the range to map
+                unsigned long long page_size);                                  // The requested page size (a power of two)
+
+
+
+// Unmaps a range previously mapped with gs_vm_map_pages
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_vm_unmap_pages(GSVmMapping* mapping);                                        // The mapping to unmap
+
+
+
+// Node value that resets the preferred node of gs_vm_prefer_node
+#define GS_VM_NO_NODE                       0xffffffffu
+
+// Returns the number of NUMA nodes memory can be bound to, capped to
+// GS_MEM_ALLOC_MAX_NUMA_NODES. Returns 1 on systems without NUMA support
+GS_MEM_ALLOC_VISIBILITY
+unsigned int
+gs_vm_num_nodes(void);
+
+
+
+// Returns the NUMA node of the CPU the calling thread is running on, or 0 if
+// it cannot be determined. The thread may migrate right after the call
+GS_MEM_ALLOC_VISIBILITY
+unsigned int
+gs_vm_current_node(void);
+
+
+
+// Binds a page aligned range of memory to a NUMA node. Pages not touched yet
+// are allocated on the node, and pages already touched are migrated to it.
+// Returns false if the operation fails or is not supported (Windows, kernels
+// without NUMA support), in which case the range is left untouched
+GS_MEM_ALLOC_VISIBILITY
+bool
+gs_vm_bind_node(void* ptr,                                                      // The start address of the range to bind
+                unsigned long long size,                                        // The size of the range to bind
+                unsigned int node);                                             // The node to bind the range to
+
+
+
+// Makes the pages first touched by the calling thread be allocated on a NUMA
+// node when possible, or resets the default policy if node is GS_VM_NO_NODE.
+// Returns false if the operation fails or is not supported
+GS_MEM_ALLOC_VISIBILITY
+bool
+gs_vm_prefer_node(unsigned int node);                                           // The preferred node, or GS_VM_NO_NODE
+
+
 ////////////////////////////////////////////////
 ////////////////// STACK ///////////////////////
 ////////////////////////////////////////////////
@@ -239,11 +679,31 @@ gs_alloc_ptr(GSAlloc* alloc);     // The alloc to get the ptr from
 #define GS_STACK_POP(stack, ptr)\
                 gs_stack_pop(stack, ptr)
 
+#define GS_STACK_PUSH_SIZED(stack, size)\
+                gs_stack_push_sized(stack, size)
+
+#define GS_STACK_PUSH_SIZED_CHECKED(stack, size)\
+                gs_stack_push_sized_CHECKED(stack, size)
+
+#define GS_STACK_POP_SIZED(stack, ptr, size)\
+                gs_stack_pop_sized(stack, ptr, size)
+
+#define GS_STACK_RESIZE_TOP(stack, ptr, size)\
+                gs_stack_resize_top(stack, ptr, size)
+
+#if defined(GS_MEM_ALLOC_ENABLE_STATS) || defined(GS_MEM_ALLOC_ENABLE_TRACE)
+#define GS_STACK_CHECKPOINT(_stack)\
+                gs_stack_checkpoint(_stack)
+
+#define GS_STACK_RESTORE(_stack, _checkpoint)\
+                gs_stack_restore(_stack, _checkpoint)
+#else
 #define GS_STACK_CHECKPOINT(_stack)\
                 *(_stack)
 
 #define GS_STACK_RESTORE(_stack, _checkpoint)\
                 *(_stack) = _checkpoint
+#endif
 
 #define GS_STACK_FLUSH(_stack)\
                 gs_stack_flush(_stack)
@@ -255,6 +715,14 @@ typedef struct GSStack
   void*             p_begin;
   void*             p_end;
   void*             p_current;
+  GSVirtualRegion*  p_region;                                                   // NULL if not backed by reserved virtual memory
+  GSVmMapping*      p_mapping;                                                  // NULL if not backed by an owned page mapping
+#ifdef GS_MEM_ALLOC_ENABLE_STATS
+  GSAllocStats      stats;
+#endif
+#ifdef GS_MEM_ALLOC_ENABLE_TRACE
+  unsigned int      trace_id;
+#endif
 } GSStack;
 
 typedef GSStack GSStackCheckpoint;
@@ -268,6 +736,46 @@ gs_stack_init(void* mem_ptr,
 
 
 
+//Returns a new initialized stack allocator backed by a reserved range of
+//virtual memory. Memory is committed in commit_granularity steps as the stack
+//grows, and decommitted on flush beyond decommit_watermark bytes (use
+//GS_MEM_ALLOC_NO_DECOMMIT to disable). If the operation fails the returned
+//stack is not marked as valid
+GS_MEM_ALLOC_VISIBILITY
+GSStack
+gs_stack_init_virtual(unsigned long long reserve_size,                          // The size of the virtual memory range to reserve
+                      unsigned long long commit_granularity,                    // The granularity memory is committed with (a power of two)
+                      unsigned long long decommit_watermark);                   // The committed bytes kept when flushing
+
+
+
+//Releases the virtual memory of a stack created with gs_stack_init_virtual
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_stack_release_virtual(GSStack* stack);                                       // The stack to release
+
+
+
+//Returns a new initialized stack allocator backed by a mapping it owns,
+//obtained with gs_vm_map_pages. The pages obtained can be read from 
+//stack.p_mapping. The mapping header is carved from the size rounded up to the
+//pages obtained, so a size multiple of the page size loses 
+//GS_VM_MAPPING_HEADER_SIZE bytes instead of mapping an extra page. If the 
+//operation fails the returned stack is not marked as valid
+GS_MEM_ALLOC_VISIBILITY
+GSStack
+gs_stack_init_huge(unsigned long long size,                                     // The size of the memory region for the stack
+                   unsigned long long page_size);                               // The requested page size (e.g. GS_VM_PAGE_SIZE_2MB)
+
+
+
+//Unmaps the memory of a stack created with gs_stack_init_huge
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_stack_release_huge(GSStack* stack);                                          // The stack to release
+
+
+
 //Flushes the stack mem alloc
 GS_MEM_ALLOC_VISIBILITY
 void
@@ -275,9 +783,20 @@ gs_stack_flush(GSStack* stack);
 
 
 
+// Returns the pages of the stack after its top to the OS, except for the first
+// retain bytes, which are kept for the next pushes. Only whole pages inside 
+// the stack are released, whatever the origin of its memory. Returns the 
+// bytes released
+GS_MEM_ALLOC_VISIBILITY
+unsigned long long
+gs_stack_trim(GSStack* stack,                                                   // The stack to trim
+              unsigned long long retain);                                       // The bytes after the top kept resident
+
+
+
 // Requests a new memory block from the stack memory allocator. The alloc is
 // NULL if the requested block cannot be allocated
-GS_MEM_ALLOC_VISIBILITY
+GS_MEM_ALLOC_FAST_PATH
 GSAlloc
 gs_stack_push(GSStack* stack,                                                   // The stack memory allocator to request the address from
               unsigned long long size,                                          // The size to reques
@@ -285,10 +804,20 @@ gs_stack_push(GSStack* stack,
 
 
 
+// The out of line path of gs_stack_push, called by its fast path when the
+// block does not fit in the stack or its committed memory
+GS_MEM_ALLOC_VISIBILITY
+GSAlloc
+gs_stack_push_slow(GSStack* stack,                                              // The stack memory allocator to request the address from
+                   unsigned long long size,                                     // The size to request
+                   unsigned int alignment);                                     // The alignment of the requested address
+
+
+
 // Requests a new memory block from the stack memory allocator. This a CHECKED
 // operation, thus it will throw an assert if the allocation fails (the returned
 // pointer is NULL) unless GS_MEM_ALLOC_DISABLE_CHECKS is defined
-GS_MEM_ALLOC_VISIBILITY
+GS_MEM_ALLOC_FAST_PATH
 void*
 gs_stack_push_CHECKED(GSStack* stack,                                           // The stack to allocate from
                       unsigned long long size,                                  // The size of the allocation
@@ -321,313 +850,6334 @@ gs_stack_push_all_CHECKED(GSStack* stack,
 // for correctness. If GS_MEM_ALLOC_DISABLE_ASSERTS is not defined, 
 // the implementation will check that ptr is actually the allocation at the top and
 // throw an assert if this is not the case.
-GS_MEM_ALLOC_VISIBILITY
+GS_MEM_ALLOC_FAST_PATH
 void
 gs_stack_pop(GSStack* stack,                                                    // The stack memory allocator to pop from
              void* ptr);                                                        // The start address region expected to pop, passed for correctness checks.
 
 
-////////////////////////////////////////////////
-/////////////////// SCRATCH ////////////////////
-////////////////////////////////////////////////
-
-#define GS_SCRATCH_PUSH(scratch, size)\
-          gs_scratch_push(scratch, size, GS_MEM_ALLOC_MIN_ALIGNMENT)
-
-#define GS_SCRATCH_PUSH_CHECKED(scratch, size)\
-          gs_scratch_push_CHECKED(scratch, size, GS_MEM_ALLOC_MIN_ALIGNMENT)
 
-#define GS_SCRATCH_PUSH_ALIGNED(scratch, size, alignment)\
-          gs_scratch_push(scratch, size, alignment)
+// Returns whether ptr is the block at the top of the stack, pushed with
+// gs_stack_push, and thus can be popped
+GS_MEM_ALLOC_VISIBILITY
+bool
+gs_stack_is_top(GSStack* stack,                                                 // The stack memory allocator
+                void* ptr);                                                     // The address of the block
 
-#define GS_SCRATCH_PUSH_ALIGNED_CHECKED(scratch, size, alignment)\
-          gs_scratch_push_CHECKED(scratch, size, alignment)
 
-#define GS_SCRATCH_PUSH_ALL(scratch, allocated)\
-          gs_scratch_push_all(scratch, GS_MEM_ALLOC_MIN_ALIGNMENT, allocated)
 
-#define GS_SCRATCH_PUSH_ALL_CHECKED(scratch, allocated)\
-          gs_scratch_push_all_CHECKED(scratch, GS_MEM_ALLOC_MIN_ALIGNMENT, allocated)
+// Requests a new memory block aligned to GS_MEM_ALLOC_PTR_ALIGNMENT without
+// writing a footer after it. The block must be popped with gs_stack_pop_sized
+// passing the same size, which avoids the footer overhead for small blocks.
+// Sized and regular pushes can be interleaved. The alloc is NULL if the 
+// requested block cannot be allocated
+GS_MEM_ALLOC_VISIBILITY
+GSAlloc
+gs_stack_push_sized(GSStack* stack,                                             // The stack to allocate from
+                    unsigned long long size);                                   // The size of the allocation
 
-#define GS_SCRATCH_CHECKPOINT(_scratch)\
-          *(_scratch)
 
-#define GS_SCRATCH_RESTORE(_scratch, _checkpoint)\
-          {\
-          *(_scratch) = _checkpoint;\
-          }
 
-#define GS_SCRATCH_FLUSH(_scratch)\
-         gs_scratch_flush(_scratch)
+// Requests a new memory block without writing a footer after it. This a 
+// CHECKED operation, thus it will throw an assert if the allocation fails (the
+// returned pointer is NULL) unless GS_MEM_ALLOC_DISABLE_CHECKS is defined
+GS_MEM_ALLOC_VISIBILITY
+void*
+gs_stack_push_sized_CHECKED(GSStack* stack,                                     // The stack to allocate from
+                    unsigned long long size);                                   // The size of the allocation
 
-typedef struct GSScratch
-{
-  bool valid;
-  void* p_begin; 
-  void* p_current; 
-  void* p_end; 
-} GSScratch;
 
-typedef GSScratch GSScratchCheckpoint;
 
- // Returns a new initialized scratch maked valid if the operation succeeds
+// Pops the last allocation from the stack, which must have been pushed with
+// gs_stack_push_sized and the same size
 GS_MEM_ALLOC_VISIBILITY
-GSScratch
-gs_scratch_init(void* base_addr,                                                // base_addr The base address of the allocator
-                unsigned long long size);                                       // The size of the allocator
+void
+gs_stack_pop_sized(GSStack* stack,                                              // The stack to pop from
+                   void* ptr,                                                   // The address of the allocation to pop
+                   unsigned long long size);                                    // The size the allocation was pushed with
 
 
 
-// Returns a new memory block from the scratch. The alloc is
-// NULL if the requested block cannot be allocated
+// Grows or shrinks the allocation at the top of the stack in place, moving its
+// footer. Returns false, leaving the stack untouched, if ptr is not the top 
+// allocation or the stack has not enough space. Allocations pushed with 
+// gs_stack_push_sized cannot be resized
 GS_MEM_ALLOC_VISIBILITY
-GSAlloc
-gs_scratch_push(GSScratch* scratch,                                             // The memory allocator to allocate from
-                 unsigned long long  size,                                      // The size to allocate
-                 unsigned int alignment);                                       // The requested alignment of the allocation
+bool
+gs_stack_resize_top(GSStack* stack,                                             // The stack the allocation belongs to
+                    void* ptr,                                                  // The address of the top allocation
+                    unsigned long long size);                                   // The new size of the allocation
 
 
 
-// Retursn a new memory block from the scratch. This a CHECKED
-// operation, thus it will throw an assert if the allocation fails (the returned
-// pointer is NULL) unless GS_MEM_ALLOC_DISABLE_CHECKS is defined
+// Returns a checkpoint of the stack. Use the GS_STACK_CHECKPOINT macro, which
+// only calls this method when statistics or tracing are enabled
 GS_MEM_ALLOC_VISIBILITY
-void*
-gs_scratch_push_CHECKED(GSScratch* scratch,                                     // The memory allocator to allocate from
-                         unsigned long long  size,                              // The size to allocate                      
-                         unsigned int alignment);                               // The requested alignment of the allocation
+GSStackCheckpoint
+gs_stack_checkpoint(GSStack* stack);                                            // The stack to checkpoint
 
 
 
-// Returns all the remianing memory in the scratch. The alloc is
-// NULL if the requested block cannot be allocated
+// Restores the stack to a checkpoint, keeping its accumulated statistics. Use
+// the GS_STACK_RESTORE macro, which only calls this method when statistics or
+// tracing are enabled
 GS_MEM_ALLOC_VISIBILITY
-GSAlloc
-gs_scratch_push_all(GSScratch* scratch,                                         // The mem alloc to allocate to
-                     unsigned int alignment,                                    // The alignment of the requested allocation
-                     unsigned long long * size);                                // The allocated size 
+void
+gs_stack_restore(GSStack* stack,                                                // The stack to restore
+                 GSStackCheckpoint checkpoint);                                 // The checkpoint to restore
 
+#ifdef GS_MEM_ALLOC_ENABLE_STATS
 
 
-// Returns all the remianing memory in the scratch. This a CHECKED
-// operation, thus it will throw an assert if the allocation fails (the returned
-// pointer is NULL) unless GS_MEM_ALLOC_DISABLE_CHECKS is defined
+// Returns the usage statistics of the stack
 GS_MEM_ALLOC_VISIBILITY
-void*
-gs_scratch_push_all_CHECKED(GSScratch* scratch,                                 // The mem alloc to allocate to
-                             unsigned int alignment,                            // The alignment of the requested allocation  
-                             unsigned long long * size);                        // The allocated size 
+GSAllocStats
+gs_stack_get_stats(GSStack* stack);                                             // The stack to get the statistics from
+#endif
 
 
+////////////////////////////////////////////////
+//////////////// COMPACT STACK /////////////////
+////////////////////////////////////////////////
 
-// Flushes the scratch memory allocator
+#define GS_COMPACT_STACK_PUSH(stack, size)\
+                gs_compact_stack_push(stack,\
+                                      size,\
+                                      GS_MEM_ALLOC_MIN_ALIGNMENT)
+
+#define GS_COMPACT_STACK_PUSH_CHECKED(stack, size)\
+                gs_compact_stack_push_CHECKED(stack,\
+                                              size,\
+                                              GS_MEM_ALLOC_MIN_ALIGNMENT)
+
+#define GS_COMPACT_STACK_PUSH_ALIGNED(stack, size, alignment)\
+                gs_compact_stack_push(stack,\
+                                      size,\
+                                      alignment)
+
+#define GS_COMPACT_STACK_PUSH_ALIGNED_CHECKED(stack, size, alignment)\
+                gs_compact_stack_push_CHECKED(stack,\
+                                              size,\
+                                              alignment)
+
+#define GS_COMPACT_STACK_POP(stack, ptr)\
+                gs_compact_stack_pop(stack, ptr)
+
+#define GS_COMPACT_STACK_CHECKPOINT(_stack)\
+                (_stack)->p_current
+
+#define GS_COMPACT_STACK_RESTORE(_stack, _checkpoint)\
+                (_stack)->p_current = _checkpoint
+
+#define GS_COMPACT_STACK_FLUSH(_stack)\
+                gs_compact_stack_flush(_stack)
+
+#define GS_COMPACT_STACK_FOOTER_SIZE 4
+
+// A stack whose allocations are followed by a 4-byte footer with the distance
+// from the footer to the previous top, instead of a pointer to it. Footers are
+// aligned to 4 bytes, so small allocations use less memory than in GSStack.
+// Memory regions are limited to 4GB.
+typedef struct GSCompactStack 
+{
+  bool              valid;
+  void*             p_begin;
+  void*             p_end;
+  void*             p_current;
+} GSCompactStack;
+
+typedef void* GSCompactStackCheckpoint;
+
+//Returns a new initialized compact stack allocator. If the operation fails the
+//returned stack is not marked as valid
+GS_MEM_ALLOC_VISIBILITY
+GSCompactStack
+gs_compact_stack_init(void* mem_ptr,                                            // The pointer to the memory region for the stack
+                      unsigned long long size);                                 // The size of the memory region (up to 4GB)
+
+
+
+// Requests a new memory block from the compact stack. The alloc is NULL if the
+// requested block cannot be allocated
+GS_MEM_ALLOC_VISIBILITY
+GSAlloc
+gs_compact_stack_push(GSCompactStack* stack,                                    // The compact stack to allocate from
+                      unsigned long long size,                                  // The size of the allocation
+                      unsigned int alignment);                                  // The alignment of the allocation
+
+
+
+// Requests a new memory block from the compact stack. This a CHECKED
+// operation, thus it will throw an assert if the allocation fails (the returned
+// pointer is NULL) unless GS_MEM_ALLOC_DISABLE_CHECKS is defined
+GS_MEM_ALLOC_VISIBILITY
+void*
+gs_compact_stack_push_CHECKED(GSCompactStack* stack,                            // The compact stack to allocate from
+                              unsigned long long size,                          // The size of the allocation
+                              unsigned int alignment);                          // The alignment of the allocation
+
+
+
+// Pops the last allocation from the compact stack. The ptr is passed for 
+// correctness checks, as in gs_stack_pop
 GS_MEM_ALLOC_VISIBILITY
 void
-gs_scratch_flush(GSScratch* scratch);                                            // The scratch to flush
+gs_compact_stack_pop(GSCompactStack* stack,                                     // The compact stack to pop from
+                     void* ptr);                                                // The address of the allocation expected to pop
+
+
 
+// Flushes the compact stack
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_compact_stack_flush(GSCompactStack* stack);                                  // The compact stack to flush
 
 ////////////////////////////////////////////////
-/////////////////// POOL ///////////////////////
+//////////////// DOUBLE STACK //////////////////
 ////////////////////////////////////////////////
 
-#define GS_POOL_ALLOC_ALIGNED(pool, size, alignment)\
-    gs_pool_alloc(pool,\
-                  size,\
-                  alignment);
+#define GS_DOUBLE_STACK_PUSH_FRONT(stack, size)\
+                gs_double_stack_push_front(stack,\
+                                           size,\
+                                           GS_MEM_ALLOC_MIN_ALIGNMENT)
 
-#define GS_POOL_ALLOC_ALIGNED_CHECKED(pool, size, alignment)\
-    gs_pool_alloc_CHECKED(pool,\
-                          size,\
-                          alignment);
+#define GS_DOUBLE_STACK_PUSH_FRONT_CHECKED(stack, size)\
+                gs_double_stack_push_front_CHECKED(stack,\
+                                                   size,\
+                                                   GS_MEM_ALLOC_MIN_ALIGNMENT)
 
-#define GS_POOL_FREE(pool, ptr)\
-    gs_pool_free(pool, ptr);
+#define GS_DOUBLE_STACK_PUSH_FRONT_ALIGNED(stack, size, alignment)\
+                gs_double_stack_push_front(stack,\
+                                           size,\
+                                           alignment)
 
-#define GS_POOL_FLUSH(pool)\
-    gs_pool_flush(pool);
+#define GS_DOUBLE_STACK_PUSH_FRONT_ALIGNED_CHECKED(stack, size, alignment)\
+                gs_double_stack_push_front_CHECKED(stack,\
+                                                   size,\
+                                                   alignment)
 
-typedef struct GSPool 
+#define GS_DOUBLE_STACK_PUSH_BACK(stack, size)\
+                gs_double_stack_push_back(stack,\
+                                          size,\
+                                          GS_MEM_ALLOC_MIN_ALIGNMENT)
+
+#define GS_DOUBLE_STACK_PUSH_BACK_CHECKED(stack, size)\
+                gs_double_stack_push_back_CHECKED(stack,\
+                                                  size,\
+                                                  GS_MEM_ALLOC_MIN_ALIGNMENT)
+
+#define GS_DOUBLE_STACK_PUSH_BACK_ALIGNED(stack, size, alignment)\
+                gs_double_stack_push_back(stack,\
+                                          size,\
+                                          alignment)
+
+#define GS_DOUBLE_STACK_PUSH_BACK_ALIGNED_CHECKED(stack, size, alignment)\
+                gs_double_stack_push_back_CHECKED(stack,\
+                                                  size,\
+                                                  alignment)
+
+#define GS_DOUBLE_STACK_POP_FRONT(stack, ptr)\
+                gs_double_stack_pop_front(stack, ptr)
+
+#define GS_DOUBLE_STACK_POP_BACK(stack, ptr)\
+                gs_double_stack_pop_back(stack, ptr)
+
+#define GS_DOUBLE_STACK_CHECKPOINT_FRONT(_stack)\
+                (_stack)->p_front
+
+#define GS_DOUBLE_STACK_CHECKPOINT_BACK(_stack)\
+                (_stack)->p_back
+
+#define GS_DOUBLE_STACK_RESTORE_FRONT(_stack, _checkpoint)\
+                (_stack)->p_front = _checkpoint
+
+#define GS_DOUBLE_STACK_RESTORE_BACK(_stack, _checkpoint)\
+                (_stack)->p_back = _checkpoint
+
+#define GS_DOUBLE_STACK_FLUSH_FRONT(_stack)\
+                gs_double_stack_flush_front(_stack)
+
+#define GS_DOUBLE_STACK_FLUSH_BACK(_stack)\
+                gs_double_stack_flush_back(_stack)
+
+#define GS_DOUBLE_STACK_FLUSH(_stack)\
+                gs_double_stack_flush(_stack)
+
+// The front stack grows from p_begin upwards and the back stack from p_end
+// downwards. Front allocations are followed by a footer with the previous
+// front, as in GSStack, while back allocations are preceded by a header with
+// the previous back, which p_back points to.
+typedef struct GSDoubleStack 
 {
   bool              valid;
   void*             p_begin;
   void*             p_end;
-  void*             p_current;
-  void*             p_next_free;
-  unsigned int      bsize;
-  unsigned int      alignment;
-  unsigned int      stride;
-} GSPool;
+  void*             p_front;
+  void*             p_back;
+} GSDoubleStack;
 
- // Returns a new initialized pool maked valid if the operation succeeds
+// Checkpoints are taken and restored independently for each end
+typedef void* GSDoubleStackCheckpoint;
+
+//Returns a new initialized double stack allocator. If the operation fails the
+//returned stack is not marked as valid
 GS_MEM_ALLOC_VISIBILITY
-GSPool
-gs_pool_init(void* mem_ptr,                                                     // The pointer to the starting address for the pool
-             unsigned long long size,                                           // The size of the pool in bytes
-             unsigned long long bsize,                                          // The size of the blocks to be allocated
-             unsigned int alignment);                                           // The alignment of the blocks to be allocated
+GSDoubleStack
+gs_double_stack_init(void* mem_ptr,                                             // The pointer to the memory region for the stack
+                     unsigned long long size);                                  // The size of the memory region
 
 
 
-// Flushes the memory allocator
+// Requests a new memory block from the front of the double stack. The alloc is
+// NULL if the block would overlap the back stack
 GS_MEM_ALLOC_VISIBILITY
-void
-gs_pool_flush(GSPool* pool);
+GSAlloc
+gs_double_stack_push_front(GSDoubleStack* stack,                                // The double stack to allocate from
+                           unsigned long long size,                             // The size of the allocation
+                           unsigned int alignment);                             // The alignment of the allocation
 
 
 
-// Returns a new block of memory from the pool. The returned block size is that
-// specified during the pool initialization. The size and alignment
-// parameters are used for checking the usage correctness. The alloc is NULL if 
-// there is not enough space in the pool
+// Requests a new memory block from the front of the double stack. This a
+// CHECKED operation, thus it will throw an assert if the allocation fails (the
+// returned pointer is NULL) unless GS_MEM_ALLOC_DISABLE_CHECKS is defined
+GS_MEM_ALLOC_VISIBILITY
+void*
+gs_double_stack_push_front_CHECKED(GSDoubleStack* stack,                        // The double stack to allocate from
+                                   unsigned long long size,                     // The size of the allocation
+                                   unsigned int alignment);                     // The alignment of the allocation
+
+
+
+// Requests a new memory block from the back of the double stack. The alloc is
+// NULL if the block would overlap the front stack
 GS_MEM_ALLOC_VISIBILITY
 GSAlloc
-gs_pool_alloc(GSPool* pool,                                                     // The pool mem alloc to use
-              unsigned long long size,                                          // The size of the memory block (used for debugging purposes)
-              unsigned int alignment);                                          // The alignment of the memory block (used for debugging purposes)
+gs_double_stack_push_back(GSDoubleStack* stack,                                 // The double stack to allocate from
+                          unsigned long long size,                              // The size of the allocation
+                          unsigned int alignment);                              // The alignment of the allocation
 
 
 
-// Returns a new block of memory from the pool. The returned block size is that
-// specified during the pool initialization. The size and alignment
-// parameters are used for checking the usage correctness. This a CHECKED
-// operation, thus it will throw an assert if the allocation fails (the returned
-// pointer is NULL) unless GS_MEM_ALLOC_DISABLE_CHECKS is defined
+// Requests a new memory block from the back of the double stack. This a
+// CHECKED operation, thus it will throw an assert if the allocation fails (the
+// returned pointer is NULL) unless GS_MEM_ALLOC_DISABLE_CHECKS is defined
 GS_MEM_ALLOC_VISIBILITY
 void*
-gs_pool_alloc_CHECKED(GSPool* pool,                                             // The pool mem alloc to use
-                      unsigned long long size,                                  // The size of the memory block (used for debugging purposes)
-                      unsigned int alignment);                                  // The alignment of the memory block (used for debugging purposes)
+gs_double_stack_push_back_CHECKED(GSDoubleStack* stack,                         // The double stack to allocate from
+                                  unsigned long long size,                      // The size of the allocation
+                                  unsigned int alignment);                      // The alignment of the allocation
 
 
 
-// Frees a block allocated with the pool 
+// Pops the last allocation from the front of the double stack. The ptr is
+// passed for correctness checks, as in gs_stack_pop
 GS_MEM_ALLOC_VISIBILITY
-void 
-gs_pool_free(GSPool* pool,                                                      // The pool mem alloc to use
-             void* ptr);                                                        // The address to the block to deallocate
+void
+gs_double_stack_pop_front(GSDoubleStack* stack,                                 // The double stack to pop from
+                          void* ptr);                                           // The address of the allocation expected to pop
 
 
-#ifdef __cplusplus
-}
-#endif
-#endif
+
+// Pops the last allocation from the back of the double stack. The ptr is
+// passed for correctness checks, as in gs_stack_pop
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_double_stack_pop_back(GSDoubleStack* stack,                                  // The double stack to pop from
+                         void* ptr);                                            // The address of the allocation expected to pop
+
+
+
+// Flushes the front of the double stack
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_double_stack_flush_front(GSDoubleStack* stack);                              // The double stack to flush
+
+
+
+// Flushes the back of the double stack
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_double_stack_flush_back(GSDoubleStack* stack);                               // The double stack to flush
+
+
+
+// Flushes both ends of the double stack
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_double_stack_flush(GSDoubleStack* stack);                                    // The double stack to flush
 
 ////////////////////////////////////////////////
-////////////////////////////////////////////////
+/////////////////// SCRATCH ////////////////////
 ////////////////////////////////////////////////
 
-#ifdef GS_MEM_ALLOC_IMPLEMENTATION
+#define GS_SCRATCH_PUSH(scratch, size)\
+          gs_scratch_push(scratch, size, GS_MEM_ALLOC_MIN_ALIGNMENT)
 
-#ifndef GS_MEM_ALLOC_DISABLE_ASSERTS
-#ifndef GS_MEM_ALLOC_DISABLE_CHECKS
-#include <signal.h>
-#include <stdio.h>
-#endif
+#define GS_SCRATCH_PUSH_CHECKED(scratch, size)\
+          gs_scratch_push_CHECKED(scratch, size, GS_MEM_ALLOC_MIN_ALIGNMENT)
+
+#define GS_SCRATCH_PUSH_ALIGNED(scratch, size, alignment)\
+          gs_scratch_push(scratch, size, alignment)
+
+#define GS_SCRATCH_PUSH_ALIGNED_CHECKED(scratch, size, alignment)\
+          gs_scratch_push_CHECKED(scratch, size, alignment)
+
+#define GS_SCRATCH_PUSH_ALL(scratch, allocated)\
+          gs_scratch_push_all(scratch, GS_MEM_ALLOC_MIN_ALIGNMENT, allocated)
+
+#define GS_SCRATCH_PUSH_ALL_CHECKED(scratch, allocated)\
+          gs_scratch_push_all_CHECKED(scratch, GS_MEM_ALLOC_MIN_ALIGNMENT, allocated)
+
+#if defined(GS_MEM_ALLOC_ENABLE_STATS) || defined(GS_MEM_ALLOC_ENABLE_TRACE)
+#define GS_SCRATCH_CHECKPOINT(_scratch)\
+          gs_scratch_checkpoint(_scratch)
+
+#define GS_SCRATCH_RESTORE(_scratch, _checkpoint)\
+          gs_scratch_restore(_scratch, _checkpoint)
+#else
+#define GS_SCRATCH_CHECKPOINT(_scratch)\
+          *(_scratch)
+
+#define GS_SCRATCH_RESTORE(_scratch, _checkpoint)\
+          {\
+          *(_scratch) = _checkpoint;\
+          }
 #endif
 
-#ifdef GS_MEM_ALLOC_INITIALIZE_TO_ZERO
-#include <string.h>
+#define GS_SCRATCH_RESIZE_LAST(scratch, ptr, size, new_size)\
+          gs_scratch_resize_last(scratch, ptr, size, new_size)
+
+#define GS_SCRATCH_FLUSH(_scratch)\
+         gs_scratch_flush(_scratch)
+
+// Callbacks used by chained scratches to acquire and release additional chunks
+typedef void* (*GSChunkAllocFunc)(void* user_data,                              // The user data of the backing
+                                  unsigned long long size);                     // The size of the chunk to acquire
+
+typedef void (*GSChunkFreeFunc)(void* user_data,                                // The user data of the backing
+                                void* ptr,                                      // The chunk to release
+                                unsigned long long size);                       // The size of the chunk to release
+
+// A source of memory chunks for chained scratches. Chunks are released in
+// reverse order of acquisition, thus a GSStack can be used as backing 
+typedef struct GSChunkBacking
+{
+  GSChunkAllocFunc  alloc;
+  GSChunkFreeFunc   free;                                                       // Can be NULL if chunks do not need to be released
+  void*             user_data;
+} GSChunkBacking;
+
+// Header stored at the beginning of each chunk of a chained scratch
+typedef struct GSScratchChunk
+{
+  struct GSScratchChunk*  p_next;
+  unsigned long long      size;
+} GSScratchChunk;
+
+// p_begin, p_current and p_end refer to the current chunk. In non-chained 
+// scratches p_first and p_chunk are NULL.
+typedef struct GSScratch
+{
+  bool valid;
+  void* p_begin; 
+  void* p_current; 
+  void* p_end; 
+  GSScratchChunk* p_first;
+  GSScratchChunk* p_chunk;
+  unsigned long long chunk_size;
+  GSChunkBacking backing;
+  GSVirtualRegion* p_region;                                                    // NULL if not backed by reserved virtual memory
+  GSVmMapping* p_mapping;                                                       // NULL if not backed by an owned page mapping
+#ifdef GS_MEM_ALLOC_ENABLE_STATS
+  unsigned long long chunk_offset;                                              // The bytes consumed in the chunks before the current one
+  GSAllocStats stats;
 #endif
+#ifdef GS_MEM_ALLOC_ENABLE_TRACE
+  unsigned int trace_id;
+#endif
+} GSScratch;
 
-#ifdef GS_MEM_ALLOC_DISABLE_ASSERTS
-#define GS_ASSERT(_cond)
-#else
-#define GS_ASSERT(_cond) \
-{\
-  if(!(_cond)) \
-  {\
-    printf("%s\n", #_cond);\
-    raise(SIGABRT);\
-  }\
+typedef GSScratch GSScratchCheckpoint;
+
+ // Returns a new initialized scratch maked valid if the operation succeeds
+GS_MEM_ALLOC_VISIBILITY
+GSScratch
+gs_scratch_init(void* base_addr,                                                // base_addr The base address of the allocator
+                unsigned long long size);                                       // The size of the allocator
+
+
+
+// Returns a new initialized chained scratch maked valid if the operation
+// succeeds. When the current chunk is exhausted, a new chunk of at least 
+// chunk_size bytes is acquired from the backing instead of failing. Chunks are
+// kept across flushes and restores to be reused. The first chunk is the memory
+// region passed, which also stores a small chunk header.
+GS_MEM_ALLOC_VISIBILITY
+GSScratch
+gs_scratch_init_chained(void* base_addr,                                        // The base address of the first chunk
+                        unsigned long long size,                                // The size of the first chunk
+                        GSChunkBacking backing,                                 // The backing to acquire additional chunks from
+                        unsigned long long chunk_size);                         // The minimum size of additional chunks
+
+
+
+// Returns a new initialized scratch backed by a reserved range of virtual
+// memory. Memory is committed in commit_granularity steps as the scratch
+// grows, and decommitted on flush beyond decommit_watermark bytes (use 
+// GS_MEM_ALLOC_NO_DECOMMIT to disable). The scratch is marked valid if the
+// operation succeeds.
+GS_MEM_ALLOC_VISIBILITY
+GSScratch
+gs_scratch_init_virtual(unsigned long long reserve_size,                        // The size of the virtual memory range to reserve
+                        unsigned long long commit_granularity,                  // The granularity memory is committed with (a power of two)
+                        unsigned long long decommit_watermark);                 // The committed bytes kept when flushing
+
+
+
+// Releases the virtual memory of a scratch created with gs_scratch_init_virtual
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_scratch_release_virtual(GSScratch* scratch);                                 // The scratch to release
+
+
+
+// Returns a new initialized scratch backed by a mapping it owns, obtained
+// with gs_vm_map_pages. The pages obtained can be read from 
+// scratch.p_mapping. As with gs_stack_init_huge, the mapping header is carved
+// from the size rounded up to the pages obtained. The scratch is marked valid
+// if the operation succeeds.
+GS_MEM_ALLOC_VISIBILITY
+GSScratch
+gs_scratch_init_huge(unsigned long long size,                                   // The size of the memory region for the scratch
+                     unsigned long long page_size);                             // The requested page size (e.g. GS_VM_PAGE_SIZE_2MB)
+
+
+
+// Unmaps the memory of a scratch created with gs_scratch_init_huge
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_scratch_release_huge(GSScratch* scratch);                                    // The scratch to release
+
+
+
+// Returns a chunk backing that acquires chunks from a scratch
+GS_MEM_ALLOC_VISIBILITY
+GSChunkBacking
+gs_chunk_backing_scratch(GSScratch* scratch);                                   // The scratch to acquire chunks from
+
+
+
+// Returns a chunk backing that acquires chunks from a stack. Chunks are popped
+// from the stack when released
+GS_MEM_ALLOC_VISIBILITY
+GSChunkBacking
+gs_chunk_backing_stack(GSStack* stack);                                         // The stack to acquire chunks from
+
+
+
+// Returns a chunk backing that maps chunks from the OS, aligned to alignment
+// (a power of two multiple of the page size). Chunks are unmapped when
+// released
+GS_MEM_ALLOC_VISIBILITY
+GSChunkBacking
+gs_chunk_backing_vm(unsigned long long alignment);                              // The alignment of the chunks
+
+
+
+// Returns a new memory block from the scratch. The alloc is
+// NULL if the requested block cannot be allocated
+GS_MEM_ALLOC_FAST_PATH
+GSAlloc
+gs_scratch_push(GSScratch* scratch,                                             // The memory allocator to allocate from
+                 unsigned long long  size,                                      // The size to allocate
+                 unsigned int alignment);                                       // The requested alignment of the allocation
+
+
+
+// The out of line path of gs_scratch_push, called by its fast path when the
+// block does not fit in the current chunk or the committed memory
+GS_MEM_ALLOC_VISIBILITY
+GSAlloc
+gs_scratch_push_slow(GSScratch* scratch,                                        // The memory allocator to allocate from
+                     unsigned long long size,                                   // The size to allocate
+                     unsigned int alignment);                                   // The requested alignment of the allocation
+
+
+
+// Retursn a new memory block from the scratch. This a CHECKED
+// operation, thus it will throw an assert if the allocation fails (the returned
+// pointer is NULL) unless GS_MEM_ALLOC_DISABLE_CHECKS is defined
+GS_MEM_ALLOC_FAST_PATH
+void*
+gs_scratch_push_CHECKED(GSScratch* scratch,                                     // The memory allocator to allocate from
+                         unsigned long long  size,                              // The size to allocate                      
+                         unsigned int alignment);                               // The requested alignment of the allocation
+
+
+
+// Returns all the remianing memory in the scratch. The alloc is
+// NULL if the requested block cannot be allocated
+GS_MEM_ALLOC_VISIBILITY
+GSAlloc
+gs_scratch_push_all(GSScratch* scratch,                                         // The mem alloc to allocate to
+                     unsigned int alignment,                                    // The alignment of the requested allocation
+                     unsigned long long * size);                                // The allocated size 
+
+
+
+// Returns all the remianing memory in the scratch. This a CHECKED
+// operation, thus it will throw an assert if the allocation fails (the returned
+// pointer is NULL) unless GS_MEM_ALLOC_DISABLE_CHECKS is defined
+GS_MEM_ALLOC_VISIBILITY
+void*
+gs_scratch_push_all_CHECKED(GSScratch* scratch,                                 // The mem alloc to allocate to
+                             unsigned int alignment,                            // The alignment of the requested allocation  
+                             unsigned long long * size);                        // The allocated size 
+
+
+
+// Grows or shrinks the last allocation of the scratch in place. Returns false,
+// leaving the scratch untouched, if ptr is not the last allocation or the 
+// current chunk has not enough space, in which case the caller has to push a
+// new block and copy
+GS_MEM_ALLOC_VISIBILITY
+bool
+gs_scratch_resize_last(GSScratch* scratch,                                      // The scratch the allocation belongs to
+                       void* ptr,                                               // The address of the last allocation
+                       unsigned long long size,                                 // The current size of the allocation
+                       unsigned long long new_size);                            // The new size of the allocation
+
+
+
+// Flushes the scratch memory allocator
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_scratch_flush(GSScratch* scratch);                                            // The scratch to flush
+
+
+
+// Flushes the scratch memory allocator and releases all the chunks but the
+// first one to the backing. Equivalent to gs_scratch_flush for non-chained
+// scratches. Checkpoints taken in released chunks cannot be restored anymore.
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_scratch_flush_release(GSScratch* scratch);                                   // The scratch to flush
+
+
+
+// Returns the pages of the scratch after p_current to the OS, except for the 
+// first retain bytes, which are kept for the next pushes. In chained scratches
+// the chunks after the current one are released as well (but their headers).
+// Only whole pages inside the scratch are released, whatever the origin of its
+// memory. Returns the bytes released
+GS_MEM_ALLOC_VISIBILITY
+unsigned long long
+gs_scratch_trim(GSScratch* scratch,                                             // The scratch to trim
+                unsigned long long retain);                                     // The bytes after p_current kept resident
+
+
+
+// Returns a checkpoint of the scratch. Use the GS_SCRATCH_CHECKPOINT macro,
+// which only calls this method when statistics or tracing are enabled
+GS_MEM_ALLOC_VISIBILITY
+GSScratchCheckpoint
+gs_scratch_checkpoint(GSScratch* scratch);                                      // The scratch to checkpoint
+
+
+
+// Restores the scratch to a checkpoint, keeping its accumulated statistics.
+// Use the GS_SCRATCH_RESTORE macro, which only calls this method when
+// statistics or tracing are enabled
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_scratch_restore(GSScratch* scratch,                                          // The scratch to restore
+                   GSScratchCheckpoint checkpoint);                             // The checkpoint to restore
+
+#ifdef GS_MEM_ALLOC_ENABLE_STATS
+
+
+// Returns the usage statistics of the scratch. For chained scratches the bytes
+// in use include all the chunks up to the current one
+GS_MEM_ALLOC_VISIBILITY
+GSAllocStats
+gs_scratch_get_stats(GSScratch* scratch);                                       // The scratch to get the statistics from
+#endif
+
+
+////////////////////////////////////////////////
+//////////////// FRAME SCRATCH /////////////////
+////////////////////////////////////////////////
+
+#define GS_FRAME_SCRATCH_PUSH(scratch, size)\
+          gs_frame_scratch_push(scratch, size, GS_MEM_ALLOC_MIN_ALIGNMENT)
+
+#define GS_FRAME_SCRATCH_PUSH_CHECKED(scratch, size)\
+          gs_frame_scratch_push_CHECKED(scratch, size, GS_MEM_ALLOC_MIN_ALIGNMENT)
+
+#define GS_FRAME_SCRATCH_PUSH_ALIGNED(scratch, size, alignment)\
+          gs_frame_scratch_push(scratch, size, alignment)
+
+#define GS_FRAME_SCRATCH_PUSH_ALIGNED_CHECKED(scratch, size, alignment)\
+          gs_frame_scratch_push_CHECKED(scratch, size, alignment)
+
+#define GS_FRAME_SCRATCH_PROMOTE(scratch, ptr, size)\
+          gs_frame_scratch_promote(scratch, ptr, size, GS_MEM_ALLOC_MIN_ALIGNMENT)
+
+#define GS_FRAME_SCRATCH_ADVANCE(_scratch)\
+          gs_frame_scratch_advance(_scratch)
+
+// The memory region is split in num_frames scratches of the same size. The
+// allocations of a frame are pushed to the current scratch, which is flushed
+// when it becomes current again num_frames frames later.
+typedef struct GSFrameScratch
+{
+  bool                valid;
+  GSScratch           scratches[GS_MEM_ALLOC_FRAME_SCRATCH_MAX_FRAMES];
+  unsigned int        num_frames;
+  unsigned int        current;                                                  // The index of the scratch of the current frame
+  unsigned long long  frame;                                                    // The number of frames advanced since the initialization
+  unsigned long long  peak_frame_usage;                                         // The maximum usage of a finished frame
+} GSFrameScratch;
+
+// Returns a new initialized frame scratch marked valid if the operation
+// succeeds. The operation fails if num_frames is out of range
+GS_MEM_ALLOC_VISIBILITY
+GSFrameScratch
+gs_frame_scratch_init(void* base_addr,                                          // The base address of the memory region
+                      unsigned long long size,                                  // The size of the memory region
+                      unsigned int num_frames);                                 // The number of frames allocations live for (2 to GS_MEM_ALLOC_FRAME_SCRATCH_MAX_FRAMES)
+
+
+
+// Returns a new memory block from the scratch of the current frame. The alloc
+// is NULL if the requested block cannot be allocated
+GS_MEM_ALLOC_VISIBILITY
+GSAlloc
+gs_frame_scratch_push(GSFrameScratch* scratch,                                  // The frame scratch to allocate from
+                      unsigned long long size,                                  // The size to allocate
+                      unsigned int alignment);                                  // The requested alignment of the allocation
+
+
+
+// Returns a new memory block from the scratch of the current frame. This a
+// CHECKED operation, thus it will throw an assert if the allocation fails (the
+// returned pointer is NULL) unless GS_MEM_ALLOC_DISABLE_CHECKS is defined
+GS_MEM_ALLOC_VISIBILITY
+void*
+gs_frame_scratch_push_CHECKED(GSFrameScratch* scratch,                          // The frame scratch to allocate from
+                              unsigned long long size,                          // The size to allocate
+                              unsigned int alignment);                          // The requested alignment of the allocation
+
+
+
+// Copies a block allocated in a previous frame into the scratch of the current
+// frame, so that it lives for num_frames more frames. The alloc is NULL if the
+// copy cannot be allocated
+GS_MEM_ALLOC_VISIBILITY
+GSAlloc
+gs_frame_scratch_promote(GSFrameScratch* scratch,                               // The frame scratch to allocate from
+                         const void* ptr,                                       // The block to copy
+                         unsigned long long size,                               // The size of the block
+                         unsigned int alignment);                               // The requested alignment of the copy
+
+
+
+// Finishes the current frame and moves to the next one, flushing the scratch
+// of the frame that is num_frames frames old. Returns the bytes used by the
+// finished frame
+GS_MEM_ALLOC_VISIBILITY
+unsigned long long
+gs_frame_scratch_advance(GSFrameScratch* scratch);                              // The frame scratch to advance
+
+
+
+// Returns the bytes used by a frame still alive, where age 0 is the current
+// frame and age num_frames-1 the oldest one
+GS_MEM_ALLOC_VISIBILITY
+unsigned long long
+gs_frame_scratch_frame_usage(GSFrameScratch* scratch,                           // The frame scratch to query
+                             unsigned int age);                                 // The number of frames since the frame queried
+
+////////////////////////////////////////////////
+/////////////////// POOL ///////////////////////
+////////////////////////////////////////////////
+
+#define GS_POOL_ALLOC_ALIGNED(pool, size, alignment)\
+    gs_pool_alloc(pool,\
+                  size,\
+                  alignment);
+
+#define GS_POOL_ALLOC_ALIGNED_CHECKED(pool, size, alignment)\
+    gs_pool_alloc_CHECKED(pool,\
+                          size,\
+                          alignment);
+
+#define GS_POOL_FREE(pool, ptr)\
+    gs_pool_free(pool, ptr);
+
+#define GS_POOL_ALLOC_N(pool, count, ptrs)\
+    gs_pool_alloc_n(pool, count, ptrs)
+
+#define GS_POOL_ALLOC_N_CHECKED(pool, count, ptrs)\
+    gs_pool_alloc_n_CHECKED(pool, count, ptrs)
+
+#define GS_POOL_FREE_N(pool, count, ptrs)\
+    gs_pool_free_n(pool, count, ptrs)
+
+#define GS_POOL_FLUSH(pool)\
+    gs_pool_flush(pool);
+
+#define GS_POOL_FOR_EACH_LIVE(pool, ptr)\
+    for(void* ptr = gs_pool_next_live(pool, NULL); ptr != NULL; ptr = gs_pool_next_live(pool, ptr))
+
+typedef struct GSPool 
+{
+  bool              valid;
+  void*             p_begin;
+  void*             p_end;
+  void*             p_current;
+  void*             p_next_free;
+  unsigned int      bsize;
+  unsigned int      alignment;
+  unsigned int      stride;
+  unsigned long long* p_live_bitmap;                                            // The occupancy bitmap, one bit per block (NULL if the pool has none)
+  unsigned long long  bitmap_hint;                                              // The first bitmap word that may contain a free block
+  GSVmMapping*      p_mapping;                                                  // NULL if not backed by an owned page mapping
+#ifdef GS_MEM_ALLOC_ENABLE_STATS
+  GSAllocStats      stats;
+#endif
+#ifdef GS_MEM_ALLOC_ENABLE_TRACE
+  unsigned int      trace_id;
+#endif
+} GSPool;
+
+ // Returns a new initialized pool maked valid if the operation succeeds
+GS_MEM_ALLOC_VISIBILITY
+GSPool
+gs_pool_init(void* mem_ptr,                                                     // The pointer to the starting address for the pool
+             unsigned long long size,                                           // The size of the pool in bytes
+             unsigned long long bsize,                                          // The size of the blocks to be allocated
+             unsigned int alignment);                                           // The alignment of the blocks to be allocated
+
+
+
+// Returns the size in bytes of the occupancy bitmap required by a pool 
+// initialized with gs_pool_init_bitmap and the same parameters
+GS_MEM_ALLOC_VISIBILITY
+unsigned long long
+gs_pool_bitmap_size(unsigned long long size,                                    // The size of the pool in bytes
+                    unsigned long long bsize,                                   // The size of the blocks to be allocated
+                    unsigned int alignment);                                    // The alignment of the blocks to be allocated
+
+
+
+// Returns a new initialized pool maked valid if the operation succeeds. The
+// pool tracks its live blocks in an occupancy bitmap stored out of band, which
+// allows iterating them in address order. Allocations take the lowest free
+// block instead of the last freed one, keeping the live blocks dense.
+GS_MEM_ALLOC_VISIBILITY
+GSPool
+gs_pool_init_bitmap(void* mem_ptr,                                              // The pointer to the starting address for the pool
+                    unsigned long long size,                                    // The size of the pool in bytes
+                    unsigned long long bsize,                                   // The size of the blocks to be allocated
+                    unsigned int alignment,                                     // The alignment of the blocks to be allocated
+                    void* bitmap_ptr,                                           // The memory to store the bitmap in
+                    unsigned long long bitmap_size);                            // The size of the bitmap memory (see gs_pool_bitmap_size)
+
+
+
+// Returns a new initialized pool backed by a mapping it owns, obtained with
+// gs_vm_map_pages. The pages obtained can be read from pool.p_mapping. As with
+// gs_stack_init_huge, the mapping header and the padding aligning the first
+// block are carved from the size rounded up to the pages obtained. The pool is
+// marked valid if the operation succeeds.
+GS_MEM_ALLOC_VISIBILITY
+GSPool
+gs_pool_init_huge(unsigned long long size,                                      // The size of the pool in bytes
+                  unsigned long long bsize,                                     // The size of the blocks to be allocated
+                  unsigned int alignment,                                       // The alignment of the blocks to be allocated
+                  unsigned long long page_size);                                // The requested page size (e.g. GS_VM_PAGE_SIZE_2MB)
+
+
+
+// Unmaps the memory of a pool created with gs_pool_init_huge
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_pool_release_huge(GSPool* pool);                                             // The pool to release
+
+
+
+// Flushes the memory allocator
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_pool_flush(GSPool* pool);
+
+
+
+// Returns a new block of memory from the pool. The returned block size is that
+// specified during the pool initialization. The size and alignment
+// parameters are used for checking the usage correctness. The alloc is NULL if 
+// there is not enough space in the pool
+GS_MEM_ALLOC_FAST_PATH
+GSAlloc
+gs_pool_alloc(GSPool* pool,                                                     // The pool mem alloc to use
+              unsigned long long size,                                          // The size of the memory block (used for debugging purposes)
+              unsigned int alignment);                                          // The alignment of the memory block (used for debugging purposes)
+
+
+
+// The out of line path of gs_pool_alloc, called by its fast path when the free
+// list is empty and the pool is exhausted, or when the pool keeps a bitmap 
+GS_MEM_ALLOC_VISIBILITY
+GSAlloc
+gs_pool_alloc_slow(GSPool* pool,                                                // The pool mem alloc to use
+                   unsigned long long size,                                     // The size of the memory block (used for debugging purposes)
+                   unsigned int alignment);                                     // The alignment of the memory block (used for debugging purposes)
+
+
+
+// Returns a new block of memory from the pool. The returned block size is that
+// specified during the pool initialization. The size and alignment
+// parameters are used for checking the usage correctness. This a CHECKED
+// operation, thus it will throw an assert if the allocation fails (the returned
+// pointer is NULL) unless GS_MEM_ALLOC_DISABLE_CHECKS is defined
+GS_MEM_ALLOC_FAST_PATH
+void*
+gs_pool_alloc_CHECKED(GSPool* pool,                                             // The pool mem alloc to use
+                      unsigned long long size,                                  // The size of the memory block (used for debugging purposes)
+                      unsigned int alignment);                                  // The alignment of the memory block (used for debugging purposes)
+
+
+
+// Frees a block allocated with the pool 
+GS_MEM_ALLOC_FAST_PATH
+void 
+gs_pool_free(GSPool* pool,                                                      // The pool mem alloc to use
+             void* ptr);                                                        // The address to the block to deallocate
+
+
+
+// The out of line path of gs_pool_free, called by its fast path when the pool
+// keeps a bitmap
+GS_MEM_ALLOC_VISIBILITY
+void 
+gs_pool_free_slow(GSPool* pool,                                                 // The pool mem alloc to use
+                  void* ptr);                                                   // The address to the block to deallocate
+
+
+
+// Allocates count blocks from the pool at once, storing their addresses in
+// ptrs. Blocks are first taken from the free list and the rest are carved as a
+// contiguous run from the unused region of the pool. Returns the number of 
+// blocks allocated, which is smaller than count if the pool runs out of space
+GS_MEM_ALLOC_VISIBILITY
+unsigned long long
+gs_pool_alloc_n(GSPool* pool,                                                   // The pool mem alloc to use
+                unsigned long long count,                                       // The number of blocks to allocate
+                void** ptrs);                                                   // The array where the addresses of the blocks are stored
+
+
+
+// Allocates count blocks from the pool at once, storing their addresses in
+// ptrs. This a CHECKED operation, thus it will throw an assert if not all the 
+// blocks can be allocated unless GS_MEM_ALLOC_DISABLE_CHECKS is defined
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_pool_alloc_n_CHECKED(GSPool* pool,                                           // The pool mem alloc to use
+                        unsigned long long count,                               // The number of blocks to allocate
+                        void** ptrs);                                           // The array where the addresses of the blocks are stored
+
+
+
+// Frees count blocks at once. The blocks are chained and spliced onto the free
+// list in a single pass
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_pool_free_n(GSPool* pool,                                                    // The pool mem alloc to use
+               unsigned long long count,                                        // The number of blocks to free
+               void** ptrs);                                                    // The addresses of the blocks to free
+
+
+
+typedef void (*GSPoolLiveFunc)(void* user_data,                                 // The user data passed to gs_pool_for_each_live
+                               void* ptr);                                      // The live block visited
+
+// Calls func for each live block of the pool in address order. The pool must
+// have been initialized with gs_pool_init_bitmap. Blocks can be freed from func
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_pool_for_each_live(GSPool* pool,                                             // The pool to iterate
+                      GSPoolLiveFunc func,                                      // The function to call for each live block
+                      void* user_data);                                         // The user data passed to func
+
+
+
+// Returns the first live block after ptr in address order, the first live
+// block of the pool if ptr is NULL, or NULL if there are no more. The pool 
+// must have been initialized with gs_pool_init_bitmap
+GS_MEM_ALLOC_VISIBILITY
+void*
+gs_pool_next_live(GSPool* pool,                                                 // The pool to iterate
+                  void* ptr);                                                   // The last block visited or NULL to start
+
+
+
+// Returns the number of live blocks of the pool. The pool must have been 
+// initialized with gs_pool_init_bitmap
+GS_MEM_ALLOC_VISIBILITY
+unsigned long long
+gs_pool_count_live(GSPool* pool);                                               // The pool to query
+
+
+
+typedef void (*GSPoolRelocateFunc)(void* user_data,                             // The user data passed to gs_pool_compact
+                                   void* old_ptr,                               // The address the block was moved from
+                                   void* new_ptr);                              // The address the block was moved to
+
+// Moves the live blocks of the pool towards p_begin, at most max_moves per
+// call so that compaction can be spread across frames. Each move copies the
+// last live block into the lowest free block and calls func with both 
+// addresses, so that the owners of the block can fix their references. The
+// free blocks after the last live block are then released by lowering 
+// p_current. The pool must have been initialized with gs_pool_init_bitmap.
+// Returns the number of blocks moved, the pool is compact once it returns 
+// less than max_moves
+GS_MEM_ALLOC_VISIBILITY
+unsigned long long
+gs_pool_compact(GSPool* pool,                                                   // The pool to compact
+                unsigned long long max_moves,                                   // The maximum number of blocks to move
+                GSPoolRelocateFunc func,                                        // The function called for each moved block
+                void* user_data);                                               // The user data passed to func
+
+
+
+// Returns the pages of the pool made up entirely of free blocks to the OS,
+// including those after p_current. The free blocks at the end of the pool are
+// uncarved first, lowering p_current, for which the free list of pools without
+// bitmap is sorted in address order. Pools without bitmap keep the pages of the
+// rest of their free blocks, since these store the free list. Only whole pages
+// inside the pool are released, whatever the origin of its memory. Returns the
+// bytes released
+GS_MEM_ALLOC_VISIBILITY
+unsigned long long
+gs_pool_trim(GSPool* pool);                                                     // The pool to trim
+
+#ifdef GS_MEM_ALLOC_ENABLE_STATS
+
+
+// Returns the usage statistics of the pool
+GS_MEM_ALLOC_VISIBILITY
+GSAllocStats
+gs_pool_get_stats(GSPool* pool);                                                // The pool to get the statistics from
+#endif
+
+
+////////////////////////////////////////////////
+//////////////// TYPED POOL ////////////////////
+////////////////////////////////////////////////
+
+// The alignment of the blocks of a typed pool, which is at least
+// GS_MEM_ALLOC_PTR_ALIGNMENT so that the free list links are aligned
+#define GS_TYPED_POOL_ALIGNMENT(alignment)\
+    ((alignment) < GS_MEM_ALLOC_PTR_ALIGNMENT ? GS_MEM_ALLOC_PTR_ALIGNMENT : (alignment))
+
+// The distance between the blocks of a typed pool, a compile time constant
+#define GS_TYPED_POOL_STRIDE(size, alignment)\
+    (((size) + GS_TYPED_POOL_ALIGNMENT(alignment) - 1) & ~((unsigned long long)GS_TYPED_POOL_ALIGNMENT(alignment) - 1))
+
+// Generates a pool of blocks of type, aligned to alignment (a power of two no
+// smaller than the alignment of type), named name:
+//
+// GS_TYPED_POOL_DEFINE(GSParticlePool, GSParticle, 16)
+// GSParticlePool pool = GSParticlePool_init(ptr, size);
+// GSParticle* particle = GSParticlePool_alloc(&pool);                          // NULL if the pool is full
+// GSParticlePool_free(&pool, particle);
+// GSParticlePool_flush(&pool);
+//
+// The functions are static inline and pass the stride as a constant, so once
+// inlined alloc and free reduce to a few instructions. Unlike gs_pool_alloc, 
+// no size or alignment is checked on allocation
+#define GS_TYPED_POOL_DEFINE(name, type, alignment)\
+    typedef struct name\
+    {\
+      GSTypedPoolBase base;\
+    } name;\
+    \
+    static inline name\
+    name##_init(void* mem_ptr, unsigned long long size)\
+    {\
+      name pool;\
+      pool.base = gs_typed_pool_init(mem_ptr, size, GS_TYPED_POOL_ALIGNMENT(alignment));\
+      return pool;\
+    }\
+    \
+    static inline type*\
+    name##_alloc(name* pool)\
+    {\
+      return (type*)gs_typed_pool_alloc(&pool->base, GS_TYPED_POOL_STRIDE(sizeof(type), alignment));\
+    }\
+    \
+    static inline void\
+    name##_free(name* pool, type* ptr)\
+    {\
+      gs_typed_pool_free(&pool->base, ptr);\
+    }\
+    \
+    static inline void\
+    name##_flush(name* pool)\
+    {\
+      gs_typed_pool_flush(&pool->base);\
+    }
+
+// The state shared by all typed pools. The stride and the alignment are not
+// stored, but passed as constants by the generated functions
+typedef struct GSTypedPoolBase
+{
+  bool  valid;
+  char* p_begin;
+  char* p_end;
+  char* p_current;
+  void* p_next_free;
+} GSTypedPoolBase;
+
+// Returns a new initialized typed pool state marked valid if the operation
+// succeeds
+static inline GSTypedPoolBase
+gs_typed_pool_init(void* mem_ptr,                                               // The pointer to the starting address for the pool
+                   unsigned long long size,                                     // The size of the pool in bytes
+                   unsigned int alignment)                                      // The alignment of the blocks (see GS_TYPED_POOL_ALIGNMENT)
+{
+  GSTypedPoolBase pool;
+  pool.p_begin = (char*)mem_ptr;
+  GS_ALIGN_PTR(pool.p_begin, alignment)
+  pool.p_end = (char*)mem_ptr + size;
+  pool.p_current = pool.p_begin;
+  pool.p_next_free = 0;
+  pool.valid = mem_ptr != 0 && pool.p_begin <= pool.p_end;
+  return pool;
+}
+
+
+
+// Returns a block of stride bytes, or NULL if the pool is full
+static inline void*
+gs_typed_pool_alloc(GSTypedPoolBase* pool,                                      // The typed pool to allocate from
+                    unsigned long long stride)                                  // The stride of the pool (see GS_TYPED_POOL_STRIDE)
+{
+  void* ret = pool->p_next_free;
+  if(ret != 0)
+  {
+    pool->p_next_free = *(void**)ret;
+  }
+  else if((unsigned long long)(pool->p_end - pool->p_current) >= stride)
+  {
+    ret = pool->p_current;
+    pool->p_current += stride;
+  }
+#ifdef GS_MEM_ALLOC_INITIALIZE_TO_ZERO
+  if(ret != 0)
+  {
+    gs_mem_zero(ret, stride);
+  }
+#endif
+  return ret;
+}
+
+
+
+// Frees a block allocated with the typed pool
+static inline void
+gs_typed_pool_free(GSTypedPoolBase* pool,                                       // The typed pool to free to
+                   void* ptr)                                                   // The block to free
+{
+  *(void**)ptr = pool->p_next_free;
+  pool->p_next_free = ptr;
+}
+
+
+
+// Frees all the blocks of the typed pool
+static inline void
+gs_typed_pool_flush(GSTypedPoolBase* pool)                                      // The typed pool to flush
+{
+  pool->p_current = pool->p_begin;
+  pool->p_next_free = 0;
+}
+
+
+////////////////////////////////////////////////
+//////////////// HANDLE POOL ///////////////////
+////////////////////////////////////////////////
+
+#ifdef GS_MEM_ALLOC_32BIT_HANDLES
+typedef unsigned int GSHandle;
+#else
+typedef unsigned long long GSHandle;
+#endif
+
+#define GS_HANDLE_NULL ((GSHandle)0)
+
+#define GS_HANDLE_INDEX_MASK\
+  ((((GSHandle)1) << GS_MEM_ALLOC_HANDLE_INDEX_BITS) - 1)
+
+#define GS_HANDLE_MAX_GENERATION\
+  (((GSHandle)~(GSHandle)0) >> GS_MEM_ALLOC_HANDLE_INDEX_BITS)
+
+// Generations are stored as 32-bit integers, so they wrap at the lowest of
+// both limits
+#define GS_HANDLE_GENERATION_LIMIT\
+  (GS_HANDLE_MAX_GENERATION < (GSHandle)0xffffffffu ? GS_HANDLE_MAX_GENERATION : (GSHandle)0xffffffffu)
+
+#define GS_HANDLE_INDEX(handle)\
+  ((handle) & GS_HANDLE_INDEX_MASK)
+
+#define GS_HANDLE_GENERATION(handle)\
+  ((handle) >> GS_MEM_ALLOC_HANDLE_INDEX_BITS)
+
+#define GS_HANDLE_MAKE(index, generation)\
+  ((((GSHandle)(generation)) << GS_MEM_ALLOC_HANDLE_INDEX_BITS) | (GSHandle)(index))
+
+#define GS_HANDLE_POOL_ALLOC(pool)\
+    gs_handle_pool_alloc(pool)
+
+#define GS_HANDLE_POOL_ALLOC_CHECKED(pool)\
+    gs_handle_pool_alloc_CHECKED(pool)
+
+#define GS_HANDLE_POOL_FREE(pool, handle)\
+    gs_handle_pool_free(pool, handle)
+
+#define GS_HANDLE_POOL_GET(pool, handle)\
+    gs_handle_pool_get(pool, handle)
+
+#define GS_HANDLE_POOL_FLUSH(pool)\
+    gs_handle_pool_flush(pool)
+
+// A pool whose blocks are referenced through handles packing the index of the
+// block (lower GS_MEM_ALLOC_HANDLE_INDEX_BITS bits) with the generation of the
+// block when it was allocated. The generation of a block is incremented every 
+// time it is freed, which invalidates the handles to it. Generations never 
+// take the value 0, so GS_HANDLE_NULL is never a valid handle. The generations
+// and the occupancy bitmap of the blocks are stored out of band.
+typedef struct GSHandlePool
+{
+  bool                valid;
+  GSPool              pool;                                                     // The pool of the blocks, with an occupancy bitmap
+  unsigned int*       p_generations;                                            // The current generation of each block
+  unsigned long long  num_blocks;
+} GSHandlePool;
+
+// Returns the size in bytes of the metadata required by a handle pool
+// initialized with the same parameters
+GS_MEM_ALLOC_VISIBILITY
+unsigned long long
+gs_handle_pool_metadata_size(unsigned long long size,                           // The size of the pool in bytes
+                             unsigned long long bsize,                          // The size of the blocks to be allocated
+                             unsigned int alignment);                           // The alignment of the blocks to be allocated
+
+
+
+// Returns a new initialized handle pool marked valid if the operation 
+// succeeds. The pool cannot hold more than 2^GS_MEM_ALLOC_HANDLE_INDEX_BITS
+// blocks
+GS_MEM_ALLOC_VISIBILITY
+GSHandlePool
+gs_handle_pool_init(void* mem_ptr,                                              // The pointer to the starting address for the pool
+                    unsigned long long size,                                    // The size of the pool in bytes
+                    unsigned long long bsize,                                   // The size of the blocks to be allocated
+                    unsigned int alignment,                                     // The alignment of the blocks to be allocated
+                    void* metadata_ptr,                                         // The memory to store the metadata in
+                    unsigned long long metadata_size);                          // The size of the metadata memory (see gs_handle_pool_metadata_size)
+
+
+
+// Allocates the lowest free block of the pool and returns a handle to it, or 
+// GS_HANDLE_NULL if the pool is full
+GS_MEM_ALLOC_VISIBILITY
+GSHandle
+gs_handle_pool_alloc(GSHandlePool* pool);                                       // The handle pool to allocate from
+
+
+
+// Allocates the lowest free block of the pool and returns a handle to it. This
+// a CHECKED operation, thus it will throw an assert if the allocation fails
+// unless GS_MEM_ALLOC_DISABLE_CHECKS is defined
+GS_MEM_ALLOC_VISIBILITY
+GSHandle
+gs_handle_pool_alloc_CHECKED(GSHandlePool* pool);                               // The handle pool to allocate from
+
+
+
+// Frees the block referenced by a valid handle, invalidating all its handles
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_handle_pool_free(GSHandlePool* pool,                                         // The handle pool the handle belongs to
+                    GSHandle handle);                                           // The handle of the block to free
+
+
+
+// Returns true if the handle references a live block of the pool
+GS_MEM_ALLOC_VISIBILITY
+bool
+gs_handle_pool_valid(GSHandlePool* pool,                                        // The handle pool the handle belongs to
+                     GSHandle handle);                                          // The handle to check
+
+
+
+// Returns the address of the block referenced by the handle, or NULL if the
+// handle is not valid
+GS_MEM_ALLOC_VISIBILITY
+void*
+gs_handle_pool_get(GSHandlePool* pool,                                          // The handle pool the handle belongs to
+                   GSHandle handle);                                            // The handle to resolve
+
+
+
+// Returns the handle of a live block of the pool from its address
+GS_MEM_ALLOC_VISIBILITY
+GSHandle
+gs_handle_pool_handle(GSHandlePool* pool,                                       // The handle pool the block belongs to
+                      void* ptr);                                               // The address of the live block
+
+
+
+// Frees all the blocks of the pool, invalidating all their handles
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_handle_pool_flush(GSHandlePool* pool);                                       // The handle pool to flush
+
+////////////////////////////////////////////////
+/////////////////// ATOMIC POOL ////////////////
+////////////////////////////////////////////////
+
+#define GS_ATOMIC_POOL_ALLOC_ALIGNED(pool, size, alignment)\
+    gs_atomic_pool_alloc(pool,\
+                         size,\
+                         alignment)
+
+#define GS_ATOMIC_POOL_ALLOC_ALIGNED_CHECKED(pool, size, alignment)\
+    gs_atomic_pool_alloc_CHECKED(pool,\
+                                 size,\
+                                 alignment)
+
+#define GS_ATOMIC_POOL_FREE(pool, ptr)\
+    gs_atomic_pool_free(pool, ptr)
+
+#define GS_ATOMIC_POOL_FLUSH(pool)\
+    gs_atomic_pool_flush(pool)
+
+// A pool allocator that can be used concurrently from multiple threads without
+// locks. Free blocks are kept in a Treiber stack whose head packs the index of
+// the first free block (lower 32 bits) with a tag (upper 32 bits) that is
+// incremented on every update, which prevents the ABA problem. The fields
+// modified by alloc/free are placed on their own cache lines.
+typedef struct GSAtomicPool
+{
+  bool                          valid;
+  void*                         p_begin;
+  void*                         p_end;
+  unsigned int                  bsize;
+  unsigned int                  alignment;
+  unsigned int                  stride;
+  char                          padding0[GS_MEM_ALLOC_CACHE_LINE_SIZE];
+  GS_MEM_ALLOC_PTR_NUMERIC_TYPE next_free;                                      // Tagged head of the free list (0 when empty)
+  char                          padding1[GS_MEM_ALLOC_CACHE_LINE_SIZE];
+  void*                         p_current;
+  char                          padding2[GS_MEM_ALLOC_CACHE_LINE_SIZE];
+} GSAtomicPool;
+
+// Returns a new initialized atomic pool maked valid if the operation succeeds.
+// The pool cannot hold more than 2^32-1 blocks.
+GS_MEM_ALLOC_VISIBILITY
+GSAtomicPool
+gs_atomic_pool_init(void* mem_ptr,                                              // The pointer to the starting address for the pool
+                    unsigned long long size,                                    // The size of the pool in bytes
+                    unsigned long long bsize,                                   // The size of the blocks to be allocated
+                    unsigned int alignment);                                    // The alignment of the blocks to be allocated
+
+
+
+// Flushes the memory allocator. This operation is not thread safe and must not
+// run concurrently with any other operation on the pool
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_atomic_pool_flush(GSAtomicPool* pool);
+
+
+
+// Returns a new block of memory from the pool. Can be called concurrently from
+// any thread. The size and alignment parameters are used for checking the
+// usage correctness. The alloc is NULL if there is not enough space in the pool
+GS_MEM_ALLOC_VISIBILITY
+GSAlloc
+gs_atomic_pool_alloc(GSAtomicPool* pool,                                        // The pool mem alloc to use
+                     unsigned long long size,                                   // The size of the memory block (used for debugging purposes)
+                     unsigned int alignment);                                   // The alignment of the memory block (used for debugging purposes)
+
+
+
+// Returns a new block of memory from the pool. Can be called concurrently from
+// any thread. This a CHECKED operation, thus it will throw an assert if the
+// allocation fails (the returned pointer is NULL) unless
+// GS_MEM_ALLOC_DISABLE_CHECKS is defined
+GS_MEM_ALLOC_VISIBILITY
+void*
+gs_atomic_pool_alloc_CHECKED(GSAtomicPool* pool,                                // The pool mem alloc to use
+                             unsigned long long size,                           // The size of the memory block (used for debugging purposes)
+                             unsigned int alignment);                           // The alignment of the memory block (used for debugging purposes)
+
+
+
+// Frees a block allocated with the pool. Can be called concurrently from any
+// thread
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_atomic_pool_free(GSAtomicPool* pool,                                         // The pool mem alloc to use
+                    void* ptr);                                                 // The address to the block to deallocate
+
+
+////////////////////////////////////////////////
+/////////////////// ATOMIC SCRATCH /////////////
+////////////////////////////////////////////////
+
+#define GS_ATOMIC_SCRATCH_PUSH(scratch, size)\
+          gs_atomic_scratch_push(scratch, size, GS_MEM_ALLOC_MIN_ALIGNMENT)
+
+#define GS_ATOMIC_SCRATCH_PUSH_CHECKED(scratch, size)\
+          gs_atomic_scratch_push_CHECKED(scratch, size, GS_MEM_ALLOC_MIN_ALIGNMENT)
+
+#define GS_ATOMIC_SCRATCH_PUSH_ALIGNED(scratch, size, alignment)\
+          gs_atomic_scratch_push(scratch, size, alignment)
+
+#define GS_ATOMIC_SCRATCH_PUSH_ALIGNED_CHECKED(scratch, size, alignment)\
+          gs_atomic_scratch_push_CHECKED(scratch, size, alignment)
+
+#define GS_ATOMIC_SCRATCH_CHECKPOINT(_scratch)\
+          gs_atomic_scratch_checkpoint(_scratch)
+
+#define GS_ATOMIC_SCRATCH_RESTORE(_scratch, _checkpoint)\
+          gs_atomic_scratch_restore(_scratch, _checkpoint)
+
+#define GS_ATOMIC_SCRATCH_FLUSH(_scratch)\
+          gs_atomic_scratch_flush(_scratch)
+
+// A scratch that can be pushed to concurrently from multiple threads without
+// locks. Allocations bump an offset from p_begin, which is always a multiple
+// of GS_MEM_ALLOC_MIN_ALIGNMENT since sizes are rounded up to it. Thus pushes 
+// with alignments up to GS_MEM_ALLOC_MIN_ALIGNMENT are a single fetch_add, and
+// larger alignments use a CAS loop to add the padding. A push that does not 
+// fit fails, and the bytes left at the end may be lost if pushes race for 
+// them. The offset is placed on its own cache line.
+typedef struct GSAtomicScratch
+{
+  bool                          valid;
+  void*                         p_begin;
+  void*                         p_end;
+  char                          padding0[GS_MEM_ALLOC_CACHE_LINE_SIZE];
+  GS_MEM_ALLOC_PTR_NUMERIC_TYPE offset;                                         // Can exceed the size of the scratch after failed pushes
+  char                          padding1[GS_MEM_ALLOC_CACHE_LINE_SIZE];
+} GSAtomicScratch;
+
+typedef struct GSAtomicScratchCheckpoint
+{
+  GS_MEM_ALLOC_PTR_NUMERIC_TYPE offset;
+} GSAtomicScratchCheckpoint;
+
+// Returns a new initialized atomic scratch maked valid if the operation 
+// succeeds
+GS_MEM_ALLOC_VISIBILITY
+GSAtomicScratch
+gs_atomic_scratch_init(void* base_addr,                                         // The base address of the allocator
+                       unsigned long long size);                                // The size of the allocator
+
+
+
+// Returns a new memory block from the scratch. Can be called concurrently from
+// any thread. The alloc is NULL if the requested block cannot be allocated
+GS_MEM_ALLOC_VISIBILITY
+GSAlloc
+gs_atomic_scratch_push(GSAtomicScratch* scratch,                                // The memory allocator to allocate from
+                       unsigned long long size,                                 // The size to allocate
+                       unsigned int alignment);                                 // The requested alignment of the allocation
+
+
+
+// Returns a new memory block from the scratch. Can be called concurrently from
+// any thread. This a CHECKED operation, thus it will throw an assert if the
+// allocation fails (the returned pointer is NULL) unless 
+// GS_MEM_ALLOC_DISABLE_CHECKS is defined
+GS_MEM_ALLOC_VISIBILITY
+void*
+gs_atomic_scratch_push_CHECKED(GSAtomicScratch* scratch,                        // The memory allocator to allocate from
+                               unsigned long long size,                         // The size to allocate
+                               unsigned int alignment);                         // The requested alignment of the allocation
+
+
+
+// Claims a block of the scratch aligned to GS_MEM_ALLOC_CACHE_LINE_SIZE and 
+// returns a (non thread safe) GSScratch over it, so that a thread can push 
+// many small allocations paying a single atomic operation. Can be called
+// concurrently from any thread. The returned scratch is not valid if the block
+// cannot be allocated. It must not be used after the atomic scratch is flushed
+// or restored to a checkpoint taken before the claim
+GS_MEM_ALLOC_VISIBILITY
+GSScratch
+gs_atomic_scratch_claim(GSAtomicScratch* scratch,                               // The memory allocator to claim the block from
+                        unsigned long long size);                               // The size of the block
+
+
+
+// Returns the bytes of the scratch in use, including alignment padding
+GS_MEM_ALLOC_VISIBILITY
+unsigned long long
+gs_atomic_scratch_usage(GSAtomicScratch* scratch);                              // The scratch to query
+
+
+
+// Flushes the scratch. This operation is not thread safe and must not run 
+// concurrently with any other operation on the scratch
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_atomic_scratch_flush(GSAtomicScratch* scratch);                              // The scratch to flush
+
+
+
+// Returns a checkpoint of the scratch. This operation is not thread safe and
+// must not run concurrently with pushes
+GS_MEM_ALLOC_VISIBILITY
+GSAtomicScratchCheckpoint
+gs_atomic_scratch_checkpoint(GSAtomicScratch* scratch);                         // The scratch to checkpoint
+
+
+
+// Restores the scratch to a checkpoint, releasing the blocks pushed after it.
+// This operation is not thread safe and must not run concurrently with any 
+// other operation on the scratch
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_atomic_scratch_restore(GSAtomicScratch* scratch,                             // The scratch to restore
+                          GSAtomicScratchCheckpoint checkpoint);                // The checkpoint to restore
+
+
+////////////////////////////////////////////////
+/////////////////// POOL CACHE /////////////////
+////////////////////////////////////////////////
+
+#define GS_POOL_CACHE_ALLOC_ALIGNED(cache, size, alignment)\
+    gs_pool_cache_alloc(cache,\
+                        size,\
+                        alignment)
+
+#define GS_POOL_CACHE_ALLOC_ALIGNED_CHECKED(cache, size, alignment)\
+    gs_pool_cache_alloc_CHECKED(cache,\
+                                size,\
+                                alignment)
+
+#define GS_POOL_CACHE_FREE(cache, ptr)\
+    gs_pool_cache_free(cache, ptr)
+
+// A magazine is a small stack of free blocks that is exchanged as a whole
+// between the per-thread caches and the depot
+typedef struct GSMagazine
+{
+  struct GSMagazine*  p_next;
+  void**              p_blocks;
+  unsigned int        count;
+} GSMagazine;
+
+// The depot is shared by all threads and stores full and empty magazines.
+// Accesses to the depot and to the underlying pool are protected by a spin 
+// lock, which is only taken when a thread cache runs empty or full.
+typedef struct GSPoolDepot
+{
+  bool              valid;
+  GSPool*           pool;
+  GSMagazine*       p_full;
+  GSMagazine*       p_empty;
+  unsigned int      magazine_size;
+  int               lock;
+} GSPoolDepot;
+
+// A per-thread cache of blocks of a pool. Each thread must use its own cache
+// (e.g. stored in a thread local variable), thus allocations and frees do not
+// touch shared memory unless both magazines of the cache are empty or full.
+// For instance:
+//
+// GSPool pool = gs_pool_init(ptr, size, bsize, alignment);
+// GSPoolDepot depot = gs_pool_depot_init(&pool, depot_ptr, depot_size, 64);
+// ...
+// // in each thread
+// GSPoolCache cache = gs_pool_cache_init(&depot);
+// void* block = GS_POOL_CACHE_ALLOC_ALIGNED_CHECKED(&cache, bsize, alignment);
+// GS_POOL_CACHE_FREE(&cache, block);
+// gs_pool_cache_release(&cache);
+typedef struct GSPoolCache
+{
+  bool              valid;
+  GSPoolDepot*      depot;
+  GSMagazine*       p_loaded;
+  GSMagazine*       p_previous;
+} GSPoolCache;
+
+// Returns a new initialized depot for the given pool, marked valid if the 
+// operation succeeds. The memory region is used to store the magazines, each 
+// taking sizeof(GSMagazine) + magazine_size*sizeof(void*) bytes. Two magazines
+// are needed for each thread cache, plus those to store blocks in the depot.
+GS_MEM_ALLOC_VISIBILITY
+GSPoolDepot
+gs_pool_depot_init(GSPool* pool,                                                // The pool to cache blocks from
+                   void* mem_ptr,                                               // The pointer to the memory region for the magazines
+                   unsigned long long size,                                     // The size of the memory region
+                   unsigned int magazine_size);                                 // The number of blocks of each magazine
+
+
+
+// Returns all the blocks stored in the full magazines of the depot to the
+// underlying pool. 
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_pool_depot_drain(GSPoolDepot* depot);                                        // The depot to drain
+
+
+
+// Returns a new initialized thread cache for the given depot, marked valid if
+// the operation succeeds (there are enough empty magazines in the depot).
+GS_MEM_ALLOC_VISIBILITY
+GSPoolCache
+gs_pool_cache_init(GSPoolDepot* depot);                                         // The depot to get magazines from
+
+
+
+// Releases the thread cache, returning its blocks to the underlying pool and 
+// its magazines to the depot. Must be called before the owning thread exits 
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_pool_cache_release(GSPoolCache* cache);                                      // The cache to release
+
+
+
+// Returns a new block of memory from the thread cache. The size and alignment
+// parameters are used for checking the usage correctness. The alloc is NULL if
+// there is not enough space in the underlying pool
+GS_MEM_ALLOC_VISIBILITY
+GSAlloc
+gs_pool_cache_alloc(GSPoolCache* cache,                                         // The thread cache to use
+                    unsigned long long size,                                    // The size of the memory block (used for debugging purposes)
+                    unsigned int alignment);                                    // The alignment of the memory block (used for debugging purposes)
+
+
+
+// Returns a new block of memory from the thread cache. This a CHECKED
+// operation, thus it will throw an assert if the allocation fails (the returned
+// pointer is NULL) unless GS_MEM_ALLOC_DISABLE_CHECKS is defined
+GS_MEM_ALLOC_VISIBILITY
+void*
+gs_pool_cache_alloc_CHECKED(GSPoolCache* cache,                                 // The thread cache to use
+                            unsigned long long size,                            // The size of the memory block (used for debugging purposes)
+                            unsigned int alignment);                            // The alignment of the memory block (used for debugging purposes)
+
+
+
+// Frees a block to the thread cache. The block can have been allocated from
+// any cache of the same depot
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_pool_cache_free(GSPoolCache* cache,                                          // The thread cache to use
+                   void* ptr);                                                  // The address to the block to deallocate
+
+
+////////////////////////////////////////////////
+/////////////////// SLAB POOL //////////////////
+////////////////////////////////////////////////
+
+#define GS_SLAB_POOL_ALLOC_ALIGNED(pool, size, alignment)\
+    gs_slab_pool_alloc(pool,\
+                       size,\
+                       alignment)
+
+#define GS_SLAB_POOL_ALLOC_ALIGNED_CHECKED(pool, size, alignment)\
+    gs_slab_pool_alloc_CHECKED(pool,\
+                               size,\
+                               alignment)
+
+#define GS_SLAB_POOL_FREE(pool, ptr)\
+    gs_slab_pool_free(pool, ptr)
+
+#define GS_SLAB_POOL_FLUSH(pool)\
+    gs_slab_pool_flush(pool)
+
+// Header stored at the beginning of each slab. Blocks are carved lazily from
+// p_carve, and freed blocks are kept in a free list local to the slab
+typedef struct GSSlab
+{
+  struct GSSlab*      p_prev;
+  struct GSSlab*      p_next;
+  void*               p_next_free;
+  char*               p_carve;
+  unsigned int        num_live;
+  unsigned int        color;                                                    // The offset of the first block from the color 0 position
+} GSSlab;
+
+// A pool of fixed size blocks that grows by acquiring slabs of slab_size bytes
+// from a backing, and releases them when they become empty. Slabs must be 
+// aligned to slab_size (see gs_chunk_backing_vm), so the slab of a block is
+// found by masking its address. Allocations are served from the current slab
+// until it fills up, and then from the fullest partial slab, so frees
+// concentrate on the emptier slabs, which can then be released. Up to
+// max_empty_slabs empty slabs are kept to be reused, the rest are released to
+// the backing. Consecutive slabs shift their first block by one cache line
+// (cache coloring), so blocks with the same index in different slabs do not
+// map to the same cache sets. For instance:
+//
+// GSSlabPool pool = gs_slab_pool_init(bsize, alignment, 64*1024, 2, gs_chunk_backing_vm(64*1024));
+// void* block = GS_SLAB_POOL_ALLOC_ALIGNED_CHECKED(&pool, bsize, alignment);
+// GS_SLAB_POOL_FREE(&pool, block);
+// gs_slab_pool_release(&pool);
+typedef struct GSSlabPool
+{
+  bool                valid;
+  unsigned long long  bsize;
+  unsigned long long  stride;
+  unsigned long long  slab_size;
+  unsigned int        alignment;
+  unsigned int        blocks_per_slab;
+  unsigned int        first_block_offset;                                       // The offset of the first block in a slab of color 0
+  unsigned int        color_step;
+  unsigned int        num_colors;
+  unsigned int        next_color;
+  GSSlab*             p_current;                                                // The slab allocations are served from, in no list
+  GSSlab*             p_partial;                                                // Slabs with live and free blocks
+  GSSlab*             p_full;                                                   // Slabs without free blocks
+  GSSlab*             p_empty;                                                  // Slabs without live blocks
+  unsigned int        num_slabs;
+  unsigned int        num_empty;
+  unsigned int        max_empty_slabs;
+  GSChunkBacking      backing;
+} GSSlabPool;
+
+// Returns a new initialized slab pool marked valid if the operation succeeds
+// (slab_size is a power of two that fits at least one block). No slab is 
+// acquired until the first allocation
+GS_MEM_ALLOC_VISIBILITY
+GSSlabPool
+gs_slab_pool_init(unsigned long long bsize,                                     // The size of the blocks
+                  unsigned int alignment,                                       // The alignment of the blocks
+                  unsigned long long slab_size,                                 // The size of the slabs (a power of two)
+                  unsigned int max_empty_slabs,                                 // The number of empty slabs kept instead of released
+                  GSChunkBacking backing);                                      // The backing to acquire slabs from
+
+
+
+// Releases all the slabs of the pool to the backing. The pool cannot be used
+// afterwards
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_slab_pool_release(GSSlabPool* pool);                                         // The pool to release
+
+
+
+// Frees all the blocks of the pool. Up to max_empty_slabs slabs are kept, the
+// rest are released to the backing
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_slab_pool_flush(GSSlabPool* pool);                                           // The pool to flush
+
+
+
+// Returns a new block of memory from the pool. The size and alignment
+// parameters are used for checking the usage correctness. The alloc is NULL if
+// no slab can be acquired from the backing
+GS_MEM_ALLOC_VISIBILITY
+GSAlloc
+gs_slab_pool_alloc(GSSlabPool* pool,                                            // The slab pool to allocate from
+                   unsigned long long size,                                     // The size of the memory block (used for debugging purposes)
+                   unsigned int alignment);                                     // The alignment of the memory block (used for debugging purposes)
+
+
+
+// Returns a new block of memory from the pool. This a CHECKED operation, thus
+// it will throw an assert if the allocation fails (the returned pointer is
+// NULL) unless GS_MEM_ALLOC_DISABLE_CHECKS is defined
+GS_MEM_ALLOC_VISIBILITY
+void*
+gs_slab_pool_alloc_CHECKED(GSSlabPool* pool,                                    // The slab pool to allocate from
+                           unsigned long long size,                             // The size of the memory block (used for debugging purposes)
+                           unsigned int alignment);                             // The alignment of the memory block (used for debugging purposes)
+
+
+
+// Frees a block to its slab. A slab left without live blocks is kept as empty
+// or released to the backing if there are already max_empty_slabs
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_slab_pool_free(GSSlabPool* pool,                                             // The slab pool to free to
+                  void* ptr);                                                   // The address to the block to deallocate
+
+
+////////////////////////////////////////////////
+/////////////////// SIZE CLASS /////////////////
+////////////////////////////////////////////////
+
+#define GS_SIZE_CLASS_ALLOC(allocator, size)\
+    gs_size_class_alloc(allocator,\
+                        size,\
+                        GS_MEM_ALLOC_MIN_ALIGNMENT)
+
+#define GS_SIZE_CLASS_ALLOC_CHECKED(allocator, size)\
+    gs_size_class_alloc_CHECKED(allocator,\
+                                size,\
+                                GS_MEM_ALLOC_MIN_ALIGNMENT)
+
+#define GS_SIZE_CLASS_ALLOC_ALIGNED(allocator, size, alignment)\
+    gs_size_class_alloc(allocator,\
+                        size,\
+                        alignment)
+
+#define GS_SIZE_CLASS_ALLOC_ALIGNED_CHECKED(allocator, size, alignment)\
+    gs_size_class_alloc_CHECKED(allocator,\
+                                size,\
+                                alignment)
+
+#define GS_SIZE_CLASS_FREE(allocator, ptr)\
+    gs_size_class_free(allocator, ptr)
+
+#define GS_SIZE_CLASS_FLUSH(allocator)\
+    gs_size_class_flush(allocator)
+
+// The number of size classes, which go from 8 bytes to 4KB with four classes
+// per power of two above 128 bytes
+#define GS_SIZE_CLASS_COUNT                 29
+#define GS_SIZE_CLASS_MAX_SIZE              4096
+
+// A general purpose allocator for small objects built from a table of GSPools,
+// one per size class. The memory region is split in pages of 
+// GS_MEM_ALLOC_SIZE_CLASS_PAGE_SIZE bytes which are assigned to the size 
+// classes on demand. The class of each page is stored in a side table at the
+// beginning of the region, so blocks can be freed without passing their size.
+// Allocations larger than GS_SIZE_CLASS_MAX_SIZE, with alignments larger than
+// GS_MEM_ALLOC_MIN_ALIGNMENT, or that do not fit in the region are forwarded
+// to the fallback backing.
+typedef struct GSSizeClassAllocator
+{
+  bool              valid;
+  void*             p_begin;                                                    // The first page
+  void*             p_end;
+  void*             p_next_page;                                                // The next page not assigned to any class
+  unsigned char*    p_page_classes;                                             // The class+1 of each page, 0 if not assigned
+  GSPool            pools[GS_SIZE_CLASS_COUNT];                                 // The pool of each class, bound to its last page
+  unsigned char     class_lookup[GS_SIZE_CLASS_MAX_SIZE / 16 + 1];              // Maps (size+15)/16 to the class index
+  GSChunkBacking    fallback;
+} GSSizeClassAllocator;
+
+// Returns a new initialized size class allocator marked valid if the operation
+// succeeds. The fallback can have NULL callbacks if large allocations are not
+// needed
+GS_MEM_ALLOC_VISIBILITY
+GSSizeClassAllocator
+gs_size_class_init(void* mem_ptr,                                               // The pointer to the memory region for the allocator
+                   unsigned long long size,                                     // The size of the memory region
+                   GSChunkBacking fallback);                                    // The backing used for the allocations not served by the size classes
+
+
+
+// Flushes the allocator. Allocations forwarded to the fallback are not 
+// released
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_size_class_flush(GSSizeClassAllocator* allocator);                           // The allocator to flush
+
+
+
+// Returns a new block of memory of at least size bytes. The alloc is NULL if
+// the block cannot be allocated 
+GS_MEM_ALLOC_VISIBILITY
+GSAlloc
+gs_size_class_alloc(GSSizeClassAllocator* allocator,                            // The allocator to allocate from
+                    unsigned long long size,                                    // The size of the allocation
+                    unsigned int alignment);                                    // The alignment of the allocation
+
+
+
+// Returns a new block of memory of at least size bytes. This a CHECKED
+// operation, thus it will throw an assert if the allocation fails (the returned
+// pointer is NULL) unless GS_MEM_ALLOC_DISABLE_CHECKS is defined
+GS_MEM_ALLOC_VISIBILITY
+void*
+gs_size_class_alloc_CHECKED(GSSizeClassAllocator* allocator,                    // The allocator to allocate from
+                            unsigned long long size,                            // The size of the allocation
+                            unsigned int alignment);                            // The alignment of the allocation
+
+
+
+// Frees a block allocated with the allocator. The size class of the block is
+// derived from its address
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_size_class_free(GSSizeClassAllocator* allocator,                             // The allocator to free to
+                   void* ptr);                                                  // The address of the block to free
+
+
+////////////////////////////////////////////////
+/////////////////// TLSF ///////////////////////
+////////////////////////////////////////////////
+
+#define GS_TLSF_ALLOC(tlsf, size)\
+    gs_tlsf_alloc(tlsf,\
+                  size,\
+                  GS_MEM_ALLOC_MIN_ALIGNMENT)
+
+#define GS_TLSF_ALLOC_CHECKED(tlsf, size)\
+    gs_tlsf_alloc_CHECKED(tlsf,\
+                          size,\
+                          GS_MEM_ALLOC_MIN_ALIGNMENT)
+
+#define GS_TLSF_ALLOC_ALIGNED(tlsf, size, alignment)\
+    gs_tlsf_alloc(tlsf,\
+                  size,\
+                  alignment)
+
+#define GS_TLSF_ALLOC_ALIGNED_CHECKED(tlsf, size, alignment)\
+    gs_tlsf_alloc_CHECKED(tlsf,\
+                          size,\
+                          alignment)
+
+#define GS_TLSF_FREE(tlsf, ptr)\
+    gs_tlsf_free(tlsf, ptr)
+
+#define GS_TLSF_FLUSH(tlsf)\
+    gs_tlsf_flush(tlsf)
+
+// Free lists are indexed by a first level (the power of two of the block
+// size) and a second level (GS_TLSF_SL_COUNT linear subdivisions of it). 
+// Blocks smaller than 2^GS_TLSF_FL_SHIFT bytes are all kept in the first level
+// 0. Blocks can be up to 2^(GS_TLSF_FL_SHIFT+GS_TLSF_FL_COUNT-1) bytes (1TB).
+#define GS_TLSF_SL_LOG2                     5
+#define GS_TLSF_SL_COUNT                    (1 << GS_TLSF_SL_LOG2)
+#define GS_TLSF_ALIGN_LOG2                  4
+#define GS_TLSF_FL_SHIFT                    (GS_TLSF_SL_LOG2 + GS_TLSF_ALIGN_LOG2)
+#define GS_TLSF_FL_COUNT                    32
+
+// Header of a TLSF block. The payload starts right after the header. The free
+// list links are stored in the payload of free blocks.
+typedef struct GSTlsfBlock
+{
+  struct GSTlsfBlock*   p_prev_phys;                                            // The previous physical block, only valid if it is free
+  unsigned long long    size;                                                   // The size of the payload, the lower bits are used as flags
+  struct GSTlsfBlock*   p_next_free;
+  struct GSTlsfBlock*   p_prev_free;
+} GSTlsfBlock;
+
+// The free list heads and bitmaps, stored at the beginning of the memory region
+typedef struct GSTlsfControl
+{
+  unsigned int          fl_bitmap;
+  unsigned int          sl_bitmap[GS_TLSF_FL_COUNT];
+  GSTlsfBlock*          blocks[GS_TLSF_FL_COUNT][GS_TLSF_SL_COUNT];
+} GSTlsfControl;
+
+// A Two-Level Segregated Fit allocator. Supports allocations of arbitrary size
+// freed in any order, with constant time alloc and free, immediate coalescing
+// of neighbour free blocks and bounded fragmentation. Each allocation has a 
+// 16 bytes overhead.
+typedef struct GSTlsf
+{
+  bool              valid;
+  void*             p_begin;
+  void*             p_end;
+  GSTlsfControl*    p_control;
+} GSTlsf;
+
+// Returns a new initialized TLSF allocator marked valid if the operation
+// succeeds. The control structure of the allocator is stored at the beginning
+// of the memory region 
+GS_MEM_ALLOC_VISIBILITY
+GSTlsf
+gs_tlsf_init(void* mem_ptr,                                                     // The pointer to the memory region for the allocator
+             unsigned long long size);                                          // The size of the memory region
+
+
+
+// Flushes the allocator, freeing all its allocations at once
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_tlsf_flush(GSTlsf* tlsf);                                                    // The allocator to flush
+
+
+
+// Returns a new block of memory of at least size bytes. The alloc is NULL if
+// there is no free block large enough
+GS_MEM_ALLOC_VISIBILITY
+GSAlloc
+gs_tlsf_alloc(GSTlsf* tlsf,                                                     // The allocator to allocate from
+              unsigned long long size,                                          // The size of the allocation
+              unsigned int alignment);                                          // The alignment of the allocation
+
+
+
+// Returns a new block of memory of at least size bytes. This a CHECKED
+// operation, thus it will throw an assert if the allocation fails (the returned
+// pointer is NULL) unless GS_MEM_ALLOC_DISABLE_CHECKS is defined
+GS_MEM_ALLOC_VISIBILITY
+void*
+gs_tlsf_alloc_CHECKED(GSTlsf* tlsf,                                             // The allocator to allocate from
+                      unsigned long long size,                                  // The size of the allocation
+                      unsigned int alignment);                                  // The alignment of the allocation
+
+
+
+// Frees a block allocated with the allocator, coalescing it with its free
+// neighbours
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_tlsf_free(GSTlsf* tlsf,                                                      // The allocator to free to
+             void* ptr);                                                        // The address of the block to free
+
+
+////////////////////////////////////////////////
+/////////////////// NODE SET ///////////////////
+////////////////////////////////////////////////
+
+// The allocators of a NUMA node, carved from a single mapping bound to it. The
+// scratch is not thread safe, so threads sharing a node must synchronize its
+// use, while the pool can be used concurrently.
+typedef struct GSNodeArena
+{
+  GSVmMapping*  p_mapping;                                                      // The mapping backing the allocators of the node
+  bool          bound;                                                          // Whether the mapping could be bound to the node
+  GSScratch     scratch;                                                        // Not valid if the set has no scratches
+  GSAtomicPool  pool;                                                           // Not valid if the set has no pools
+} GSNodeArena;
+
+// A set of allocators per NUMA node. On systems with a single node, or without
+// NUMA support, the set has a single node whose memory is not bound
+typedef struct GSNodeSet
+{
+  bool          valid;
+  unsigned int  num_nodes;
+  GSNodeArena   nodes[GS_MEM_ALLOC_MAX_NUMA_NODES];
+} GSNodeSet;
+
+// Returns a new initialized node set, with a scratch of scratch_size bytes and
+// an atomic pool of pool_size bytes per node (either size can be 0 to skip the
+// allocator). The memory of each node is mapped with gs_vm_map_pages and bound
+// to the node with gs_vm_bind_node. A node whose memory cannot be bound is 
+// still usable. The set is marked valid if the operation succeeds
+GS_MEM_ALLOC_VISIBILITY
+GSNodeSet
+gs_node_set_init(unsigned long long scratch_size,                               // The size of the scratch of each node
+                 unsigned long long pool_size,                                  // The size of the pool of each node
+                 unsigned long long pool_bsize,                                 // The size of the blocks of the pools
+                 unsigned int pool_alignment,                                   // The alignment of the blocks of the pools
+                 unsigned long long page_size);                                 // The requested page size (see gs_vm_map_pages)
+
+
+
+// Unmaps the memory of all the nodes of the set
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_node_set_release(GSNodeSet* set);                                            // The node set to release
+
+
+
+// Returns the allocators of a node. Nodes beyond the nodes of the set wrap
+// around
+GS_MEM_ALLOC_VISIBILITY
+GSNodeArena*
+gs_node_set_get(GSNodeSet* set,                                                 // The node set 
+                unsigned int node);                                             // The node
+
+
+
+// Returns the allocators of the node the calling thread is running on
+GS_MEM_ALLOC_VISIBILITY
+GSNodeArena*
+gs_node_set_local(GSNodeSet* set);                                              // The node set 
+
+
+////////////////////////////////////////////////
+/////////////////// FAST PATHS /////////////////
+////////////////////////////////////////////////
+
+// The common case of the stack, scratch and pool operations, inlined in the
+// caller: the block fits in the memory already reserved (and committed) by the
+// allocator, or is taken from the pool free list. Everything else (growing a
+// scratch, committing memory, the pool bitmap and failures) is handled by the
+// out of line gs_*_slow methods, which implement the full operation. The fast
+// paths are only inlined when GS_MEM_ALLOC_INLINE_FAST_PATHS is defined (see
+// GS_MEM_ALLOC_DISABLE_INLINE), otherwise the methods are defined out of line 
+// as the rest of the library
+#ifdef GS_MEM_ALLOC_INLINE_FAST_PATHS
+
+#ifdef GS_MEM_ALLOC_DISABLE_ASSERTS
+#define GS_INLINE_ASSERT(_cond)
+#else
+#define GS_INLINE_ASSERT(_cond) \
+{\
+  if(GS_UNLIKELY(!(_cond))) \
+  {\
+    gs_assert_fail(#_cond);\
+  }\
+}
+#endif
+
+#ifdef GS_MEM_ALLOC_DISABLE_CHECKS
+#define GS_INLINE_CHECK(_alloc)\
+            (_alloc).checked = true;
+#else
+#define GS_INLINE_CHECK(_alloc) \
+{\
+  if(GS_UNLIKELY(gs_alloc_is_null(&(_alloc)))) \
+  {\
+    gs_assert_fail("!gs_alloc_is_null(&alloc)");\
+  }\
+}
+#endif
+
+static inline
+bool
+gs_alloc_is_null(GSAlloc* alloc)
+{
+  alloc->checked = true;
+  return alloc->ptr == 0;
+}
+
+static inline
+void* 
+gs_alloc_ptr(GSAlloc* alloc)
+{
+  GS_INLINE_ASSERT(alloc->checked && "GSAlloc cannot get ptr of an unchecked alloc")
+  return alloc->ptr;
+}
+
+static inline
+GSAlloc
+gs_stack_push(GSStack* stack, 
+              unsigned long long size,
+              unsigned int alignment)
+{
+  GS_INLINE_ASSERT(stack->valid == true && 
+                   "GSStack cannot push an invalid stack mem alloc")
+
+  char* ret = (char*)GS_ALIGN_ADDRESS(stack->p_current, alignment);
+  char* new_current = (char*)GS_ALIGN_ADDRESS(ret + size, GS_MEM_ALLOC_PTR_ALIGNMENT) + GS_MEM_ALLOC_PTR_ALIGNMENT;
+  if(GS_UNLIKELY(new_current >= (char*)stack->p_end ||
+                 (stack->p_region != 0 && new_current > (char*)stack->p_region->p_committed)))
+  {
+    return gs_stack_push_slow(stack, size, alignment);
+  }
+
+  *(GS_MEM_ALLOC_PTR_NUMERIC_TYPE*)(new_current - GS_MEM_ALLOC_PTR_ALIGNMENT) = (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)stack->p_current;
+  stack->p_current = new_current; 
+  GSAlloc alloc;
+  alloc.ptr = ret;
+  alloc.checked = false;
+  return alloc;
+}
+
+static inline
+void*
+gs_stack_push_CHECKED(GSStack* stack, 
+                      unsigned long long size,
+                      unsigned int alignment)
+{
+  GSAlloc alloc = gs_stack_push(stack, size, alignment);
+  GS_INLINE_CHECK(alloc)
+  return alloc.ptr;
+}
+
+static inline
+void
+gs_stack_pop(GSStack* stack, 
+             void* ptr)
+{
+  void* prev_stack_base = stack->p_begin;
+  if(GS_LIKELY(stack->p_current != stack->p_begin))
+  {
+    prev_stack_base = (void*)(*(GS_MEM_ALLOC_PTR_NUMERIC_TYPE*)(((char*)stack->p_current) - GS_MEM_ALLOC_PTR_ALIGNMENT));
+  }
+  
+  GS_INLINE_ASSERT(prev_stack_base <= ptr && 
+                   "GSStack cannot pop from this address. Popping must be performed in reverse order of push")
+  GS_INLINE_ASSERT(prev_stack_base && "Stack previous memory address cannot be null")
+  stack->p_current = prev_stack_base;
+}
+
+static inline
+GSAlloc
+gs_scratch_push(GSScratch* scratch, 
+                unsigned long long size, 
+                unsigned int alignment)
+{
+  GS_INLINE_ASSERT(scratch->valid && "GSScratch not properly initialized")
+
+  char* ret = (char*)GS_ALIGN_ADDRESS(scratch->p_current, alignment);
+  char* new_current = ret + size;
+  if(GS_UNLIKELY(new_current >= (char*)scratch->p_end ||
+                 (scratch->p_region != 0 && new_current > (char*)scratch->p_region->p_committed)))
+  {
+    return gs_scratch_push_slow(scratch, size, alignment);
+  }
+
+  scratch->p_current = new_current;
+  GSAlloc alloc;
+  alloc.ptr = ret;
+  alloc.checked = false;
+  return alloc;
+}
+
+static inline
+void*
+gs_scratch_push_CHECKED(GSScratch* scratch, 
+                        unsigned long long size, 
+                        unsigned int alignment)
+{
+  GSAlloc alloc = gs_scratch_push(scratch, size, alignment);
+  GS_INLINE_CHECK(alloc)
+  return alloc.ptr;
+}
+
+static inline
+GSAlloc
+gs_pool_alloc(GSPool* pool, 
+              unsigned long long size, 
+              unsigned int alignment)
+{
+  GS_INLINE_ASSERT(pool->valid == true && 
+                   "GSPool cannot allocate from an invalid pool mem alloc")
+  GS_INLINE_ASSERT(pool->alignment == alignment && 
+                   "GSPool incompatible alignment in allocation ")
+  GS_INLINE_ASSERT((pool->bsize == size || 
+                    (size < sizeof(GS_MEM_ALLOC_PTR_NUMERIC_TYPE) && pool->bsize == sizeof(GS_MEM_ALLOC_PTR_NUMERIC_TYPE))) && 
+                   "GSPool incompatible size in allocation")
+
+  GSAlloc alloc;
+  alloc.checked = false;
+  if(GS_LIKELY(pool->p_live_bitmap == 0))
+  {
+    char* ret = (char*)pool->p_next_free;
+    if(ret != 0)
+    {
+      pool->p_next_free = (void*)*(GS_MEM_ALLOC_PTR_NUMERIC_TYPE*)ret;
+      alloc.ptr = ret;
+      return alloc;
+    }
+
+    ret = (char*)pool->p_current;
+    if(GS_LIKELY(ret + size < (char*)pool->p_end))
+    {
+      pool->p_current = ret + pool->stride;
+      alloc.ptr = ret;
+      return alloc;
+    }
+  }
+  return gs_pool_alloc_slow(pool, size, alignment);
+}
+
+static inline
+void*
+gs_pool_alloc_CHECKED(GSPool* pool, 
+                      unsigned long long size, 
+                      unsigned int alignment)
+{
+  GSAlloc alloc = gs_pool_alloc(pool, size, alignment);
+  GS_INLINE_CHECK(alloc)
+  return alloc.ptr;
+}
+
+static inline
+void 
+gs_pool_free(GSPool* pool, 
+             void* ptr)
+{
+  if(GS_UNLIKELY(pool->p_live_bitmap != 0))
+  {
+    gs_pool_free_slow(pool, ptr);
+    return;
+  }
+
+  GS_INLINE_ASSERT(pool->valid == true && 
+                   "GSPool cannot free from an invalid pool mem alloc")
+  GS_INLINE_ASSERT(((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ptr % pool->alignment == 0) && "GSPool this should not happen")
+  GS_INLINE_ASSERT(((char*)ptr >= (char*)pool->p_begin && (char*)ptr < (char*)pool->p_current) && "GSPool invalid freed ptr")
+  *(GS_MEM_ALLOC_PTR_NUMERIC_TYPE*)ptr = (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)pool->p_next_free;
+  pool->p_next_free = ptr;
+}
+
+#endif
+
+
+#ifdef __cplusplus
+}
+#endif
+
+////////////////////////////////////////////////
+/////////////////// C++ ////////////////////////
+////////////////////////////////////////////////
+
+// Adapters to allocate the memory of C++ containers from the allocators. The
+// GS*Allocator templates satisfy the Allocator requirements of the standard 
+// containers and are resolved at compile time, while the GS*Resource classes
+// derive from std::pmr::memory_resource to be used with the std::pmr 
+// containers. Both reference an allocator owned by the caller, and report
+// allocation failures with std::bad_alloc (or abort when exceptions are
+// disabled). 
+//
+// - Scratch: deallocation is a no-op, memory is reclaimed when the scratch is
+//   restored or flushed
+// - Stack: deallocating the block at the top pops it, other blocks are 
+//   reclaimed when the stack is restored or flushed
+// - Pool: allocations must fit in a block (bsize and alignment), so they suit
+//   node based containers (std::list, std::map, std::set) with one element
+//   per allocation. Larger requests fail
+//
+// GSTypedPool is the C++ counterpart of GS_TYPED_POOL_DEFINE
+#if defined(__cplusplus) && defined(GS_MEM_ALLOC_ENABLE_CPP)
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <utility>
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#define GS_MEM_ALLOC_HAS_PMR
+#endif
+#endif
+
+[[noreturn]] inline void
+gs_cpp_bad_alloc()
+{
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+  throw std::bad_alloc();
+#else
+  std::abort();
+#endif
+}
+
+// Returns the alignment passed to the allocators for a requested alignment
+inline unsigned int
+gs_cpp_alignment(std::size_t alignment)
+{
+  return alignment < GS_MEM_ALLOC_MIN_ALIGNMENT ? GS_MEM_ALLOC_MIN_ALIGNMENT : (unsigned int)alignment;
+}
+
+inline void*
+gs_cpp_scratch_allocate(GSScratch* scratch, 
+                        std::size_t bytes, 
+                        std::size_t alignment)
+{
+  GSAlloc alloc = gs_scratch_push(scratch, bytes, gs_cpp_alignment(alignment));
+  if(gs_alloc_is_null(&alloc))
+  {
+    gs_cpp_bad_alloc();
+  }
+  return gs_alloc_ptr(&alloc);
+}
+
+inline void*
+gs_cpp_stack_allocate(GSStack* stack, 
+                      std::size_t bytes, 
+                      std::size_t alignment)
+{
+  GSAlloc alloc = gs_stack_push(stack, bytes, gs_cpp_alignment(alignment));
+  if(gs_alloc_is_null(&alloc))
+  {
+    gs_cpp_bad_alloc();
+  }
+  return gs_alloc_ptr(&alloc);
+}
+
+inline void
+gs_cpp_stack_deallocate(GSStack* stack, 
+                        void* ptr)
+{
+  if(gs_stack_is_top(stack, ptr))
+  {
+    gs_stack_pop(stack, ptr);
+  }
+}
+
+inline void*
+gs_cpp_pool_allocate(GSPool* pool, 
+                     std::size_t bytes, 
+                     std::size_t alignment)
+{
+  if(bytes > pool->bsize || alignment > pool->alignment)
+  {
+    gs_cpp_bad_alloc();
+  }
+  GSAlloc alloc = gs_pool_alloc(pool, pool->bsize, pool->alignment);
+  if(gs_alloc_is_null(&alloc))
+  {
+    gs_cpp_bad_alloc();
+  }
+  return gs_alloc_ptr(&alloc);
+}
+
+// Returns the size in bytes of n objects of size, failing on overflow
+inline std::size_t
+gs_cpp_array_size(std::size_t n, 
+                  std::size_t size)
+{
+  if(n > (std::size_t)-1 / size)
+  {
+    gs_cpp_bad_alloc();
+  }
+  return n * size;
+}
+
+template <typename T>
+struct GSScratchAllocator
+{
+  typedef T value_type;
+
+  GSScratch* p_scratch;
+
+  explicit GSScratchAllocator(GSScratch* scratch) noexcept : p_scratch(scratch) {}
+
+  template <typename U>
+  GSScratchAllocator(const GSScratchAllocator<U>& other) noexcept : p_scratch(other.p_scratch) {}
+
+  T* 
+  allocate(std::size_t n)
+  {
+    return (T*)gs_cpp_scratch_allocate(p_scratch, gs_cpp_array_size(n, sizeof(T)), alignof(T));
+  }
+
+  void 
+  deallocate(T*, std::size_t) noexcept {}
+};
+
+template <typename T, typename U>
+inline bool 
+operator==(const GSScratchAllocator<T>& a, const GSScratchAllocator<U>& b) noexcept { return a.p_scratch == b.p_scratch; }
+
+template <typename T, typename U>
+inline bool 
+operator!=(const GSScratchAllocator<T>& a, const GSScratchAllocator<U>& b) noexcept { return a.p_scratch != b.p_scratch; }
+
+template <typename T>
+struct GSStackAllocator
+{
+  typedef T value_type;
+
+  GSStack* p_stack;
+
+  explicit GSStackAllocator(GSStack* stack) noexcept : p_stack(stack) {}
+
+  template <typename U>
+  GSStackAllocator(const GSStackAllocator<U>& other) noexcept : p_stack(other.p_stack) {}
+
+  T* 
+  allocate(std::size_t n)
+  {
+    return (T*)gs_cpp_stack_allocate(p_stack, gs_cpp_array_size(n, sizeof(T)), alignof(T));
+  }
+
+  void 
+  deallocate(T* ptr, std::size_t) noexcept 
+  {
+    gs_cpp_stack_deallocate(p_stack, ptr);
+  }
+};
+
+template <typename T, typename U>
+inline bool 
+operator==(const GSStackAllocator<T>& a, const GSStackAllocator<U>& b) noexcept { return a.p_stack == b.p_stack; }
+
+template <typename T, typename U>
+inline bool 
+operator!=(const GSStackAllocator<T>& a, const GSStackAllocator<U>& b) noexcept { return a.p_stack != b.p_stack; }
+
+template <typename T>
+struct GSPoolAllocator
+{
+  typedef T value_type;
+
+  GSPool* p_pool;
+
+  explicit GSPoolAllocator(GSPool* pool) noexcept : p_pool(pool) {}
+
+  template <typename U>
+  GSPoolAllocator(const GSPoolAllocator<U>& other) noexcept : p_pool(other.p_pool) {}
+
+  T* 
+  allocate(std::size_t n)
+  {
+    return (T*)gs_cpp_pool_allocate(p_pool, gs_cpp_array_size(n, sizeof(T)), alignof(T));
+  }
+
+  void 
+  deallocate(T* ptr, std::size_t) noexcept 
+  {
+    gs_pool_free(p_pool, ptr);
+  }
+};
+
+template <typename T, typename U>
+inline bool 
+operator==(const GSPoolAllocator<T>& a, const GSPoolAllocator<U>& b) noexcept { return a.p_pool == b.p_pool; }
+
+template <typename T, typename U>
+inline bool 
+operator!=(const GSPoolAllocator<T>& a, const GSPoolAllocator<U>& b) noexcept { return a.p_pool != b.p_pool; }
+
+// A pool of blocks of type T aligned to Align, with the stride and alignment
+// known at compile time. create/destroy construct and destroy the objects in
+// place, while alloc/free only hand out and take back raw blocks. flush does 
+// not call the destructors of the live objects
+template <typename T, unsigned int Align = alignof(T)>
+struct GSTypedPool
+{
+  static_assert((Align & (Align - 1)) == 0, "GSTypedPool alignment must be a power of two");
+  static_assert(Align >= alignof(T), "GSTypedPool alignment cannot be smaller than the alignment of T");
+
+  static constexpr unsigned int       alignment = GS_TYPED_POOL_ALIGNMENT(Align);
+  static constexpr unsigned long long stride = GS_TYPED_POOL_STRIDE(sizeof(T), Align);
+
+  GSTypedPoolBase base;
+
+  GSTypedPool(void* mem_ptr, unsigned long long size) noexcept : base(gs_typed_pool_init(mem_ptr, size, alignment)) {}
+
+  bool 
+  valid() const noexcept { return base.valid; }
+
+  T* 
+  alloc() noexcept { return (T*)gs_typed_pool_alloc(&base, stride); }
+
+  void 
+  free(T* ptr) noexcept { gs_typed_pool_free(&base, ptr); }
+
+  void 
+  flush() noexcept { gs_typed_pool_flush(&base); }
+
+  // Returns a new object constructed with args, or nullptr if the pool is full.
+  // The block is returned to the pool if the constructor throws
+  template <typename... Args>
+  T* 
+  create(Args&&... args)
+  {
+    struct Guard
+    {
+      GSTypedPoolBase* p_base;
+      void*            p_block;
+      ~Guard() { if(p_block != nullptr) gs_typed_pool_free(p_base, p_block); }
+    };
+    void* ptr = gs_typed_pool_alloc(&base, stride);
+    if(ptr == nullptr)
+    {
+      return nullptr;
+    }
+    Guard guard = {&base, ptr};
+    T* object = new(ptr) T(std::forward<Args>(args)...);
+    guard.p_block = nullptr;
+    return object;
+  }
+
+  void 
+  destroy(T* ptr) noexcept
+  {
+    ptr->~T();
+    gs_typed_pool_free(&base, ptr);
+  }
+};
+
+#ifdef GS_MEM_ALLOC_HAS_PMR
+class GSScratchResource : public std::pmr::memory_resource
+{
+public:
+  explicit GSScratchResource(GSScratch* scratch) noexcept : p_scratch(scratch) {}
+
+  GSScratch* p_scratch;
+
+private:
+  void* 
+  do_allocate(std::size_t bytes, std::size_t alignment) override
+  {
+    return gs_cpp_scratch_allocate(p_scratch, bytes, alignment);
+  }
+
+  void 
+  do_deallocate(void*, std::size_t, std::size_t) override {}
+
+  bool 
+  do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+  {
+    return this == &other;
+  }
+};
+
+class GSStackResource : public std::pmr::memory_resource
+{
+public:
+  explicit GSStackResource(GSStack* stack) noexcept : p_stack(stack) {}
+
+  GSStack* p_stack;
+
+private:
+  void* 
+  do_allocate(std::size_t bytes, std::size_t alignment) override
+  {
+    return gs_cpp_stack_allocate(p_stack, bytes, alignment);
+  }
+
+  void 
+  do_deallocate(void* ptr, std::size_t, std::size_t) override 
+  {
+    gs_cpp_stack_deallocate(p_stack, ptr);
+  }
+
+  bool 
+  do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+  {
+    return this == &other;
+  }
+};
+
+class GSPoolResource : public std::pmr::memory_resource
+{
+public:
+  explicit GSPoolResource(GSPool* pool) noexcept : p_pool(pool) {}
+
+  GSPool* p_pool;
+
+private:
+  void* 
+  do_allocate(std::size_t bytes, std::size_t alignment) override
+  {
+    return gs_cpp_pool_allocate(p_pool, bytes, alignment);
+  }
+
+  void 
+  do_deallocate(void* ptr, std::size_t, std::size_t) override 
+  {
+    gs_pool_free(p_pool, ptr);
+  }
+
+  bool 
+  do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+  {
+    return this == &other;
+  }
+};
+#endif
+
+#endif
+#endif
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
+#ifdef GS_MEM_ALLOC_IMPLEMENTATION
+
+// The mmap flags, madvise and syscall used by the virtual memory functions
+// are extensions hidden by strict modes such as -std=c99 unless requested.
+// Feature macros only apply to the system headers included after them, so in
+// those modes the implementation must be included before any system header
+#if !defined(_WIN32) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+
+#if !defined(GS_MEM_ALLOC_DISABLE_ASSERTS) || !defined(GS_MEM_ALLOC_DISABLE_CHECKS)
+#include <signal.h>
+#include <stdio.h>
+#endif
+
+#ifdef GS_MEM_ALLOC_INITIALIZE_TO_ZERO
+#include <string.h>
+#endif
+
+#ifdef GS_MEM_ALLOC_ENABLE_TRACE
+#include <stdio.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+
+#ifdef GS_MEM_ALLOC_DISABLE_ASSERTS
+#define GS_ASSERT(_cond)
+#else
+#define GS_ASSERT(_cond) \
+{\
+  if(!(_cond)) \
+  {\
+    printf("%s\n", #_cond);\
+    raise(SIGABRT);\
+  }\
+}
+#endif
+
+#define GS_PERMA_ASSERT(_cond) \
+{\
+  if(!(_cond)) \
+  {\
+    printf("%s\n", #_cond);\
+    raise(SIGABRT);\
+  }\
+}
+
+#define GS_ATOMIC_LOAD(_ptr)\
+            __atomic_load_n(_ptr, __ATOMIC_ACQUIRE)
+
+#define GS_ATOMIC_LOAD_RELAXED(_ptr)\
+            __atomic_load_n(_ptr, __ATOMIC_RELAXED)
+
+#define GS_ATOMIC_STORE(_ptr, _value)\
+            __atomic_store_n(_ptr, _value, __ATOMIC_RELEASE)
+
+#define GS_ATOMIC_STORE_RELAXED(_ptr, _value)\
+            __atomic_store_n(_ptr, _value, __ATOMIC_RELAXED)
+
+#define GS_ATOMIC_FETCH_ADD(_ptr, _value)\
+            __atomic_fetch_add(_ptr, _value, __ATOMIC_ACQ_REL)
+
+#define GS_ATOMIC_CAS(_ptr, _expected, _desired)\
+            __atomic_compare_exchange_n(_ptr, _expected, _desired, true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+////////////////////////////////////////////////
+/////////////////// ALLOC //////////////////////
+////////////////////////////////////////////////
+#ifndef GS_MEM_ALLOC_INLINE_FAST_PATHS
+GS_MEM_ALLOC_VISIBILITY
+bool
+gs_alloc_is_null(GSAlloc* alloc)
+{
+  alloc->checked = true;
+  return alloc->ptr == NULL;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void* 
+gs_alloc_ptr(GSAlloc* alloc)
+{
+  GS_ASSERT(alloc->checked && "GSAlloc cannot get ptr of an unchecked alloc");
+  return alloc->ptr;
+}
+#endif
+
+#if !defined(GS_MEM_ALLOC_DISABLE_ASSERTS) || !defined(GS_MEM_ALLOC_DISABLE_CHECKS)
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_assert_fail(const char* condition)
+{
+  printf("%s\n", condition);
+  raise(SIGABRT);
+}
+#endif
+
+////////////////////////////////////////////////
+////////////////// VIRTUAL MEMORY //////////////
+////////////////////////////////////////////////
+
+GS_MEM_ALLOC_VISIBILITY
+unsigned long long
+gs_vm_page_size(void)
+{
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwPageSize;
+#else
+  return (unsigned long long)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void*
+gs_vm_reserve(unsigned long long size)
+{
+#ifdef _WIN32
+  return VirtualAlloc(NULL, size, MEM_RESERVE, PAGE_NOACCESS);
+#else
+  void* ptr = mmap(NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  return ptr == MAP_FAILED ? NULL : ptr;
+#endif
+}
+
+GS_MEM_ALLOC_VISIBILITY
+bool
+gs_vm_commit(void* ptr, 
+             unsigned long long size)
+{
+#ifdef _WIN32
+  return VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE) != NULL;
+#else
+  return mprotect(ptr, size, PROT_READ | PROT_WRITE) == 0;
+#endif
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_vm_decommit(void* ptr, 
+               unsigned long long size)
+{
+#ifdef _WIN32
+  VirtualFree(ptr, size, MEM_DECOMMIT);
+#else
+  madvise(ptr, size, MADV_DONTNEED);
+  mprotect(ptr, size, PROT_NONE);
+#endif
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_vm_purge(void* ptr, 
+            unsigned long long size)
+{
+#ifdef _WIN32
+  VirtualAlloc(ptr, size, MEM_RESET, PAGE_READWRITE);
+#elif defined(GS_MEM_ALLOC_LAZY_PURGE) && defined(MADV_FREE)
+  madvise(ptr, size, MADV_FREE);
+#else
+  madvise(ptr, size, MADV_DONTNEED);
+#endif
+}
+
+// Purges the whole pages inside [begin, end), where pages are those of the
+// mapping backing the allocator, if any. Returns the bytes purged
+static unsigned long long
+gs_vm_purge_range(void* begin, 
+                  void* end, 
+                  GSVmMapping* mapping)
+{
+  unsigned long long page_size = mapping != NULL ? mapping->page_size : gs_vm_page_size();
+  char* first = (char*)GS_ALIGN_ADDRESS(begin, page_size);
+  char* last = (char*)((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)end & ~((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)page_size - 1));
+  if(first >= last)
+  {
+    return 0;
+  }
+  gs_vm_purge(first, GS_PTR_DIFF(last, first));
+  return GS_PTR_DIFF(last, first);
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_vm_release(void* ptr, 
+              unsigned long long size)
+{
+#ifdef _WIN32
+  VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+  munmap(ptr, size);
+#endif
+}
+
+// Maps size bytes of committed read-write memory aligned to alignment, a power
+// of two multiple of the page size, by over-reserving and keeping the aligned
+// part. The range can be released with gs_vm_release. Returns NULL if the 
+// operation fails
+static void*
+gs_vm_map_aligned(unsigned long long size, 
+                  unsigned long long alignment)
+{
+#ifdef _WIN32
+  // Parts of a reservation cannot be released, so the aligned address found in
+  // a larger reservation is reserved again, which fails if another thread
+  // mapped it in between
+  for(int i = 0; i < 16; ++i)
+  {
+    void* ptr = VirtualAlloc(NULL, size + alignment, MEM_RESERVE, PAGE_NOACCESS);
+    if(ptr == NULL)
+    {
+      return NULL;
+    }
+    char* begin = (char*)ptr;
+    GS_ALIGN_PTR(begin, alignment)
+    VirtualFree(ptr, 0, MEM_RELEASE);
+    ptr = VirtualAlloc(begin, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if(ptr != NULL)
+    {
+      return ptr;
+    }
+  }
+  return NULL;
+#else
+  unsigned long long reserve_size = size + alignment;
+  void* ptr = mmap(NULL, reserve_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(ptr == MAP_FAILED)
+  {
+    return NULL;
+  }
+  char* begin = (char*)ptr;
+  GS_ALIGN_PTR(begin, alignment)
+  unsigned long long head = GS_PTR_DIFF(begin, ptr);
+  if(head > 0)
+  {
+    munmap(ptr, head);
+  }
+  munmap(begin + size, reserve_size - head - size);
+  return begin;
+#endif
+}
+
+#ifndef _WIN32
+// Maps size bytes of explicit huge pages of page_size bytes. Returns NULL if
+// the system has no huge pages of that size reserved
+static void*
+gs_vm_map_hugetlb(unsigned long long size, 
+                  unsigned long long page_size)
+{
+#ifdef MAP_HUGETLB
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+#ifdef MAP_HUGE_SHIFT
+  flags |= (63 - __builtin_clzll(page_size)) << MAP_HUGE_SHIFT;
+#endif
+  void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+  return ptr == MAP_FAILED ? NULL : ptr;
+#else
+  return NULL;
+#endif
+}
+
+// Maps size bytes of normal pages aligned to page_size and advises the kernel
+// to back them with transparent huge pages, which are only used for aligned
+// ranges. Returns NULL if the advice is not supported
+static void*
+gs_vm_map_transparent(unsigned long long size, 
+                      unsigned long long page_size)
+{
+#ifdef MADV_HUGEPAGE
+  char* begin = (char*)gs_vm_map_aligned(size, page_size);
+  if(begin == NULL)
+  {
+    return NULL;
+  }
+  if(madvise(begin, size, MADV_HUGEPAGE) != 0)
+  {
+    munmap(begin, size);
+    return NULL;
+  }
+  return begin;
+#else
+  return NULL;
+#endif
+}
+#endif
+
+GS_MEM_ALLOC_VISIBILITY
+GSVmMapping*
+gs_vm_map_pages(unsigned long long size, 
+                unsigned long long page_size)
+{
+  GS_ASSERT(page_size > 0 && (page_size & (page_size - 1)) == 0 && 
+            "GSVmMapping page size must be a power of two")
+  unsigned long long normal_page_size = gs_vm_page_size();
+  void* ptr = NULL;
+  unsigned long long obtained_page_size = normal_page_size;
+  unsigned int kind = GS_VM_PAGES_NORMAL;
+#ifdef _WIN32
+  unsigned long long large_page_size = GetLargePageMinimum();
+  if(page_size > normal_page_size && large_page_size > 0)
+  {
+    unsigned long long large_size = (size + large_page_size - 1) & ~(large_page_size - 1);
+    ptr = VirtualAlloc(NULL, large_size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+    if(ptr != NULL)
+    {
+      size = large_size;
+      obtained_page_size = large_page_size;
+      kind = GS_VM_PAGES_HUGETLB;
+    }
+  }
+  if(ptr == NULL)
+  {
+    size = (size + normal_page_size - 1) & ~(normal_page_size - 1);
+    ptr = VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+  }
+#else
+  if(page_size > normal_page_size)
+  {
+    unsigned long long huge_size = (size + page_size - 1) & ~(page_size - 1);
+    ptr = gs_vm_map_hugetlb(huge_size, page_size);
+    if(ptr != NULL)
+    {
+      size = huge_size;
+      obtained_page_size = page_size;
+      kind = GS_VM_PAGES_HUGETLB;
+    }
+  }
+  if(ptr == NULL && page_size > normal_page_size)
+  {
+    // Transparent huge pages are at most 2MB (one page table directory entry)
+    unsigned long long thp_size = page_size < GS_VM_PAGE_SIZE_2MB ? page_size : GS_VM_PAGE_SIZE_2MB;
+    unsigned long long huge_size = (size + thp_size - 1) & ~(thp_size - 1);
+    ptr = gs_vm_map_transparent(huge_size, thp_size);
+    if(ptr != NULL)
+    {
+      size = huge_size;
+      obtained_page_size = thp_size;
+      kind = GS_VM_PAGES_TRANSPARENT;
+    }
+  }
+  if(ptr == NULL)
+  {
+    size = (size + normal_page_size - 1) & ~(normal_page_size - 1);
+    kind = GS_VM_PAGES_NORMAL;
+    ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ptr = ptr == MAP_FAILED ? NULL : ptr;
+  }
+#endif
+  if(ptr == NULL)
+  {
+    return NULL;
+  }
+
+  GSVmMapping* mapping = (GSVmMapping*)ptr;
+  mapping->size = size;
+  mapping->page_size = obtained_page_size;
+  mapping->kind = kind;
+  return mapping;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_vm_unmap_pages(GSVmMapping* mapping)
+{
+#ifdef _WIN32
+  VirtualFree(mapping, 0, MEM_RELEASE);
+#else
+  munmap(mapping, mapping->size);
+#endif
+}
+
+// Memory policy values of the Linux mbind/set_mempolicy system calls
+#define GS_VM_MPOL_DEFAULT                  0
+#define GS_VM_MPOL_PREFERRED                1
+#define GS_VM_MPOL_BIND                     2
+#define GS_VM_MPOL_F_MEMS_ALLOWED           (1 << 2)
+#define GS_VM_MPOL_MF_MOVE                  (1 << 1)
+
+// The node masks passed to the kernel must cover all its possible nodes
+#define GS_VM_NODE_MASK_WORDS               16
+
+GS_MEM_ALLOC_VISIBILITY
+unsigned int
+gs_vm_num_nodes(void)
+{
+  unsigned int num_nodes = 1;
+#if defined(_WIN32)
+  ULONG highest_node;
+  if(GetNumaHighestNodeNumber(&highest_node))
+  {
+    num_nodes = (unsigned int)highest_node + 1;
+  }
+#elif defined(__linux__) && defined(SYS_get_mempolicy)
+  unsigned long mask[GS_VM_NODE_MASK_WORDS] = {0};
+  int mode;
+  if(syscall(SYS_get_mempolicy, &mode, mask, sizeof(mask)*8, NULL, GS_VM_MPOL_F_MEMS_ALLOWED) == 0)
+  {
+    for(int i = GS_VM_NODE_MASK_WORDS - 1; i >= 0; --i)
+    {
+      if(mask[i] != 0)
+      {
+        num_nodes = i*sizeof(unsigned long)*8 + (sizeof(unsigned long)*8 - __builtin_clzl(mask[i]));
+        break;
+      }
+    }
+  }
+#endif
+  return num_nodes < GS_MEM_ALLOC_MAX_NUMA_NODES ? num_nodes : GS_MEM_ALLOC_MAX_NUMA_NODES;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+unsigned int
+gs_vm_current_node(void)
+{
+#if defined(_WIN32)
+  PROCESSOR_NUMBER processor;
+  USHORT node;
+  GetCurrentProcessorNumberEx(&processor);
+  if(GetNumaProcessorNodeEx(&processor, &node))
+  {
+    return node;
+  }
+#elif defined(__linux__) && defined(SYS_getcpu)
+  unsigned int cpu;
+  unsigned int node;
+  if(syscall(SYS_getcpu, &cpu, &node, NULL) == 0)
+  {
+    return node;
+  }
+#endif
+  return 0;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+bool
+gs_vm_bind_node(void* ptr, 
+                unsigned long long size, 
+                unsigned int node)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+  if(node >= GS_VM_NODE_MASK_WORDS*sizeof(unsigned long)*8)
+  {
+    return false;
+  }
+  unsigned long mask[GS_VM_NODE_MASK_WORDS] = {0};
+  mask[node / (sizeof(unsigned long)*8)] = 1ul << (node % (sizeof(unsigned long)*8));
+  return syscall(SYS_mbind, ptr, size, GS_VM_MPOL_BIND, mask, sizeof(mask)*8, GS_VM_MPOL_MF_MOVE) == 0;
+#else
+  return false;
+#endif
+}
+
+GS_MEM_ALLOC_VISIBILITY
+bool
+gs_vm_prefer_node(unsigned int node)
+{
+#if defined(__linux__) && defined(SYS_set_mempolicy)
+  if(node == GS_VM_NO_NODE)
+  {
+    return syscall(SYS_set_mempolicy, GS_VM_MPOL_DEFAULT, NULL, 0) == 0;
+  }
+  if(node >= GS_VM_NODE_MASK_WORDS*sizeof(unsigned long)*8)
+  {
+    return false;
+  }
+  unsigned long mask[GS_VM_NODE_MASK_WORDS] = {0};
+  mask[node / (sizeof(unsigned long)*8)] = 1ul << (node % (sizeof(unsigned long)*8));
+  return syscall(SYS_set_mempolicy, GS_VM_MPOL_PREFERRED, mask, sizeof(mask)*8) == 0;
+#else
+  return false;
+#endif
+}
+
+#define GS_VIRTUAL_REGION_BEGIN(_region)\
+  ((char*)(_region) + ((sizeof(GSVirtualRegion) + GS_MEM_ALLOC_MIN_ALIGNMENT - 1) & ~(GS_MEM_ALLOC_MIN_ALIGNMENT - 1)))
+
+#define GS_VIRTUAL_REGION_END(_region)\
+  ((char*)(_region) + (_region)->reserve_size)
+
+// Reserves a virtual memory range and commits its first granule, which holds
+// the region header. Returns NULL if the operation fails
+static GSVirtualRegion*
+gs_virtual_region_create(unsigned long long reserve_size, 
+                         unsigned long long commit_granularity, 
+                         unsigned long long decommit_watermark)
+{
+  unsigned long long page_size = gs_vm_page_size();
+  if(commit_granularity < page_size)
+  {
+    commit_granularity = page_size;
+  }
+  GS_ASSERT((commit_granularity & (commit_granularity - 1)) == 0 && 
+            "GSVirtualRegion commit granularity must be a power of two")
+  commit_granularity = (commit_granularity + page_size - 1) & ~(page_size - 1);
+  reserve_size = (reserve_size + commit_granularity - 1) & ~(commit_granularity - 1);
+
+  void* ptr = gs_vm_reserve(reserve_size);
+  if(ptr == NULL)
+  {
+    return NULL;
+  }
+
+  if(!gs_vm_commit(ptr, commit_granularity))
+  {
+    gs_vm_release(ptr, reserve_size);
+    return NULL;
+  }
+
+  GSVirtualRegion* region = (GSVirtualRegion*)ptr;
+  region->p_committed = (char*)ptr + commit_granularity;
+  region->reserve_size = reserve_size;
+  region->commit_granularity = commit_granularity;
+  region->decommit_watermark = decommit_watermark;
+  return region;
+}
+
+// Ensures that the memory of the region up to ptr is committed. Returns false
+// if ptr is out of the region or the memory cannot be committed
+static bool
+gs_virtual_region_commit(GSVirtualRegion* region, 
+                         void* ptr)
+{
+  if((char*)ptr <= (char*)region->p_committed)
+  {
+    return true;
+  }
+
+  char* end = GS_VIRTUAL_REGION_END(region);
+  if((char*)ptr > end)
+  {
+    return false;
+  }
+
+  unsigned long long offset = GS_PTR_DIFF(ptr, region);
+  offset = (offset + region->commit_granularity - 1) & ~(region->commit_granularity - 1);
+  char* new_committed = (char*)region + offset;
+  if(new_committed > end)
+  {
+    new_committed = end;
+  }
+
+  if(!gs_vm_commit(region->p_committed, GS_PTR_DIFF(new_committed, region->p_committed)))
+  {
+    return false;
+  }
+  region->p_committed = new_committed;
+  return true;
+}
+
+// Decommits the memory of the region beyond decommit_watermark bytes from
+// p_begin, unless the watermark is GS_MEM_ALLOC_NO_DECOMMIT
+static void
+gs_virtual_region_flush(GSVirtualRegion* region, 
+                        void* p_begin)
+{
+  if(region->decommit_watermark == GS_MEM_ALLOC_NO_DECOMMIT)
+  {
+    return;
+  }
+
+  unsigned long long offset = GS_PTR_DIFF(p_begin, region);
+  if(region->decommit_watermark > region->reserve_size - offset)
+  {
+    return;
+  }
+  offset += region->decommit_watermark;
+  offset = (offset + region->commit_granularity - 1) & ~(region->commit_granularity - 1);
+  char* keep = (char*)region + offset;
+  if(keep < (char*)region->p_committed)
+  {
+    gs_vm_decommit(keep, GS_PTR_DIFF(region->p_committed, keep));
+    region->p_committed = keep;
+  }
+}
+
+////////////////////////////////////////////////
+////////////////// STATS ///////////////////////
+////////////////////////////////////////////////
+
+// The statistics are updated through these macros, which expand to nothing
+// when GS_MEM_ALLOC_ENABLE_STATS is not defined
+#ifdef GS_MEM_ALLOC_ENABLE_STATS
+
+static void
+gs_alloc_stats_init(GSAllocStats* stats)
+{
+  stats->bytes_in_use = 0;
+  stats->high_water_mark = 0;
+  stats->num_allocs = 0;
+  stats->num_frees = 0;
+  stats->num_failed_allocs = 0;
+  stats->padding_bytes = 0;
+  stats->overhead_bytes = 0;
+  stats->live_blocks = 0;
+  stats->free_list_length = 0;
+}
+
+static void
+gs_alloc_stats_alloc(GSAllocStats* stats, 
+                     unsigned long long count,
+                     unsigned long long in_use,
+                     unsigned long long padding,
+                     unsigned long long overhead)
+{
+  stats->num_allocs += count;
+  stats->padding_bytes += padding;
+  stats->overhead_bytes += overhead;
+  if(in_use > stats->high_water_mark)
+  {
+    stats->high_water_mark = in_use;
+  }
+}
+
+#define GS_STATS_INIT(_stats)\
+            gs_alloc_stats_init(_stats);
+
+#define GS_STATS_ALLOC(_stats, _count, _in_use, _padding, _overhead)\
+            gs_alloc_stats_alloc(_stats, _count, _in_use, _padding, _overhead);
+
+#define GS_STATS_FREE(_stats, _count)\
+            (_stats)->num_frees += (_count);
+
+#define GS_STATS_FAILED(_stats)\
+            (_stats)->num_failed_allocs++;
+
+#define GS_STATS_UPDATE(_code) _code
+
+#else
+
+#define GS_STATS_INIT(_stats)
+#define GS_STATS_ALLOC(_stats, _count, _in_use, _padding, _overhead)
+#define GS_STATS_FREE(_stats, _count)
+#define GS_STATS_FAILED(_stats)
+#define GS_STATS_UPDATE(_code)
+
+#endif
+
+////////////////////////////////////////////////
+////////////////// TRACE ///////////////////////
+////////////////////////////////////////////////
+
+// Operations are recorded through these macros, which expand to nothing when
+// GS_MEM_ALLOC_ENABLE_TRACE is not defined
+#ifdef GS_MEM_ALLOC_ENABLE_TRACE
+
+static GSTrace* gs_trace_active = NULL;
+static unsigned int gs_trace_ids = 0;
+
+GS_MEM_ALLOC_VISIBILITY
+GSTrace
+gs_trace_init(void* mem_ptr, 
+              unsigned long long size)
+{
+  GS_ASSERT(mem_ptr != NULL && 
+            "GSTrace mem ptr cannot be NULL")
+  GSTrace trace;
+  trace.p_events = (GSTraceEvent*)mem_ptr;
+  trace.capacity = 0;
+  trace.count = 0;
+  unsigned long long num_events = size / sizeof(GSTraceEvent);
+  if(num_events > 0)
+  {
+    // The capacity is rounded down to a power of two to index the ring buffer
+    // with a mask
+    trace.capacity = 1ull << (63 - __builtin_clzll(num_events));
+  }
+  trace.valid = trace.capacity > 0;
+  return trace;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_trace_begin(GSTrace* trace)
+{
+  GS_ASSERT(trace->valid && "GSTrace cannot record to an invalid trace")
+  GS_ATOMIC_STORE(&gs_trace_active, trace);
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_trace_end(void)
+{
+  GS_ATOMIC_STORE(&gs_trace_active, (GSTrace*)NULL);
+}
+
+GS_MEM_ALLOC_VISIBILITY
+bool
+gs_trace_dump(GSTrace* trace, 
+              const char* path)
+{
+  GS_ASSERT(trace->valid && "GSTrace cannot dump an invalid trace")
+  FILE* file = fopen(path, "wb");
+  if(file == NULL)
+  {
+    return false;
+  }
+
+  GSTraceFileHeader header;
+  header.magic = GS_TRACE_FILE_MAGIC;
+  header.version = GS_TRACE_FILE_VERSION;
+  header.event_size = sizeof(GSTraceEvent);
+  header.reserved = 0;
+  header.num_events = trace->count < trace->capacity ? trace->count : trace->capacity;
+  header.num_dropped = trace->count - header.num_events;
+  bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+
+  // The oldest event is written first. The ring buffer is written in at most
+  // two runs
+  unsigned long long first = header.num_dropped & (trace->capacity - 1);
+  unsigned long long first_run = trace->capacity - first;
+  if(first_run > header.num_events)
+  {
+    first_run = header.num_events;
+  }
+  success = success && fwrite(&trace->p_events[first], sizeof(GSTraceEvent), first_run, file) == first_run;
+  success = success && fwrite(trace->p_events, sizeof(GSTraceEvent), header.num_events - first_run, file) == header.num_events - first_run;
+  return fclose(file) == 0 && success;
+}
+
+static unsigned int
+gs_trace_new_id(void)
+{
+  return GS_ATOMIC_FETCH_ADD(&gs_trace_ids, 1);
+}
+
+static void
+gs_trace_record(unsigned int id, 
+                unsigned char allocator, 
+                unsigned char op, 
+                const void* ptr, 
+                unsigned long long size, 
+                unsigned int alignment)
+{
+  GSTrace* trace = GS_ATOMIC_LOAD(&gs_trace_active);
+  if(trace == NULL)
+  {
+    return;
+  }
+  unsigned long long index = GS_ATOMIC_FETCH_ADD(&trace->count, 1);
+  GSTraceEvent* event = &trace->p_events[index & (trace->capacity - 1)];
+  event->ptr = (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ptr;
+  event->size = size;
+  event->alignment = alignment;
+  event->id = id;
+  event->allocator = allocator;
+  event->op = op;
+}
+
+#define GS_TRACE(_id, _allocator, _op, _ptr, _size, _alignment)\
+            gs_trace_record(_id, _allocator, _op, _ptr, _size, _alignment);
+
+#define GS_TRACE_UPDATE(_code) _code
+
+#else
+
+#define GS_TRACE(_id, _allocator, _op, _ptr, _size, _alignment)
+#define GS_TRACE_UPDATE(_code)
+
+#endif
+
+////////////////////////////////////////////////
+////////////////// STACK ///////////////////////
+////////////////////////////////////////////////
+
+GS_MEM_ALLOC_VISIBILITY
+GSStack
+gs_stack_init(void* mem_ptr, 
+              unsigned long long size)
+{
+  GS_ASSERT(mem_ptr != NULL && 
+            "GSStack mem ptr cannot be NULL")
+  GSStack stack; 
+  stack.p_begin = mem_ptr;
+  stack.p_current = mem_ptr; 
+  stack.p_end = ((char*)mem_ptr)+size;
+  stack.p_region = NULL;
+  stack.p_mapping = NULL;
+  GS_STATS_INIT(&stack.stats)
+  GS_TRACE_UPDATE(stack.trace_id = gs_trace_new_id();)
+  GS_TRACE(stack.trace_id, GS_TRACE_STACK, GS_TRACE_OP_INIT, NULL, size, 0)
+  stack.valid = true;
+  return stack;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+GSStack
+gs_stack_init_virtual(unsigned long long reserve_size, 
+                      unsigned long long commit_granularity, 
+                      unsigned long long decommit_watermark)
+{
+  GSStack stack;
+  GSVirtualRegion* region = gs_virtual_region_create(reserve_size, 
+                                                     commit_granularity, 
+                                                     decommit_watermark);
+  if(region == NULL)
+  {
+    stack.p_begin = NULL;
+    stack.p_current = NULL;
+    stack.p_end = NULL;
+    stack.p_region = NULL;
+    stack.p_mapping = NULL;
+    GS_STATS_INIT(&stack.stats)
+    GS_TRACE_UPDATE(stack.trace_id = 0;)
+    stack.valid = false;
+    return stack;
+  }
+
+  char* begin = GS_VIRTUAL_REGION_BEGIN(region);
+  stack = gs_stack_init(begin, GS_PTR_DIFF(GS_VIRTUAL_REGION_END(region), begin));
+  stack.p_region = region;
+  return stack;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_stack_release_virtual(GSStack* stack)
+{
+  GS_ASSERT(stack->valid == true && stack->p_region != NULL && 
+            "GSStack cannot release a non virtual stack mem alloc")
+  gs_vm_release(stack->p_region, stack->p_region->reserve_size);
+  stack->p_region = NULL;
+  stack->valid = false;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+GSStack
+gs_stack_init_huge(unsigned long long size, 
+                   unsigned long long page_size)
+{
+  GSStack stack;
+  GSVmMapping* mapping = gs_vm_map_pages(size, page_size);
+  if(mapping == NULL)
+  {
+    stack.p_begin = NULL;
+    stack.p_current = NULL;
+    stack.p_end = NULL;
+    stack.p_region = NULL;
+    stack.p_mapping = NULL;
+    GS_STATS_INIT(&stack.stats)
+    GS_TRACE_UPDATE(stack.trace_id = 0;)
+    stack.valid = false;
+    return stack;
+  }
+
+  char* begin = GS_VM_MAPPING_BEGIN(mapping);
+  stack = gs_stack_init(begin, GS_PTR_DIFF(GS_VM_MAPPING_END(mapping), begin));
+  stack.p_mapping = mapping;
+  return stack;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_stack_release_huge(GSStack* stack)
+{
+  GS_ASSERT(stack->valid == true && stack->p_mapping != NULL && 
+            "GSStack cannot release a stack mem alloc not owning its mapping")
+  gs_vm_unmap_pages(stack->p_mapping);
+  stack->p_mapping = NULL;
+  stack->valid = false;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+GSAlloc
+gs_stack_push_slow(GSStack* stack, 
+                   unsigned long long size,
+                   unsigned int alignment)
+{
+  GS_ASSERT(stack->valid == true && 
+            "GSStack cannot push an invalid stack mem alloc")
+
+  void* ret = stack->p_current;
+  GS_ALIGN_PTR(ret, alignment);
+
+  GS_ASSERT(((unsigned long long )ret) % alignment == 0 && 
+            "GSStack has a bug at computing a properly aligned address")
+
+
+  char* new_current = (char*)ret+size;
+  GS_ALIGN_PTR(new_current, GS_MEM_ALLOC_PTR_ALIGNMENT);
+  new_current+=GS_MEM_ALLOC_PTR_ALIGNMENT;
+
+  if(new_current >= (char*)stack->p_end ||
+     (stack->p_region != NULL && !gs_virtual_region_commit(stack->p_region, new_current)))
+  {
+    GS_STATS_FAILED(&stack->stats)
+    GS_TRACE(stack->trace_id, GS_TRACE_STACK, GS_TRACE_OP_ALLOC, NULL, size, alignment)
+    GSAlloc alloc;
+    alloc.ptr = NULL;
+    alloc.checked = false;
+    return alloc; 
+  }
+
+  GS_ASSERT(stack->p_current && "GSStack previous base cannot be set to NULL");
+  *(GS_MEM_ALLOC_PTR_NUMERIC_TYPE*)(new_current - GS_MEM_ALLOC_PTR_ALIGNMENT) = (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)stack->p_current;
+  GS_STATS_ALLOC(&stack->stats, 
+                 1, 
+                 GS_PTR_DIFF(new_current, stack->p_begin), 
+                 GS_PTR_DIFF(ret, stack->p_current), 
+                 GS_PTR_DIFF(new_current, (char*)ret + size))
+  GS_TRACE(stack->trace_id, GS_TRACE_STACK, GS_TRACE_OP_ALLOC, ret, size, alignment)
+  stack->p_current = new_current; 
+
+#ifdef GS_MEM_ALLOC_INITIALIZE_TO_ZERO
+  // The padding before the footer is also zeroed for gs_stack_resize_top
+  memset(ret, 0, new_current - GS_MEM_ALLOC_PTR_ALIGNMENT - (char*)ret);
+#endif
+  GSAlloc alloc;
+  alloc.ptr = ret;
+  alloc.checked = false;
+  return alloc;
+}
+
+#ifndef GS_MEM_ALLOC_INLINE_FAST_PATHS
+GS_MEM_ALLOC_VISIBILITY
+GSAlloc
+gs_stack_push(GSStack* stack, 
+              unsigned long long size,
+              unsigned int alignment)
+{
+  return gs_stack_push_slow(stack, size, alignment);
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void*
+gs_stack_push_CHECKED(GSStack* stack, 
+                        unsigned long long size,
+                        unsigned int alignment)
+{
+  GSAlloc alloc = gs_stack_push(stack, size, alignment);
+#ifndef GS_MEM_ALLOC_DISABLE_CHECKS
+  GS_PERMA_ASSERT(!gs_alloc_is_null(&alloc));
+#else
+  alloc.checked = true;
+#endif
+  return gs_alloc_ptr(&alloc);
+}
+#endif
+
+GS_MEM_ALLOC_VISIBILITY
+GSAlloc
+gs_stack_push_all(GSStack* stack, 
+                            unsigned int alignment,
+                            unsigned long long* size)
+{
+
+  GS_ASSERT(stack->valid == true && 
+            "GSStack cannot push an invalid stack mem alloc")
+
+  void* ret = stack->p_current;
+  GS_ALIGN_PTR(ret, alignment)
+
+  GS_ASSERT(((unsigned long long )ret) % alignment == 0 && 
+            "GSStack has a bug at computing a properly aligned address")
+
+  char* new_current = (char*)stack->p_end;
+  new_current -= GS_MEM_ALLOC_PTR_ALIGNMENT;
+
+  // We need to ensure that the previous base address is aligned to
+  // GS_PTR_ALINGMENT
+  int prev_base_slack = ((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)new_current % GS_MEM_ALLOC_PTR_ALIGNMENT);
+  if(prev_base_slack != GS_MEM_ALLOC_PTR_ALIGNMENT)
+  {
+    new_current -= prev_base_slack;
+  }
+
+  if(new_current >= (char*)stack->p_end ||
+     (stack->p_region != NULL && !gs_virtual_region_commit(stack->p_region, new_current + GS_MEM_ALLOC_PTR_ALIGNMENT)))
+  {
+    GS_STATS_FAILED(&stack->stats)
+    GS_TRACE(stack->trace_id, GS_TRACE_STACK, GS_TRACE_OP_ALLOC_ALL, NULL, 0, alignment)
+    GSAlloc alloc;
+    alloc.ptr = NULL;
+    alloc.checked = false;
+    return alloc;
+  }
+
+  GS_ASSERT(stack->p_current && "GSStack previous base cannot be set to NULL");
+  *(GS_MEM_ALLOC_PTR_NUMERIC_TYPE*)(new_current) = (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)stack->p_current;
+  *size = GS_PTR_DIFF(new_current, ret);
+  GS_STATS_ALLOC(&stack->stats, 
+                 1, 
+                 GS_PTR_DIFF(new_current + GS_MEM_ALLOC_PTR_ALIGNMENT, stack->p_begin), 
+                 GS_PTR_DIFF(ret, stack->p_current), 
+                 GS_MEM_ALLOC_PTR_ALIGNMENT)
+  GS_TRACE(stack->trace_id, GS_TRACE_STACK, GS_TRACE_OP_ALLOC_ALL, ret, *size, alignment)
+  stack->p_current = new_current + GS_MEM_ALLOC_PTR_ALIGNMENT; 
+
+#ifdef GS_MEM_ALLOC_INITIALIZE_TO_ZERO
+  memset(ret, 0, *size);
+#endif
+  GSAlloc alloc;
+  alloc.ptr = ret;
+  alloc.checked = false;
+  return alloc;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void*
+gs_stack_push_all_CHECKED(GSStack* stack, 
+                            unsigned int alignment,
+                            unsigned long long* size)
+{
+  GSAlloc alloc = gs_stack_push_all(stack, alignment, size);
+#ifndef GS_MEM_ALLOC_DISABLE_CHECKS
+  GS_PERMA_ASSERT(!gs_alloc_is_null(&alloc));
+#else
+  alloc.checked = true;
+#endif
+  return gs_alloc_ptr(&alloc);
+}
+
+// Returns the previous top stored in the footer below the top of a stack
+// growing from base, checking that ptr was pushed after it. Shared by the 
+// stacks storing pointer footers (GSStack and the front of GSDoubleStack)
+static void*
+gs_stack_footer_prev(void* base, 
+                     void* top, 
+                     void* ptr)
+{
+  void* prev_stack_base = base;
+  if(top != base)
+  {
+    prev_stack_base = (void*)(*(GS_MEM_ALLOC_PTR_NUMERIC_TYPE*)(((char*)top) - GS_MEM_ALLOC_PTR_ALIGNMENT));
+  }
+  
+  GS_ASSERT(prev_stack_base <= ptr && 
+            "GSStack cannot pop from this address.\
+            Popping must be performed in reverse order of push");
+  GS_ASSERT(prev_stack_base && "Stack previous memory address cannot be null");
+  return prev_stack_base;
+}
+
+#ifndef GS_MEM_ALLOC_INLINE_FAST_PATHS
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_stack_pop(GSStack* stack, 
+                   void* ptr)
+{
+  void* prev_stack_base = gs_stack_footer_prev(stack->p_begin, stack->p_current, ptr);
+
+  GS_STATS_FREE(&stack->stats, 1)
+  GS_TRACE(stack->trace_id, GS_TRACE_STACK, GS_TRACE_OP_FREE, ptr, 0, 0)
+  stack->p_current = prev_stack_base;
+}
+#endif
+
+GS_MEM_ALLOC_VISIBILITY
+bool
+gs_stack_is_top(GSStack* stack, 
+                void* ptr)
+{
+  if(stack->p_current == stack->p_begin)
+  {
+    return false;
+  }
+  char* prev_stack_base = (char*)(*(unsigned long long *)(((char*)stack->p_current) - GS_MEM_ALLOC_PTR_ALIGNMENT));
+  return prev_stack_base <= (char*)ptr && (char*)ptr < (char*)stack->p_current;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+GSAlloc
+gs_stack_push_sized(GSStack* stack, 
+                    unsigned long long size)
+{
+  GS_ASSERT(stack->valid == true && 
+            "GSStack cannot push an invalid stack mem alloc")
+
+  // The top is kept aligned to GS_MEM_ALLOC_PTR_ALIGNMENT, so that popping
+  // restores it exactly without storing it
+  char* ret = (char*)stack->p_current;
+  GS_ALIGN_PTR(ret, GS_MEM_ALLOC_PTR_ALIGNMENT);
+  char* new_current = ret+size;
+  GS_ALIGN_PTR(new_current, GS_MEM_ALLOC_PTR_ALIGNMENT);
+
+  if(new_current >= (char*)stack->p_end ||
+     (stack->p_region != NULL && !gs_virtual_region_commit(stack->p_region, new_current)))
+  {
+    GS_STATS_FAILED(&stack->stats)
+    GS_TRACE(stack->trace_id, GS_TRACE_STACK, GS_TRACE_OP_ALLOC, NULL, size, GS_MEM_ALLOC_PTR_ALIGNMENT)
+    GSAlloc alloc;
+    alloc.ptr = NULL;
+    alloc.checked = false;
+    return alloc; 
+  }
+
+  GS_STATS_ALLOC(&stack->stats, 
+                 1, 
+                 GS_PTR_DIFF(new_current, stack->p_begin), 
+                 GS_PTR_DIFF(ret, stack->p_current), 
+                 GS_PTR_DIFF(new_current, ret + size))
+  GS_TRACE(stack->trace_id, GS_TRACE_STACK, GS_TRACE_OP_ALLOC, ret, size, GS_MEM_ALLOC_PTR_ALIGNMENT)
+  stack->p_current = new_current; 
+
+#ifdef GS_MEM_ALLOC_INITIALIZE_TO_ZERO
+  memset(ret, 0, size);
+#endif
+  GSAlloc alloc;
+  alloc.ptr = ret;
+  alloc.checked = false;
+  return alloc;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void*
+gs_stack_push_sized_CHECKED(GSStack* stack, 
+                            unsigned long long size)
+{
+  GSAlloc alloc = gs_stack_push_sized(stack, size);
+#ifndef GS_MEM_ALLOC_DISABLE_CHECKS
+  GS_PERMA_ASSERT(!gs_alloc_is_null(&alloc));
+#else
+  alloc.checked = true;
+#endif
+  return gs_alloc_ptr(&alloc);
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_stack_pop_sized(GSStack* stack, 
+                   void* ptr, 
+                   unsigned long long size)
+{
+  char* end = (char*)ptr + size;
+  GS_ALIGN_PTR(end, GS_MEM_ALLOC_PTR_ALIGNMENT);
+  GS_ASSERT((void*)end == stack->p_current && 
+            "GSStack cannot pop from this address.\
+            Sized popping must be performed on the last allocation with its size");
+
+  // Only the first allocation of an unaligned stack can have padding before it
+  char* begin = (char*)stack->p_begin;
+  GS_ALIGN_PTR(begin, GS_MEM_ALLOC_PTR_ALIGNMENT);
+
+  GS_STATS_FREE(&stack->stats, 1)
+  GS_TRACE(stack->trace_id, GS_TRACE_STACK, GS_TRACE_OP_FREE, ptr, 0, 0)
+  stack->p_current = (char*)ptr == begin ? stack->p_begin : ptr;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+bool
+gs_stack_resize_top(GSStack* stack, 
+                    void* ptr, 
+                    unsigned long long size)
+{
+  GS_ASSERT(stack->valid == true && 
+            "GSStack cannot resize in an invalid stack mem alloc")
+  if(stack->p_current == stack->p_begin)
+  {
+    return false;
+  }
+
+  char* footer = (char*)stack->p_current - GS_MEM_ALLOC_PTR_ALIGNMENT;
+  void* prev_stack_base = (void*)(*(GS_MEM_ALLOC_PTR_NUMERIC_TYPE*)footer);
+  if(ptr < prev_stack_base || (char*)ptr >= footer)
+  {
+    return false;
+  }
+
+  char* new_current = (char*)ptr+size;
+  GS_ALIGN_PTR(new_current, GS_MEM_ALLOC_PTR_ALIGNMENT);
+  new_current+=GS_MEM_ALLOC_PTR_ALIGNMENT;
+  if(new_current >= (char*)stack->p_end ||
+     (stack->p_region != NULL && !gs_virtual_region_commit(stack->p_region, new_current)))
+  {
+    return false;
+  }
+
+#ifdef GS_MEM_ALLOC_INITIALIZE_TO_ZERO
+  // The padding before the footer is kept zeroed, so only the old footer has
+  // to be cleared when growing
+  if((char*)ptr + size > footer)
+  {
+    memset(footer, 0, (char*)ptr + size - footer);
+  }
+  memset((char*)ptr + size, 0, new_current - GS_MEM_ALLOC_PTR_ALIGNMENT - ((char*)ptr + size));
+#endif
+  *(GS_MEM_ALLOC_PTR_NUMERIC_TYPE*)(new_current - GS_MEM_ALLOC_PTR_ALIGNMENT) = (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)prev_stack_base;
+  GS_STATS_ALLOC(&stack->stats, 
+                 0, 
+                 GS_PTR_DIFF(new_current, stack->p_begin), 
+                 0, 
+                 0)
+  GS_TRACE(stack->trace_id, GS_TRACE_STACK, GS_TRACE_OP_RESIZE, ptr, size, 0)
+  stack->p_current = new_current;
+  return true;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_stack_flush(GSStack* stack)
+{
+  GS_ASSERT(stack->valid == true && 
+            "GSStack cannot flush an invalid stack mem alloc")
+  GS_TRACE(stack->trace_id, GS_TRACE_STACK, GS_TRACE_OP_FLUSH, NULL, 0, 0)
+  stack->p_current = stack->p_begin;
+  if(stack->p_region != NULL)
+  {
+    gs_virtual_region_flush(stack->p_region, stack->p_begin);
+  }
+}
+
+GS_MEM_ALLOC_VISIBILITY
+unsigned long long
+gs_stack_trim(GSStack* stack, 
+              unsigned long long retain)
+{
+  GS_ASSERT(stack->valid == true && 
+            "GSStack cannot trim an invalid stack mem alloc")
+  char* end = (char*)stack->p_end;
+  if(stack->p_region != NULL)
+  {
+    end = (char*)stack->p_region->p_committed;
+  }
+  if(retain >= (unsigned long long)(end - (char*)stack->p_current))
+  {
+    return 0;
+  }
+  return gs_vm_purge_range((char*)stack->p_current + retain, end, stack->p_mapping);
+}
+
+GS_MEM_ALLOC_VISIBILITY
+GSStackCheckpoint
+gs_stack_checkpoint(GSStack* stack)
+{
+  GS_TRACE(stack->trace_id, GS_TRACE_STACK, GS_TRACE_OP_CHECKPOINT, stack->p_current, 0, 0)
+  return *stack;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_stack_restore(GSStack* stack, 
+                 GSStackCheckpoint checkpoint)
+{
+  GS_TRACE(stack->trace_id, GS_TRACE_STACK, GS_TRACE_OP_RESTORE, checkpoint.p_current, 0, 0)
+  GS_STATS_UPDATE(checkpoint.stats = stack->stats;)
+  *stack = checkpoint;
+}
+
+#ifdef GS_MEM_ALLOC_ENABLE_STATS
+GS_MEM_ALLOC_VISIBILITY
+GSAllocStats
+gs_stack_get_stats(GSStack* stack)
+{
+  GS_ASSERT(stack->valid == true && 
+            "GSStack cannot get the stats of an invalid stack mem alloc")
+  GSAllocStats stats = stack->stats;
+  stats.bytes_in_use = GS_PTR_DIFF(stack->p_current, stack->p_begin);
+  return stats;
+}
+#endif
+
+////////////////////////////////////////////////
+//////////////// COMPACT STACK /////////////////
+////////////////////////////////////////////////
+
+GS_MEM_ALLOC_VISIBILITY
+GSCompactStack
+gs_compact_stack_init(void* mem_ptr, 
+                      unsigned long long size)
+{
+  GS_ASSERT(mem_ptr != NULL && 
+            "GSCompactStack mem ptr cannot be NULL")
+  GSCompactStack stack; 
+  stack.p_begin = mem_ptr;
+  stack.p_current = mem_ptr; 
+  stack.p_end = ((char*)mem_ptr)+size;
+  stack.valid = size <= 0xffffffffull;
+  return stack;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+GSAlloc
+gs_compact_stack_push(GSCompactStack* stack, 
+                      unsigned long long size,
+                      unsigned int alignment)
+{
+  GS_ASSERT(stack->valid == true && 
+            "GSCompactStack cannot push an invalid compact stack mem alloc")
+
+  char* ret = (char*)stack->p_current;
+  GS_ALIGN_PTR(ret, alignment);
+
+  GS_ASSERT(((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ret) % alignment == 0 && 
+            "GSCompactStack has a bug at computing a properly aligned address")
+
+  // The size is checked before computing the footer to avoid overflows
+  if(ret + GS_COMPACT_STACK_FOOTER_SIZE > (char*)stack->p_end ||
+     size > (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)((char*)stack->p_end - ret))
+  {
+    GSAlloc alloc;
+    alloc.ptr = NULL;
+    alloc.checked = false;
+    return alloc; 
+  }
+
+  char* footer = ret+size;
+  GS_ALIGN_PTR(footer, GS_COMPACT_STACK_FOOTER_SIZE);
+  char* new_current = footer + GS_COMPACT_STACK_FOOTER_SIZE;
+  if(new_current > (char*)stack->p_end)
+  {
+    GSAlloc alloc;
+    alloc.ptr = NULL;
+    alloc.checked = false;
+    return alloc; 
+  }
+
+  *(unsigned int*)footer = (unsigned int)(GS_PTR_DIFF(footer, stack->p_current));
+  stack->p_current = new_current; 
+
+#ifdef GS_MEM_ALLOC_INITIALIZE_TO_ZERO
+  memset(ret, 0, size);
+#endif
+  GSAlloc alloc;
+  alloc.ptr = ret;
+  alloc.checked = false;
+  return alloc;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void*
+gs_compact_stack_push_CHECKED(GSCompactStack* stack, 
+                              unsigned long long size,
+                              unsigned int alignment)
+{
+  GSAlloc alloc = gs_compact_stack_push(stack, size, alignment);
+#ifndef GS_MEM_ALLOC_DISABLE_CHECKS
+  GS_PERMA_ASSERT(!gs_alloc_is_null(&alloc));
+#else
+  alloc.checked = true;
+#endif
+  return gs_alloc_ptr(&alloc);
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_compact_stack_pop(GSCompactStack* stack, 
+                     void* ptr)
+{
+  GS_ASSERT(stack->p_current != stack->p_begin && 
+            "GSCompactStack cannot pop from an empty stack")
+  char* footer = (char*)stack->p_current - GS_COMPACT_STACK_FOOTER_SIZE;
+  char* prev_current = footer - *(unsigned int*)footer;
+
+  GS_ASSERT((void*)prev_current <= ptr && ptr <= (void*)footer && 
+            "GSCompactStack cannot pop from this address.\
+            Popping must be performed in reverse order of push");
+
+  stack->p_current = prev_current;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_compact_stack_flush(GSCompactStack* stack)
+{
+  GS_ASSERT(stack->valid == true && 
+            "GSCompactStack cannot flush an invalid compact stack mem alloc")
+  stack->p_current = stack->p_begin;
+}
+
+////////////////////////////////////////////////
+//////////////// DOUBLE STACK //////////////////
+////////////////////////////////////////////////
+
+GS_MEM_ALLOC_VISIBILITY
+GSDoubleStack
+gs_double_stack_init(void* mem_ptr, 
+                     unsigned long long size)
+{
+  GS_ASSERT(mem_ptr != NULL && 
+            "GSDoubleStack mem ptr cannot be NULL")
+  GSDoubleStack stack; 
+  stack.p_begin = mem_ptr;
+  stack.p_end = ((char*)mem_ptr)+size;
+  stack.p_front = stack.p_begin;
+
+  // The back stack headers are stored at the top of the back stack, which
+  // must be aligned to store pointers
+  stack.p_back = (void*)(((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)stack.p_end) & ~((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)GS_MEM_ALLOC_PTR_ALIGNMENT - 1));
+  stack.p_end = stack.p_back;
+  stack.valid = stack.p_back >= stack.p_front;
+  return stack;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+GSAlloc
+gs_double_stack_push_front(GSDoubleStack* stack, 
+                           unsigned long long size,
+                           unsigned int alignment)
+{
+  GS_ASSERT(stack->valid == true && 
+            "GSDoubleStack cannot push an invalid double stack mem alloc")
+
+  char* ret = (char*)stack->p_front;
+  GS_ALIGN_PTR(ret, alignment);
+
+  GS_ASSERT(((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ret) % alignment == 0 && 
+            "GSDoubleStack has a bug at computing a properly aligned address")
+
+  // The size is checked before computing the new front to avoid overflows
+  if(ret + GS_MEM_ALLOC_PTR_ALIGNMENT > (char*)stack->p_back ||
+     size > (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)((char*)stack->p_back - ret))
+  {
+    GSAlloc alloc;
+    alloc.ptr = NULL;
+    alloc.checked = false;
+    return alloc; 
+  }
+
+  char* new_front = ret+size;
+  GS_ALIGN_PTR(new_front, GS_MEM_ALLOC_PTR_ALIGNMENT);
+  new_front+=GS_MEM_ALLOC_PTR_ALIGNMENT;
+  if(new_front > (char*)stack->p_back)
+  {
+    GSAlloc alloc;
+    alloc.ptr = NULL;
+    alloc.checked = false;
+    return alloc; 
+  }
+
+  *(GS_MEM_ALLOC_PTR_NUMERIC_TYPE*)(new_front - GS_MEM_ALLOC_PTR_ALIGNMENT) = (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)stack->p_front;
+  stack->p_front = new_front; 
+
+#ifdef GS_MEM_ALLOC_INITIALIZE_TO_ZERO
+  memset(ret, 0, size);
+#endif
+  GSAlloc alloc;
+  alloc.ptr = ret;
+  alloc.checked = false;
+  return alloc;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void*
+gs_double_stack_push_front_CHECKED(GSDoubleStack* stack, 
+                                   unsigned long long size,
+                                   unsigned int alignment)
+{
+  GSAlloc alloc = gs_double_stack_push_front(stack, size, alignment);
+#ifndef GS_MEM_ALLOC_DISABLE_CHECKS
+  GS_PERMA_ASSERT(!gs_alloc_is_null(&alloc));
+#else
+  alloc.checked = true;
+#endif
+  return gs_alloc_ptr(&alloc);
+}
+
+GS_MEM_ALLOC_VISIBILITY
+GSAlloc
+gs_double_stack_push_back(GSDoubleStack* stack, 
+                          unsigned long long size,
+                          unsigned int alignment)
+{
+  GS_ASSERT(stack->valid == true && 
+            "GSDoubleStack cannot push an invalid double stack mem alloc")
+
+  // The allocation is placed below the current back and aligned downwards,
+  // followed below by the header with the previous back
+  GS_MEM_ALLOC_PTR_NUMERIC_TYPE back = (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)stack->p_back;
+  GS_MEM_ALLOC_PTR_NUMERIC_TYPE front = (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)stack->p_front;
+  GS_MEM_ALLOC_PTR_NUMERIC_TYPE ret = 0;
+  GS_MEM_ALLOC_PTR_NUMERIC_TYPE new_back = 0;
+  // The size is checked before adding the header to avoid overflows
+  if(size <= back - front && back - front - size >= GS_MEM_ALLOC_PTR_ALIGNMENT)
+  {
+    ret = (back - size) & ~((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)alignment - 1);
+    new_back = (ret - GS_MEM_ALLOC_PTR_ALIGNMENT) & ~((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)GS_MEM_ALLOC_PTR_ALIGNMENT - 1);
+  }
+
+  if(ret < front + GS_MEM_ALLOC_PTR_ALIGNMENT || new_back < front)
+  {
+    GSAlloc alloc;
+    alloc.ptr = NULL;
+    alloc.checked = false;
+    return alloc; 
+  }
+
+  GS_ASSERT(ret % alignment == 0 && 
+            "GSDoubleStack has a bug at computing a properly aligned address")
+
+  *(GS_MEM_ALLOC_PTR_NUMERIC_TYPE*)new_back = back;
+  stack->p_back = (void*)new_back;
+
+#ifdef GS_MEM_ALLOC_INITIALIZE_TO_ZERO
+  memset((void*)ret, 0, size);
+#endif
+  GSAlloc alloc;
+  alloc.ptr = (void*)ret;
+  alloc.checked = false;
+  return alloc;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void*
+gs_double_stack_push_back_CHECKED(GSDoubleStack* stack, 
+                                  unsigned long long size,
+                                  unsigned int alignment)
+{
+  GSAlloc alloc = gs_double_stack_push_back(stack, size, alignment);
+#ifndef GS_MEM_ALLOC_DISABLE_CHECKS
+  GS_PERMA_ASSERT(!gs_alloc_is_null(&alloc));
+#else
+  alloc.checked = true;
+#endif
+  return gs_alloc_ptr(&alloc);
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_double_stack_pop_front(GSDoubleStack* stack, 
+                          void* ptr)
+{
+  GS_ASSERT(ptr < stack->p_front && 
+            "GSDoubleStack cannot pop from this address.\
+            Popping must be performed in reverse order of push");
+  stack->p_front = gs_stack_footer_prev(stack->p_begin, stack->p_front, ptr);
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_double_stack_pop_back(GSDoubleStack* stack, 
+                         void* ptr)
+{
+  // Mirrors gs_stack_footer_prev, with the header below the allocation
+  void* prev_back = stack->p_end;
+  if(stack->p_back != stack->p_end)
+  {
+    prev_back = (void*)(*(GS_MEM_ALLOC_PTR_NUMERIC_TYPE*)stack->p_back);
+  }
+
+  GS_ASSERT((char*)stack->p_back + GS_MEM_ALLOC_PTR_ALIGNMENT <= (char*)ptr && ptr <= prev_back && 
+            "GSDoubleStack cannot pop from this address.\
+            Popping must be performed in reverse order of push");
+  GS_ASSERT(prev_back && "GSDoubleStack previous back cannot be null");
+
+  stack->p_back = prev_back;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_double_stack_flush_front(GSDoubleStack* stack)
+{
+  GS_ASSERT(stack->valid == true && 
+            "GSDoubleStack cannot flush an invalid double stack mem alloc")
+  stack->p_front = stack->p_begin;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_double_stack_flush_back(GSDoubleStack* stack)
+{
+  GS_ASSERT(stack->valid == true && 
+            "GSDoubleStack cannot flush an invalid double stack mem alloc")
+  stack->p_back = stack->p_end;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_double_stack_flush(GSDoubleStack* stack)
+{
+  gs_double_stack_flush_front(stack);
+  gs_double_stack_flush_back(stack);
+}
+
+////////////////////////////////////////////////
+////////////////// SCRATCH  ////////////////////
+////////////////////////////////////////////////
+
+// Initializes the scratch without recording it, so that the different init
+// methods record a single event
+static GSScratch
+gs_scratch_create(void* base_addr, 
+                  unsigned long long size)
+{
+  GS_ASSERT(base_addr != NULL && 
+            "GSScratch base addr cannot be NULL")
+  GS_ASSERT(((unsigned long long)base_addr % GS_MEM_ALLOC_MIN_ALIGNMENT) == 0 && 
+            "GSScratch mem ptr must be aligned to GS_MIN_ALINGMENT")
+
+  GSScratch scratch;
+  scratch.p_begin = base_addr; 
+  scratch.p_current = base_addr;
+  scratch.p_end = (char*)base_addr + size;
+  scratch.p_first = NULL;
+  scratch.p_chunk = NULL;
+  scratch.chunk_size = 0;
+  scratch.backing.alloc = NULL;
+  scratch.backing.free = NULL;
+  scratch.backing.user_data = NULL;
+  scratch.p_region = NULL;
+  scratch.p_mapping = NULL;
+  GS_STATS_UPDATE(scratch.chunk_offset = 0;)
+  GS_STATS_INIT(&scratch.stats)
+  GS_TRACE_UPDATE(scratch.trace_id = gs_trace_new_id();)
+  scratch.valid = true;
+  return scratch;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+GSScratch
+gs_scratch_init(void* base_addr, 
+                unsigned long long size)
+{
+  GSScratch scratch = gs_scratch_create(base_addr, size);
+  GS_TRACE(scratch.trace_id, GS_TRACE_SCRATCH, GS_TRACE_OP_INIT, NULL, size, 0)
+  return scratch;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+GSScratch
+gs_scratch_init_virtual(unsigned long long reserve_size, 
+                        unsigned long long commit_granularity, 
+                        unsigned long long decommit_watermark)
+{
+  GSVirtualRegion* region = gs_virtual_region_create(reserve_size, 
+                                                     commit_granularity, 
+                                                     decommit_watermark);
+  GSScratch scratch;
+  if(region == NULL)
+  {
+    scratch.p_begin = NULL;
+    scratch.p_current = NULL;
+    scratch.p_end = NULL;
+    scratch.p_first = NULL;
+    scratch.p_chunk = NULL;
+    scratch.chunk_size = 0;
+    scratch.backing.alloc = NULL;
+    scratch.backing.free = NULL;
+    scratch.backing.user_data = NULL;
+    scratch.p_region = NULL;
+    scratch.p_mapping = NULL;
+    GS_STATS_UPDATE(scratch.chunk_offset = 0;)
+    GS_STATS_INIT(&scratch.stats)
+    GS_TRACE_UPDATE(scratch.trace_id = 0;)
+    scratch.valid = false;
+    return scratch;
+  }
+
+  char* begin = GS_VIRTUAL_REGION_BEGIN(region);
+  scratch = gs_scratch_init(begin, GS_PTR_DIFF(GS_VIRTUAL_REGION_END(region), begin));
+  scratch.p_region = region;
+  return scratch;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_scratch_release_virtual(GSScratch* scratch)
+{
+  GS_ASSERT(scratch->valid && scratch->p_region != NULL && 
+            "GSScratch cannot release a non virtual scratch")
+  gs_vm_release(scratch->p_region, scratch->p_region->reserve_size);
+  scratch->p_region = NULL;
+  scratch->valid = false;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+GSScratch
+gs_scratch_init_huge(unsigned long long size, 
+                     unsigned long long page_size)
+{
+  GSVmMapping* mapping = gs_vm_map_pages(size, page_size);
+  GSScratch scratch;
+  if(mapping == NULL)
+  {
+    scratch.p_begin = NULL;
+    scratch.p_current = NULL;
+    scratch.p_end = NULL;
+    scratch.p_first = NULL;
+    scratch.p_chunk = NULL;
+    scratch.chunk_size = 0;
+    scratch.backing.alloc = NULL;
+    scratch.backing.free = NULL;
+    scratch.backing.user_data = NULL;
+    scratch.p_region = NULL;
+    scratch.p_mapping = NULL;
+    GS_STATS_UPDATE(scratch.chunk_offset = 0;)
+    GS_STATS_INIT(&scratch.stats)
+    GS_TRACE_UPDATE(scratch.trace_id = 0;)
+    scratch.valid = false;
+    return scratch;
+  }
+
+  char* begin = GS_VM_MAPPING_BEGIN(mapping);
+  scratch = gs_scratch_init(begin, GS_PTR_DIFF(GS_VM_MAPPING_END(mapping), begin));
+  scratch.p_mapping = mapping;
+  return scratch;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_scratch_release_huge(GSScratch* scratch)
+{
+  GS_ASSERT(scratch->valid && scratch->p_mapping != NULL && 
+            "GSScratch cannot release a scratch not owning its mapping")
+  gs_vm_unmap_pages(scratch->p_mapping);
+  scratch->p_mapping = NULL;
+  scratch->valid = false;
+}
+
+// The chunk header size is rounded up to keep the chunk data aligned
+#define GS_SCRATCH_CHUNK_HEADER_SIZE\
+  ((sizeof(GSScratchChunk) + GS_MEM_ALLOC_MIN_ALIGNMENT - 1) & ~(GS_MEM_ALLOC_MIN_ALIGNMENT - 1))
+
+#define GS_SCRATCH_CHUNK_BEGIN(_chunk)\
+  ((char*)(_chunk) + GS_SCRATCH_CHUNK_HEADER_SIZE)
+
+GS_MEM_ALLOC_VISIBILITY
+GSScratch
+gs_scratch_init_chained(void* base_addr, 
+                        unsigned long long size, 
+                        GSChunkBacking backing,
+                        unsigned long long chunk_size)
+{
+  GS_ASSERT(backing.alloc != NULL && 
+            "GSScratch chunk backing must provide an alloc function")
+  GSScratch scratch = gs_scratch_create(base_addr, size);
+  GS_ASSERT(size > GS_SCRATCH_CHUNK_HEADER_SIZE && 
+            "GSScratch first chunk is too small to hold the chunk header")
+
+  GSScratchChunk* chunk = (GSScratchChunk*)base_addr;
+  chunk->p_next = NULL;
+  chunk->size = size;
+  scratch.p_first = chunk;
+  scratch.p_chunk = chunk;
+  scratch.p_begin = GS_SCRATCH_CHUNK_BEGIN(chunk);
+  scratch.p_current = scratch.p_begin;
+  scratch.chunk_size = chunk_size;
+  scratch.backing = backing;
+  GS_TRACE(scratch.trace_id, GS_TRACE_SCRATCH, GS_TRACE_OP_INIT, (void*)(GS_MEM_ALLOC_PTR_NUMERIC_TYPE)chunk_size, size, 0)
+  return scratch;
+}
+
+static void*
+gs_chunk_backing_scratch_alloc(void* user_data, 
+                               unsigned long long size)
+{
+  GSAlloc alloc = gs_scratch_push((GSScratch*)user_data, size, GS_MEM_ALLOC_MIN_ALIGNMENT);
+  if(gs_alloc_is_null(&alloc))
+    return NULL;
+  return gs_alloc_ptr(&alloc);
+}
+
+GS_MEM_ALLOC_VISIBILITY
+GSChunkBacking
+gs_chunk_backing_scratch(GSScratch* scratch)
+{
+  GSChunkBacking backing;
+  backing.alloc = gs_chunk_backing_scratch_alloc;
+  backing.free = NULL;
+  backing.user_data = scratch;
+  return backing;
+}
+
+static void*
+gs_chunk_backing_stack_alloc(void* user_data, 
+                             unsigned long long size)
+{
+  GSAlloc alloc = gs_stack_push((GSStack*)user_data, size, GS_MEM_ALLOC_MIN_ALIGNMENT);
+  if(gs_alloc_is_null(&alloc))
+    return NULL;
+  return gs_alloc_ptr(&alloc);
+}
+
+static void
+gs_chunk_backing_stack_free(void* user_data, 
+                            void* ptr, 
+                            unsigned long long size)
+{
+  (void)size;
+  gs_stack_pop((GSStack*)user_data, ptr);
+}
+
+GS_MEM_ALLOC_VISIBILITY
+GSChunkBacking
+gs_chunk_backing_stack(GSStack* stack)
+{
+  GSChunkBacking backing;
+  backing.alloc = gs_chunk_backing_stack_alloc;
+  backing.free = gs_chunk_backing_stack_free;
+  backing.user_data = stack;
+  return backing;
+}
+
+static void*
+gs_chunk_backing_vm_alloc(void* user_data, 
+                          unsigned long long size)
+{
+  return gs_vm_map_aligned(size, (unsigned long long)(GS_MEM_ALLOC_PTR_NUMERIC_TYPE)user_data);
+}
+
+static void
+gs_chunk_backing_vm_free(void* user_data, 
+                         void* ptr, 
+                         unsigned long long size)
+{
+  (void)user_data;
+  gs_vm_release(ptr, size);
+}
+
+GS_MEM_ALLOC_VISIBILITY
+GSChunkBacking
+gs_chunk_backing_vm(unsigned long long alignment)
+{
+  GS_ASSERT(alignment > 0 && (alignment & (alignment - 1)) == 0 && 
+            "GSChunkBacking alignment must be a power of two")
+  GSChunkBacking backing;
+  backing.alloc = gs_chunk_backing_vm_alloc;
+  backing.free = gs_chunk_backing_vm_free;
+  backing.user_data = (void*)(GS_MEM_ALLOC_PTR_NUMERIC_TYPE)alignment;
+  return backing;
+}
+
+// Moves the scratch to a chunk with room for the requested allocation. The
+// following chunks in the chain are reused if they are large enough, otherwise
+// a new chunk is acquired from the backing and appended at the end of the
+// chain, so chunks are always chained in order of acquisition. Returns false if
+// no chunk could be acquired. 
+static bool
+gs_scratch_next_chunk(GSScratch* scratch, 
+                      unsigned long long size, 
+                      unsigned int alignment)
+{
+  unsigned long long required = GS_SCRATCH_CHUNK_HEADER_SIZE + size + alignment;
+  GSScratchChunk* last = scratch->p_chunk;
+  GSScratchChunk* next = last->p_next;
+  while(next != NULL && next->size <= required)
+  {
+    last = next;
+    next = next->p_next;
+  }
+
+  if(next == NULL)
+  {
+    unsigned long long chunk_size = scratch->chunk_size > required ? scratch->chunk_size : required;
+    next = (GSScratchChunk*)scratch->backing.alloc(scratch->backing.user_data, chunk_size);
+    if(next == NULL)
+    {
+      return false;
+    }
+    next->size = chunk_size;
+    next->p_next = NULL;
+    last->p_next = next;
+  }
+
+  // The unused tail of the chunk left behind is accounted as padding
+  GS_STATS_UPDATE(scratch->chunk_offset += GS_PTR_DIFF(scratch->p_end, scratch->p_begin);)
+  GS_STATS_UPDATE(scratch->stats.padding_bytes += GS_PTR_DIFF(scratch->p_end, scratch->p_current);)
+  scratch->p_chunk = next;
+  scratch->p_begin = GS_SCRATCH_CHUNK_BEGIN(next);
+  scratch->p_current = scratch->p_begin;
+  scratch->p_end = (char*)next + next->size;
+  return true;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+GSAlloc
+gs_scratch_push_slow(GSScratch* scratch, 
+                     unsigned long long size, 
+                     unsigned int alignment)
+{
+  GS_ASSERT(scratch->valid && "GSScratch not properly initialized")
+  void* ret = scratch->p_current;
+  GS_ALIGN_PTR(ret, alignment)
+
+  GS_ASSERT(((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ret) % alignment == 0 && 
+            "GSScrachMemAlloc aligned address is not correclty computed")
+
+  char* new_current = ((char*)ret) + size;
+  if(new_current >= (char*)scratch->p_end)
+  {
+    if(scratch->p_chunk == NULL || 
+       !gs_scratch_next_chunk(scratch, size, alignment))
+    {
+      GS_STATS_FAILED(&scratch->stats)
+      GS_TRACE(scratch->trace_id, GS_TRACE_SCRATCH, GS_TRACE_OP_ALLOC, NULL, size, alignment)
+      GSAlloc alloc;
+      alloc.ptr = NULL;
+      alloc.checked = false;
+      return alloc;
+    }
+    ret = scratch->p_current;
+    GS_ALIGN_PTR(ret, alignment)
+    new_current = ((char*)ret) + size;
+  }
+
+  if(scratch->p_region != NULL && 
+     !gs_virtual_region_commit(scratch->p_region, new_current))
+  {
+    GS_STATS_FAILED(&scratch->stats)
+    GS_TRACE(scratch->trace_id, GS_TRACE_SCRATCH, GS_TRACE_OP_ALLOC, NULL, size, alignment)
+    GSAlloc alloc;
+    alloc.ptr = NULL;
+    alloc.checked = false;
+    return alloc;
+  }
+  GS_STATS_ALLOC(&scratch->stats, 
+                 1, 
+                 scratch->chunk_offset + GS_PTR_DIFF(new_current, scratch->p_begin), 
+                 GS_PTR_DIFF(ret, scratch->p_current), 
+                 0)
+  GS_TRACE(scratch->trace_id, GS_TRACE_SCRATCH, GS_TRACE_OP_ALLOC, ret, size, alignment)
+  scratch->p_current = new_current;
+
+#ifdef GS_MEM_ALLOC_INITIALIZE_TO_ZERO
+  memset(ret, 0, size);
+#endif
+  GSAlloc alloc;
+  alloc.ptr = ret;
+  alloc.checked = false;
+  return alloc;
+}
+
+#ifndef GS_MEM_ALLOC_INLINE_FAST_PATHS
+GS_MEM_ALLOC_VISIBILITY
+GSAlloc
+gs_scratch_push(GSScratch* scratch, 
+                 unsigned long long size, 
+                 unsigned int alignment)
+{
+  return gs_scratch_push_slow(scratch, size, alignment);
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void*
+gs_scratch_push_CHECKED(GSScratch* scratch, 
+                         unsigned long long size, 
+                         unsigned int alignment)
+{
+  GSAlloc alloc = gs_scratch_push(scratch, size, alignment);
+#ifndef GS_MEM_ALLOC_DISABLE_CHECKS
+  GS_PERMA_ASSERT(!gs_alloc_is_null(&alloc));
+#else
+  alloc.checked = true;
+#endif
+  return gs_alloc_ptr(&alloc);
+}
+#endif
+
+GS_MEM_ALLOC_VISIBILITY
+GSAlloc
+gs_scratch_push_all(GSScratch* scratch, 
+                     unsigned int alignment,
+                     unsigned long long* size)
+{
+  GS_ASSERT(scratch->valid && "GSScratch not properly initialized")
+  void* ret = scratch->p_current;
+  GS_ALIGN_PTR(ret, alignment);
+
+  GS_ASSERT(((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ret) % alignment == 0 && 
+            "GSScrachMemAlloc aligned address is not correclty computed")
+
+  if((char*)ret >= (char*)scratch->p_end ||
+     (scratch->p_region != NULL && !gs_virtual_region_commit(scratch->p_region, scratch->p_end)))
+  {
+    GS_STATS_FAILED(&scratch->stats)
+    GS_TRACE(scratch->trace_id, GS_TRACE_SCRATCH, GS_TRACE_OP_ALLOC_ALL, NULL, 0, alignment)
+    GSAlloc alloc;
+    alloc.ptr = NULL;
+    alloc.checked = false;
+    return alloc;
+  }
+
+  *size = ((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)scratch->p_end) - ((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ret);
+  GS_STATS_ALLOC(&scratch->stats, 
+                 1, 
+                 scratch->chunk_offset + GS_PTR_DIFF(scratch->p_end, scratch->p_begin), 
+                 GS_PTR_DIFF(ret, scratch->p_current), 
+                 0)
+  GS_TRACE(scratch->trace_id, GS_TRACE_SCRATCH, GS_TRACE_OP_ALLOC_ALL, ret, *size, alignment)
+  scratch->p_current = scratch->p_end;
+
+#ifdef GS_MEM_ALLOC_INITIALIZE_TO_ZERO
+  memset(ret, 0, *size);
+#endif
+  GSAlloc alloc;
+  alloc.ptr = ret;
+  alloc.checked = false;
+  return alloc;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void*
+gs_scratch_push_all_CHECKED(GSScratch* scratch, 
+                             unsigned int alignment,
+                             unsigned long long* size)
+{
+  GSAlloc alloc = gs_scratch_push_all(scratch, alignment, size);
+#ifndef GS_MEM_ALLOC_DISABLE_CHECKS
+  GS_PERMA_ASSERT(!gs_alloc_is_null(&alloc));
+#else 
+  alloc.checked = true;
+#endif
+  return gs_alloc_ptr(&alloc);
+}
+
+GS_MEM_ALLOC_VISIBILITY
+bool
+gs_scratch_resize_last(GSScratch* scratch, 
+                       void* ptr, 
+                       unsigned long long size, 
+                       unsigned long long new_size)
+{
+  GS_ASSERT(scratch->valid && "GSScratch not properly initialized")
+  if((char*)ptr + size != (char*)scratch->p_current)
+  {
+    return false;
+  }
+
+  char* new_current = (char*)ptr + new_size;
+  if(new_current >= (char*)scratch->p_end ||
+     (scratch->p_region != NULL && !gs_virtual_region_commit(scratch->p_region, new_current)))
+  {
+    return false;
+  }
+
+#ifdef GS_MEM_ALLOC_INITIALIZE_TO_ZERO
+  if(new_size > size)
+  {
+    memset((char*)ptr + size, 0, new_size - size);
+  }
+#endif
+  GS_STATS_ALLOC(&scratch->stats, 
+                 0, 
+                 scratch->chunk_offset + GS_PTR_DIFF(new_current, scratch->p_begin), 
+                 0, 
+                 0)
+  GS_TRACE(scratch->trace_id, GS_TRACE_SCRATCH, GS_TRACE_OP_RESIZE, ptr, new_size, 0)
+  scratch->p_current = new_current;
+  return true;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_scratch_flush(GSScratch* scratch)
+{
+  GS_ASSERT(scratch->valid && "GSScratch not properly initialized")
+  GS_TRACE(scratch->trace_id, GS_TRACE_SCRATCH, GS_TRACE_OP_FLUSH, NULL, 0, 0)
+  if(scratch->p_first != NULL)
+  {
+    scratch->p_chunk = scratch->p_first;
+    scratch->p_begin = GS_SCRATCH_CHUNK_BEGIN(scratch->p_first);
+    scratch->p_end = (char*)scratch->p_first + scratch->p_first->size;
+  }
+  scratch->p_current = scratch->p_begin;
+  GS_STATS_UPDATE(scratch->chunk_offset = 0;)
+  if(scratch->p_region != NULL)
+  {
+    gs_virtual_region_flush(scratch->p_region, scratch->p_begin);
+  }
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_scratch_flush_release(GSScratch* scratch)
+{
+  GS_ASSERT(scratch->valid && "GSScratch not properly initialized")
+  if(scratch->p_first != NULL)
+  {
+    // Chunks are released in reverse order of acquisition, so stack backings
+    // can pop them
+    GSScratchChunk* reversed = NULL;
+    GSScratchChunk* chunk = scratch->p_first->p_next;
+    while(chunk != NULL)
+    {
+      GSScratchChunk* next = chunk->p_next;
+      chunk->p_next = reversed;
+      reversed = chunk;
+      chunk = next;
+    }
+
+    while(reversed != NULL)
+    {
+      GSScratchChunk* next = reversed->p_next;
+      if(scratch->backing.free != NULL)
+      {
+        scratch->backing.free(scratch->backing.user_data, reversed, reversed->size);
+      }
+      reversed = next;
+    }
+    scratch->p_first->p_next = NULL;
+  }
+  gs_scratch_flush(scratch);
+}
+
+GS_MEM_ALLOC_VISIBILITY
+unsigned long long
+gs_scratch_trim(GSScratch* scratch, 
+                unsigned long long retain)
+{
+  GS_ASSERT(scratch->valid && "GSScratch not properly initialized")
+  unsigned long long released = 0;
+  char* end = (char*)scratch->p_end;
+  if(scratch->p_region != NULL)
+  {
+    end = (char*)scratch->p_region->p_committed;
+  }
+  if(retain < (unsigned long long)(end - (char*)scratch->p_current))
+  {
+    released += gs_vm_purge_range((char*)scratch->p_current + retain, end, scratch->p_mapping);
+  }
+  if(scratch->p_chunk != NULL)
+  {
+    for(GSScratchChunk* chunk = scratch->p_chunk->p_next; chunk != NULL; chunk = chunk->p_next)
+    {
+      released += gs_vm_purge_range(GS_SCRATCH_CHUNK_BEGIN(chunk), (char*)chunk + chunk->size, NULL);
+    }
+  }
+  return released;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+GSScratchCheckpoint
+gs_scratch_checkpoint(GSScratch* scratch)
+{
+  GS_TRACE(scratch->trace_id, GS_TRACE_SCRATCH, GS_TRACE_OP_CHECKPOINT, scratch->p_current, 0, 0)
+  return *scratch;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_scratch_restore(GSScratch* scratch, 
+                   GSScratchCheckpoint checkpoint)
+{
+  GS_TRACE(scratch->trace_id, GS_TRACE_SCRATCH, GS_TRACE_OP_RESTORE, checkpoint.p_current, 0, 0)
+  GS_STATS_UPDATE(checkpoint.stats = scratch->stats;)
+  *scratch = checkpoint;
+}
+
+#ifdef GS_MEM_ALLOC_ENABLE_STATS
+GS_MEM_ALLOC_VISIBILITY
+GSAllocStats
+gs_scratch_get_stats(GSScratch* scratch)
+{
+  GS_ASSERT(scratch->valid && "GSScratch not properly initialized")
+  GSAllocStats stats = scratch->stats;
+  stats.bytes_in_use = scratch->chunk_offset + GS_PTR_DIFF(scratch->p_current, scratch->p_begin);
+  return stats;
+}
+#endif
+
+
+////////////////////////////////////////////////
+//////////////// FRAME SCRATCH /////////////////
+////////////////////////////////////////////////
+
+GS_MEM_ALLOC_VISIBILITY
+GSFrameScratch
+gs_frame_scratch_init(void* base_addr, 
+                      unsigned long long size, 
+                      unsigned int num_frames)
+{
+  GS_ASSERT(base_addr != NULL && 
+            "GSFrameScratch base addr cannot be NULL")
+
+  GSFrameScratch scratch;
+  scratch.current = 0;
+  scratch.frame = 0;
+  scratch.peak_frame_usage = 0;
+  // The scratches are stored inline, so the range is checked even when the
+  // asserts are disabled
+  if(num_frames < 2 || num_frames > GS_MEM_ALLOC_FRAME_SCRATCH_MAX_FRAMES)
+  {
+    scratch.num_frames = 0;
+    scratch.valid = false;
+    return scratch;
+  }
+
+  // Sub-arena sizes are rounded down to keep their beginnings aligned
+  unsigned long long arena_size = (size / num_frames) & ~((unsigned long long)GS_MEM_ALLOC_MIN_ALIGNMENT - 1);
+  scratch.valid = arena_size > 0;
+  for(unsigned int i = 0; i < num_frames; ++i)
+  {
+    scratch.scratches[i] = gs_scratch_init((char*)base_addr + i*arena_size, arena_size);
+    scratch.valid = scratch.valid && scratch.scratches[i].valid;
+  }
+  scratch.num_frames = num_frames;
+  return scratch;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+GSAlloc
+gs_frame_scratch_push(GSFrameScratch* scratch, 
+                      unsigned long long size, 
+                      unsigned int alignment)
+{
+  GS_ASSERT(scratch->valid && "GSFrameScratch not properly initialized")
+  return gs_scratch_push(&scratch->scratches[scratch->current], size, alignment);
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void*
+gs_frame_scratch_push_CHECKED(GSFrameScratch* scratch, 
+                              unsigned long long size, 
+                              unsigned int alignment)
+{
+  GSAlloc alloc = gs_frame_scratch_push(scratch, size, alignment);
+#ifndef GS_MEM_ALLOC_DISABLE_CHECKS
+  GS_PERMA_ASSERT(!gs_alloc_is_null(&alloc));
+#else
+  alloc.checked = true;
+#endif
+  return gs_alloc_ptr(&alloc);
+}
+
+GS_MEM_ALLOC_VISIBILITY
+GSAlloc
+gs_frame_scratch_promote(GSFrameScratch* scratch, 
+                         const void* ptr, 
+                         unsigned long long size, 
+                         unsigned int alignment)
+{
+  GSScratch* current = &scratch->scratches[scratch->current];
+  GS_ASSERT(((char*)ptr < (char*)current->p_begin || (char*)ptr >= (char*)current->p_end) && 
+            "GSFrameScratch cannot promote a block of the current frame")
+  GSAlloc alloc = gs_frame_scratch_push(scratch, size, alignment);
+  if(alloc.ptr != NULL)
+  {
+    gs_mem_copy(alloc.ptr, ptr, size);
+  }
+  return alloc;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+unsigned long long
+gs_frame_scratch_advance(GSFrameScratch* scratch)
+{
+  GS_ASSERT(scratch->valid && "GSFrameScratch not properly initialized")
+  unsigned long long usage = gs_frame_scratch_frame_usage(scratch, 0);
+  if(usage > scratch->peak_frame_usage)
+  {
+    scratch->peak_frame_usage = usage;
+  }
+  scratch->current = (scratch->current + 1) % scratch->num_frames;
+  scratch->frame++;
+  gs_scratch_flush(&scratch->scratches[scratch->current]);
+  return usage;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+unsigned long long
+gs_frame_scratch_frame_usage(GSFrameScratch* scratch, 
+                             unsigned int age)
+{
+  GS_ASSERT(scratch->valid && "GSFrameScratch not properly initialized")
+  GS_ASSERT(age < scratch->num_frames && 
+            "GSFrameScratch frame age must be smaller than the number of frames")
+  GSScratch* frame = &scratch->scratches[(scratch->current + scratch->num_frames - age) % scratch->num_frames];
+  return GS_PTR_DIFF(frame->p_current, frame->p_begin);
+}
+
+////////////////////////////////////////////////
+/////////////////// POOL ///////////////////////
+////////////////////////////////////////////////
+
+
+// Returns the distance between consecutive blocks of a pool. Blocks are at
+// least as large as a pointer, which links them in the free list
+static unsigned long long
+gs_pool_stride(unsigned long long bsize, 
+               unsigned int alignment)
+{
+  unsigned long long stride = bsize < sizeof(GS_MEM_ALLOC_PTR_NUMERIC_TYPE) ? sizeof(GS_MEM_ALLOC_PTR_NUMERIC_TYPE) : bsize;
+  unsigned int modulo = stride & (alignment-1);
+  if(modulo != 0)
+  {
+    stride += alignment - modulo;
+  }
+  return stride;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+GSPool
+gs_pool_init(void* mem_ptr, 
+                       unsigned long long size, 
+                       unsigned long long bsize, 
+                       unsigned int alignment)
+{
+  GS_ASSERT(mem_ptr != NULL && 
+            "GSPool mem ptr cannot be NULL")
+
+  GSPool pool;
+  pool.p_begin = mem_ptr;
+  pool.p_end = (char*)mem_ptr + size; 
+  pool.bsize = bsize; 
+  pool.alignment = alignment;
+  pool.p_next_free = NULL;
+  pool.p_live_bitmap = NULL;
+  pool.bitmap_hint = 0;
+  pool.p_mapping = NULL;
+  GS_STATS_INIT(&pool.stats)
+  GS_TRACE_UPDATE(pool.trace_id = gs_trace_new_id();)
+  GS_TRACE(pool.trace_id, GS_TRACE_POOL, GS_TRACE_OP_INIT, (void*)(GS_MEM_ALLOC_PTR_NUMERIC_TYPE)bsize, size, alignment)
+
+  if(pool.bsize < sizeof(GS_MEM_ALLOC_PTR_NUMERIC_TYPE))
+  {
+    pool.bsize = sizeof(GS_MEM_ALLOC_PTR_NUMERIC_TYPE);
+  }
+  GS_ALIGN_PTR(pool.p_begin, alignment)
+
+  pool.p_current = pool.p_begin;
+  pool.stride = gs_pool_stride(bsize, alignment);
+  pool.valid = true;
+  return pool;
+}
+
+#define GS_POOL_BITMAP_WORDS(num_blocks) (((num_blocks) + 63) / 64)
+
+#define GS_POOL_NUM_CARVED(pool)\
+  ((GS_PTR_DIFF((pool)->p_current, (pool)->p_begin)) / (pool)->stride)
+
+GS_MEM_ALLOC_VISIBILITY
+unsigned long long
+gs_pool_bitmap_size(unsigned long long size, 
+                    unsigned long long bsize, 
+                    unsigned int alignment)
+{
+  return GS_POOL_BITMAP_WORDS(size / gs_pool_stride(bsize, alignment)) * sizeof(unsigned long long);
+}
+
+GS_MEM_ALLOC_VISIBILITY
+GSPool
+gs_pool_init_bitmap(void* mem_ptr, 
+                    unsigned long long size, 
+                    unsigned long long bsize, 
+                    unsigned int alignment, 
+                    void* bitmap_ptr, 
+                    unsigned long long bitmap_size)
+{
+  GS_ASSERT(bitmap_ptr != NULL && 
+            "GSPool bitmap ptr cannot be NULL")
+  GS_ASSERT((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)bitmap_ptr % sizeof(unsigned long long) == 0 && 
+            "GSPool bitmap ptr must be aligned to 8 bytes")
+
+  GSPool pool = gs_pool_init(mem_ptr, size, bsize, alignment);
+  if(bitmap_size < gs_pool_bitmap_size(size, bsize, alignment))
+  {
+    pool.valid = false;
+    return pool;
+  }
+
+  pool.p_live_bitmap = (unsigned long long*)bitmap_ptr;
+  unsigned long long num_words = bitmap_size / sizeof(unsigned long long);
+  for(unsigned long long i = 0; i < num_words; ++i)
+  {
+    pool.p_live_bitmap[i] = 0;
+  }
+  return pool;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+GSPool
+gs_pool_init_huge(unsigned long long size, 
+                  unsigned long long bsize, 
+                  unsigned int alignment, 
+                  unsigned long long page_size)
+{
+  GSVmMapping* mapping = gs_vm_map_pages(size, page_size);
+  if(mapping == NULL)
+  {
+    GSPool pool;
+    pool.p_begin = NULL;
+    pool.p_end = NULL;
+    pool.p_current = NULL;
+    pool.p_next_free = NULL;
+    pool.bsize = bsize;
+    pool.alignment = alignment;
+    pool.stride = bsize;
+    pool.p_live_bitmap = NULL;
+    pool.bitmap_hint = 0;
+    pool.p_mapping = NULL;
+    GS_STATS_INIT(&pool.stats)
+    GS_TRACE_UPDATE(pool.trace_id = 0;)
+    pool.valid = false;
+    return pool;
+  }
+
+  char* begin = GS_VM_MAPPING_BEGIN(mapping);
+  GSPool pool = gs_pool_init(begin, GS_PTR_DIFF(GS_VM_MAPPING_END(mapping), begin), bsize, alignment);
+  pool.p_mapping = mapping;
+  return pool;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_pool_release_huge(GSPool* pool)
+{
+  GS_ASSERT(pool->valid && pool->p_mapping != NULL && 
+            "GSPool cannot release a pool not owning its mapping")
+  gs_vm_unmap_pages(pool->p_mapping);
+  pool->p_mapping = NULL;
+  pool->valid = false;
+}
+
+// Takes the lowest free block of a pool with a bitmap, carving a new one only
+// when all the carved blocks are live. Returns NULL if the pool is full
+static char*
+gs_pool_bitmap_acquire(GSPool* pool)
+{
+  unsigned long long num_carved = GS_POOL_NUM_CARVED(pool);
+  unsigned long long num_words = GS_POOL_BITMAP_WORDS(num_carved);
+  for(unsigned long long i = pool->bitmap_hint; i < num_words; ++i)
+  {
+    unsigned long long free_bits = ~pool->p_live_bitmap[i];
+    if(i == num_words - 1 && (num_carved & 63) != 0)
+    {
+      free_bits &= (1ull << (num_carved & 63)) - 1;
+    }
+    if(free_bits != 0)
+    {
+      unsigned long long index = i*64 + __builtin_ctzll(free_bits);
+      pool->p_live_bitmap[i] |= 1ull << (index & 63);
+      pool->bitmap_hint = i;
+      GS_STATS_UPDATE(pool->stats.free_list_length--;)
+      return (char*)pool->p_begin + index*pool->stride;
+    }
+  }
+
+  char* current = (char*)pool->p_current;
+  if(current >= (char*)pool->p_end || (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)((char*)pool->p_end - current) <= pool->bsize)
+  {
+    return NULL;
+  }
+  pool->p_live_bitmap[num_carved / 64] |= 1ull << (num_carved & 63);
+  pool->bitmap_hint = num_carved / 64;
+  pool->p_current = current + pool->stride;
+  return current;
+}
+
+// Marks a block of a pool with a bitmap as free
+static void
+gs_pool_bitmap_release(GSPool* pool, 
+                       void* ptr)
+{
+  unsigned long long index = (GS_PTR_DIFF(ptr, pool->p_begin)) / pool->stride;
+  GS_ASSERT((pool->p_live_bitmap[index / 64] & (1ull << (index & 63))) != 0 && 
+            "GSPool freed block is not live")
+  pool->p_live_bitmap[index / 64] &= ~(1ull << (index & 63));
+  if(index / 64 < pool->bitmap_hint)
+  {
+    pool->bitmap_hint = index / 64;
+  }
+}
+
+
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_pool_flush(GSPool* pool)
+{
+  GS_ASSERT(pool->valid == true && 
+            "GSPool cannot flush an invalid pool mem alloc")
+  GS_TRACE(pool->trace_id, GS_TRACE_POOL, GS_TRACE_OP_FLUSH, NULL, 0, 0)
+  if(pool->p_live_bitmap != NULL)
+  {
+    unsigned long long num_words = GS_POOL_BITMAP_WORDS(GS_POOL_NUM_CARVED(pool));
+    for(unsigned long long i = 0; i < num_words; ++i)
+    {
+      pool->p_live_bitmap[i] = 0;
+    }
+    pool->bitmap_hint = 0;
+  }
+  pool->p_current = pool->p_begin;
+  pool->p_next_free = NULL;
+  GS_STATS_UPDATE(pool->stats.live_blocks = 0;)
+  GS_STATS_UPDATE(pool->stats.free_list_length = 0;)
+}
+
+
+GS_MEM_ALLOC_VISIBILITY
+GSAlloc
+gs_pool_alloc_slow(GSPool* pool, 
+                   unsigned long long size, 
+                   unsigned int alignment)
+{
+  GS_ASSERT(pool->valid == true && 
+            "GSPool cannot allocate from an invalid pool mem alloc")
+  GS_ASSERT(pool->alignment == alignment && 
+            "GSPool incompatible alignment in allocation ")
+  GS_ASSERT(pool->bsize == size || 
+            (size < sizeof(GS_MEM_ALLOC_PTR_NUMERIC_TYPE) && pool->bsize == sizeof(GS_MEM_ALLOC_PTR_NUMERIC_TYPE)) && 
+            "GSPool incompatible size in allocation")
+
+  char* ret = NULL;
+  if(pool->p_live_bitmap != NULL)
+  {
+    ret = gs_pool_bitmap_acquire(pool);
+  }
+  else if(pool->p_next_free != NULL)
+  {
+    void* next_free = (void*)*(GS_MEM_ALLOC_PTR_NUMERIC_TYPE*)pool->p_next_free;
+    ret = (char*)pool->p_next_free;
+    pool->p_next_free = next_free;
+    GS_STATS_UPDATE(pool->stats.free_list_length--;)
+  }
+  else
+  {
+    ret = (char*)pool->p_current;
+    pool->p_current = (char*)pool->p_current + pool->stride;
+    GS_ASSERT((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)pool->p_current % alignment == 0)
+  }
+
+  if(((unsigned long long)ret) % alignment != 0 )
+  {
+    GS_ASSERT(((unsigned long long)ret) % alignment == 0 && 
+            "GSPool has a bug at computing a properly aligned address")
+  }
+
+  if(ret == NULL || (void*)(ret + size) >= pool->p_end)
+  {
+    GS_STATS_FAILED(&pool->stats)
+    GS_TRACE(pool->trace_id, GS_TRACE_POOL, GS_TRACE_OP_ALLOC, NULL, size, alignment)
+    GSAlloc alloc;
+    alloc.ptr = NULL;
+    alloc.checked = false;
+    return alloc;
+  }
+
+  GS_STATS_UPDATE(pool->stats.live_blocks++;)
+  GS_STATS_ALLOC(&pool->stats, 
+                 1, 
+                 pool->stats.live_blocks*pool->stride, 
+                 pool->stride - pool->bsize, 
+                 0)
+  GS_TRACE(pool->trace_id, GS_TRACE_POOL, GS_TRACE_OP_ALLOC, ret, size, alignment)
+
+#ifdef GS_MEM_ALLOC_INITIALIZE_TO_ZERO
+  memset(ret, 0, pool->bsize);
+#endif
+
+  GSAlloc alloc;
+  alloc.ptr = ret;
+  alloc.checked = false;
+  return alloc;
+}
+
+#ifndef GS_MEM_ALLOC_INLINE_FAST_PATHS
+GS_MEM_ALLOC_VISIBILITY
+GSAlloc
+gs_pool_alloc(GSPool* pool, 
+              unsigned long long size, 
+              unsigned int alignment)
+{
+  return gs_pool_alloc_slow(pool, size, alignment);
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void*
+gs_pool_alloc_CHECKED(GSPool* pool, 
+              unsigned long long size, 
+              unsigned int alignment)
+{
+  GSAlloc alloc = gs_pool_alloc(pool, size, alignment);
+#ifndef GS_MEM_ALLOC_DISABLE_CHECKS
+  GS_PERMA_ASSERT(!gs_alloc_is_null(&alloc));
+#else
+  alloc.checked = true;
+#endif
+  return gs_alloc_ptr(&alloc);
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void 
+gs_pool_free(GSPool* pool, 
+             void* ptr)
+{
+  gs_pool_free_slow(pool, ptr);
+}
+#endif
+
+GS_MEM_ALLOC_VISIBILITY
+void 
+gs_pool_free_slow(GSPool* pool, 
+                  void* ptr)
+{
+  GS_ASSERT(pool->valid == true && 
+            "GSPool cannot free from an invalid pool mem alloc")
+  GS_ASSERT(((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ptr % pool->alignment == 0) && "GSPool this should not happen")
+  GS_ASSERT(((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ptr >= (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)pool->p_begin && (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ptr < (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)pool->p_current) && "GSPool invalid freed ptr")
+
+  if(pool->p_live_bitmap != NULL)
+  {
+    gs_pool_bitmap_release(pool, ptr);
+  }
+  else
+  {
+    *(GS_MEM_ALLOC_PTR_NUMERIC_TYPE*)ptr = (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)pool->p_next_free;
+    pool->p_next_free = ptr;
+  }
+  GS_STATS_FREE(&pool->stats, 1)
+  GS_STATS_UPDATE(pool->stats.live_blocks--;)
+  GS_STATS_UPDATE(pool->stats.free_list_length++;)
+  GS_TRACE(pool->trace_id, GS_TRACE_POOL, GS_TRACE_OP_FREE, ptr, 0, 0)
+}
+
+GS_MEM_ALLOC_VISIBILITY
+unsigned long long
+gs_pool_alloc_n(GSPool* pool, 
+                unsigned long long count, 
+                void** ptrs)
+{
+  GS_ASSERT(pool->valid == true && 
+            "GSPool cannot allocate from an invalid pool mem alloc")
+
+  unsigned long long allocated = 0;
+  if(pool->p_live_bitmap != NULL)
+  {
+    // Blocks are taken one at a time to keep the live blocks dense
+    char* ret = NULL;
+    while(allocated < count && (ret = gs_pool_bitmap_acquire(pool)) != NULL)
+    {
+      ptrs[allocated++] = ret;
+    }
+  }
+  else
+  {
+    char* next_free = (char*)pool->p_next_free;
+    while(allocated < count && next_free != NULL)
+    {
+      ptrs[allocated++] = next_free;
+      next_free = (char*)*(GS_MEM_ALLOC_PTR_NUMERIC_TYPE*)next_free;
+    }
+    pool->p_next_free = next_free;
+    GS_STATS_UPDATE(pool->stats.free_list_length -= allocated;)
+
+    // The remaining blocks are carved from the bump region. A block fits if it
+    // ends before p_end, as in gs_pool_alloc
+    char* current = (char*)pool->p_current;
+    char* end = (char*)pool->p_end;
+    unsigned long long available = 0;
+    if(current < end && (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)(end - current) > pool->bsize)
+    {
+      available = (GS_PTR_DIFF(end, current) - pool->bsize - 1) / pool->stride + 1;
+    }
+    unsigned long long bumped = count - allocated;
+    if(bumped > available)
+    {
+      bumped = available;
+    }
+    for(unsigned long long i = 0; i < bumped; ++i)
+    {
+      ptrs[allocated++] = current + i*pool->stride;
+    }
+    pool->p_current = current + bumped*pool->stride;
+  }
+
+  GS_STATS_UPDATE(pool->stats.live_blocks += allocated;)
+  GS_STATS_ALLOC(&pool->stats, 
+                 allocated, 
+                 pool->stats.live_blocks*pool->stride, 
+                 allocated*(pool->stride - pool->bsize), 
+                 0)
+  GS_STATS_UPDATE(if(allocated < count) pool->stats.num_failed_allocs++;)
+#ifdef GS_MEM_ALLOC_ENABLE_TRACE
+  for(unsigned long long i = 0; i < allocated; ++i)
+  {
+    GS_TRACE(pool->trace_id, GS_TRACE_POOL, GS_TRACE_OP_ALLOC, ptrs[i], pool->bsize, pool->alignment)
+  }
+  if(allocated < count)
+  {
+    GS_TRACE(pool->trace_id, GS_TRACE_POOL, GS_TRACE_OP_ALLOC, NULL, pool->bsize, pool->alignment)
+  }
+#endif
+
+#ifdef GS_MEM_ALLOC_INITIALIZE_TO_ZERO
+  for(unsigned long long i = 0; i < allocated; ++i)
+  {
+    memset(ptrs[i], 0, pool->bsize);
+  }
+#endif
+  return allocated;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_pool_alloc_n_CHECKED(GSPool* pool, 
+                        unsigned long long count, 
+                        void** ptrs)
+{
+  unsigned long long allocated = gs_pool_alloc_n(pool, count, ptrs);
+#ifndef GS_MEM_ALLOC_DISABLE_CHECKS
+  GS_PERMA_ASSERT(allocated == count);
+#else
+  (void)allocated;
+#endif
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_pool_free_n(GSPool* pool, 
+               unsigned long long count, 
+               void** ptrs)
+{
+  GS_ASSERT(pool->valid == true && 
+            "GSPool cannot free from an invalid pool mem alloc")
+  if(count == 0)
+  {
+    return;
+  }
+
+  if(pool->p_live_bitmap != NULL)
+  {
+    for(unsigned long long i = 0; i < count; ++i)
+    {
+      GS_ASSERT(((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ptrs[i] >= (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)pool->p_begin && (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ptrs[i] < (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)pool->p_current) && "GSPool invalid freed ptr")
+      gs_pool_bitmap_release(pool, ptrs[i]);
+    }
+  }
+  else
+  {
+    for(unsigned long long i = 0; i < count - 1; ++i)
+    {
+      GS_ASSERT(((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ptrs[i] % pool->alignment == 0) && "GSPool this should not happen")
+      GS_ASSERT(((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ptrs[i] >= (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)pool->p_begin && (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ptrs[i] < (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)pool->p_current) && "GSPool invalid freed ptr")
+      *(GS_MEM_ALLOC_PTR_NUMERIC_TYPE*)ptrs[i] = (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ptrs[i+1];
+    }
+    GS_ASSERT(((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ptrs[count-1] >= (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)pool->p_begin && (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ptrs[count-1] < (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)pool->p_current) && "GSPool invalid freed ptr")
+    *(GS_MEM_ALLOC_PTR_NUMERIC_TYPE*)ptrs[count-1] = (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)pool->p_next_free;
+    pool->p_next_free = ptrs[0];
+  }
+  GS_STATS_FREE(&pool->stats, count)
+  GS_STATS_UPDATE(pool->stats.live_blocks -= count;)
+  GS_STATS_UPDATE(pool->stats.free_list_length += count;)
+#ifdef GS_MEM_ALLOC_ENABLE_TRACE
+  for(unsigned long long i = 0; i < count; ++i)
+  {
+    GS_TRACE(pool->trace_id, GS_TRACE_POOL, GS_TRACE_OP_FREE, ptrs[i], 0, 0)
+  }
+#endif
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_pool_for_each_live(GSPool* pool, 
+                      GSPoolLiveFunc func, 
+                      void* user_data)
+{
+  GS_ASSERT(pool->valid == true && pool->p_live_bitmap != NULL && 
+            "GSPool cannot iterate a pool without bitmap")
+
+  // Each word is copied before visiting its blocks, so func can free them
+  unsigned long long num_words = GS_POOL_BITMAP_WORDS(GS_POOL_NUM_CARVED(pool));
+  for(unsigned long long i = 0; i < num_words; ++i)
+  {
+    unsigned long long live_bits = pool->p_live_bitmap[i];
+    while(live_bits != 0)
+    {
+      unsigned long long index = i*64 + __builtin_ctzll(live_bits);
+      live_bits &= live_bits - 1;
+      func(user_data, (char*)pool->p_begin + index*pool->stride);
+    }
+  }
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void*
+gs_pool_next_live(GSPool* pool, 
+                  void* ptr)
+{
+  GS_ASSERT(pool->valid == true && pool->p_live_bitmap != NULL && 
+            "GSPool cannot iterate a pool without bitmap")
+
+  unsigned long long index = 0;
+  if(ptr != NULL)
+  {
+    index = (GS_PTR_DIFF(ptr, pool->p_begin)) / pool->stride + 1;
+  }
+  unsigned long long num_words = GS_POOL_BITMAP_WORDS(GS_POOL_NUM_CARVED(pool));
+  unsigned long long i = index / 64;
+  if(i >= num_words)
+  {
+    return NULL;
+  }
+
+  unsigned long long live_bits = pool->p_live_bitmap[i] & (~0ull << (index & 63));
+  while(live_bits == 0)
+  {
+    if(++i == num_words)
+    {
+      return NULL;
+    }
+    live_bits = pool->p_live_bitmap[i];
+  }
+  return (char*)pool->p_begin + (i*64 + __builtin_ctzll(live_bits))*pool->stride;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+unsigned long long
+gs_pool_count_live(GSPool* pool)
+{
+  GS_ASSERT(pool->valid == true && pool->p_live_bitmap != NULL && 
+            "GSPool cannot count the live blocks of a pool without bitmap")
+
+  unsigned long long count = 0;
+  unsigned long long num_words = GS_POOL_BITMAP_WORDS(GS_POOL_NUM_CARVED(pool));
+  for(unsigned long long i = 0; i < num_words; ++i)
+  {
+    count += __builtin_popcountll(pool->p_live_bitmap[i]);
+  }
+  return count;
+}
+
+// Returns the index following the last live block of a pool with a bitmap
+// among the blocks before limit, 0 if there are none
+static unsigned long long
+gs_pool_bitmap_live_end(GSPool* pool, 
+                        unsigned long long limit)
+{
+  unsigned long long i = GS_POOL_BITMAP_WORDS(limit);
+  while(i > 0)
+  {
+    --i;
+    unsigned long long live_bits = pool->p_live_bitmap[i];
+    if(i == limit / 64 && (limit & 63) != 0)
+    {
+      live_bits &= (1ull << (limit & 63)) - 1;
+    }
+    if(live_bits != 0)
+    {
+      return i*64 + 64 - __builtin_clzll(live_bits);
+    }
+  }
+  return 0;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+unsigned long long
+gs_pool_compact(GSPool* pool, 
+                unsigned long long max_moves, 
+                GSPoolRelocateFunc func, 
+                void* user_data)
+{
+  GS_ASSERT(pool->valid == true && pool->p_live_bitmap != NULL && 
+            "GSPool cannot compact a pool without bitmap")
+
+  unsigned long long num_carved = GS_POOL_NUM_CARVED(pool);
+  unsigned long long end = gs_pool_bitmap_live_end(pool, num_carved);
+  unsigned long long word = pool->bitmap_hint;
+  unsigned long long moved = 0;
+  while(moved < max_moves)
+  {
+    while(word*64 < end && pool->p_live_bitmap[word] == ~0ull)
+    {
+      word++;
+    }
+    if(word*64 >= end)
+    {
+      break;
+    }
+    unsigned long long to = word*64 + __builtin_ctzll(~pool->p_live_bitmap[word]);
+    if(to >= end)
+    {
+      break;
+    }
+
+    // The block before end is live, and it is moved to the lowest free block
+    unsigned long long from = end - 1;
+    char* old_ptr = (char*)pool->p_begin + from*pool->stride;
+    char* new_ptr = (char*)pool->p_begin + to*pool->stride;
+    gs_mem_copy(new_ptr, old_ptr, pool->bsize);
+    pool->p_live_bitmap[to / 64] |= 1ull << (to & 63);
+    pool->p_live_bitmap[from / 64] &= ~(1ull << (from & 63));
+    GS_TRACE(pool->trace_id, GS_TRACE_POOL, GS_TRACE_OP_ALLOC, new_ptr, pool->bsize, pool->alignment)
+    GS_TRACE(pool->trace_id, GS_TRACE_POOL, GS_TRACE_OP_FREE, old_ptr, 0, 0)
+    func(user_data, old_ptr, new_ptr);
+    moved++;
+    end = gs_pool_bitmap_live_end(pool, from);
+  }
+
+  GS_STATS_UPDATE(pool->stats.free_list_length -= num_carved - end;)
+  pool->p_current = (char*)pool->p_begin + end*pool->stride;
+  pool->bitmap_hint = word < GS_POOL_BITMAP_WORDS(end) ? word : GS_POOL_BITMAP_WORDS(end);
+  return moved;
+}
+
+// Returns whether the blocks from first to last (included) of a pool with a
+// bitmap are all free
+static bool
+gs_pool_bitmap_all_free(GSPool* pool, 
+                        unsigned long long first, 
+                        unsigned long long last)
+{
+  unsigned long long i = first;
+  while(i <= last)
+  {
+    unsigned long long live_bits = pool->p_live_bitmap[i / 64] >> (i & 63);
+    unsigned long long count = 64 - (i & 63);
+    if(count > last - i + 1)
+    {
+      count = last - i + 1;
+    }
+    if(count < 64)
+    {
+      live_bits &= (1ull << count) - 1;
+    }
+    if(live_bits != 0)
+    {
+      return false;
+    }
+    i += count;
+  }
+  return true;
+}
+
+// Sorts the free list of a pool without bitmap in address order, with a bottom
+// up merge sort of the list that needs no additional memory
+static void
+gs_pool_sort_free_list(GSPool* pool)
+{
+  void* list = pool->p_next_free;
+  for(unsigned long long width = 1; list != NULL; width *= 2)
+  {
+    void* head = NULL;
+    void** tail = &head;
+    unsigned long long merges = 0;
+    void* p = list;
+    while(p != NULL)
+    {
+      merges++;
+      void* q = p;
+      unsigned long long p_size = 0;
+      while(p_size < width && q != NULL)
+      {
+        q = *(void**)q;
+        p_size++;
+      }
+      unsigned long long q_size = width;
+      while(p_size > 0 || (q_size > 0 && q != NULL))
+      {
+        void* block;
+        if(p_size == 0 || (q_size > 0 && q != NULL && (char*)q < (char*)p))
+        {
+          block = q;
+          q = *(void**)q;
+          q_size--;
+        }
+        else
+        {
+          block = p;
+          p = *(void**)p;
+          p_size--;
+        }
+        *tail = block;
+        tail = (void**)block;
+      }
+      p = q;
+    }
+    *tail = NULL;
+    list = head;
+    if(merges <= 1)
+    {
+      break;
+    }
+  }
+  pool->p_next_free = list;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+unsigned long long
+gs_pool_trim(GSPool* pool)
+{
+  GS_ASSERT(pool->valid == true && 
+            "GSPool cannot trim an invalid pool mem alloc")
+
+  unsigned long long released = 0;
+  if(pool->p_live_bitmap != NULL)
+  {
+    unsigned long long num_carved = GS_POOL_NUM_CARVED(pool);
+    unsigned long long end = gs_pool_bitmap_live_end(pool, num_carved);
+    GS_STATS_UPDATE(pool->stats.free_list_length -= num_carved - end;)
+    pool->p_current = (char*)pool->p_begin + end*pool->stride;
+    if(pool->bitmap_hint > GS_POOL_BITMAP_WORDS(end))
+    {
+      pool->bitmap_hint = GS_POOL_BITMAP_WORDS(end);
+    }
+
+    // Free blocks do not store anything, so the pages between live blocks can 
+    // be released as well
+    unsigned long long page_size = pool->p_mapping != NULL ? pool->p_mapping->page_size : gs_vm_page_size();
+    char* page = (char*)GS_ALIGN_ADDRESS(pool->p_begin, page_size);
+    while(page + page_size <= (char*)pool->p_current)
+    {
+      unsigned long long first = (GS_PTR_DIFF(page, pool->p_begin)) / pool->stride;
+      unsigned long long last = (GS_PTR_DIFF(page + page_size - 1, pool->p_begin)) / pool->stride;
+      if(gs_pool_bitmap_all_free(pool, first, last))
+      {
+        gs_vm_purge(page, page_size);
+        released += page_size;
+      }
+      page += page_size;
+    }
+  }
+  else
+  {
+    // Looking for the run of contiguous free blocks at the end of the sorted
+    // list, which is uncarved if it reaches p_current
+    gs_pool_sort_free_list(pool);
+    void** run_link = &pool->p_next_free;
+    char* prev = NULL;
+    void** link = &pool->p_next_free;
+    while(*link != NULL)
+    {
+      char* block = (char*)*link;
+      if(prev == NULL || block != prev + pool->stride)
+      {
+        run_link = link;
+      }
+      prev = block;
+      link = (void**)block;
+    }
+    if(prev != NULL && prev + pool->stride == (char*)pool->p_current)
+    {
+      GS_STATS_UPDATE(pool->stats.free_list_length -= (GS_PTR_DIFF(pool->p_current, *run_link)) / pool->stride;)
+      pool->p_current = *run_link;
+      *run_link = NULL;
+    }
+  }
+
+  released += gs_vm_purge_range(pool->p_current, pool->p_end, pool->p_mapping);
+  return released;
+}
+
+#ifdef GS_MEM_ALLOC_ENABLE_STATS
+GS_MEM_ALLOC_VISIBILITY
+GSAllocStats
+gs_pool_get_stats(GSPool* pool)
+{
+  GS_ASSERT(pool->valid == true && 
+            "GSPool cannot get the stats of an invalid pool mem alloc")
+  GSAllocStats stats = pool->stats;
+  stats.bytes_in_use = stats.live_blocks*pool->stride;
+  return stats;
+}
+#endif
+
+////////////////////////////////////////////////
+//////////////// HANDLE POOL ///////////////////
+////////////////////////////////////////////////
+
+GS_MEM_ALLOC_VISIBILITY
+unsigned long long
+gs_handle_pool_metadata_size(unsigned long long size, 
+                             unsigned long long bsize, 
+                             unsigned int alignment)
+{
+  return gs_pool_bitmap_size(size, bsize, alignment) + 
+         (size / gs_pool_stride(bsize, alignment))*sizeof(unsigned int);
+}
+
+GS_MEM_ALLOC_VISIBILITY
+GSHandlePool
+gs_handle_pool_init(void* mem_ptr, 
+                    unsigned long long size, 
+                    unsigned long long bsize, 
+                    unsigned int alignment, 
+                    void* metadata_ptr, 
+                    unsigned long long metadata_size)
+{
+  GSHandlePool pool;
+  unsigned long long bitmap_size = gs_pool_bitmap_size(size, bsize, alignment);
+  unsigned long long num_blocks = size / gs_pool_stride(bsize, alignment);
+  bool fits = metadata_size >= gs_handle_pool_metadata_size(size, bsize, alignment) && 
+              num_blocks - 1 <= GS_HANDLE_INDEX_MASK;
+
+  // The metadata size is checked first, as initializing the bitmap clears it
+  pool.pool = gs_pool_init_bitmap(mem_ptr, 
+                                  size, 
+                                  bsize, 
+                                  alignment, 
+                                  metadata_ptr, 
+                                  fits ? bitmap_size : 0);
+  pool.p_generations = (unsigned int*)((char*)metadata_ptr + bitmap_size);
+  pool.num_blocks = num_blocks;
+  pool.valid = pool.pool.valid && fits;
+  if(!pool.valid)
+  {
+    pool.pool.valid = false;
+    return pool;
+  }
+
+  for(unsigned long long i = 0; i < pool.num_blocks; ++i)
+  {
+    pool.p_generations[i] = 1;
+  }
+  return pool;
+}
+
+// Returns the generation following the given one, skipping 0 when wrapping
+static unsigned int
+gs_handle_next_generation(unsigned int generation)
+{
+  return generation == GS_HANDLE_GENERATION_LIMIT ? 1 : generation + 1;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+GSHandle
+gs_handle_pool_alloc(GSHandlePool* pool)
+{
+  GS_ASSERT(pool->valid == true && 
+            "GSHandlePool cannot allocate from an invalid handle pool")
+  GSAlloc alloc = gs_pool_alloc(&pool->pool, pool->pool.bsize, pool->pool.alignment);
+  if(gs_alloc_is_null(&alloc))
+  {
+    return GS_HANDLE_NULL;
+  }
+  unsigned long long index = (GS_PTR_DIFF(gs_alloc_ptr(&alloc), pool->pool.p_begin)) / pool->pool.stride;
+  return GS_HANDLE_MAKE(index, pool->p_generations[index]);
+}
+
+GS_MEM_ALLOC_VISIBILITY
+GSHandle
+gs_handle_pool_alloc_CHECKED(GSHandlePool* pool)
+{
+  GSHandle handle = gs_handle_pool_alloc(pool);
+#ifndef GS_MEM_ALLOC_DISABLE_CHECKS
+  GS_PERMA_ASSERT(handle != GS_HANDLE_NULL);
+#endif
+  return handle;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_handle_pool_free(GSHandlePool* pool, 
+                    GSHandle handle)
+{
+  GS_ASSERT(gs_handle_pool_valid(pool, handle) && 
+            "GSHandlePool cannot free an invalid handle")
+  unsigned long long index = GS_HANDLE_INDEX(handle);
+  pool->p_generations[index] = gs_handle_next_generation(pool->p_generations[index]);
+  gs_pool_free(&pool->pool, (char*)pool->pool.p_begin + index*pool->pool.stride);
+}
+
+GS_MEM_ALLOC_VISIBILITY
+bool
+gs_handle_pool_valid(GSHandlePool* pool, 
+                     GSHandle handle)
+{
+  GS_ASSERT(pool->valid == true && 
+            "GSHandlePool cannot check a handle of an invalid handle pool")
+  unsigned long long index = GS_HANDLE_INDEX(handle);
+  return index < pool->num_blocks && 
+         pool->p_generations[index] == GS_HANDLE_GENERATION(handle) && 
+         (pool->pool.p_live_bitmap[index / 64] & (1ull << (index & 63))) != 0;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void*
+gs_handle_pool_get(GSHandlePool* pool, 
+                   GSHandle handle)
+{
+  if(!gs_handle_pool_valid(pool, handle))
+  {
+    return NULL;
+  }
+  return (char*)pool->pool.p_begin + GS_HANDLE_INDEX(handle)*pool->pool.stride;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+GSHandle
+gs_handle_pool_handle(GSHandlePool* pool, 
+                      void* ptr)
+{
+  GS_ASSERT(pool->valid == true && 
+            "GSHandlePool cannot get a handle from an invalid handle pool")
+  GS_ASSERT(((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ptr >= (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)pool->pool.p_begin && (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ptr < (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)pool->pool.p_current) && "GSHandlePool invalid block ptr")
+  unsigned long long index = (GS_PTR_DIFF(ptr, pool->pool.p_begin)) / pool->pool.stride;
+  return GS_HANDLE_MAKE(index, pool->p_generations[index]);
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_handle_pool_flush(GSHandlePool* pool)
+{
+  GS_ASSERT(pool->valid == true && 
+            "GSHandlePool cannot flush an invalid handle pool")
+  for(void* ptr = gs_pool_next_live(&pool->pool, NULL); ptr != NULL; ptr = gs_pool_next_live(&pool->pool, ptr))
+  {
+    unsigned long long index = (GS_PTR_DIFF(ptr, pool->pool.p_begin)) / pool->pool.stride;
+    pool->p_generations[index] = gs_handle_next_generation(pool->p_generations[index]);
+  }
+  gs_pool_flush(&pool->pool);
+}
+
+////////////////////////////////////////////////
+/////////////////// ATOMIC POOL ////////////////
+////////////////////////////////////////////////
+
+#define GS_ATOMIC_POOL_TAG(head) ((head) >> 32)
+#define GS_ATOMIC_POOL_INDEX(head) ((head) & 0xffffffffull)
+#define GS_ATOMIC_POOL_HEAD(tag, index) ((((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)(tag)) << 32) | ((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)(index) & 0xffffffffull))
+
+GS_MEM_ALLOC_VISIBILITY
+GSAtomicPool
+gs_atomic_pool_init(void* mem_ptr, 
+                    unsigned long long size, 
+                    unsigned long long bsize, 
+                    unsigned int alignment)
+{
+  GS_ASSERT(mem_ptr != NULL && 
+            "GSAtomicPool mem ptr cannot be NULL")
+
+  GSAtomicPool pool;
+  pool.p_begin = mem_ptr;
+  pool.p_end = (char*)mem_ptr + size; 
+  pool.bsize = bsize; 
+  pool.alignment = alignment;
+  pool.next_free = 0;
+
+  if(pool.bsize < sizeof(GS_MEM_ALLOC_PTR_NUMERIC_TYPE))
+  {
+    pool.bsize = sizeof(GS_MEM_ALLOC_PTR_NUMERIC_TYPE);
+  }
+  GS_ALIGN_PTR(pool.p_begin, alignment)
+
+  pool.p_current = pool.p_begin;
+  pool.stride = pool.bsize;
+  unsigned int modulo = pool.bsize & (alignment-1);
+  if(modulo != 0)
+  {
+    pool.stride += alignment - modulo;
+  }
+
+  // Block indices are stored 1-based in 32 bits, 0 is reserved for the empty list
+  GS_ASSERT((GS_PTR_DIFF(pool.p_end, pool.p_begin)) / pool.stride < 0xffffffffull && 
+            "GSAtomicPool cannot hold more than 2^32-1 blocks")
+  pool.valid = true;
+  return pool;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_atomic_pool_flush(GSAtomicPool* pool)
+{
+  GS_ASSERT(pool->valid == true && 
+            "GSAtomicPool cannot flush an invalid pool mem alloc")
+  // The tag is preserved so that stale heads read before the flush cannot match
+  GS_MEM_ALLOC_PTR_NUMERIC_TYPE head = GS_ATOMIC_LOAD(&pool->next_free);
+  GS_ATOMIC_STORE(&pool->next_free, GS_ATOMIC_POOL_HEAD(GS_ATOMIC_POOL_TAG(head) + 1, 0));
+  GS_ATOMIC_STORE(&pool->p_current, pool->p_begin);
+}
+
+GS_MEM_ALLOC_VISIBILITY
+GSAlloc
+gs_atomic_pool_alloc(GSAtomicPool* pool, 
+                     unsigned long long size, 
+                     unsigned int alignment)
+{
+  GS_ASSERT(pool->valid == true && 
+            "GSAtomicPool cannot allocate from an invalid pool mem alloc")
+  GS_ASSERT(pool->alignment == alignment && 
+            "GSAtomicPool incompatible alignment in allocation ")
+  GS_ASSERT((pool->bsize == size || 
+            (size < sizeof(GS_MEM_ALLOC_PTR_NUMERIC_TYPE) && pool->bsize == sizeof(GS_MEM_ALLOC_PTR_NUMERIC_TYPE))) && 
+            "GSAtomicPool incompatible size in allocation")
+
+  char* ret = NULL;
+
+  // Popping from the free list. The next index is read from a block that might
+  // have been concurrently allocated and overwritten, in which case the tag of
+  // the head has changed and the CAS fails.
+  GS_MEM_ALLOC_PTR_NUMERIC_TYPE head = GS_ATOMIC_LOAD(&pool->next_free);
+  while(GS_ATOMIC_POOL_INDEX(head) != 0)
+  {
+    char* block = (char*)pool->p_begin + (GS_ATOMIC_POOL_INDEX(head) - 1) * pool->stride;
+    GS_MEM_ALLOC_PTR_NUMERIC_TYPE next_index = GS_ATOMIC_LOAD_RELAXED((GS_MEM_ALLOC_PTR_NUMERIC_TYPE*)block);
+    GS_MEM_ALLOC_PTR_NUMERIC_TYPE new_head = GS_ATOMIC_POOL_HEAD(GS_ATOMIC_POOL_TAG(head) + 1, next_index);
+    if(GS_ATOMIC_CAS(&pool->next_free, &head, new_head))
+    {
+      ret = block;
+      break;
+    }
+  }
+
+  if(ret == NULL)
+  {
+    // Bumping p_current. The previous load avoids p_current growing unbounded
+    // when the pool is exhausted and many threads keep trying to allocate
+    if((char*)GS_ATOMIC_LOAD_RELAXED(&pool->p_current) + pool->bsize > (char*)pool->p_end)
+    {
+      GSAlloc alloc;
+      alloc.ptr = NULL;
+      alloc.checked = false;
+      return alloc;
+    }
+
+    ret = (char*)GS_ATOMIC_FETCH_ADD((GS_MEM_ALLOC_PTR_NUMERIC_TYPE*)&pool->p_current, 
+                                     pool->stride);
+    if(ret + pool->bsize > (char*)pool->p_end)
+    {
+      GSAlloc alloc;
+      alloc.ptr = NULL;
+      alloc.checked = false;
+      return alloc;
+    }
+  }
+
+  GS_ASSERT(((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ret) % alignment == 0 && 
+            "GSAtomicPool has a bug at computing a properly aligned address")
+
+#ifdef GS_MEM_ALLOC_INITIALIZE_TO_ZERO
+  memset(ret, 0, pool->bsize);
+#endif
+
+  GSAlloc alloc;
+  alloc.ptr = ret;
+  alloc.checked = false;
+  return alloc;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void*
+gs_atomic_pool_alloc_CHECKED(GSAtomicPool* pool, 
+                             unsigned long long size, 
+                             unsigned int alignment)
+{
+  GSAlloc alloc = gs_atomic_pool_alloc(pool, size, alignment);
+#ifndef GS_MEM_ALLOC_DISABLE_CHECKS
+  GS_PERMA_ASSERT(!gs_alloc_is_null(&alloc));
+#else
+  alloc.checked = true;
+#endif
+  return gs_alloc_ptr(&alloc);
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void 
+gs_atomic_pool_free(GSAtomicPool* pool, 
+                    void* ptr)
+{
+  GS_ASSERT(pool->valid == true && 
+            "GSAtomicPool cannot free from an invalid pool mem alloc")
+  GS_ASSERT(((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ptr % pool->alignment == 0) && "GSAtomicPool this should not happen")
+  GS_ASSERT(((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ptr >= (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)pool->p_begin && (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ptr < (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)GS_ATOMIC_LOAD_RELAXED(&pool->p_current)) && "GSAtomicPool invalid freed ptr")
+
+  GS_MEM_ALLOC_PTR_NUMERIC_TYPE index = (GS_PTR_DIFF(ptr, pool->p_begin)) / pool->stride + 1;
+  GS_MEM_ALLOC_PTR_NUMERIC_TYPE head = GS_ATOMIC_LOAD_RELAXED(&pool->next_free);
+  GS_MEM_ALLOC_PTR_NUMERIC_TYPE new_head;
+  do
+  {
+    GS_ATOMIC_STORE_RELAXED((GS_MEM_ALLOC_PTR_NUMERIC_TYPE*)ptr, GS_ATOMIC_POOL_INDEX(head));
+    new_head = GS_ATOMIC_POOL_HEAD(GS_ATOMIC_POOL_TAG(head) + 1, index);
+  } while(!GS_ATOMIC_CAS(&pool->next_free, &head, new_head));
+}
+
+////////////////////////////////////////////////
+/////////////////// ATOMIC SCRATCH /////////////
+////////////////////////////////////////////////
+
+GS_MEM_ALLOC_VISIBILITY
+GSAtomicScratch
+gs_atomic_scratch_init(void* base_addr, 
+                       unsigned long long size)
+{
+  GS_ASSERT(base_addr != NULL && 
+            "GSAtomicScratch base addr cannot be NULL")
+
+  GSAtomicScratch scratch;
+  scratch.p_begin = base_addr;
+  scratch.p_end = (char*)base_addr + size;
+  scratch.offset = 0;
+  GS_ALIGN_PTR(scratch.p_begin, GS_MEM_ALLOC_MIN_ALIGNMENT)
+  if((char*)scratch.p_begin > (char*)scratch.p_end)
+  {
+    scratch.p_begin = scratch.p_end;
+  }
+  scratch.valid = true;
+  return scratch;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+GSAlloc
+gs_atomic_scratch_push(GSAtomicScratch* scratch, 
+                       unsigned long long size, 
+                       unsigned int alignment)
+{
+  GS_ASSERT(scratch->valid && "GSAtomicScratch not properly initialized")
+
+  GSAlloc alloc;
+  alloc.ptr = NULL;
+  alloc.checked = false;
+
+  // Requests larger than the scratch are rejected before touching the offset,
+  // so that each failed push adds at most the size of the scratch to it and 
+  // the offset cannot wrap around
+  unsigned long long capacity = GS_PTR_DIFF(scratch->p_end, scratch->p_begin);
+  if(size > capacity)
+  {
+    return alloc;
+  }
+  unsigned long long rounded = GS_ALIGN_ADDRESS(size, GS_MEM_ALLOC_MIN_ALIGNMENT);
+
+  GS_MEM_ALLOC_PTR_NUMERIC_TYPE offset = GS_ATOMIC_LOAD_RELAXED(&scratch->offset);
+  if(alignment <= GS_MEM_ALLOC_MIN_ALIGNMENT)
+  {
+    // The previous load avoids the offset growing unbounded when the scratch 
+    // is exhausted and many threads keep trying to push
+    if(offset + rounded > capacity)
+    {
+      return alloc;
+    }
+    offset = GS_ATOMIC_FETCH_ADD(&scratch->offset, rounded);
+    if(offset + rounded > capacity)
+    {
+      return alloc;
+    }
+  }
+  else
+  {
+    GS_MEM_ALLOC_PTR_NUMERIC_TYPE aligned;
+    do
+    {
+      aligned = GS_ALIGN_ADDRESS((char*)scratch->p_begin + offset, alignment) - (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)scratch->p_begin;
+      if(aligned + rounded > capacity)
+      {
+        return alloc;
+      }
+    } while(!GS_ATOMIC_CAS(&scratch->offset, &offset, aligned + rounded));
+    offset = aligned;
+  }
+
+  char* ret = (char*)scratch->p_begin + offset;
+  GS_ASSERT(((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ret) % alignment == 0 && 
+            "GSAtomicScratch aligned address is not correclty computed")
+
+#ifdef GS_MEM_ALLOC_INITIALIZE_TO_ZERO
+  memset(ret, 0, size);
+#endif
+  alloc.ptr = ret;
+  return alloc;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void*
+gs_atomic_scratch_push_CHECKED(GSAtomicScratch* scratch, 
+                               unsigned long long size, 
+                               unsigned int alignment)
+{
+  GSAlloc alloc = gs_atomic_scratch_push(scratch, size, alignment);
+#ifndef GS_MEM_ALLOC_DISABLE_CHECKS
+  GS_PERMA_ASSERT(!gs_alloc_is_null(&alloc));
+#else
+  alloc.checked = true;
+#endif
+  return gs_alloc_ptr(&alloc);
+}
+
+GS_MEM_ALLOC_VISIBILITY
+GSScratch
+gs_atomic_scratch_claim(GSAtomicScratch* scratch, 
+                        unsigned long long size)
+{
+  GSAlloc alloc = gs_atomic_scratch_push(scratch, size, GS_MEM_ALLOC_CACHE_LINE_SIZE);
+  if(gs_alloc_is_null(&alloc))
+  {
+    GSScratch block;
+    block.p_begin = NULL;
+    block.p_current = NULL;
+    block.p_end = NULL;
+    block.p_first = NULL;
+    block.p_chunk = NULL;
+    block.chunk_size = 0;
+    block.backing.alloc = NULL;
+    block.backing.free = NULL;
+    block.backing.user_data = NULL;
+    block.p_region = NULL;
+    block.p_mapping = NULL;
+    GS_STATS_UPDATE(block.chunk_offset = 0;)
+    GS_STATS_INIT(&block.stats)
+    GS_TRACE_UPDATE(block.trace_id = 0;)
+    block.valid = false;
+    return block;
+  }
+  return gs_scratch_init(gs_alloc_ptr(&alloc), size);
 }
-#endif
 
-#define GS_PERMA_ASSERT(_cond) \
-{\
-  if(!(_cond)) \
-  {\
-    printf("%s\n", #_cond);\
-    raise(SIGABRT);\
-  }\
+GS_MEM_ALLOC_VISIBILITY
+unsigned long long
+gs_atomic_scratch_usage(GSAtomicScratch* scratch)
+{
+  GS_ASSERT(scratch->valid && "GSAtomicScratch not properly initialized")
+  unsigned long long capacity = GS_PTR_DIFF(scratch->p_end, scratch->p_begin);
+  GS_MEM_ALLOC_PTR_NUMERIC_TYPE offset = GS_ATOMIC_LOAD(&scratch->offset);
+  return offset < capacity ? offset : capacity;
 }
 
-#ifdef __cplusplus
-extern "C" {
-#endif
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_atomic_scratch_flush(GSAtomicScratch* scratch)
+{
+  GS_ASSERT(scratch->valid && "GSAtomicScratch not properly initialized")
+  GS_ATOMIC_STORE(&scratch->offset, 0);
+}
 
-////////////////////////////////////////////////
-/////////////////// ALLOC //////////////////////
-////////////////////////////////////////////////
 GS_MEM_ALLOC_VISIBILITY
-bool
-gs_alloc_is_null(GSAlloc* alloc)
+GSAtomicScratchCheckpoint
+gs_atomic_scratch_checkpoint(GSAtomicScratch* scratch)
 {
-  alloc->checked = true;
-  return alloc->ptr == NULL;
+  // Failed pushes may have left the offset beyond the end, which is the same
+  // state as an exhausted scratch
+  GSAtomicScratchCheckpoint checkpoint;
+  checkpoint.offset = gs_atomic_scratch_usage(scratch);
+  return checkpoint;
 }
 
 GS_MEM_ALLOC_VISIBILITY
-void* 
-gs_alloc_ptr(GSAlloc* alloc)
+void
+gs_atomic_scratch_restore(GSAtomicScratch* scratch, 
+                          GSAtomicScratchCheckpoint checkpoint)
 {
-  GS_ASSERT(alloc->checked && "GSAlloc cannot get ptr of an unchecked alloc");
-  return alloc->ptr;
+  GS_ASSERT(scratch->valid && "GSAtomicScratch not properly initialized")
+  GS_ASSERT(checkpoint.offset <= GS_ATOMIC_LOAD(&scratch->offset) && 
+            "GSAtomicScratch cannot restore a checkpoint taken after a later flush or restore")
+  GS_ATOMIC_STORE(&scratch->offset, checkpoint.offset);
 }
 
 ////////////////////////////////////////////////
-////////////////// STACK ///////////////////////
+/////////////////// POOL CACHE /////////////////
 ////////////////////////////////////////////////
 
+#define GS_DEPOT_LOCK(depot)\
+  while(__atomic_exchange_n(&(depot)->lock, 1, __ATOMIC_ACQUIRE) != 0)\
+  {\
+    while(GS_ATOMIC_LOAD_RELAXED(&(depot)->lock) != 0);\
+  }
+
+#define GS_DEPOT_UNLOCK(depot)\
+  __atomic_store_n(&(depot)->lock, 0, __ATOMIC_RELEASE)
+
 GS_MEM_ALLOC_VISIBILITY
-GSStack
-gs_stack_init(void* mem_ptr, 
-              unsigned long long size)
+GSPoolDepot
+gs_pool_depot_init(GSPool* pool, 
+                   void* mem_ptr, 
+                   unsigned long long size, 
+                   unsigned int magazine_size)
 {
+  GS_ASSERT(pool != NULL && pool->valid && 
+            "GSPoolDepot pool must be a valid pool")
   GS_ASSERT(mem_ptr != NULL && 
-            "GSStack mem ptr cannot be NULL")
-  GSStack stack; 
-  stack.p_begin = mem_ptr;
-  stack.p_current = mem_ptr; 
-  stack.p_end = ((char*)mem_ptr)+size;
-  stack.valid = true;
-  return stack;
+            "GSPoolDepot mem ptr cannot be NULL")
+  GS_ASSERT(magazine_size > 0 && 
+            "GSPoolDepot magazine size must be greater than zero")
+
+  GSPoolDepot depot;
+  depot.pool = pool;
+  depot.p_full = NULL;
+  depot.p_empty = NULL;
+  depot.magazine_size = magazine_size;
+  depot.lock = 0;
+  depot.valid = false;
+
+  char* current = (char*)mem_ptr;
+  GS_ALIGN_PTR(current, GS_MEM_ALLOC_PTR_ALIGNMENT)
+  char* end = (char*)mem_ptr + size;
+  unsigned long long magazine_bytes = sizeof(GSMagazine) + magazine_size*sizeof(void*);
+  while(current + magazine_bytes <= end)
+  {
+    GSMagazine* magazine = (GSMagazine*)current;
+    magazine->p_blocks = (void**)(current + sizeof(GSMagazine));
+    magazine->count = 0;
+    magazine->p_next = depot.p_empty;
+    depot.p_empty = magazine;
+    current += magazine_bytes;
+  }
+  depot.valid = depot.p_empty != NULL;
+  return depot;
 }
 
 GS_MEM_ALLOC_VISIBILITY
-GSAlloc
-gs_stack_push(GSStack* stack, 
-                        unsigned long long size,
-                        unsigned int alignment)
+void
+gs_pool_depot_drain(GSPoolDepot* depot)
 {
-  GS_ASSERT(stack->valid == true && 
-            "GSStack cannot push an invalid stack mem alloc")
-
-  void* ret = stack->p_current;
-  GS_ALIGN_PTR(ret, alignment);
-
-  GS_ASSERT(((unsigned long long )ret) % alignment == 0 && 
-            "GSStack has a bug at computing a properly aligned address")
+  GS_ASSERT(depot->valid && "GSPoolDepot not properly initialized")
+  GS_DEPOT_LOCK(depot);
+  while(depot->p_full != NULL)
+  {
+    GSMagazine* magazine = depot->p_full;
+    depot->p_full = magazine->p_next;
+    for(unsigned int i = 0; i < magazine->count; ++i)
+    {
+      gs_pool_free(depot->pool, magazine->p_blocks[i]);
+    }
+    magazine->count = 0;
+    magazine->p_next = depot->p_empty;
+    depot->p_empty = magazine;
+  }
+  GS_DEPOT_UNLOCK(depot);
+}
 
+GS_MEM_ALLOC_VISIBILITY
+GSPoolCache
+gs_pool_cache_init(GSPoolDepot* depot)
+{
+  GS_ASSERT(depot->valid && "GSPoolDepot not properly initialized")
+  GSPoolCache cache;
+  cache.depot = depot;
+  cache.p_loaded = NULL;
+  cache.p_previous = NULL;
+  cache.valid = false;
+
+  GS_DEPOT_LOCK(depot);
+  if(depot->p_empty != NULL && depot->p_empty->p_next != NULL)
+  {
+    cache.p_loaded = depot->p_empty;
+    cache.p_previous = depot->p_empty->p_next;
+    depot->p_empty = cache.p_previous->p_next;
+    cache.valid = true;
+  }
+  GS_DEPOT_UNLOCK(depot);
+  return cache;
+}
 
-  char* new_current = ret+size;
-  GS_ALIGN_PTR(new_current, GS_MEM_ALLOC_PTR_ALIGNMENT);
-  new_current+=GS_MEM_ALLOC_PTR_ALIGNMENT;
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_pool_cache_release(GSPoolCache* cache)
+{
+  GS_ASSERT(cache->valid && "GSPoolCache not properly initialized")
+  GSPoolDepot* depot = cache->depot;
+  GSMagazine* magazines[2] = {cache->p_loaded, cache->p_previous};
+  GS_DEPOT_LOCK(depot);
+  for(int m = 0; m < 2; ++m)
+  {
+    GSMagazine* magazine = magazines[m];
+    for(unsigned int i = 0; i < magazine->count; ++i)
+    {
+      gs_pool_free(depot->pool, magazine->p_blocks[i]);
+    }
+    magazine->count = 0;
+    magazine->p_next = depot->p_empty;
+    depot->p_empty = magazine;
+  }
+  GS_DEPOT_UNLOCK(depot);
+  cache->p_loaded = NULL;
+  cache->p_previous = NULL;
+  cache->valid = false;
+}
 
-  if(new_current >= (char*)stack->p_end)
+GS_MEM_ALLOC_VISIBILITY
+GSAlloc
+gs_pool_cache_alloc(GSPoolCache* cache, 
+                    unsigned long long size, 
+                    unsigned int alignment)
+{
+  GS_ASSERT(cache->valid && "GSPoolCache cannot allocate from an invalid cache")
+  GS_ASSERT(cache->depot->pool->alignment == alignment && 
+            "GSPoolCache incompatible alignment in allocation ")
+  GS_ASSERT((cache->depot->pool->bsize == size || 
+            (size < sizeof(GS_MEM_ALLOC_PTR_NUMERIC_TYPE) && cache->depot->pool->bsize == sizeof(GS_MEM_ALLOC_PTR_NUMERIC_TYPE))) && 
+            "GSPoolCache incompatible size in allocation")
+
+  if(cache->p_loaded->count == 0)
   {
-    GSAlloc alloc;
-    alloc.ptr = NULL;
-    alloc.checked = false;
-    return alloc; 
+    if(cache->p_previous->count > 0)
+    {
+      GSMagazine* tmp = cache->p_loaded;
+      cache->p_loaded = cache->p_previous;
+      cache->p_previous = tmp;
+    }
+    else
+    {
+      GSPoolDepot* depot = cache->depot;
+      GS_DEPOT_LOCK(depot);
+      if(depot->p_full != NULL)
+      {
+        // Both magazines are empty, we exchange one of them by a full one
+        GSMagazine* full = depot->p_full;
+        depot->p_full = full->p_next;
+        cache->p_previous->p_next = depot->p_empty;
+        depot->p_empty = cache->p_previous;
+        cache->p_previous = cache->p_loaded;
+        cache->p_loaded = full;
+      }
+      else
+      {
+        // The depot has no blocks, we fill the magazine from the pool 
+        GSMagazine* magazine = cache->p_loaded;
+        while(magazine->count < depot->magazine_size)
+        {
+          GSAlloc alloc = gs_pool_alloc(depot->pool, depot->pool->bsize, depot->pool->alignment);
+          if(gs_alloc_is_null(&alloc))
+            break;
+          magazine->p_blocks[magazine->count++] = gs_alloc_ptr(&alloc);
+        }
+      }
+      GS_DEPOT_UNLOCK(depot);
+
+      if(cache->p_loaded->count == 0)
+      {
+        GSAlloc alloc;
+        alloc.ptr = NULL;
+        alloc.checked = false;
+        return alloc;
+      }
+    }
   }
 
-  GS_ASSERT(stack->p_current && "GSStack previous base cannot be set to NULL");
-  *(GS_MEM_ALLOC_PTR_NUMERIC_TYPE*)(new_current - GS_MEM_ALLOC_PTR_ALIGNMENT) = (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)stack->p_current;
-  stack->p_current = new_current; 
+  void* ret = cache->p_loaded->p_blocks[--cache->p_loaded->count];
 
 #ifdef GS_MEM_ALLOC_INITIALIZE_TO_ZERO
-  memset(ret, 0, size);
+  memset(ret, 0, cache->depot->pool->bsize);
 #endif
+
   GSAlloc alloc;
   alloc.ptr = ret;
   alloc.checked = false;
@@ -636,11 +7186,11 @@ gs_stack_push(GSStack* stack,
 
 GS_MEM_ALLOC_VISIBILITY
 void*
-gs_stack_push_CHECKED(GSStack* stack, 
-                        unsigned long long size,
-                        unsigned int alignment)
+gs_pool_cache_alloc_CHECKED(GSPoolCache* cache, 
+                            unsigned long long size, 
+                            unsigned int alignment)
 {
-  GSAlloc alloc = gs_stack_push(stack, size, alignment);
+  GSAlloc alloc = gs_pool_cache_alloc(cache, size, alignment);
 #ifndef GS_MEM_ALLOC_DISABLE_CHECKS
   GS_PERMA_ASSERT(!gs_alloc_is_null(&alloc));
 #else
@@ -650,61 +7200,332 @@ gs_stack_push_CHECKED(GSStack* stack,
 }
 
 GS_MEM_ALLOC_VISIBILITY
-GSAlloc
-gs_stack_push_all(GSStack* stack, 
-                            unsigned int alignment,
-                            unsigned long long* size)
+void 
+gs_pool_cache_free(GSPoolCache* cache, 
+                   void* ptr)
 {
+  GS_ASSERT(cache->valid && "GSPoolCache cannot free to an invalid cache")
+  GS_ASSERT(((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ptr % cache->depot->pool->alignment == 0) && "GSPoolCache this should not happen")
+  GS_ASSERT(((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ptr >= (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)cache->depot->pool->p_begin && (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ptr < (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)cache->depot->pool->p_end) && "GSPoolCache invalid freed ptr")
 
-  GS_ASSERT(stack->valid == true && 
-            "GSStack cannot push an invalid stack mem alloc")
+  GSPoolDepot* depot = cache->depot;
+  if(cache->p_loaded->count == depot->magazine_size)
+  {
+    if(cache->p_previous->count < depot->magazine_size)
+    {
+      GSMagazine* tmp = cache->p_loaded;
+      cache->p_loaded = cache->p_previous;
+      cache->p_previous = tmp;
+    }
+    else
+    {
+      GS_DEPOT_LOCK(depot);
+      if(depot->p_empty != NULL)
+      {
+        // Both magazines are full, we exchange one of them by an empty one
+        GSMagazine* empty = depot->p_empty;
+        depot->p_empty = empty->p_next;
+        cache->p_previous->p_next = depot->p_full;
+        depot->p_full = cache->p_previous;
+        cache->p_previous = cache->p_loaded;
+        cache->p_loaded = empty;
+      }
+      else
+      {
+        // The depot has no room, we return the blocks to the pool
+        GSMagazine* magazine = cache->p_loaded;
+        for(unsigned int i = 0; i < magazine->count; ++i)
+        {
+          gs_pool_free(depot->pool, magazine->p_blocks[i]);
+        }
+        magazine->count = 0;
+      }
+      GS_DEPOT_UNLOCK(depot);
+    }
+  }
 
-  void* ret = stack->p_current;
-  GS_ALIGN_PTR(ret, alignment)
+  cache->p_loaded->p_blocks[cache->p_loaded->count++] = ptr;
+}
 
-  GS_ASSERT(((unsigned long long )ret) % alignment == 0 && 
-            "GSStack has a bug at computing a properly aligned address")
+////////////////////////////////////////////////
+/////////////////// SLAB POOL //////////////////
+////////////////////////////////////////////////
 
-  char* new_current = stack->p_end;
-  new_current -= GS_MEM_ALLOC_PTR_ALIGNMENT;
+GS_MEM_ALLOC_VISIBILITY
+GSSlabPool
+gs_slab_pool_init(unsigned long long bsize, 
+                  unsigned int alignment, 
+                  unsigned long long slab_size, 
+                  unsigned int max_empty_slabs, 
+                  GSChunkBacking backing)
+{
+  GS_ASSERT(backing.alloc != NULL && 
+            "GSSlabPool backing alloc cannot be NULL")
 
-  // We need to ensure that the previous base address is aligned to
-  // GS_PTR_ALINGMENT
-  int prev_base_slack = ((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)new_current % GS_MEM_ALLOC_PTR_ALIGNMENT);
-  if(prev_base_slack != GS_MEM_ALLOC_PTR_ALIGNMENT)
+  GSSlabPool pool;
+  pool.bsize = bsize < sizeof(GS_MEM_ALLOC_PTR_NUMERIC_TYPE) ? sizeof(GS_MEM_ALLOC_PTR_NUMERIC_TYPE) : bsize;
+  pool.alignment = alignment;
+  pool.stride = gs_pool_stride(pool.bsize, alignment);
+  pool.slab_size = slab_size;
+  pool.blocks_per_slab = 0;
+  pool.first_block_offset = (unsigned int)GS_ALIGN_ADDRESS(sizeof(GSSlab), alignment);
+  pool.color_step = alignment > GS_MEM_ALLOC_CACHE_LINE_SIZE ? alignment : GS_MEM_ALLOC_CACHE_LINE_SIZE;
+  pool.num_colors = 1;
+  pool.next_color = 0;
+  pool.p_current = NULL;
+  pool.p_partial = NULL;
+  pool.p_full = NULL;
+  pool.p_empty = NULL;
+  pool.num_slabs = 0;
+  pool.num_empty = 0;
+  pool.max_empty_slabs = max_empty_slabs;
+  pool.backing = backing;
+  pool.valid = false;
+
+  if(slab_size == 0 || (slab_size & (slab_size - 1)) != 0 || 
+     pool.first_block_offset + pool.stride > slab_size)
   {
-    new_current -= prev_base_slack;
+    return pool;
   }
 
-  if(new_current >= (char*)stack->p_end)
+  // The space left after the blocks of a slab is used to shift the blocks of
+  // the slab, so all slabs fit the same number of blocks
+  pool.blocks_per_slab = (unsigned int)((slab_size - pool.first_block_offset) / pool.stride);
+  unsigned long long slack = slab_size - pool.first_block_offset - pool.blocks_per_slab*pool.stride;
+  pool.num_colors = (unsigned int)(slack / pool.color_step) + 1;
+  pool.valid = true;
+  return pool;
+}
+
+static void
+gs_slab_list_push(GSSlab** list, 
+                  GSSlab* slab)
+{
+  slab->p_prev = NULL;
+  slab->p_next = *list;
+  if(*list != NULL)
   {
-    GSAlloc alloc;
-    alloc.ptr = NULL;
-    alloc.checked = false;
-    return alloc;
+    (*list)->p_prev = slab;
   }
+  *list = slab;
+}
 
-  GS_ASSERT(stack->p_current && "GSStack previous base cannot be set to NULL");
-  *(GS_MEM_ALLOC_PTR_NUMERIC_TYPE*)(new_current) = (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)stack->p_current;
-  *size = GS_PTR_DIFF(new_current, ret);
-  stack->p_current = new_current + GS_MEM_ALLOC_PTR_ALIGNMENT; 
+static void
+gs_slab_list_remove(GSSlab** list, 
+                    GSSlab* slab)
+{
+  if(slab->p_prev != NULL)
+  {
+    slab->p_prev->p_next = slab->p_next;
+  }
+  else
+  {
+    *list = slab->p_next;
+  }
+  if(slab->p_next != NULL)
+  {
+    slab->p_next->p_prev = slab->p_prev;
+  }
+}
+
+// Sets a slab as if none of its blocks had been allocated
+static void
+gs_slab_reset(GSSlabPool* pool, 
+              GSSlab* slab)
+{
+  slab->p_next_free = NULL;
+  slab->p_carve = (char*)slab + pool->first_block_offset + slab->color;
+  slab->num_live = 0;
+}
+
+// Keeps a slab without live blocks, which is in no list, as empty, or releases
+// it to the backing if there are already max_empty_slabs empty slabs. Slabs 
+// are always kept if the backing cannot release them
+static void
+gs_slab_pool_retire(GSSlabPool* pool, 
+                    GSSlab* slab)
+{
+  if(pool->num_empty < pool->max_empty_slabs || pool->backing.free == NULL)
+  {
+    gs_slab_reset(pool, slab);
+    gs_slab_list_push(&pool->p_empty, slab);
+    pool->num_empty++;
+    return;
+  }
+  pool->backing.free(pool->backing.user_data, slab, pool->slab_size);
+  pool->num_slabs--;
+}
+
+// Replaces the current slab, which is full, by the fullest partial slab, an
+// empty slab or a new slab acquired from the backing, in this order. Partial
+// slabs are scanned, which only happens once every time a slab fills up.
+// Returns false if no slab can be acquired
+static bool
+gs_slab_pool_next_slab(GSSlabPool* pool)
+{
+  if(pool->p_current != NULL)
+  {
+    gs_slab_list_push(&pool->p_full, pool->p_current);
+    pool->p_current = NULL;
+  }
+
+  GSSlab* fullest = pool->p_partial;
+  for(GSSlab* slab = pool->p_partial; slab != NULL; slab = slab->p_next)
+  {
+    if(slab->num_live > fullest->num_live)
+    {
+      fullest = slab;
+    }
+  }
+  if(fullest != NULL)
+  {
+    gs_slab_list_remove(&pool->p_partial, fullest);
+    pool->p_current = fullest;
+    return true;
+  }
+
+  if(pool->p_empty != NULL)
+  {
+    GSSlab* slab = pool->p_empty;
+    gs_slab_list_remove(&pool->p_empty, slab);
+    pool->num_empty--;
+    pool->p_current = slab;
+    return true;
+  }
+
+  void* ptr = pool->backing.alloc(pool->backing.user_data, pool->slab_size);
+  if(ptr == NULL)
+  {
+    return false;
+  }
+  GS_ASSERT(((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ptr & (pool->slab_size - 1)) == 0 && 
+            "GSSlabPool slabs must be aligned to the slab size")
+  GSSlab* slab = (GSSlab*)ptr;
+  slab->p_prev = NULL;
+  slab->p_next = NULL;
+  slab->color = (pool->next_color++ % pool->num_colors)*pool->color_step;
+  gs_slab_reset(pool, slab);
+  pool->num_slabs++;
+  pool->p_current = slab;
+  return true;
+}
+
+// Releases all the slabs of a list to the backing
+static void
+gs_slab_list_release(GSSlabPool* pool, 
+                     GSSlab* list)
+{
+  while(list != NULL)
+  {
+    GSSlab* next = list->p_next;
+    if(pool->backing.free != NULL)
+    {
+      pool->backing.free(pool->backing.user_data, list, pool->slab_size);
+    }
+    list = next;
+  }
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_slab_pool_release(GSSlabPool* pool)
+{
+  GS_ASSERT(pool->valid && "GSSlabPool cannot release an invalid pool")
+  if(pool->p_current != NULL)
+  {
+    pool->p_current->p_next = NULL;
+    gs_slab_list_release(pool, pool->p_current);
+  }
+  gs_slab_list_release(pool, pool->p_partial);
+  gs_slab_list_release(pool, pool->p_full);
+  gs_slab_list_release(pool, pool->p_empty);
+  pool->p_current = NULL;
+  pool->p_partial = NULL;
+  pool->p_full = NULL;
+  pool->p_empty = NULL;
+  pool->num_slabs = 0;
+  pool->num_empty = 0;
+  pool->valid = false;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_slab_pool_flush(GSSlabPool* pool)
+{
+  GS_ASSERT(pool->valid && "GSSlabPool cannot flush an invalid pool")
+  GSSlab* lists[2] = {pool->p_partial, pool->p_full};
+  pool->p_partial = NULL;
+  pool->p_full = NULL;
+  if(pool->p_current != NULL)
+  {
+    gs_slab_pool_retire(pool, pool->p_current);
+    pool->p_current = NULL;
+  }
+  for(int i = 0; i < 2; ++i)
+  {
+    GSSlab* slab = lists[i];
+    while(slab != NULL)
+    {
+      GSSlab* next = slab->p_next;
+      gs_slab_pool_retire(pool, slab);
+      slab = next;
+    }
+  }
+}
+
+GS_MEM_ALLOC_VISIBILITY
+GSAlloc
+gs_slab_pool_alloc(GSSlabPool* pool, 
+                   unsigned long long size, 
+                   unsigned int alignment)
+{
+  GS_ASSERT(pool->valid && "GSSlabPool cannot allocate from an invalid pool")
+  GS_ASSERT(pool->alignment == alignment && 
+            "GSSlabPool incompatible alignment in allocation ")
+  GS_ASSERT((pool->bsize == size || 
+            (size < sizeof(GS_MEM_ALLOC_PTR_NUMERIC_TYPE) && pool->bsize == sizeof(GS_MEM_ALLOC_PTR_NUMERIC_TYPE))) && 
+            "GSSlabPool incompatible size in allocation")
+
+  GSAlloc alloc;
+  alloc.checked = false;
+  alloc.ptr = NULL;
+  GSSlab* slab = pool->p_current;
+  if(slab == NULL || slab->num_live == pool->blocks_per_slab)
+  {
+    if(!gs_slab_pool_next_slab(pool))
+    {
+      return alloc;
+    }
+    slab = pool->p_current;
+  }
+
+  char* ret = (char*)slab->p_next_free;
+  if(ret != NULL)
+  {
+    slab->p_next_free = (void*)*(GS_MEM_ALLOC_PTR_NUMERIC_TYPE*)ret;
+  }
+  else
+  {
+    ret = slab->p_carve;
+    slab->p_carve += pool->stride;
+  }
+  slab->num_live++;
 
 #ifdef GS_MEM_ALLOC_INITIALIZE_TO_ZERO
-  memset(ret, 0, *size);
+  memset(ret, 0, pool->bsize);
 #endif
-  GSAlloc alloc;
+
   alloc.ptr = ret;
-  alloc.checked = false;
   return alloc;
 }
 
 GS_MEM_ALLOC_VISIBILITY
 void*
-gs_stack_push_all_CHECKED(GSStack* stack, 
-                            unsigned int alignment,
-                            unsigned long long* size)
+gs_slab_pool_alloc_CHECKED(GSSlabPool* pool, 
+                           unsigned long long size, 
+                           unsigned int alignment)
 {
-  GSAlloc alloc = gs_stack_push_all(stack, alignment, size);
+  GSAlloc alloc = gs_slab_pool_alloc(pool, size, alignment);
 #ifndef GS_MEM_ALLOC_DISABLE_CHECKS
   GS_PERMA_ASSERT(!gs_alloc_is_null(&alloc));
 #else
@@ -715,144 +7536,222 @@ gs_stack_push_all_CHECKED(GSStack* stack,
 
 GS_MEM_ALLOC_VISIBILITY
 void
-gs_stack_pop(GSStack* stack, 
-                   void* ptr)
+gs_slab_pool_free(GSSlabPool* pool, 
+                  void* ptr)
 {
-  void* prev_stack_base = stack->p_begin;
-  if(stack->p_current != stack->p_begin)
+  GS_ASSERT(pool->valid && "GSSlabPool cannot free to an invalid pool")
+  GSSlab* slab = (GSSlab*)((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ptr & ~((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)pool->slab_size - 1));
+  GS_ASSERT(((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ptr % pool->alignment == 0) && "GSSlabPool this should not happen")
+  GS_ASSERT(((char*)ptr >= (char*)slab + pool->first_block_offset + slab->color && (char*)ptr < slab->p_carve && slab->num_live > 0) && 
+            "GSSlabPool invalid freed ptr")
+
+  *(GS_MEM_ALLOC_PTR_NUMERIC_TYPE*)ptr = (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)slab->p_next_free;
+  slab->p_next_free = ptr;
+  slab->num_live--;
+  if(slab == pool->p_current)
   {
-    prev_stack_base = (void*)(*(unsigned long long *)(((char*)stack->p_current) - GS_MEM_ALLOC_PTR_ALIGNMENT));
+    return;
   }
-  
-  GS_ASSERT(prev_stack_base <= ptr && 
-            "GSStack cannot pop from this address.\
-            Popping must be performed in reverse order of push");
-  GS_ASSERT(prev_stack_base && "Stack previous memory address cannot be null");
 
-  stack->p_current = prev_stack_base;
-}
+  if(slab->num_live + 1 == pool->blocks_per_slab)
+  {
+    gs_slab_list_remove(&pool->p_full, slab);
+    if(slab->num_live > 0)
+    {
+      gs_slab_list_push(&pool->p_partial, slab);
+    }
+  }
+  else if(slab->num_live == 0)
+  {
+    gs_slab_list_remove(&pool->p_partial, slab);
+  }
 
-GS_MEM_ALLOC_VISIBILITY
-void
-gs_stack_flush(GSStack* stack)
-{
-  GS_ASSERT(stack->valid == true && 
-            "GSStack cannot flush an invalid stack mem alloc")
-  stack->p_current = stack->p_begin;
+  if(slab->num_live == 0)
+  {
+    gs_slab_pool_retire(pool, slab);
+  }
 }
 
 ////////////////////////////////////////////////
-////////////////// SCRATCH  ////////////////////
+/////////////////// SIZE CLASS /////////////////
 ////////////////////////////////////////////////
 
-GS_MEM_ALLOC_VISIBILITY
-GSScratch
-gs_scratch_init(void* base_addr, 
-                unsigned long long size)
+static const unsigned int gs_size_class_sizes[GS_SIZE_CLASS_COUNT] = 
 {
-  GS_ASSERT(base_addr != NULL && 
-            "GSScratch base addr cannot be NULL")
-  GS_ASSERT(((unsigned long long)base_addr % GS_MEM_ALLOC_MIN_ALIGNMENT) == 0 && 
-            "GSScratch mem ptr must be aligned to GS_MIN_ALINGMENT")
+  8, 16, 32, 48, 64, 80, 96, 112, 128,
+  160, 192, 224, 256,
+  320, 384, 448, 512,
+  640, 768, 896, 1024,
+  1280, 1536, 1792, 2048,
+  2560, 3072, 3584, 4096
+};
+
+// Header stored right before the allocations forwarded to the fallback 
+typedef struct GSSizeClassLargeHeader
+{
+  void*              p_chunk;
+  unsigned long long size;
+} GSSizeClassLargeHeader;
 
-  GSScratch scratch;
-  scratch.p_begin = base_addr; 
-  scratch.p_current = base_addr;
-  scratch.p_end = (char*)base_addr + size;
-  scratch.valid = true;
-  return scratch;
+GS_MEM_ALLOC_VISIBILITY
+GSSizeClassAllocator
+gs_size_class_init(void* mem_ptr, 
+                   unsigned long long size, 
+                   GSChunkBacking fallback)
+{
+  GS_ASSERT(mem_ptr != NULL && 
+            "GSSizeClassAllocator mem ptr cannot be NULL")
+  GS_ASSERT((GS_MEM_ALLOC_SIZE_CLASS_PAGE_SIZE & (GS_MEM_ALLOC_SIZE_CLASS_PAGE_SIZE - 1)) == 0 && 
+            GS_MEM_ALLOC_SIZE_CLASS_PAGE_SIZE >= 2*GS_SIZE_CLASS_MAX_SIZE && 
+            "GSSizeClassAllocator page size must be a power of two of at least twice the largest class")
+
+  GSSizeClassAllocator allocator;
+  allocator.fallback = fallback;
+
+  // The page table is placed at the beginning of the region, followed by the
+  // pages aligned to the page size
+  unsigned long long max_pages = size / GS_MEM_ALLOC_SIZE_CLASS_PAGE_SIZE;
+  allocator.p_page_classes = (unsigned char*)mem_ptr;
+  char* begin = (char*)mem_ptr + max_pages;
+  GS_ALIGN_PTR(begin, GS_MEM_ALLOC_SIZE_CLASS_PAGE_SIZE)
+  char* end = (char*)mem_ptr + size;
+  unsigned long long num_pages = begin < end ? (GS_PTR_DIFF(end, begin)) / GS_MEM_ALLOC_SIZE_CLASS_PAGE_SIZE : 0;
+  allocator.p_begin = begin;
+  allocator.p_end = begin + num_pages*GS_MEM_ALLOC_SIZE_CLASS_PAGE_SIZE;
+
+  unsigned int next_class = 0;
+  for(unsigned int i = 0; i <= GS_SIZE_CLASS_MAX_SIZE / 16; ++i)
+  {
+    while(gs_size_class_sizes[next_class] < i*16)
+    {
+      next_class++;
+    }
+    allocator.class_lookup[i] = next_class;
+  }
+  // size 0 is served by the 16 bytes class, sizes up to 8 are special cased
+  allocator.class_lookup[0] = 1;
+
+  allocator.valid = true;
+  gs_size_class_flush(&allocator);
+  return allocator;
 }
 
 GS_MEM_ALLOC_VISIBILITY
-GSAlloc
-gs_scratch_push(GSScratch* scratch, 
-                 unsigned long long size, 
-                 unsigned int alignment)
+void
+gs_size_class_flush(GSSizeClassAllocator* allocator)
 {
-  GS_ASSERT(scratch->valid && "GSScratch not properly initialized")
-  void* ret = scratch->p_current;
-  GS_ALIGN_PTR(ret, alignment)
+  GS_ASSERT(allocator->valid && 
+            "GSSizeClassAllocator cannot flush an invalid allocator")
+  allocator->p_next_page = allocator->p_begin;
+  unsigned long long num_pages = (GS_PTR_DIFF(allocator->p_end, allocator->p_begin)) / GS_MEM_ALLOC_SIZE_CLASS_PAGE_SIZE;
+  for(unsigned long long i = 0; i < num_pages; ++i)
+  {
+    allocator->p_page_classes[i] = 0;
+  }
+  for(unsigned int i = 0; i < GS_SIZE_CLASS_COUNT; ++i)
+  {
+    allocator->pools[i].valid = false;
+    allocator->pools[i].p_next_free = NULL;
+    GS_STATS_INIT(&allocator->pools[i].stats)
+  }
+}
 
-  GS_ASSERT(((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ret) % alignment == 0 && 
-            "GSScrachMemAlloc aligned address is not correclty computed")
+// Forwards an allocation to the fallback, prepending a header to recognize it
+// on free
+static GSAlloc
+gs_size_class_alloc_large(GSSizeClassAllocator* allocator, 
+                          unsigned long long size, 
+                          unsigned int alignment)
+{
+  GSAlloc alloc;
+  alloc.ptr = NULL;
+  alloc.checked = false;
+  if(allocator->fallback.alloc == NULL)
+  {
+    return alloc;
+  }
 
-  char* new_current = ((char*)ret) + size;
-  if(new_current >= (char*)scratch->p_end)
+  if(alignment < GS_MEM_ALLOC_MIN_ALIGNMENT)
+  {
+    alignment = GS_MEM_ALLOC_MIN_ALIGNMENT;
+  }
+  unsigned long long chunk_size = size + alignment + sizeof(GSSizeClassLargeHeader);
+  char* chunk = (char*)allocator->fallback.alloc(allocator->fallback.user_data, chunk_size);
+  if(chunk == NULL)
   {
-    GSAlloc alloc;
-    alloc.ptr = NULL;
-    alloc.checked = false;
     return alloc;
   }
-  scratch->p_current = new_current;
+
+  char* ret = chunk + sizeof(GSSizeClassLargeHeader);
+  GS_ALIGN_PTR(ret, alignment)
+  GSSizeClassLargeHeader* header = ((GSSizeClassLargeHeader*)ret) - 1;
+  header->p_chunk = chunk;
+  header->size = chunk_size;
 
 #ifdef GS_MEM_ALLOC_INITIALIZE_TO_ZERO
   memset(ret, 0, size);
 #endif
-  GSAlloc alloc;
   alloc.ptr = ret;
-  alloc.checked = false;
   return alloc;
 }
 
-GS_MEM_ALLOC_VISIBILITY
-void*
-gs_scratch_push_CHECKED(GSScratch* scratch, 
-                         unsigned long long size, 
-                         unsigned int alignment)
-{
-  GSAlloc alloc = gs_scratch_push(scratch, size, alignment);
-#ifndef GS_MEM_ALLOC_DISABLE_CHECKS
-  GS_PERMA_ASSERT(!gs_alloc_is_null(&alloc));
-#else
-  alloc.checked = true;
-#endif
-  return gs_alloc_ptr(&alloc);
-}
-
 GS_MEM_ALLOC_VISIBILITY
 GSAlloc
-gs_scratch_push_all(GSScratch* scratch, 
-                     unsigned int alignment,
-                     unsigned long long* size)
+gs_size_class_alloc(GSSizeClassAllocator* allocator, 
+                    unsigned long long size, 
+                    unsigned int alignment)
 {
-  GS_ASSERT(scratch->valid && "GSScratch not properly initialized")
-  void* ret = scratch->p_current;
-  GS_ALIGN_PTR(ret, alignment);
-
-  GS_ASSERT(((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ret) % alignment == 0 && 
-            "GSScrachMemAlloc aligned address is not correclty computed")
+  GS_ASSERT(allocator->valid && 
+            "GSSizeClassAllocator cannot allocate from an invalid allocator")
 
-  if((char*)ret >= (char*)scratch->p_end)
+  if(size > GS_SIZE_CLASS_MAX_SIZE || alignment > GS_MEM_ALLOC_MIN_ALIGNMENT)
   {
-    GSAlloc alloc;
-    alloc.ptr = NULL;
-    alloc.checked = false;
-    return alloc;
+    return gs_size_class_alloc_large(allocator, size, alignment);
   }
 
-  *size = ((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)scratch->p_end) - ((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ret);
-  scratch->p_current = scratch->p_end;
+  unsigned int size_class = (size <= 8 && alignment <= 8) ? 0 : allocator->class_lookup[(size + 15) >> 4];
+  GSPool* pool = &allocator->pools[size_class];
+  if(pool->valid)
+  {
+    GSAlloc alloc = gs_pool_alloc(pool, pool->bsize, pool->alignment);
+    if(!gs_alloc_is_null(&alloc))
+    {
+      alloc.checked = false;
+      return alloc;
+    }
+  }
 
-#ifdef GS_MEM_ALLOC_INITIALIZE_TO_ZERO
-  memset(ret, 0, *size);
-#endif
-  GSAlloc alloc;
-  alloc.ptr = ret;
-  alloc.checked = false;
-  return alloc;
+  // The last page of the class is exhausted, a new one is assigned to it. The
+  // free list of the class is shared by all its pages
+  if((char*)allocator->p_next_page >= (char*)allocator->p_end)
+  {
+    return gs_size_class_alloc_large(allocator, size, alignment);
+  }
+  char* page = (char*)allocator->p_next_page;
+  allocator->p_next_page = page + GS_MEM_ALLOC_SIZE_CLASS_PAGE_SIZE;
+  allocator->p_page_classes[(GS_PTR_DIFF(page, allocator->p_begin)) / GS_MEM_ALLOC_SIZE_CLASS_PAGE_SIZE] = size_class + 1;
+
+  void* next_free = pool->p_next_free;
+  GS_STATS_UPDATE(GSAllocStats stats = pool->stats;)
+  *pool = gs_pool_init(page, 
+                       GS_MEM_ALLOC_SIZE_CLASS_PAGE_SIZE, 
+                       gs_size_class_sizes[size_class], 
+                       size_class == 0 ? 8 : GS_MEM_ALLOC_MIN_ALIGNMENT);
+  pool->p_next_free = next_free;
+  GS_STATS_UPDATE(pool->stats = stats;)
+  return gs_pool_alloc(pool, pool->bsize, pool->alignment);
 }
 
 GS_MEM_ALLOC_VISIBILITY
 void*
-gs_scratch_push_all_CHECKED(GSScratch* scratch, 
-                             unsigned int alignment,
-                             unsigned long long* size)
+gs_size_class_alloc_CHECKED(GSSizeClassAllocator* allocator, 
+                            unsigned long long size, 
+                            unsigned int alignment)
 {
-  GSAlloc alloc = gs_scratch_push_all(scratch, alignment, size);
+  GSAlloc alloc = gs_size_class_alloc(allocator, size, alignment);
 #ifndef GS_MEM_ALLOC_DISABLE_CHECKS
   GS_PERMA_ASSERT(!gs_alloc_is_null(&alloc));
-#else 
+#else
   alloc.checked = true;
 #endif
   return gs_alloc_ptr(&alloc);
@@ -860,122 +7759,342 @@ gs_scratch_push_all_CHECKED(GSScratch* scratch,
 
 GS_MEM_ALLOC_VISIBILITY
 void
-gs_scratch_flush(GSScratch* scratch)
+gs_size_class_free(GSSizeClassAllocator* allocator, 
+                   void* ptr)
 {
-  GS_ASSERT(scratch->valid && "GSScratch not properly initialized")
-  scratch->p_current = scratch->p_begin;
-}
+  GS_ASSERT(allocator->valid && 
+            "GSSizeClassAllocator cannot free to an invalid allocator")
+
+  if((char*)ptr < (char*)allocator->p_begin || (char*)ptr >= (char*)allocator->p_end)
+  {
+    GSSizeClassLargeHeader* header = ((GSSizeClassLargeHeader*)ptr) - 1;
+    if(allocator->fallback.free != NULL)
+    {
+      allocator->fallback.free(allocator->fallback.user_data, header->p_chunk, header->size);
+    }
+    return;
+  }
 
+  unsigned char page_class = allocator->p_page_classes[(GS_PTR_DIFF(ptr, allocator->p_begin)) / GS_MEM_ALLOC_SIZE_CLASS_PAGE_SIZE];
+  GS_ASSERT(page_class != 0 && 
+            "GSSizeClassAllocator freed ptr belongs to an unassigned page")
+
+  // Blocks can belong to any page of the class, not only the one the pool is
+  // bound to, thus they are pushed directly to the free list of the class
+  GSPool* pool = &allocator->pools[page_class - 1];
+  *(GS_MEM_ALLOC_PTR_NUMERIC_TYPE*)ptr = (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)pool->p_next_free;
+  pool->p_next_free = ptr;
+  GS_STATS_FREE(&pool->stats, 1)
+  GS_STATS_UPDATE(pool->stats.live_blocks--;)
+  GS_STATS_UPDATE(pool->stats.free_list_length++;)
+}
 
 ////////////////////////////////////////////////
-/////////////////// POOL ///////////////////////
+/////////////////// TLSF ///////////////////////
 ////////////////////////////////////////////////
 
+#define GS_TLSF_BLOCK_FREE                  0x1ull
+#define GS_TLSF_BLOCK_PREV_FREE             0x2ull
+#define GS_TLSF_BLOCK_FLAGS                 (GS_TLSF_BLOCK_FREE | GS_TLSF_BLOCK_PREV_FREE)
+#define GS_TLSF_ALIGNMENT                   (1ull << GS_TLSF_ALIGN_LOG2)
+#define GS_TLSF_HEADER_SIZE                 (2*sizeof(void*))
+#define GS_TLSF_MIN_PAYLOAD                 (2*sizeof(void*))
+#define GS_TLSF_MIN_BLOCK                   (GS_TLSF_HEADER_SIZE + GS_TLSF_MIN_PAYLOAD)
+#define GS_TLSF_MAX_BLOCK                   (1ull << (GS_TLSF_FL_SHIFT + GS_TLSF_FL_COUNT - 1))
+
+#define GS_TLSF_BLOCK_SIZE(_block)          ((_block)->size & ~GS_TLSF_BLOCK_FLAGS)
+#define GS_TLSF_BLOCK_PAYLOAD(_block)       ((char*)(_block) + GS_TLSF_HEADER_SIZE)
+#define GS_TLSF_BLOCK_FROM_PAYLOAD(_ptr)    ((GSTlsfBlock*)((char*)(_ptr) - GS_TLSF_HEADER_SIZE))
+#define GS_TLSF_BLOCK_NEXT(_block)          ((GSTlsfBlock*)(GS_TLSF_BLOCK_PAYLOAD(_block) + GS_TLSF_BLOCK_SIZE(_block)))
+
+static inline unsigned int
+gs_tlsf_msb(unsigned long long value)
+{
+  return 63 - __builtin_clzll(value);
+}
 
-GS_MEM_ALLOC_VISIBILITY
-GSPool
-gs_pool_init(void* mem_ptr, 
-                       unsigned long long size, 
-                       unsigned long long bsize, 
-                       unsigned int alignment)
+// Computes the free list indices where a block of the given size is stored
+static inline void
+gs_tlsf_mapping(unsigned long long size, 
+                unsigned int* fl, 
+                unsigned int* sl)
 {
-  GS_ASSERT(mem_ptr != NULL && 
-            "GSPool mem ptr cannot be NULL")
+  if(size < (1ull << GS_TLSF_FL_SHIFT))
+  {
+    *fl = 0;
+    *sl = (unsigned int)(size >> GS_TLSF_ALIGN_LOG2);
+  }
+  else
+  {
+    unsigned int msb = gs_tlsf_msb(size);
+    *fl = msb - GS_TLSF_FL_SHIFT + 1;
+    *sl = (unsigned int)(size >> (msb - GS_TLSF_SL_LOG2)) ^ GS_TLSF_SL_COUNT;
+  }
+}
 
-  GSPool pool;
-  pool.p_begin = mem_ptr;
-  pool.p_end = (char*)mem_ptr + size; 
-  pool.bsize = bsize; 
-  pool.alignment = alignment;
-  pool.p_next_free = NULL;
+static inline void
+gs_tlsf_insert_block(GSTlsfControl* control, 
+                     GSTlsfBlock* block)
+{
+  unsigned int fl, sl;
+  gs_tlsf_mapping(GS_TLSF_BLOCK_SIZE(block), &fl, &sl);
+  GSTlsfBlock* head = control->blocks[fl][sl];
+  block->p_next_free = head;
+  block->p_prev_free = NULL;
+  if(head != NULL)
+  {
+    head->p_prev_free = block;
+  }
+  control->blocks[fl][sl] = block;
+  control->fl_bitmap |= 1u << fl;
+  control->sl_bitmap[fl] |= 1u << sl;
+}
 
-  if(pool.bsize < sizeof(GS_MEM_ALLOC_PTR_NUMERIC_TYPE))
+static inline void
+gs_tlsf_remove_block(GSTlsfControl* control, 
+                     GSTlsfBlock* block)
+{
+  unsigned int fl, sl;
+  gs_tlsf_mapping(GS_TLSF_BLOCK_SIZE(block), &fl, &sl);
+  if(block->p_prev_free != NULL)
   {
-    pool.bsize = sizeof(GS_MEM_ALLOC_PTR_NUMERIC_TYPE);
+    block->p_prev_free->p_next_free = block->p_next_free;
   }
-  GS_ALIGN_PTR(pool.p_begin, alignment)
+  else
+  {
+    control->blocks[fl][sl] = block->p_next_free;
+    if(block->p_next_free == NULL)
+    {
+      control->sl_bitmap[fl] &= ~(1u << sl);
+      if(control->sl_bitmap[fl] == 0)
+      {
+        control->fl_bitmap &= ~(1u << fl);
+      }
+    }
+  }
+  if(block->p_next_free != NULL)
+  {
+    block->p_next_free->p_prev_free = block->p_prev_free;
+  }
+}
 
-  pool.p_current = pool.p_begin;
-  pool.stride = bsize;
-  unsigned int modulo = bsize & (alignment-1);
-  if(modulo != 0)
+// Marks a block as free or used, updating the flags of the next physical block
+static inline void
+gs_tlsf_set_free(GSTlsfBlock* block, 
+                 bool free)
+{
+  GSTlsfBlock* next = GS_TLSF_BLOCK_NEXT(block);
+  if(free)
   {
-    pool.stride += alignment - modulo;
+    block->size |= GS_TLSF_BLOCK_FREE;
+    next->size |= GS_TLSF_BLOCK_PREV_FREE;
+    next->p_prev_phys = block;
+  }
+  else
+  {
+    block->size &= ~GS_TLSF_BLOCK_FREE;
+    next->size &= ~GS_TLSF_BLOCK_PREV_FREE;
   }
-  pool.valid = true;
-  return pool;
 }
 
+// Splits the block so that its payload has the given size, returning the
+// remainder, or NULL if the remainder would be smaller than a block
+static inline GSTlsfBlock*
+gs_tlsf_split(GSTlsfBlock* block, 
+              unsigned long long size)
+{
+  unsigned long long block_size = GS_TLSF_BLOCK_SIZE(block);
+  if(block_size < size + GS_TLSF_MIN_BLOCK)
+  {
+    return NULL;
+  }
+  GSTlsfBlock* remainder = (GSTlsfBlock*)(GS_TLSF_BLOCK_PAYLOAD(block) + size);
+  remainder->size = block_size - size - GS_TLSF_HEADER_SIZE;
+  block->size = size | (block->size & GS_TLSF_BLOCK_FLAGS);
+  return remainder;
+}
 
 GS_MEM_ALLOC_VISIBILITY
-void
-gs_pool_flush(GSPool* pool)
+GSTlsf
+gs_tlsf_init(void* mem_ptr, 
+             unsigned long long size)
 {
-  GS_ASSERT(pool->valid == true && 
-            "GSPool cannot flush an invalid pool mem alloc")
-  pool->p_current = pool->p_begin;
+  GS_ASSERT(mem_ptr != NULL && 
+            "GSTlsf mem ptr cannot be NULL")
+
+  GSTlsf tlsf;
+  tlsf.valid = false;
+  char* control = (char*)mem_ptr;
+  GS_ALIGN_PTR(control, GS_MEM_ALLOC_PTR_ALIGNMENT)
+  char* begin = control + sizeof(GSTlsfControl);
+  GS_ALIGN_PTR(begin, GS_TLSF_ALIGNMENT)
+  char* end = (char*)mem_ptr + size;
+  end = (char*)((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)end & ~(GS_TLSF_ALIGNMENT - 1));
+  tlsf.p_control = (GSTlsfControl*)control;
+  tlsf.p_begin = begin;
+  tlsf.p_end = end;
+
+  // The region must hold at least a block and the sentinel header
+  if(end < begin + GS_TLSF_MIN_BLOCK + GS_TLSF_HEADER_SIZE)
+  {
+    return tlsf;
+  }
+
+  // Blocks larger than the largest size class are not supported
+  if((GS_PTR_DIFF(end, begin)) > GS_TLSF_MAX_BLOCK)
+  {
+    tlsf.p_end = begin + GS_TLSF_MAX_BLOCK;
+  }
+  tlsf.valid = true;
+  gs_tlsf_flush(&tlsf);
+  return tlsf;
 }
 
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_tlsf_flush(GSTlsf* tlsf)
+{
+  GS_ASSERT(tlsf->valid && 
+            "GSTlsf cannot flush an invalid allocator")
+
+  GSTlsfControl* control = tlsf->p_control;
+  control->fl_bitmap = 0;
+  for(unsigned int i = 0; i < GS_TLSF_FL_COUNT; ++i)
+  {
+    control->sl_bitmap[i] = 0;
+    for(unsigned int j = 0; j < GS_TLSF_SL_COUNT; ++j)
+    {
+      control->blocks[i][j] = NULL;
+    }
+  }
+
+  // A single free block spans the whole region, followed by a zero sized
+  // sentinel block that is never freed and stops coalescing
+  GSTlsfBlock* block = (GSTlsfBlock*)tlsf->p_begin;
+  block->size = (GS_PTR_DIFF(tlsf->p_end, tlsf->p_begin)) - 2*GS_TLSF_HEADER_SIZE;
+  GSTlsfBlock* sentinel = GS_TLSF_BLOCK_NEXT(block);
+  sentinel->size = 0;
+  gs_tlsf_set_free(block, true);
+  gs_tlsf_insert_block(control, block);
+}
 
 GS_MEM_ALLOC_VISIBILITY
 GSAlloc
-gs_pool_alloc(GSPool* pool, 
+gs_tlsf_alloc(GSTlsf* tlsf, 
               unsigned long long size, 
               unsigned int alignment)
 {
-  GS_ASSERT(pool->valid == true && 
-            "GSPool cannot allocate from an invalid pool mem alloc")
-  GS_ASSERT(pool->alignment == alignment && 
-            "GSPool incompatible alignment in allocation ")
-  GS_ASSERT(pool->bsize == size || 
-            (size < sizeof(GS_MEM_ALLOC_PTR_NUMERIC_TYPE) && pool->bsize == sizeof(GS_MEM_ALLOC_PTR_NUMERIC_TYPE)) && 
-            "GSPool incompatible size in allocation")
+  GS_ASSERT(tlsf->valid && 
+            "GSTlsf cannot allocate from an invalid allocator")
+  GS_ASSERT((alignment & (alignment - 1)) == 0 && 
+            "GSTlsf alignment must be a power of two")
 
-  char* ret = NULL;
-  if(pool->p_next_free != NULL)
+  GSAlloc alloc;
+  alloc.ptr = NULL;
+  alloc.checked = false;
+
+  if(size < GS_TLSF_MIN_PAYLOAD)
   {
-    void* next_free = (void*)*(GS_MEM_ALLOC_PTR_NUMERIC_TYPE*)pool->p_next_free;
-    ret = pool->p_next_free;
-    pool->p_next_free = next_free;
+    size = GS_TLSF_MIN_PAYLOAD;
   }
-  else
+  size = (size + GS_TLSF_ALIGNMENT - 1) & ~(GS_TLSF_ALIGNMENT - 1);
+
+  // Blocks with larger alignments need room to split a leading free block
+  unsigned long long search_size = size;
+  if(alignment > GS_TLSF_ALIGNMENT)
   {
-    ret = pool->p_current;
-    pool->p_current = (char*)pool->p_current + pool->stride;
-    GS_ASSERT((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)pool->p_current % alignment == 0)
+    search_size += alignment + GS_TLSF_MIN_BLOCK;
   }
-
-  if(((unsigned long long)ret) % alignment != 0 )
+  if(search_size >= GS_TLSF_MAX_BLOCK)
   {
-    GS_ASSERT(((unsigned long long)ret) % alignment == 0 && 
-            "GSPool has a bug at computing a properly aligned address")
+    return alloc;
   }
 
-  if((void*)(ret + size) >= pool->p_end)
+  // Rounding up the size to the next list guarantees that any block in it is
+  // large enough, so the search is a couple of bit scans
+  if(search_size >= (1ull << GS_TLSF_FL_SHIFT))
+  {
+    search_size += (1ull << (gs_tlsf_msb(search_size) - GS_TLSF_SL_LOG2)) - 1;
+  }
+  unsigned int fl, sl;
+  gs_tlsf_mapping(search_size, &fl, &sl);
+  if(fl >= GS_TLSF_FL_COUNT)
   {
-    GSAlloc alloc;
-    alloc.ptr = NULL;
-    alloc.checked = false;
     return alloc;
   }
 
+  GSTlsfControl* control = tlsf->p_control;
+  unsigned int sl_map = control->sl_bitmap[fl] & (~0u << sl);
+  if(sl_map == 0)
+  {
+    unsigned int fl_map = fl + 1 < GS_TLSF_FL_COUNT ? control->fl_bitmap & (~0u << (fl + 1)) : 0;
+    if(fl_map == 0)
+    {
+      return alloc;
+    }
+    fl = __builtin_ctz(fl_map);
+    sl_map = control->sl_bitmap[fl];
+  }
+  sl = __builtin_ctz(sl_map);
+  GSTlsfBlock* block = control->blocks[fl][sl];
+  GS_ASSERT(block != NULL && GS_TLSF_BLOCK_SIZE(block) >= size && 
+            "GSTlsf has a bug at searching a free block")
+  gs_tlsf_remove_block(control, block);
+
+  if(alignment > GS_TLSF_ALIGNMENT)
+  {
+    char* payload = GS_TLSF_BLOCK_PAYLOAD(block);
+    char* aligned = payload;
+    GS_ALIGN_PTR(aligned, alignment)
+    unsigned long long gap = GS_PTR_DIFF(aligned, payload);
+    if(gap != 0 && gap < GS_TLSF_MIN_BLOCK)
+    {
+      aligned = payload + GS_TLSF_MIN_BLOCK;
+      GS_ALIGN_PTR(aligned, alignment)
+      gap = GS_PTR_DIFF(aligned, payload);
+    }
+
+    if(gap != 0)
+    {
+      // The leading gap becomes a free block. The previous physical block is
+      // used, otherwise it would have been coalesced with this one
+      GSTlsfBlock* aligned_block = gs_tlsf_split(block, gap - GS_TLSF_HEADER_SIZE);
+      GS_ASSERT(aligned_block != NULL && 
+                "GSTlsf has a bug at splitting an aligned block")
+      aligned_block->size |= GS_TLSF_BLOCK_PREV_FREE;
+      aligned_block->p_prev_phys = block;
+      GS_TLSF_BLOCK_NEXT(aligned_block)->p_prev_phys = aligned_block;
+      gs_tlsf_insert_block(control, block);
+      block = aligned_block;
+    }
+  }
+
+  GSTlsfBlock* remainder = gs_tlsf_split(block, size);
+  if(remainder != NULL)
+  {
+    gs_tlsf_set_free(remainder, true);
+    gs_tlsf_insert_block(control, remainder);
+  }
+  gs_tlsf_set_free(block, false);
+
+  void* ret = GS_TLSF_BLOCK_PAYLOAD(block);
+  GS_ASSERT(((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ret) % alignment == 0 && 
+            "GSTlsf has a bug at computing a properly aligned address")
+
 #ifdef GS_MEM_ALLOC_INITIALIZE_TO_ZERO
-  memset(ret, 0, pool->bsize);
+  memset(ret, 0, size);
 #endif
-
-  GSAlloc alloc;
   alloc.ptr = ret;
-  alloc.checked = false;
   return alloc;
 }
 
 GS_MEM_ALLOC_VISIBILITY
 void*
-gs_pool_alloc_CHECKED(GSPool* pool, 
-              unsigned long long size, 
-              unsigned int alignment)
+gs_tlsf_alloc_CHECKED(GSTlsf* tlsf, 
+                      unsigned long long size, 
+                      unsigned int alignment)
 {
-  GSAlloc alloc = gs_pool_alloc(pool, size, alignment);
+  GSAlloc alloc = gs_tlsf_alloc(tlsf, size, alignment);
 #ifndef GS_MEM_ALLOC_DISABLE_CHECKS
   GS_PERMA_ASSERT(!gs_alloc_is_null(&alloc));
 #else
@@ -984,19 +8103,116 @@ gs_pool_alloc_CHECKED(GSPool* pool,
   return gs_alloc_ptr(&alloc);
 }
 
-
 GS_MEM_ALLOC_VISIBILITY
-void 
-gs_pool_free(GSPool* pool, 
+void
+gs_tlsf_free(GSTlsf* tlsf, 
              void* ptr)
 {
-  GS_ASSERT(pool->valid == true && 
-            "GSPool cannot free from an invalid pool mem alloc")
-  GS_ASSERT(((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ptr % pool->alignment == 0) && "GSPool this should not happen")
-  GS_ASSERT(((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ptr >= (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)pool->p_begin && (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)ptr < (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)pool->p_current) && "GSPool invalid freed ptr")
+  GS_ASSERT(tlsf->valid && 
+            "GSTlsf cannot free to an invalid allocator")
+  GS_ASSERT((char*)ptr >= (char*)tlsf->p_begin && (char*)ptr < (char*)tlsf->p_end && 
+            "GSTlsf invalid freed ptr")
 
-  *(GS_MEM_ALLOC_PTR_NUMERIC_TYPE*)ptr = (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)pool->p_next_free;
-  pool->p_next_free = ptr;
+  GSTlsfControl* control = tlsf->p_control;
+  GSTlsfBlock* block = GS_TLSF_BLOCK_FROM_PAYLOAD(ptr);
+  GS_ASSERT((block->size & GS_TLSF_BLOCK_FREE) == 0 && 
+            "GSTlsf block freed twice")
+
+  if(block->size & GS_TLSF_BLOCK_PREV_FREE)
+  {
+    GSTlsfBlock* prev = block->p_prev_phys;
+    gs_tlsf_remove_block(control, prev);
+    prev->size += GS_TLSF_BLOCK_SIZE(block) + GS_TLSF_HEADER_SIZE;
+    block = prev;
+  }
+
+  GSTlsfBlock* next = GS_TLSF_BLOCK_NEXT(block);
+  if(next->size & GS_TLSF_BLOCK_FREE)
+  {
+    gs_tlsf_remove_block(control, next);
+    block->size += GS_TLSF_BLOCK_SIZE(next) + GS_TLSF_HEADER_SIZE;
+  }
+
+  gs_tlsf_set_free(block, true);
+  gs_tlsf_insert_block(control, block);
+}
+
+////////////////////////////////////////////////
+/////////////////// NODE SET ///////////////////
+////////////////////////////////////////////////
+
+GS_MEM_ALLOC_VISIBILITY
+GSNodeSet
+gs_node_set_init(unsigned long long scratch_size, 
+                 unsigned long long pool_size, 
+                 unsigned long long pool_bsize, 
+                 unsigned int pool_alignment, 
+                 unsigned long long page_size)
+{
+  GSNodeSet set;
+  set.num_nodes = gs_vm_num_nodes();
+  set.valid = true;
+  // The scratch size is rounded up so that the pool starts aligned
+  scratch_size = (scratch_size + GS_MEM_ALLOC_MIN_ALIGNMENT - 1) & ~(GS_MEM_ALLOC_MIN_ALIGNMENT - 1);
+  unsigned long long size = scratch_size + (pool_size > 0 ? pool_size + pool_alignment : 0);
+  for(unsigned int i = 0; i < set.num_nodes; ++i)
+  {
+    GSNodeArena* arena = &set.nodes[i];
+    arena->scratch.valid = false;
+    arena->pool.valid = false;
+    arena->bound = false;
+    arena->p_mapping = gs_vm_map_pages(size + GS_VM_MAPPING_HEADER_SIZE, page_size);
+    if(arena->p_mapping == NULL)
+    {
+      set.num_nodes = i;
+      gs_node_set_release(&set);
+      return set;
+    }
+    arena->bound = gs_vm_bind_node(arena->p_mapping, arena->p_mapping->size, i);
+
+    char* begin = GS_VM_MAPPING_BEGIN(arena->p_mapping);
+    if(scratch_size > 0)
+    {
+      arena->scratch = gs_scratch_init(begin, scratch_size);
+    }
+    if(pool_size > 0)
+    {
+      arena->pool = gs_atomic_pool_init(begin + scratch_size, 
+                                        GS_PTR_DIFF(GS_VM_MAPPING_END(arena->p_mapping), begin + scratch_size), 
+                                        pool_bsize, 
+                                        pool_alignment);
+    }
+  }
+  return set;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+void
+gs_node_set_release(GSNodeSet* set)
+{
+  for(unsigned int i = 0; i < set->num_nodes; ++i)
+  {
+    gs_vm_unmap_pages(set->nodes[i].p_mapping);
+    set->nodes[i].p_mapping = NULL;
+  }
+  set->num_nodes = 0;
+  set->valid = false;
+}
+
+GS_MEM_ALLOC_VISIBILITY
+GSNodeArena*
+gs_node_set_get(GSNodeSet* set, 
+                unsigned int node)
+{
+  GS_ASSERT(set->valid && "GSNodeSet not properly initialized")
+  return &set->nodes[node % set->num_nodes];
+}
+
+GS_MEM_ALLOC_VISIBILITY
+GSNodeArena*
+gs_node_set_local(GSNodeSet* set)
+{
+  return gs_node_set_get(set, gs_vm_current_node());
 }
 
 #ifdef __cplusplus
@@ -8,6 +8,7 @@ EXITCODE=0
 TARGET=""
 CLANG_OPTIONS=""
 INCLUDES="-I ../"
+LIBS="-lpthread"
 
 #"Processing script parameters"
 while [[ $# > 0 ]]
@@ -33,7 +34,7 @@ then
   CLANG_OPTIONS="-O0 -g -pg"
 fi
 
-if [ ${TARGET} == "DEBUG" ]
+if [ ${TARGET} == "RELEASE" ]
 then
   CLANG_OPTIONS="-O2 -DNDEBUG"
 fi
@@ -44,11 +45,27 @@ BUILD_DIR="build_linux64_${TARGET}"
 mkdir -p ${BUILD_DIR}
 
 
-TESTS="gs_mem_alloc_test"
+TESTS="gs_mem_alloc_test gs_mem_alloc_bench gs_mem_alloc_replay"
+
+for a in ${TESTS} 
+do
+  echo "clang ${INCLUDES} ${CLANG_OPTIONS} -o ${BUILD_DIR}/$a ${a}.c ${LIBS}"
+  clang ${INCLUDES} ${CLANG_OPTIONS} -o ${BUILD_DIR}/${a} ${a}.c ${LIBS}
+done
 
+# The header must also build in strict C99 mode, which hides the POSIX and GNU
+# extensions unless the implementation requests them
 for a in ${TESTS} 
 do
-  echo "clang ${INCLUDES} ${CLANG_OPTIONS} -o ${BUILD_DIR}/$a ${a}.c"
-  clang ${INCLUDES} ${CLANG_OPTIONS} -o ${BUILD_DIR}/${a} ${a}.c
+  echo "clang -std=c99 ${INCLUDES} ${CLANG_OPTIONS} -o ${BUILD_DIR}/${a}_c99 ${a}.c ${LIBS}"
+  clang -std=c99 ${INCLUDES} ${CLANG_OPTIONS} -o ${BUILD_DIR}/${a}_c99 ${a}.c ${LIBS}
+done
+
+CPP_TESTS="gs_mem_alloc_cpp_test"
+
+for a in ${CPP_TESTS} 
+do
+  echo "clang++ -std=c++17 ${INCLUDES} ${CLANG_OPTIONS} -o ${BUILD_DIR}/$a ${a}.cpp ${LIBS}"
+  clang++ -std=c++17 ${INCLUDES} ${CLANG_OPTIONS} -o ${BUILD_DIR}/${a} ${a}.cpp ${LIBS}
 done
 exit 0
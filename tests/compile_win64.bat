@@ -38,7 +38,7 @@ SET BUILD_DIR=build_win64_%TARGET%
 MKDIR %BUILD_DIR%
 
 
-SET TESTS=gs_mem_alloc_test
+SET TESTS=gs_mem_alloc_test gs_mem_alloc_bench gs_mem_alloc_replay
 
 FOR %%a in (%TESTS%) do (
   echo clang-cl %INCLUDES% %CLANG_OPTIONS% /o %BUILD_DIR%\%%a %%a.c
@@ -46,6 +46,14 @@ FOR %%a in (%TESTS%) do (
   IF ERRORLEVEL 1 GOTO Failure
 ) 
 
+SET CPP_TESTS=gs_mem_alloc_cpp_test
+
+FOR %%a in (%CPP_TESTS%) do (
+  echo clang-cl /std:c++17 /EHsc %INCLUDES% %CLANG_OPTIONS% /o %BUILD_DIR%\%%a %%a.cpp
+  clang-cl /std:c++17 /EHsc %INCLUDES% %CLANG_OPTIONS% /o %BUILD_DIR%\%%a %%a.cpp
+  IF ERRORLEVEL 1 GOTO Failure
+) 
+
 
 GOTO Success
 
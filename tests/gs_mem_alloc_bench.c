@@ -0,0 +1,928 @@
+// The implementation is included before any system header, so that its
+// feature macros apply to them (see gs_mem_alloc.h)
+#define GS_MEM_ALLOC_IMPLEMENTATION
+#include "gs_mem_alloc.h"
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define GS_BENCH_HAS_TSC
+#endif
+
+#define GS_BENCH_BUFFER_SIZE 64*1024*1024
+#define GS_BENCH_SLOTS 1024
+#define GS_BENCH_BATCH 256
+#define GS_BENCH_DEFAULT_OPS 200000
+#define GS_BENCH_TLB_BLOCK_SIZE 64
+#define GS_BENCH_TLB_DEFAULT_MB 256
+
+////////////////////////////////////////////////
+/////////////////// TIMING /////////////////////
+////////////////////////////////////////////////
+
+unsigned long long
+gs_bench_now_ns()
+{
+#ifdef _WIN32
+  LARGE_INTEGER counter, frequency;
+  QueryPerformanceCounter(&counter);
+  QueryPerformanceFrequency(&frequency);
+  return (unsigned long long)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ull + (unsigned long long)ts.tv_nsec;
+#endif
+}
+
+// Ticks are used to time single operations, since reading the time stamp
+// counter is much cheaper than querying the OS clock
+static inline unsigned long long
+gs_bench_ticks()
+{
+#ifdef GS_BENCH_HAS_TSC
+  return __rdtsc();
+#else
+  return gs_bench_now_ns();
+#endif
+}
+
+double
+gs_bench_calibrate_ns_per_tick()
+{
+#ifdef GS_BENCH_HAS_TSC
+  unsigned long long start_ns = gs_bench_now_ns();
+  unsigned long long start_ticks = gs_bench_ticks();
+  while(gs_bench_now_ns() - start_ns < 50000000ull);
+  unsigned long long end_ns = gs_bench_now_ns();
+  unsigned long long end_ticks = gs_bench_ticks();
+  return (double)(end_ns - start_ns) / (double)(end_ticks - start_ticks);
+#else
+  return 1.0;
+#endif
+}
+
+////////////////////////////////////////////////
+/////////////////// BENCHMARKS /////////////////
+////////////////////////////////////////////////
+
+typedef struct GSBenchContext
+{
+  unsigned long long  size;
+  unsigned int        alignment;
+  unsigned long long  ops;
+  void*               buffer;
+  void**              slots;
+  unsigned int*       random;                                                   // Precomputed random slot indices, shared by all allocators
+  bool                sample;                                                   // Whether the latency of each operation is sampled
+  unsigned long long* samples;
+  unsigned long long  num_samples;
+  unsigned long long  num_ops;                                                  // The number of operations actually performed
+  unsigned long long  bytes_used;                                               // The peak bytes of the buffer used, 0 if not measured
+} GSBenchContext;
+
+typedef void (*GSBenchFunc)(GSBenchContext* ctx);
+
+#define GS_BENCH_OP(ctx, op)\
+  (ctx)->num_ops++;\
+  if((ctx)->sample)\
+  {\
+    unsigned long long t0 = gs_bench_ticks();\
+    op;\
+    (ctx)->samples[(ctx)->num_samples++] = gs_bench_ticks() - t0;\
+  }\
+  else\
+  {\
+    op;\
+  }
+
+// Touches the allocation so that the compiler cannot remove it
+#define GS_BENCH_TOUCH(ptr)\
+  *(volatile char*)(ptr) = 1
+
+void
+gs_bench_stack_push_pop(GSBenchContext* ctx)
+{
+  GSStack stack = gs_stack_init(ctx->buffer, GS_BENCH_BUFFER_SIZE);
+  for(unsigned long long i = 0; i < ctx->ops; ++i)
+  {
+    GS_BENCH_OP(ctx,
+                void* ptr = gs_stack_push_CHECKED(&stack, ctx->size, ctx->alignment);
+                GS_BENCH_TOUCH(ptr);
+                gs_stack_pop(&stack, ptr));
+  }
+}
+
+void
+gs_bench_malloc_push_pop(GSBenchContext* ctx)
+{
+  for(unsigned long long i = 0; i < ctx->ops; ++i)
+  {
+    GS_BENCH_OP(ctx,
+                void* ptr = malloc(ctx->size);
+                GS_BENCH_TOUCH(ptr);
+                free(ptr));
+  }
+}
+
+void
+gs_bench_stack_push_n_pop_n(GSBenchContext* ctx)
+{
+  GSStack stack = gs_stack_init(ctx->buffer, GS_BENCH_BUFFER_SIZE);
+  for(unsigned long long i = 0; i < ctx->ops; i += 2*GS_BENCH_BATCH)
+  {
+    for(int j = 0; j < GS_BENCH_BATCH; ++j)
+    {
+      GS_BENCH_OP(ctx,
+                  ctx->slots[j] = gs_stack_push_CHECKED(&stack, ctx->size, ctx->alignment);
+                  GS_BENCH_TOUCH(ctx->slots[j]));
+    }
+    ctx->bytes_used = GS_PTR_DIFF(stack.p_current, stack.p_begin);
+    for(int j = GS_BENCH_BATCH-1; j >= 0; --j)
+    {
+      GS_BENCH_OP(ctx, gs_stack_pop(&stack, ctx->slots[j]));
+    }
+  }
+}
+
+void
+gs_bench_stack_sized_push_n_pop_n(GSBenchContext* ctx)
+{
+  GSStack stack = gs_stack_init(ctx->buffer, GS_BENCH_BUFFER_SIZE);
+  for(unsigned long long i = 0; i < ctx->ops; i += 2*GS_BENCH_BATCH)
+  {
+    for(int j = 0; j < GS_BENCH_BATCH; ++j)
+    {
+      GS_BENCH_OP(ctx,
+                  ctx->slots[j] = gs_stack_push_sized_CHECKED(&stack, ctx->size);
+                  GS_BENCH_TOUCH(ctx->slots[j]));
+    }
+    ctx->bytes_used = GS_PTR_DIFF(stack.p_current, stack.p_begin);
+    for(int j = GS_BENCH_BATCH-1; j >= 0; --j)
+    {
+      GS_BENCH_OP(ctx, gs_stack_pop_sized(&stack, ctx->slots[j], ctx->size));
+    }
+  }
+}
+
+void
+gs_bench_compact_stack_push_n_pop_n(GSBenchContext* ctx)
+{
+  GSCompactStack stack = gs_compact_stack_init(ctx->buffer, GS_BENCH_BUFFER_SIZE);
+  for(unsigned long long i = 0; i < ctx->ops; i += 2*GS_BENCH_BATCH)
+  {
+    for(int j = 0; j < GS_BENCH_BATCH; ++j)
+    {
+      GS_BENCH_OP(ctx,
+                  ctx->slots[j] = gs_compact_stack_push_CHECKED(&stack, ctx->size, ctx->alignment);
+                  GS_BENCH_TOUCH(ctx->slots[j]));
+    }
+    ctx->bytes_used = GS_PTR_DIFF(stack.p_current, stack.p_begin);
+    for(int j = GS_BENCH_BATCH-1; j >= 0; --j)
+    {
+      GS_BENCH_OP(ctx, gs_compact_stack_pop(&stack, ctx->slots[j]));
+    }
+  }
+}
+
+void
+gs_bench_malloc_push_n_pop_n(GSBenchContext* ctx)
+{
+  for(unsigned long long i = 0; i < ctx->ops; i += 2*GS_BENCH_BATCH)
+  {
+    for(int j = 0; j < GS_BENCH_BATCH; ++j)
+    {
+      GS_BENCH_OP(ctx,
+                  ctx->slots[j] = malloc(ctx->size);
+                  GS_BENCH_TOUCH(ctx->slots[j]));
+    }
+    for(int j = GS_BENCH_BATCH-1; j >= 0; --j)
+    {
+      GS_BENCH_OP(ctx, free(ctx->slots[j]));
+    }
+  }
+}
+
+void
+gs_bench_scratch_push_flush(GSBenchContext* ctx)
+{
+  GSScratch scratch = gs_scratch_init(ctx->buffer, GS_BENCH_BUFFER_SIZE);
+  for(unsigned long long i = 0; i < ctx->ops; i += GS_BENCH_BATCH + 1)
+  {
+    for(int j = 0; j < GS_BENCH_BATCH; ++j)
+    {
+      GS_BENCH_OP(ctx,
+                  void* ptr = gs_scratch_push_CHECKED(&scratch, ctx->size, ctx->alignment);
+                  GS_BENCH_TOUCH(ptr));
+    }
+    GS_BENCH_OP(ctx, gs_scratch_flush(&scratch));
+  }
+}
+
+void
+gs_bench_malloc_push_flush(GSBenchContext* ctx)
+{
+  for(unsigned long long i = 0; i < ctx->ops; i += GS_BENCH_BATCH + 1)
+  {
+    for(int j = 0; j < GS_BENCH_BATCH; ++j)
+    {
+      GS_BENCH_OP(ctx,
+                  ctx->slots[j] = malloc(ctx->size);
+                  GS_BENCH_TOUCH(ctx->slots[j]));
+    }
+    GS_BENCH_OP(ctx,
+                for(int j = 0; j < GS_BENCH_BATCH; ++j)
+                {
+                  free(ctx->slots[j]);
+                });
+  }
+}
+
+void
+gs_bench_pool_alloc_free_random(GSBenchContext* ctx)
+{
+  GSPool pool = gs_pool_init(ctx->buffer, GS_BENCH_BUFFER_SIZE, ctx->size, ctx->alignment);
+  memset(ctx->slots, 0, sizeof(void*)*GS_BENCH_SLOTS);
+  for(unsigned long long i = 0; i < ctx->ops; ++i)
+  {
+    unsigned int index = ctx->random[i];
+    if(ctx->slots[index] == NULL)
+    {
+      GS_BENCH_OP(ctx,
+                  ctx->slots[index] = gs_pool_alloc_CHECKED(&pool, ctx->size, ctx->alignment);
+                  GS_BENCH_TOUCH(ctx->slots[index]));
+    }
+    else
+    {
+      GS_BENCH_OP(ctx, gs_pool_free(&pool, ctx->slots[index]));
+      ctx->slots[index] = NULL;
+    }
+  }
+}
+
+void
+gs_bench_malloc_alloc_free_random(GSBenchContext* ctx)
+{
+  memset(ctx->slots, 0, sizeof(void*)*GS_BENCH_SLOTS);
+  for(unsigned long long i = 0; i < ctx->ops; ++i)
+  {
+    unsigned int index = ctx->random[i];
+    if(ctx->slots[index] == NULL)
+    {
+      GS_BENCH_OP(ctx,
+                  ctx->slots[index] = malloc(ctx->size);
+                  GS_BENCH_TOUCH(ctx->slots[index]));
+    }
+    else
+    {
+      GS_BENCH_OP(ctx, free(ctx->slots[index]));
+      ctx->slots[index] = NULL;
+    }
+  }
+  for(int i = 0; i < GS_BENCH_SLOTS; ++i)
+  {
+    free(ctx->slots[i]);
+  }
+}
+
+typedef struct GSBench
+{
+  const char* allocator;
+  const char* pattern;
+  GSBenchFunc func;
+  unsigned int max_alignment;                                                   // The largest alignment supported, 0 if any
+} GSBench;
+
+// Each allocator benchmark is followed by its malloc counterpart. malloc does
+// not take the alignment into account. Sized stack pushes are always aligned
+// to GS_MEM_ALLOC_PTR_ALIGNMENT
+GSBench gs_benchmarks[] =
+{
+  {"stack",         "push_pop",           gs_bench_stack_push_pop,              0},
+  {"malloc",        "push_pop",           gs_bench_malloc_push_pop,             0},
+  {"stack",         "push_n_pop_n",       gs_bench_stack_push_n_pop_n,          0},
+  {"stack_sized",   "push_n_pop_n",       gs_bench_stack_sized_push_n_pop_n,    GS_MEM_ALLOC_PTR_ALIGNMENT},
+  {"compact_stack", "push_n_pop_n",       gs_bench_compact_stack_push_n_pop_n,  0},
+  {"malloc",        "push_n_pop_n",       gs_bench_malloc_push_n_pop_n,         0},
+  {"scratch",       "push_flush",         gs_bench_scratch_push_flush,          0},
+  {"malloc",        "push_flush",         gs_bench_malloc_push_flush,           0},
+  {"pool",          "alloc_free_random",  gs_bench_pool_alloc_free_random,      0},
+  {"malloc",        "alloc_free_random",  gs_bench_malloc_alloc_free_random,    0},
+};
+
+////////////////////////////////////////////////
+/////////////////// TLB ////////////////////////
+////////////////////////////////////////////////
+
+typedef enum GSBenchFormat
+{
+  GS_BENCH_FORMAT_CSV,
+  GS_BENCH_FORMAT_JSON
+} GSBenchFormat;
+
+
+// Opens a counter of the data TLB read misses of the calling thread. Returns
+// -1 if the counter is not available
+int
+gs_bench_tlb_counter_open()
+{
+#ifdef __linux__
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HW_CACHE;
+  attr.config = PERF_COUNT_HW_CACHE_DTLB | 
+                (PERF_COUNT_HW_CACHE_OP_READ << 8) | 
+                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+  return -1;
+#endif
+}
+
+void
+gs_bench_tlb_counter_enable(int fd, 
+                            bool enable)
+{
+#ifdef __linux__
+  if(fd >= 0)
+  {
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, enable ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE, 0);
+  }
+#endif
+}
+
+// Returns the counted misses, or -1 if the counter is not available
+long long
+gs_bench_tlb_counter_read(int fd)
+{
+#ifdef __linux__
+  long long count;
+  if(fd >= 0 && read(fd, &count, sizeof(count)) == sizeof(count))
+  {
+    return count;
+  }
+#endif
+  return -1;
+}
+
+typedef struct GSBenchTlbResult
+{
+  unsigned long long  requested_page_size;
+  unsigned long long  page_size;                                                // The page size obtained
+  unsigned int        kind;
+  unsigned long long  region_size;
+  unsigned long long  accesses;
+  double              ns_per_access;
+  double              misses_per_access;                                        // Negative if the counter is not available
+} GSBenchTlbResult;
+
+// Allocates all the blocks of a pool owning a mapping of the requested page
+// size, up to the region size since the mapping may be larger, links them in
+// a single random cycle and chases it, so that every access lands on a random
+// block of the region
+GSBenchTlbResult
+gs_bench_tlb_run(unsigned long long region_size, 
+                 unsigned long long page_size, 
+                 unsigned long long accesses, 
+                 void** blocks)
+{
+  GSBenchTlbResult result;
+  memset(&result, 0, sizeof(result));
+  result.requested_page_size = page_size;
+  GSPool pool = gs_pool_init_huge(region_size, GS_BENCH_TLB_BLOCK_SIZE, GS_BENCH_TLB_BLOCK_SIZE, page_size);
+  if(!pool.valid)
+    return result;
+  result.page_size = pool.p_mapping->page_size;
+  result.kind = pool.p_mapping->kind;
+  result.region_size = region_size;
+  result.accesses = accesses;
+
+  unsigned long long num_blocks = 0;
+  while(num_blocks < region_size / GS_BENCH_TLB_BLOCK_SIZE)
+  {
+    GSAlloc alloc = gs_pool_alloc(&pool, GS_BENCH_TLB_BLOCK_SIZE, GS_BENCH_TLB_BLOCK_SIZE);
+    if(gs_alloc_is_null(&alloc))
+      break;
+    blocks[num_blocks++] = gs_alloc_ptr(&alloc);
+  }
+
+  // Sattolo's shuffle yields a permutation with a single cycle
+  srand(0);
+  for(unsigned long long i = num_blocks - 1; i > 0; --i)
+  {
+    unsigned long long j = (((unsigned long long)rand() << 31) ^ (unsigned long long)rand()) % i;
+    void* tmp = blocks[i];
+    blocks[i] = blocks[j];
+    blocks[j] = tmp;
+  }
+  for(unsigned long long i = 0; i < num_blocks; ++i)
+  {
+    *(void**)blocks[i] = blocks[(i + 1) % num_blocks];
+  }
+
+  int fd = gs_bench_tlb_counter_open();
+  void* volatile* current = (void* volatile*)blocks[0];
+  gs_bench_tlb_counter_enable(fd, true);
+  unsigned long long start = gs_bench_now_ns();
+  for(unsigned long long i = 0; i < accesses; ++i)
+  {
+    current = (void* volatile*)*current;
+  }
+  unsigned long long elapsed = gs_bench_now_ns() - start;
+  gs_bench_tlb_counter_enable(fd, false);
+  long long misses = gs_bench_tlb_counter_read(fd);
+#ifdef __linux__
+  if(fd >= 0)
+    close(fd);
+#endif
+
+  result.ns_per_access = (double)elapsed / (double)accesses;
+  result.misses_per_access = misses < 0 ? -1.0 : (double)misses / (double)accesses;
+  gs_pool_release_huge(&pool);
+  return result;
+}
+
+// Chases random pointers through a pool region mapped with normal, 2MB and
+// 1GB pages. The page size obtained may be smaller than the requested one
+// when huge pages are not available
+int
+gs_bench_tlb(GSBenchFormat format, 
+             unsigned long long region_size, 
+             unsigned long long accesses)
+{
+  void** blocks = (void**)malloc(sizeof(void*)*(region_size / GS_BENCH_TLB_BLOCK_SIZE));
+  if(!blocks)
+  {
+    fprintf(stderr, "Unable to allocate benchmark buffers\n");
+    return 1;
+  }
+
+  const char* kinds[] = {"normal", "transparent", "hugetlb"};
+  unsigned long long page_sizes[] = {gs_vm_page_size(), GS_VM_PAGE_SIZE_2MB, GS_VM_PAGE_SIZE_1GB};
+  if(format == GS_BENCH_FORMAT_CSV)
+  {
+    printf("requested_page_size,page_size,pages,region_size,accesses,ns_per_access,dtlb_misses_per_access\n");
+  }
+  else
+  {
+    printf("[\n");
+  }
+  for(int i = 0; i < 3; ++i)
+  {
+    GSBenchTlbResult result = gs_bench_tlb_run(region_size, page_sizes[i], accesses, blocks);
+    if(result.region_size == 0)
+    {
+      fprintf(stderr, "Unable to map %llu bytes\n", region_size);
+      free(blocks);
+      return 1;
+    }
+    char misses[32];
+    if(result.misses_per_access < 0.0)
+      snprintf(misses, sizeof(misses), format == GS_BENCH_FORMAT_CSV ? "n/a" : "null");
+    else
+      snprintf(misses, sizeof(misses), "%.4f", result.misses_per_access);
+    if(format == GS_BENCH_FORMAT_CSV)
+    {
+      printf("%llu,%llu,%s,%llu,%llu,%.3f,%s\n",
+             result.requested_page_size,
+             result.page_size,
+             kinds[result.kind],
+             result.region_size,
+             result.accesses,
+             result.ns_per_access,
+             misses);
+    }
+    else
+    {
+      printf("%s  {\"requested_page_size\": %llu, \"page_size\": %llu, \"pages\": \"%s\", \"region_size\": %llu, "
+             "\"accesses\": %llu, \"ns_per_access\": %.3f, \"dtlb_misses_per_access\": %s}",
+             i == 0 ? "" : ",\n",
+             result.requested_page_size,
+             result.page_size,
+             kinds[result.kind],
+             result.region_size,
+             result.accesses,
+             result.ns_per_access,
+             misses);
+    }
+  }
+  if(format == GS_BENCH_FORMAT_JSON)
+  {
+    printf("\n]\n");
+  }
+  free(blocks);
+  return 0;
+}
+
+////////////////////////////////////////////////
+/////////////////// CYCLES /////////////////////
+////////////////////////////////////////////////
+
+// Compares the inline fast paths of the stack, scratch and pool allocations 
+// with their out of line gs_*_slow paths, which is what every allocation costs
+// when the fast paths are not inlined. Batches of allocations are timed with 
+// the time stamp counter (reference cycles, or nanoseconds where there is no
+// TSC) and released untimed between batches
+#define GS_BENCH_CYCLES_BATCH(ctx, ticks, alloc_expr)\
+  {\
+    unsigned long long t0 = gs_bench_ticks();\
+    for(int i = 0; i < GS_BENCH_BATCH; ++i)\
+    {\
+      GSAlloc alloc = alloc_expr;\
+      (ctx)->slots[i] = gs_alloc_is_null(&alloc) ? NULL : gs_alloc_ptr(&alloc);\
+    }\
+    ticks += gs_bench_ticks() - t0;\
+    (ctx)->num_ops += GS_BENCH_BATCH;\
+  }
+
+typedef unsigned long long (*GSBenchCyclesFunc)(GSBenchContext* ctx, bool fast);
+
+unsigned long long
+gs_bench_cycles_stack(GSBenchContext* ctx, 
+                      bool fast)
+{
+  GSStack stack = gs_stack_init(ctx->buffer, GS_BENCH_BUFFER_SIZE);
+  unsigned long long ticks = 0;
+  while(ctx->num_ops < ctx->ops)
+  {
+    if(fast)
+      GS_BENCH_CYCLES_BATCH(ctx, ticks, gs_stack_push(&stack, ctx->size, ctx->alignment))
+    else
+      GS_BENCH_CYCLES_BATCH(ctx, ticks, gs_stack_push_slow(&stack, ctx->size, ctx->alignment))
+    gs_stack_flush(&stack);
+  }
+  return ticks;
+}
+
+unsigned long long
+gs_bench_cycles_scratch(GSBenchContext* ctx, 
+                        bool fast)
+{
+  GSScratch scratch = gs_scratch_init(ctx->buffer, GS_BENCH_BUFFER_SIZE);
+  unsigned long long ticks = 0;
+  while(ctx->num_ops < ctx->ops)
+  {
+    if(fast)
+      GS_BENCH_CYCLES_BATCH(ctx, ticks, gs_scratch_push(&scratch, ctx->size, ctx->alignment))
+    else
+      GS_BENCH_CYCLES_BATCH(ctx, ticks, gs_scratch_push_slow(&scratch, ctx->size, ctx->alignment))
+    gs_scratch_flush(&scratch);
+  }
+  return ticks;
+}
+
+// The first batch is carved from the unused region of the pool and the rest
+// are taken from the free list
+unsigned long long
+gs_bench_cycles_pool(GSBenchContext* ctx, 
+                     bool fast)
+{
+  GSPool pool = gs_pool_init(ctx->buffer, GS_BENCH_BUFFER_SIZE, ctx->size, ctx->alignment);
+  unsigned long long ticks = 0;
+  while(ctx->num_ops < ctx->ops)
+  {
+    if(fast)
+      GS_BENCH_CYCLES_BATCH(ctx, ticks, gs_pool_alloc(&pool, ctx->size, ctx->alignment))
+    else
+      GS_BENCH_CYCLES_BATCH(ctx, ticks, gs_pool_alloc_slow(&pool, ctx->size, ctx->alignment))
+    for(int i = GS_BENCH_BATCH - 1; i >= 0; --i)
+    {
+      gs_pool_free(&pool, ctx->slots[i]);
+    }
+  }
+  return ticks;
+}
+
+int
+gs_bench_cycles(GSBenchFormat format, 
+                GSBenchContext* ctx,
+                double ns_per_tick)
+{
+  const char* allocators[] = {"stack", "scratch", "pool"};
+  GSBenchCyclesFunc funcs[] = {gs_bench_cycles_stack, gs_bench_cycles_scratch, gs_bench_cycles_pool};
+  unsigned long long sizes[] = {16, 64, 256};
+  if(format == GS_BENCH_FORMAT_CSV)
+  {
+    printf("allocator,path,size,alignment,allocs,cycles_per_alloc,ns_per_alloc\n");
+  }
+  else
+  {
+    printf("[\n");
+  }
+  bool first = true;
+  for(int a = 0; a < 3; ++a)
+  {
+    for(int i = 0; i < 3; ++i)
+    {
+      for(int fast = 1; fast >= 0; --fast)
+      {
+        ctx->size = sizes[i];
+        ctx->alignment = 16;
+        ctx->num_ops = 0;
+        unsigned long long ticks = funcs[a](ctx, fast == 1);
+        double cycles = (double)ticks / (double)ctx->num_ops;
+        const char* path = fast ? "fast" : "slow";
+        if(format == GS_BENCH_FORMAT_CSV)
+        {
+          printf("%s,%s,%llu,%u,%llu,%.2f,%.3f\n",
+                 allocators[a],
+                 path,
+                 ctx->size,
+                 ctx->alignment,
+                 ctx->num_ops,
+                 cycles,
+                 cycles*ns_per_tick);
+        }
+        else
+        {
+          printf("%s  {\"allocator\": \"%s\", \"path\": \"%s\", \"size\": %llu, \"alignment\": %u, \"allocs\": %llu, "
+                 "\"cycles_per_alloc\": %.2f, \"ns_per_alloc\": %.3f}",
+                 first ? "" : ",\n",
+                 allocators[a],
+                 path,
+                 ctx->size,
+                 ctx->alignment,
+                 ctx->num_ops,
+                 cycles,
+                 cycles*ns_per_tick);
+        }
+        first = false;
+      }
+    }
+  }
+  if(format == GS_BENCH_FORMAT_JSON)
+  {
+    printf("\n]\n");
+  }
+  return 0;
+}
+
+////////////////////////////////////////////////
+/////////////////// REPORTING //////////////////
+////////////////////////////////////////////////
+
+typedef struct GSBenchResult
+{
+  const char*         allocator;
+  const char*         pattern;
+  unsigned long long  size;
+  unsigned int        alignment;
+  unsigned long long  ops;
+  double              ns_per_op;
+  double              ops_per_sec;
+  double              p50_ns;
+  double              p99_ns;
+  double              p999_ns;
+  unsigned long long  bytes_used;
+} GSBenchResult;
+
+int
+gs_bench_compare_samples(const void* a,
+                         const void* b)
+{
+  unsigned long long sa = *(const unsigned long long*)a;
+  unsigned long long sb = *(const unsigned long long*)b;
+  return sa < sb ? -1 : (sa > sb ? 1 : 0);
+}
+
+double
+gs_bench_percentile(unsigned long long* sorted_samples,
+                    unsigned long long num_samples,
+                    double percentile,
+                    double ns_per_tick)
+{
+  if(num_samples == 0)
+    return 0.0;
+  unsigned long long index = (unsigned long long)(percentile * (double)(num_samples - 1));
+  return (double)sorted_samples[index] * ns_per_tick;
+}
+
+void
+gs_bench_print_header(GSBenchFormat format)
+{
+  if(format == GS_BENCH_FORMAT_CSV)
+  {
+    printf("allocator,pattern,size,alignment,ops,ns_per_op,ops_per_sec,p50_ns,p99_ns,p999_ns,bytes_used\n");
+  }
+  else
+  {
+    printf("[\n");
+  }
+}
+
+void
+gs_bench_print_result(GSBenchFormat format,
+                      GSBenchResult* result,
+                      bool first)
+{
+  if(format == GS_BENCH_FORMAT_CSV)
+  {
+    printf("%s,%s,%llu,%u,%llu,%.3f,%.0f,%.1f,%.1f,%.1f,%llu\n",
+           result->allocator,
+           result->pattern,
+           result->size,
+           result->alignment,
+           result->ops,
+           result->ns_per_op,
+           result->ops_per_sec,
+           result->p50_ns,
+           result->p99_ns,
+           result->p999_ns,
+           result->bytes_used);
+  }
+  else
+  {
+    printf("%s  {\"allocator\": \"%s\", \"pattern\": \"%s\", \"size\": %llu, \"alignment\": %u, \"ops\": %llu, "
+           "\"ns_per_op\": %.3f, \"ops_per_sec\": %.0f, \"p50_ns\": %.1f, \"p99_ns\": %.1f, \"p999_ns\": %.1f, \"bytes_used\": %llu}",
+           first ? "" : ",\n",
+           result->allocator,
+           result->pattern,
+           result->size,
+           result->alignment,
+           result->ops,
+           result->ns_per_op,
+           result->ops_per_sec,
+           result->p50_ns,
+           result->p99_ns,
+           result->p999_ns,
+           result->bytes_used);
+  }
+}
+
+void
+gs_bench_print_footer(GSBenchFormat format)
+{
+  if(format == GS_BENCH_FORMAT_JSON)
+  {
+    printf("\n]\n");
+  }
+}
+
+// Runs a benchmark twice: a first pass measures the throughput without any
+// per operation timing, and a second pass samples the latency of each operation
+GSBenchResult
+gs_bench_run(GSBench* bench,
+             GSBenchContext* ctx,
+             double ns_per_tick)
+{
+  GSBenchResult result;
+  result.allocator = bench->allocator;
+  result.pattern = bench->pattern;
+  result.size = ctx->size;
+  result.alignment = ctx->alignment;
+
+  ctx->sample = false;
+  ctx->num_ops = 0;
+  ctx->bytes_used = 0;
+  unsigned long long start = gs_bench_now_ns();
+  bench->func(ctx);
+  unsigned long long elapsed = gs_bench_now_ns() - start;
+  result.ops = ctx->num_ops;
+  result.ns_per_op = (double)elapsed / (double)ctx->num_ops;
+  result.ops_per_sec = result.ns_per_op > 0.0 ? 1e9 / result.ns_per_op : 0.0;
+  result.bytes_used = ctx->bytes_used;
+
+  ctx->sample = true;
+  ctx->num_samples = 0;
+  ctx->num_ops = 0;
+  bench->func(ctx);
+  qsort(ctx->samples, ctx->num_samples, sizeof(unsigned long long), gs_bench_compare_samples);
+  result.p50_ns = gs_bench_percentile(ctx->samples, ctx->num_samples, 0.5, ns_per_tick);
+  result.p99_ns = gs_bench_percentile(ctx->samples, ctx->num_samples, 0.99, ns_per_tick);
+  result.p999_ns = gs_bench_percentile(ctx->samples, ctx->num_samples, 0.999, ns_per_tick);
+  return result;
+}
+
+int
+main(int argc, char** argv)
+{
+  GSBenchFormat format = GS_BENCH_FORMAT_CSV;
+  unsigned long long ops = GS_BENCH_DEFAULT_OPS;
+  unsigned long long tlb_mb = 0;
+  bool cycles = false;
+  for(int i = 1; i < argc; ++i)
+  {
+    if(strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+    {
+      format = strcmp(argv[++i], "json") == 0 ? GS_BENCH_FORMAT_JSON : GS_BENCH_FORMAT_CSV;
+    }
+    else if(strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+    {
+      ops = strtoull(argv[++i], NULL, 10);
+    }
+    else if(strcmp(argv[i], "-t") == 0)
+    {
+      tlb_mb = GS_BENCH_TLB_DEFAULT_MB;
+      if(i + 1 < argc && argv[i+1][0] != '-')
+      {
+        tlb_mb = strtoull(argv[++i], NULL, 10);
+      }
+    }
+    else if(strcmp(argv[i], "-c") == 0)
+    {
+      cycles = true;
+    }
+    else
+    {
+      fprintf(stderr, "Usage: %s [-f csv|json] [-n ops] [-t [region_mb]] [-c]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if(tlb_mb > 0)
+  {
+    return gs_bench_tlb(format, tlb_mb*1024*1024, ops*50);
+  }
+
+  unsigned long long sizes[] = {12, 16, 24, 32, 64, 256, 1024, 4096};
+  int count_sizes = sizeof(sizes) / sizeof(unsigned long long);
+  unsigned int alignments[] = {8, 16, 64};
+  int count_alignments = sizeof(alignments) / sizeof(unsigned int);
+  int count_benchmarks = sizeof(gs_benchmarks) / sizeof(GSBench);
+
+  GSBenchContext ctx;
+  ctx.ops = ops;
+  ctx.buffer = malloc(GS_BENCH_BUFFER_SIZE);
+  ctx.slots = (void**)malloc(sizeof(void*)*GS_BENCH_SLOTS);
+  ctx.random = (unsigned int*)malloc(sizeof(unsigned int)*ops);
+  // Some patterns perform an extra operation per batch
+  ctx.samples = (unsigned long long*)malloc(sizeof(unsigned long long)*(ops + 2*GS_BENCH_BATCH));
+  if(!ctx.buffer || !ctx.slots || !ctx.random || !ctx.samples)
+  {
+    fprintf(stderr, "Unable to allocate benchmark buffers\n");
+    return 1;
+  }
+  // Pages are touched beforehand so that page faults are not measured
+  memset(ctx.buffer, 0, GS_BENCH_BUFFER_SIZE);
+  srand(0);
+  for(unsigned long long i = 0; i < ops; ++i)
+  {
+    ctx.random[i] = (unsigned int)rand() % GS_BENCH_SLOTS;
+  }
+
+  double ns_per_tick = gs_bench_calibrate_ns_per_tick();
+
+  if(cycles)
+  {
+    int ret = gs_bench_cycles(format, &ctx, ns_per_tick);
+    free(ctx.samples);
+    free(ctx.random);
+    free(ctx.slots);
+    free(ctx.buffer);
+    return ret;
+  }
+
+  gs_bench_print_header(format);
+  bool first = true;
+  for(int b = 0; b < count_benchmarks; ++b)
+  {
+    for(int i = 0; i < count_sizes; ++i)
+    {
+      for(int j = 0; j < count_alignments; ++j)
+      {
+        if(gs_benchmarks[b].max_alignment != 0 && alignments[j] > gs_benchmarks[b].max_alignment)
+        {
+          continue;
+        }
+        ctx.size = sizes[i];
+        ctx.alignment = alignments[j];
+        GSBenchResult result = gs_bench_run(&gs_benchmarks[b], &ctx, ns_per_tick);
+        gs_bench_print_result(format, &result, first);
+        first = false;
+      }
+    }
+  }
+  gs_bench_print_footer(format);
+
+  free(ctx.samples);
+  free(ctx.random);
+  free(ctx.slots);
+  free(ctx.buffer);
+  return 0;
+}
@@ -0,0 +1,316 @@
+#include <stdlib.h>
+#include <list>
+#include <map>
+#include <new>
+#include <vector>
+
+#define GS_MEM_ALLOC_IMPLEMENTATION
+#define GS_MEM_ALLOC_ENABLE_CPP
+#include "gs_mem_alloc.h"
+
+#ifdef GS_MEM_ALLOC_HAS_PMR
+#include <string>
+#include <unordered_map>
+#endif
+
+#define GS_CPP_TEST_SIZE 1024*1024
+
+bool
+gs_cpp_scratch_test()
+{
+  void* ptr = malloc(GS_CPP_TEST_SIZE);
+  if(!ptr)
+    return false;
+
+  GSScratch scratch = gs_scratch_init(ptr, GS_CPP_TEST_SIZE);
+  GSScratchCheckpoint checkpoint = GS_SCRATCH_CHECKPOINT(&scratch);
+  {
+    GSScratchAllocator<int> allocator(&scratch);
+    std::vector<int, GSScratchAllocator<int> > values(allocator);
+    for(int i = 0; i < 1000; ++i)
+    {
+      values.push_back(i);
+    }
+    for(int i = 0; i < 1000; ++i)
+    {
+      GS_ASSERT(values[i] == i);
+    }
+    GS_ASSERT((char*)values.data() >= (char*)scratch.p_begin &&
+              (char*)values.data() < (char*)scratch.p_end);
+
+    // Rebound allocators share the scratch
+    std::map<int, double, std::less<int>, GSScratchAllocator<std::pair<const int, double> > > map(std::less<int>(), allocator);
+    for(int i = 0; i < 100; ++i)
+    {
+      map[i] = i * 0.5;
+    }
+    GS_ASSERT(map.size() == 100 && map[50] == 25.0);
+  }
+  GS_SCRATCH_RESTORE(&scratch, checkpoint);
+  GS_ASSERT(scratch.p_current == scratch.p_begin);
+
+  // Exhausting the scratch fails with std::bad_alloc
+  bool failed = false;
+  try
+  {
+    GSScratchAllocator<char> allocator(&scratch);
+    std::vector<char, GSScratchAllocator<char> > values(GS_CPP_TEST_SIZE + 1, 0, allocator);
+  }
+  catch(const std::bad_alloc&)
+  {
+    failed = true;
+  }
+  GS_ASSERT(failed);
+
+  free(ptr);
+  return true;
+}
+
+bool
+gs_cpp_stack_test()
+{
+  void* ptr = malloc(GS_CPP_TEST_SIZE);
+  if(!ptr)
+    return false;
+
+  GSStack stack = gs_stack_init(ptr, GS_CPP_TEST_SIZE);
+  GSStackCheckpoint checkpoint = GS_STACK_CHECKPOINT(&stack);
+  {
+    // Growing a vector deallocates blocks below the top, which are kept until
+    // the stack is restored
+    GSStackAllocator<long long> allocator(&stack);
+    std::vector<long long, GSStackAllocator<long long> > values(allocator);
+    for(int i = 0; i < 1000; ++i)
+    {
+      values.push_back(i);
+    }
+    for(int i = 0; i < 1000; ++i)
+    {
+      GS_ASSERT(values[i] == i);
+    }
+  }
+  // The last block was at the top, so it was popped
+  GS_ASSERT(stack.p_current != checkpoint.p_current);
+  GS_STACK_RESTORE(&stack, checkpoint);
+
+  {
+    GSStackAllocator<int> allocator(&stack);
+    std::vector<int, GSStackAllocator<int> > values(allocator);
+    values.reserve(100);
+    GS_ASSERT(gs_stack_is_top(&stack, values.data()));
+  }
+  GS_ASSERT(stack.p_current == checkpoint.p_current);
+
+  free(ptr);
+  return true;
+}
+
+bool
+gs_cpp_pool_test()
+{
+  void* ptr = malloc(GS_CPP_TEST_SIZE);
+  if(!ptr)
+    return false;
+
+  GSPool pool = gs_pool_init(ptr, GS_CPP_TEST_SIZE, 64, 16);
+  {
+    GSPoolAllocator<int> allocator(&pool);
+    std::list<int, GSPoolAllocator<int> > values(allocator);
+    for(int i = 0; i < 1000; ++i)
+    {
+      values.push_back(i);
+    }
+    int expected = 0;
+    for(std::list<int, GSPoolAllocator<int> >::iterator it = values.begin(); it != values.end(); ++it)
+    {
+      GS_ASSERT(*it == expected++);
+    }
+    // Freed nodes are reused
+    void* p_current = pool.p_current;
+    values.pop_front();
+    values.push_back(1000);
+    GS_ASSERT(pool.p_current == p_current);
+  }
+
+  // Requests larger than a block fail with std::bad_alloc
+  bool failed = false;
+  try
+  {
+    GSPoolAllocator<int> allocator(&pool);
+    std::vector<int, GSPoolAllocator<int> > values(100, 0, allocator);
+  }
+  catch(const std::bad_alloc&)
+  {
+    failed = true;
+  }
+  GS_ASSERT(failed);
+
+  free(ptr);
+  return true;
+}
+
+struct GSCppTestObject
+{
+  static int count;
+
+  int  value;
+  char padding[20];
+
+  explicit GSCppTestObject(int v) : value(v) 
+  { 
+    if(v < 0)
+      throw std::bad_alloc();
+    count++; 
+  }
+  ~GSCppTestObject() { count--; }
+};
+
+int GSCppTestObject::count = 0;
+
+bool
+gs_cpp_typed_pool_test()
+{
+  void* ptr = malloc(GS_CPP_TEST_SIZE);
+  if(!ptr)
+    return false;
+
+  typedef GSTypedPool<GSCppTestObject, 32> ObjectPool;
+  static_assert(ObjectPool::stride == 32, "GSTypedPool stride");
+  static_assert(ObjectPool::alignment == 32, "GSTypedPool alignment");
+  static_assert(GSTypedPool<char>::stride == GS_MEM_ALLOC_PTR_ALIGNMENT, "GSTypedPool minimum stride");
+
+  ObjectPool pool(ptr, 100*ObjectPool::stride + ObjectPool::alignment - 1);
+  GS_ASSERT(pool.valid());
+  GSCppTestObject* objects[100];
+  for(int i = 0; i < 100; ++i)
+  {
+    objects[i] = pool.create(i);
+    GS_ASSERT(objects[i] != nullptr);
+    GS_ASSERT((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)objects[i] % 32 == 0);
+  }
+  GS_ASSERT(pool.create(100) == nullptr);
+  GS_ASSERT(GSCppTestObject::count == 100);
+  for(int i = 0; i < 100; ++i)
+  {
+    GS_ASSERT(objects[i]->value == i);
+    pool.destroy(objects[i]);
+  }
+  GS_ASSERT(GSCppTestObject::count == 0);
+
+  // A throwing constructor returns the block to the pool
+  void* next = pool.alloc();
+  pool.free((GSCppTestObject*)next);
+  bool failed = false;
+  try
+  {
+    pool.create(-1);
+  }
+  catch(const std::bad_alloc&)
+  {
+    failed = true;
+  }
+  GS_ASSERT(failed);
+  GS_ASSERT(pool.alloc() == next);
+
+  pool.flush();
+  GS_ASSERT((char*)pool.alloc() == pool.base.p_begin);
+
+  free(ptr);
+  return true;
+}
+
+bool
+gs_cpp_resource_test()
+{
+#ifdef GS_MEM_ALLOC_HAS_PMR
+  void* ptr = malloc(3*GS_CPP_TEST_SIZE);
+  if(!ptr)
+    return false;
+
+  GSScratch scratch = gs_scratch_init(ptr, GS_CPP_TEST_SIZE);
+  GSStack stack = gs_stack_init((char*)ptr + GS_CPP_TEST_SIZE, GS_CPP_TEST_SIZE);
+  GSPool pool = gs_pool_init((char*)ptr + 2*GS_CPP_TEST_SIZE, GS_CPP_TEST_SIZE, 64, 16);
+  GSScratchResource scratch_resource(&scratch);
+  GSStackResource stack_resource(&stack);
+  GSPoolResource pool_resource(&pool);
+  GS_ASSERT(scratch_resource.is_equal(scratch_resource));
+  GS_ASSERT(!scratch_resource.is_equal(stack_resource));
+  {
+    std::pmr::vector<std::pmr::string> strings(&scratch_resource);
+    for(int i = 0; i < 100; ++i)
+    {
+      strings.emplace_back(64, (char)('a' + i % 26));
+    }
+    GS_ASSERT(strings[27][63] == 'b');
+    GS_ASSERT(strings[27].get_allocator().resource() == &scratch_resource);
+
+    std::pmr::unordered_map<int, int> map(&stack_resource);
+    for(int i = 0; i < 1000; ++i)
+    {
+      map[i] = 2*i;
+    }
+    GS_ASSERT(map.size() == 1000 && map[500] == 1000);
+
+    std::pmr::list<int> values(&pool_resource);
+    for(int i = 0; i < 1000; ++i)
+    {
+      values.push_back(i);
+    }
+    GS_ASSERT(values.back() == 999);
+  }
+  GS_ASSERT((char*)scratch.p_current > (char*)scratch.p_begin);
+
+  bool failed = false;
+  try
+  {
+    std::pmr::vector<int> values(100, 0, &pool_resource);
+  }
+  catch(const std::bad_alloc&)
+  {
+    failed = true;
+  }
+  GS_ASSERT(failed);
+
+  free(ptr);
+#endif
+  return true;
+}
+
+int
+main(int argc, char** argv)
+{
+  int EXIT_CODE = 0;
+
+  if(!gs_cpp_scratch_test())
+  {
+    EXIT_CODE = 1;
+    goto exit;
+  }
+
+  if(!gs_cpp_stack_test())
+  {
+    EXIT_CODE = 1;
+    goto exit;
+  }
+
+  if(!gs_cpp_pool_test())
+  {
+    EXIT_CODE = 1;
+    goto exit;
+  }
+
+  if(!gs_cpp_typed_pool_test())
+  {
+    EXIT_CODE = 1;
+    goto exit;
+  }
+
+  if(!gs_cpp_resource_test())
+  {
+    EXIT_CODE = 1;
+    goto exit;
+  }
+
+exit:
+  return EXIT_CODE;
+}
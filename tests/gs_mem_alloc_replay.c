@@ -0,0 +1,923 @@
+// The implementation is included before any system header, so that its
+// feature macros apply to them (see gs_mem_alloc.h). Stats are used to report
+// the peak usage of the allocators. Tracing must not be enabled, otherwise the
+// replay would record itself
+#define GS_MEM_ALLOC_IMPLEMENTATION
+#define GS_MEM_ALLOC_ENABLE_STATS
+#include "gs_mem_alloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define GS_REPLAY_BACKEND_GS      0
+#define GS_REPLAY_BACKEND_MALLOC  1
+
+#define GS_REPLAY_NO_SLOT         0xffffffffffffffffull
+
+////////////////////////////////////////////////
+/////////////////// TIMING /////////////////////
+////////////////////////////////////////////////
+
+unsigned long long
+gs_replay_now_ns()
+{
+#ifdef _WIN32
+  LARGE_INTEGER counter, frequency;
+  QueryPerformanceCounter(&counter);
+  QueryPerformanceFrequency(&frequency);
+  return (unsigned long long)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ull + (unsigned long long)ts.tv_nsec;
+#endif
+}
+
+////////////////////////////////////////////////
+/////////////////// ARRAYS /////////////////////
+////////////////////////////////////////////////
+
+typedef struct GSReplayArray
+{
+  unsigned long long* p_data;
+  unsigned long long  count;
+  unsigned long long  capacity;
+} GSReplayArray;
+
+void
+gs_replay_array_push(GSReplayArray* array,
+                     unsigned long long value)
+{
+  if(array->count == array->capacity)
+  {
+    array->capacity = array->capacity == 0 ? 64 : array->capacity*2;
+    array->p_data = (unsigned long long*)realloc(array->p_data, sizeof(unsigned long long)*array->capacity);
+    if(array->p_data == NULL)
+    {
+      printf("Out of memory\n");
+      exit(1);
+    }
+  }
+  array->p_data[array->count++] = value;
+}
+
+////////////////////////////////////////////////
+/////////////////// PTR MAP ////////////////////
+////////////////////////////////////////////////
+
+// Maps the addresses of the live allocations in the trace to their slots.
+// Addresses are keyed together with their allocator, since nested allocators
+// can return the same address (e.g. a pool in a stack allocation). Open
+// addressing with linear probing and backward shift deletion
+typedef struct GSReplayPtrMap
+{
+  unsigned long long* p_keys;
+  unsigned long long* p_owners;
+  unsigned long long* p_values;
+  unsigned long long  mask;
+} GSReplayPtrMap;
+
+static unsigned long long
+gs_replay_hash(unsigned long long key, 
+               unsigned long long owner)
+{
+  key ^= owner * 0x9e3779b97f4a7c15ull;
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdull;
+  key ^= key >> 33;
+  return key;
+}
+
+void
+gs_replay_ptr_map_init(GSReplayPtrMap* map,
+                       unsigned long long max_entries)
+{
+  unsigned long long capacity = 64;
+  while(capacity < 2*max_entries)
+  {
+    capacity *= 2;
+  }
+  map->p_keys = (unsigned long long*)calloc(capacity, sizeof(unsigned long long));
+  map->p_owners = (unsigned long long*)malloc(capacity*sizeof(unsigned long long));
+  map->p_values = (unsigned long long*)malloc(capacity*sizeof(unsigned long long));
+  map->mask = capacity - 1;
+  if(map->p_keys == NULL || map->p_owners == NULL || map->p_values == NULL)
+  {
+    printf("Out of memory\n");
+    exit(1);
+  }
+}
+
+void
+gs_replay_ptr_map_insert(GSReplayPtrMap* map,
+                         unsigned long long key,
+                         unsigned long long owner,
+                         unsigned long long value)
+{
+  unsigned long long i = gs_replay_hash(key, owner) & map->mask;
+  while(map->p_keys[i] != 0 && (map->p_keys[i] != key || map->p_owners[i] != owner))
+  {
+    i = (i + 1) & map->mask;
+  }
+  map->p_keys[i] = key;
+  map->p_owners[i] = owner;
+  map->p_values[i] = value;
+}
+
+// Removes the key and returns its value, or GS_REPLAY_NO_SLOT if not found
+unsigned long long
+gs_replay_ptr_map_remove(GSReplayPtrMap* map,
+                         unsigned long long key,
+                         unsigned long long owner)
+{
+  unsigned long long i = gs_replay_hash(key, owner) & map->mask;
+  while(map->p_keys[i] != key || map->p_owners[i] != owner)
+  {
+    if(map->p_keys[i] == 0)
+    {
+      return GS_REPLAY_NO_SLOT;
+    }
+    i = (i + 1) & map->mask;
+  }
+  unsigned long long value = map->p_values[i];
+
+  // The following entries of the cluster are shifted back if the removed
+  // entry lies between their home position and their current position
+  unsigned long long j = i;
+  while(true)
+  {
+    j = (j + 1) & map->mask;
+    if(map->p_keys[j] == 0)
+    {
+      break;
+    }
+    unsigned long long home = gs_replay_hash(map->p_keys[j], map->p_owners[j]) & map->mask;
+    if(((j - home) & map->mask) >= ((j - i) & map->mask))
+    {
+      map->p_keys[i] = map->p_keys[j];
+      map->p_owners[i] = map->p_owners[j];
+      map->p_values[i] = map->p_values[j];
+      i = j;
+    }
+  }
+  map->p_keys[i] = 0;
+  return value;
+}
+
+////////////////////////////////////////////////
+/////////////////// PROGRAM ////////////////////
+////////////////////////////////////////////////
+
+// A trace is compiled into a program where allocations are referred to by
+// slots and checkpoints by checkpoint slots, so that the replay does not
+// perform any lookup
+typedef struct GSReplayOp
+{
+  unsigned char       op;
+  unsigned int        allocator;
+  unsigned long long  slot;                                                     // The allocation slot, or the checkpoint slot
+  unsigned long long  size;
+  unsigned int        alignment;
+  unsigned long long  prev_size;                                                // The size of the allocation before a resize
+  unsigned long long  first_released;                                           // The slots released by flushes and restores in the released array
+  unsigned long long  num_released;
+} GSReplayOp;
+
+typedef struct GSReplayCheckpoint
+{
+  unsigned long long  ptr;                                                      // The current pointer recorded in the trace
+  unsigned long long  num_live;                                                 // The number of live allocations when taken
+  unsigned long long  slot;
+} GSReplayCheckpoint;
+
+typedef struct GSReplayAllocator
+{
+  unsigned char       type;
+  unsigned long long  size;
+  unsigned long long  param;                                                    // The block size of pools, the chunk size of chained scratches
+  unsigned int        alignment;
+  void*               region;
+  GSStack             stack;
+  GSScratch           scratch;
+  GSPool              pool;
+
+  // Compilation state
+  GSReplayArray       live;                                                     // The live slots in allocation order
+  GSReplayCheckpoint* p_checkpoints;
+  unsigned long long  num_checkpoints;
+} GSReplayAllocator;
+
+typedef union GSReplayCheckpointState
+{
+  GSStackCheckpoint   stack;
+  GSScratchCheckpoint scratch;
+} GSReplayCheckpointState;
+
+typedef struct GSReplayProgram
+{
+  GSReplayOp*         p_ops;
+  unsigned long long  num_ops;
+  GSReplayAllocator*  p_allocators;
+  unsigned long long  num_allocators;
+  GSReplayArray       released;
+  unsigned long long  first_remaining;                                          // The slots still live at the end of the trace in the released array
+  unsigned long long  num_slots;
+  unsigned long long  num_checkpoint_slots;
+  unsigned long long  num_skipped;
+  unsigned long long  num_failed;
+  unsigned long long  peak_requested;
+} GSReplayProgram;
+
+static void
+gs_replay_release(GSReplayProgram* program,
+                  unsigned int index,
+                  GSReplayPtrMap* map,
+                  unsigned long long* slot_ptrs,
+                  unsigned long long* slot_sizes,
+                  unsigned long long num_live,
+                  unsigned long long* requested)
+{
+  GSReplayAllocator* allocator = &program->p_allocators[index];
+  while(allocator->live.count > num_live)
+  {
+    unsigned long long slot = allocator->live.p_data[--allocator->live.count];
+    gs_replay_ptr_map_remove(map, slot_ptrs[slot], index);
+    *requested -= slot_sizes[slot];
+    gs_replay_array_push(&program->released, slot);
+  }
+}
+
+bool
+gs_replay_compile(GSTraceEvent* events,
+                  unsigned long long num_events,
+                  GSReplayProgram* program)
+{
+  memset(program, 0, sizeof(GSReplayProgram));
+  unsigned int max_id = 0;
+  for(unsigned long long i = 0; i < num_events; ++i)
+  {
+    max_id = events[i].id > max_id ? events[i].id : max_id;
+  }
+
+  unsigned int* id_to_allocator = (unsigned int*)malloc(sizeof(unsigned int)*((unsigned long long)max_id + 1));
+  program->p_ops = (GSReplayOp*)malloc(sizeof(GSReplayOp)*(num_events + 1));
+  program->p_allocators = (GSReplayAllocator*)calloc(num_events + 1, sizeof(GSReplayAllocator));
+  unsigned long long* slot_ptrs = (unsigned long long*)malloc(sizeof(unsigned long long)*(num_events + 1));
+  unsigned long long* slot_sizes = (unsigned long long*)malloc(sizeof(unsigned long long)*(num_events + 1));
+  unsigned int* slot_alignments = (unsigned int*)malloc(sizeof(unsigned int)*(num_events + 1));
+  unsigned long long* slot_allocators = (unsigned long long*)malloc(sizeof(unsigned long long)*(num_events + 1));
+  unsigned long long* slot_positions = (unsigned long long*)malloc(sizeof(unsigned long long)*(num_events + 1));
+  if(!id_to_allocator || !program->p_ops || !program->p_allocators ||
+     !slot_ptrs || !slot_sizes || !slot_alignments || !slot_allocators || !slot_positions)
+  {
+    return false;
+  }
+  for(unsigned long long i = 0; i <= max_id; ++i)
+  {
+    id_to_allocator[i] = 0xffffffff;
+  }
+
+  GSReplayPtrMap map;
+  gs_replay_ptr_map_init(&map, num_events);
+  unsigned long long requested = 0;
+
+  for(unsigned long long i = 0; i < num_events; ++i)
+  {
+    GSTraceEvent* event = &events[i];
+    if(event->op == GS_TRACE_OP_INIT)
+    {
+      GSReplayAllocator* allocator = &program->p_allocators[program->num_allocators];
+      allocator->type = event->allocator;
+      allocator->size = event->size;
+      allocator->param = event->ptr;
+      allocator->alignment = event->alignment;
+      id_to_allocator[event->id] = (unsigned int)program->num_allocators;
+      allocator->p_checkpoints = NULL;
+      GSReplayOp* op = &program->p_ops[program->num_ops++];
+      op->op = GS_TRACE_OP_INIT;
+      op->allocator = (unsigned int)program->num_allocators++;
+      op->slot = GS_REPLAY_NO_SLOT;
+      op->size = event->size;
+      op->alignment = event->alignment;
+      op->prev_size = 0;
+      op->first_released = program->released.count;
+      op->num_released = 0;
+      continue;
+    }
+
+    // Events of allocators initialized before the trace started cannot be
+    // replayed
+    unsigned int index = id_to_allocator[event->id];
+    if(index == 0xffffffff || program->p_allocators[index].type != event->allocator)
+    {
+      program->num_skipped++;
+      continue;
+    }
+    GSReplayAllocator* allocator = &program->p_allocators[index];
+
+    GSReplayOp op;
+    op.op = event->op;
+    op.allocator = index;
+    op.slot = GS_REPLAY_NO_SLOT;
+    op.size = event->size;
+    op.alignment = event->alignment;
+    op.prev_size = 0;
+    op.first_released = program->released.count;
+    op.num_released = 0;
+
+    switch(event->op)
+    {
+      case GS_TRACE_OP_ALLOC:
+      case GS_TRACE_OP_ALLOC_ALL:
+        // Failed allocations are not replayed, otherwise they could succeed
+        // in the replay and break the order of pops
+        if(event->ptr == 0)
+        {
+          program->num_failed++;
+          continue;
+        }
+        op.slot = program->num_slots++;
+        slot_ptrs[op.slot] = event->ptr;
+        slot_sizes[op.slot] = event->size;
+        slot_alignments[op.slot] = event->alignment;
+        slot_allocators[op.slot] = index;
+        slot_positions[op.slot] = allocator->live.count;
+        gs_replay_array_push(&allocator->live, op.slot);
+        gs_replay_ptr_map_insert(&map, event->ptr, index, op.slot);
+        requested += event->size;
+        if(requested > program->peak_requested)
+        {
+          program->peak_requested = requested;
+        }
+        break;
+      case GS_TRACE_OP_FREE:
+        op.slot = gs_replay_ptr_map_remove(&map, event->ptr, index);
+        if(op.slot == GS_REPLAY_NO_SLOT || slot_allocators[op.slot] != index)
+        {
+          program->num_skipped++;
+          continue;
+        }
+        requested -= slot_sizes[op.slot];
+        if(allocator->type == GS_TRACE_POOL)
+        {
+          // Pool blocks are freed in any order, the last live slot takes the
+          // place of the freed one
+          unsigned long long last = allocator->live.p_data[--allocator->live.count];
+          allocator->live.p_data[slot_positions[op.slot]] = last;
+          slot_positions[last] = slot_positions[op.slot];
+        }
+        else
+        {
+          // Pops free the top of the stack, releasing any allocation above
+          // it that was never popped
+          unsigned long long position = slot_positions[op.slot];
+          gs_replay_release(program, index, &map, slot_ptrs, slot_sizes, position + 1, &requested);
+          allocator->live.count = position;
+          op.num_released = program->released.count - op.first_released;
+        }
+        break;
+      case GS_TRACE_OP_RESIZE:
+        op.slot = gs_replay_ptr_map_remove(&map, event->ptr, index);
+        if(op.slot == GS_REPLAY_NO_SLOT)
+        {
+          program->num_skipped++;
+          continue;
+        }
+        gs_replay_ptr_map_insert(&map, event->ptr, index, op.slot);
+        op.prev_size = slot_sizes[op.slot];
+        op.alignment = slot_alignments[op.slot];
+        requested += event->size - slot_sizes[op.slot];
+        if(requested > program->peak_requested)
+        {
+          program->peak_requested = requested;
+        }
+        slot_sizes[op.slot] = event->size;
+        break;
+      case GS_TRACE_OP_FLUSH:
+        gs_replay_release(program, index, &map, slot_ptrs, slot_sizes, 0, &requested);
+        op.num_released = program->released.count - op.first_released;
+        allocator->num_checkpoints = 0;
+        break;
+      case GS_TRACE_OP_CHECKPOINT:
+        {
+          allocator->p_checkpoints = (GSReplayCheckpoint*)realloc(allocator->p_checkpoints,
+                                                                  sizeof(GSReplayCheckpoint)*(allocator->num_checkpoints + 1));
+          GSReplayCheckpoint* checkpoint = &allocator->p_checkpoints[allocator->num_checkpoints++];
+          checkpoint->ptr = event->ptr;
+          checkpoint->num_live = allocator->live.count;
+          checkpoint->slot = program->num_checkpoint_slots++;
+          op.slot = checkpoint->slot;
+        }
+        break;
+      case GS_TRACE_OP_RESTORE:
+        {
+          // The most recent checkpoint taken at the restored pointer is the
+          // one restored. Newer checkpoints are discarded
+          unsigned long long i = allocator->num_checkpoints;
+          while(i > 0 && allocator->p_checkpoints[i-1].ptr != event->ptr)
+          {
+            i--;
+          }
+          if(i == 0)
+          {
+            program->num_skipped++;
+            continue;
+          }
+          allocator->num_checkpoints = i;
+          GSReplayCheckpoint* checkpoint = &allocator->p_checkpoints[i-1];
+          gs_replay_release(program, index, &map, slot_ptrs, slot_sizes, checkpoint->num_live, &requested);
+          op.slot = checkpoint->slot;
+          op.num_released = program->released.count - op.first_released;
+        }
+        break;
+      default:
+        program->num_skipped++;
+        continue;
+    }
+    program->p_ops[program->num_ops++] = op;
+  }
+
+  program->first_remaining = program->released.count;
+  for(unsigned long long i = 0; i < program->num_allocators; ++i)
+  {
+    GSReplayAllocator* allocator = &program->p_allocators[i];
+    for(unsigned long long j = 0; j < allocator->live.count; ++j)
+    {
+      gs_replay_array_push(&program->released, allocator->live.p_data[j]);
+    }
+    free(allocator->live.p_data);
+    free(allocator->p_checkpoints);
+    allocator->live.p_data = NULL;
+    allocator->p_checkpoints = NULL;
+  }
+
+  free(map.p_keys);
+  free(map.p_owners);
+  free(map.p_values);
+  free(slot_positions);
+  free(slot_allocators);
+  free(slot_alignments);
+  free(slot_sizes);
+  free(slot_ptrs);
+  free(id_to_allocator);
+  return true;
+}
+
+////////////////////////////////////////////////
+/////////////////// REPLAY /////////////////////
+////////////////////////////////////////////////
+
+static void*
+gs_replay_malloc_chunk(void* user_data,
+                       unsigned long long size)
+{
+  (void)user_data;
+  return malloc(size);
+}
+
+static void
+gs_replay_free_chunk(void* user_data,
+                     void* ptr,
+                     unsigned long long size)
+{
+  (void)user_data;
+  (void)size;
+  free(ptr);
+}
+
+// Replays the program against the allocators recorded in the trace. Returns
+// the number of allocations that failed
+unsigned long long
+gs_replay_run_gs(GSReplayProgram* program,
+                 void** slots,
+                 GSReplayCheckpointState* checkpoints)
+{
+  unsigned long long num_failed = 0;
+  for(unsigned long long i = 0; i < program->num_ops; ++i)
+  {
+    GSReplayOp* op = &program->p_ops[i];
+    GSReplayAllocator* allocator = &program->p_allocators[op->allocator];
+    GSAlloc alloc;
+    unsigned long long size;
+    switch(allocator->type)
+    {
+      case GS_TRACE_STACK:
+        switch(op->op)
+        {
+          case GS_TRACE_OP_INIT:
+            allocator->stack = gs_stack_init(allocator->region, allocator->size);
+            break;
+          case GS_TRACE_OP_ALLOC:
+            alloc = gs_stack_push(&allocator->stack, op->size, op->alignment);
+            num_failed += gs_alloc_is_null(&alloc);
+            slots[op->slot] = alloc.ptr;
+            break;
+          case GS_TRACE_OP_ALLOC_ALL:
+            alloc = gs_stack_push_all(&allocator->stack, op->alignment, &size);
+            num_failed += gs_alloc_is_null(&alloc);
+            slots[op->slot] = alloc.ptr;
+            break;
+          case GS_TRACE_OP_FREE:
+            if(slots[op->slot] != NULL)
+            {
+              gs_stack_pop(&allocator->stack, slots[op->slot]);
+            }
+            break;
+          case GS_TRACE_OP_RESIZE:
+            num_failed += slots[op->slot] == NULL || 
+                          !gs_stack_resize_top(&allocator->stack, slots[op->slot], op->size);
+            break;
+          case GS_TRACE_OP_FLUSH:
+            gs_stack_flush(&allocator->stack);
+            break;
+          case GS_TRACE_OP_CHECKPOINT:
+            checkpoints[op->slot].stack = GS_STACK_CHECKPOINT(&allocator->stack);
+            break;
+          case GS_TRACE_OP_RESTORE:
+            GS_STACK_RESTORE(&allocator->stack, checkpoints[op->slot].stack);
+            break;
+        }
+        break;
+      case GS_TRACE_SCRATCH:
+        switch(op->op)
+        {
+          case GS_TRACE_OP_INIT:
+            if(allocator->param != 0)
+            {
+              GSChunkBacking backing;
+              backing.alloc = gs_replay_malloc_chunk;
+              backing.free = gs_replay_free_chunk;
+              backing.user_data = NULL;
+              allocator->scratch = gs_scratch_init_chained(allocator->region,
+                                                           allocator->size,
+                                                           backing,
+                                                           allocator->param);
+            }
+            else
+            {
+              allocator->scratch = gs_scratch_init(allocator->region, allocator->size);
+            }
+            break;
+          case GS_TRACE_OP_ALLOC:
+            alloc = gs_scratch_push(&allocator->scratch, op->size, op->alignment);
+            num_failed += gs_alloc_is_null(&alloc);
+            slots[op->slot] = alloc.ptr;
+            break;
+          case GS_TRACE_OP_ALLOC_ALL:
+            alloc = gs_scratch_push_all(&allocator->scratch, op->alignment, &size);
+            num_failed += gs_alloc_is_null(&alloc);
+            slots[op->slot] = alloc.ptr;
+            break;
+          case GS_TRACE_OP_RESIZE:
+            num_failed += slots[op->slot] == NULL || 
+                          !gs_scratch_resize_last(&allocator->scratch, slots[op->slot], op->prev_size, op->size);
+            break;
+          case GS_TRACE_OP_FLUSH:
+            gs_scratch_flush(&allocator->scratch);
+            break;
+          case GS_TRACE_OP_CHECKPOINT:
+            checkpoints[op->slot].scratch = GS_SCRATCH_CHECKPOINT(&allocator->scratch);
+            break;
+          case GS_TRACE_OP_RESTORE:
+            GS_SCRATCH_RESTORE(&allocator->scratch, checkpoints[op->slot].scratch);
+            break;
+        }
+        break;
+      case GS_TRACE_POOL:
+        switch(op->op)
+        {
+          case GS_TRACE_OP_INIT:
+            allocator->pool = gs_pool_init(allocator->region,
+                                           allocator->size,
+                                           allocator->param,
+                                           allocator->alignment);
+            break;
+          case GS_TRACE_OP_ALLOC:
+            alloc = gs_pool_alloc(&allocator->pool, allocator->pool.bsize, allocator->pool.alignment);
+            num_failed += gs_alloc_is_null(&alloc);
+            slots[op->slot] = alloc.ptr;
+            break;
+          case GS_TRACE_OP_FREE:
+            if(slots[op->slot] != NULL)
+            {
+              gs_pool_free(&allocator->pool, slots[op->slot]);
+            }
+            break;
+          case GS_TRACE_OP_FLUSH:
+            gs_pool_flush(&allocator->pool);
+            break;
+        }
+        break;
+    }
+  }
+  return num_failed;
+}
+
+// Replays the program against malloc. Aligned allocations over-allocate and
+// keep the pointer returned by malloc to free it
+unsigned long long
+gs_replay_run_malloc(GSReplayProgram* program,
+                     void** slots,
+                     void** raw_slots)
+{
+  unsigned long long num_failed = 0;
+  unsigned long long* released = program->released.p_data;
+  for(unsigned long long i = 0; i < program->num_ops; ++i)
+  {
+    GSReplayOp* op = &program->p_ops[i];
+    switch(op->op)
+    {
+      case GS_TRACE_OP_ALLOC:
+      case GS_TRACE_OP_ALLOC_ALL:
+        if(op->alignment <= GS_MEM_ALLOC_MIN_ALIGNMENT)
+        {
+          raw_slots[op->slot] = malloc(op->size);
+          slots[op->slot] = raw_slots[op->slot];
+        }
+        else
+        {
+          void* ptr = malloc(op->size + op->alignment);
+          raw_slots[op->slot] = ptr;
+          if(ptr != NULL)
+          {
+            GS_ALIGN_PTR(ptr, op->alignment);
+          }
+          slots[op->slot] = ptr;
+        }
+        num_failed += slots[op->slot] == NULL;
+        break;
+      case GS_TRACE_OP_FREE:
+        free(raw_slots[op->slot]);
+        break;
+      case GS_TRACE_OP_RESIZE:
+        if(op->alignment <= GS_MEM_ALLOC_MIN_ALIGNMENT)
+        {
+          raw_slots[op->slot] = realloc(raw_slots[op->slot], op->size);
+          slots[op->slot] = raw_slots[op->slot];
+        }
+        else
+        {
+          // realloc could break the alignment, so the block is moved by hand
+          void* ptr = malloc(op->size + op->alignment);
+          void* raw_ptr = ptr;
+          if(ptr != NULL)
+          {
+            GS_ALIGN_PTR(ptr, op->alignment);
+            memcpy(ptr, slots[op->slot], op->prev_size < op->size ? op->prev_size : op->size);
+          }
+          free(raw_slots[op->slot]);
+          raw_slots[op->slot] = raw_ptr;
+          slots[op->slot] = ptr;
+        }
+        num_failed += slots[op->slot] == NULL;
+        break;
+    }
+
+    for(unsigned long long j = 0; j < op->num_released; ++j)
+    {
+      free(raw_slots[released[op->first_released + j]]);
+    }
+  }
+  return num_failed;
+}
+
+// Releases what is left after a run, outside of the timed region
+void
+gs_replay_cleanup(GSReplayProgram* program,
+                  int backend,
+                  void** raw_slots)
+{
+  if(backend == GS_REPLAY_BACKEND_MALLOC)
+  {
+    for(unsigned long long i = program->first_remaining; i < program->released.count; ++i)
+    {
+      free(raw_slots[program->released.p_data[i]]);
+    }
+    return;
+  }
+
+  for(unsigned long long i = 0; i < program->num_allocators; ++i)
+  {
+    GSReplayAllocator* allocator = &program->p_allocators[i];
+    if(allocator->type == GS_TRACE_SCRATCH && allocator->scratch.valid)
+    {
+      gs_scratch_flush_release(&allocator->scratch);
+    }
+  }
+}
+
+// Returns the sum of the high water marks of all the allocators
+unsigned long long
+gs_replay_peak_usage(GSReplayProgram* program)
+{
+  unsigned long long peak = 0;
+  for(unsigned long long i = 0; i < program->num_allocators; ++i)
+  {
+    GSReplayAllocator* allocator = &program->p_allocators[i];
+    GSAllocStats stats;
+    switch(allocator->type)
+    {
+      case GS_TRACE_STACK:
+        stats = gs_stack_get_stats(&allocator->stack);
+        break;
+      case GS_TRACE_SCRATCH:
+        stats = gs_scratch_get_stats(&allocator->scratch);
+        break;
+      default:
+        stats = gs_pool_get_stats(&allocator->pool);
+        break;
+    }
+    peak += stats.high_water_mark;
+  }
+  return peak;
+}
+
+////////////////////////////////////////////////
+/////////////////// MAIN ///////////////////////
+////////////////////////////////////////////////
+
+GSTraceEvent*
+gs_replay_load(const char* path,
+               GSTraceFileHeader* header)
+{
+  FILE* file = fopen(path, "rb");
+  if(file == NULL)
+  {
+    printf("Cannot open trace %s\n", path);
+    return NULL;
+  }
+
+  GSTraceEvent* events = NULL;
+  if(fread(header, sizeof(GSTraceFileHeader), 1, file) != 1 ||
+     header->magic != GS_TRACE_FILE_MAGIC ||
+     header->version != GS_TRACE_FILE_VERSION ||
+     header->event_size != sizeof(GSTraceEvent))
+  {
+    printf("Invalid trace file %s\n", path);
+  }
+  else
+  {
+    events = (GSTraceEvent*)malloc(sizeof(GSTraceEvent)*(header->num_events + 1));
+    if(events != NULL &&
+       fread(events, sizeof(GSTraceEvent), header->num_events, file) != header->num_events)
+    {
+      printf("Truncated trace file %s\n", path);
+      free(events);
+      events = NULL;
+    }
+  }
+  fclose(file);
+  return events;
+}
+
+void
+gs_replay_usage()
+{
+  printf("Usage: gs_mem_alloc_replay [-b gs|malloc] [-r runs] trace_file\n");
+  printf("  -b  The backend to replay against: the allocators in the trace (gs, default) or malloc\n");
+  printf("  -r  The number of runs, the fastest one is reported. Default: 5\n");
+}
+
+int
+main(int argc, char** argv)
+{
+  int backend = GS_REPLAY_BACKEND_GS;
+  int runs = 5;
+  const char* path = NULL;
+  for(int i = 1; i < argc; ++i)
+  {
+    if(strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+    {
+      i++;
+      if(strcmp(argv[i], "malloc") == 0)
+      {
+        backend = GS_REPLAY_BACKEND_MALLOC;
+      }
+      else if(strcmp(argv[i], "gs") != 0)
+      {
+        gs_replay_usage();
+        return 1;
+      }
+    }
+    else if(strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+    {
+      runs = atoi(argv[++i]);
+      runs = runs < 1 ? 1 : runs;
+    }
+    else if(argv[i][0] != '-' && path == NULL)
+    {
+      path = argv[i];
+    }
+    else
+    {
+      gs_replay_usage();
+      return 1;
+    }
+  }
+
+  if(path == NULL)
+  {
+    gs_replay_usage();
+    return 1;
+  }
+
+  GSTraceFileHeader header;
+  GSTraceEvent* events = gs_replay_load(path, &header);
+  if(events == NULL)
+  {
+    return 1;
+  }
+
+  GSReplayProgram program;
+  if(!gs_replay_compile(events, header.num_events, &program))
+  {
+    printf("Out of memory\n");
+    return 1;
+  }
+  free(events);
+
+  void** slots = (void**)calloc(program.num_slots + 1, sizeof(void*));
+  void** raw_slots = (void**)calloc(program.num_slots + 1, sizeof(void*));
+  GSReplayCheckpointState* checkpoints = (GSReplayCheckpointState*)calloc(program.num_checkpoint_slots + 1,
+                                                                          sizeof(GSReplayCheckpointState));
+  if(!slots || !raw_slots || !checkpoints)
+  {
+    printf("Out of memory\n");
+    return 1;
+  }
+
+  if(backend == GS_REPLAY_BACKEND_GS)
+  {
+    for(unsigned long long i = 0; i < program.num_allocators; ++i)
+    {
+      GSReplayAllocator* allocator = &program.p_allocators[i];
+      allocator->region = malloc(allocator->size);
+      if(allocator->region == NULL)
+      {
+        printf("Cannot allocate a region of %llu bytes\n", allocator->size);
+        return 1;
+      }
+    }
+  }
+
+  unsigned long long best_ns = 0;
+  unsigned long long num_failed = 0;
+  for(int run = 0; run < runs; ++run)
+  {
+    unsigned long long start = gs_replay_now_ns();
+    if(backend == GS_REPLAY_BACKEND_GS)
+    {
+      num_failed = gs_replay_run_gs(&program, slots, checkpoints);
+    }
+    else
+    {
+      num_failed = gs_replay_run_malloc(&program, slots, raw_slots);
+    }
+    unsigned long long elapsed = gs_replay_now_ns() - start;
+    best_ns = (run == 0 || elapsed < best_ns) ? elapsed : best_ns;
+
+    if(run + 1 < runs)
+    {
+      gs_replay_cleanup(&program, backend, raw_slots);
+    }
+  }
+
+  printf("trace:               %s\n", path);
+  printf("events:              %llu (%llu dropped by the ring buffer)\n", header.num_events, header.num_dropped);
+  printf("allocators:          %llu\n", program.num_allocators);
+  printf("operations:          %llu (%llu skipped, %llu failed in the trace)\n", program.num_ops, program.num_skipped, program.num_failed);
+  printf("backend:             %s\n", backend == GS_REPLAY_BACKEND_GS ? "gs" : "malloc");
+  printf("time:                %.3f ms (%.2f ns/op, best of %d runs)\n",
+         (double)best_ns / 1e6,
+         program.num_ops > 0 ? (double)best_ns / (double)program.num_ops : 0.0,
+         runs);
+  printf("failed allocations:  %llu\n", num_failed);
+  printf("peak requested:      %llu bytes\n", program.peak_requested);
+  if(backend == GS_REPLAY_BACKEND_GS)
+  {
+    printf("peak usage:          %llu bytes\n", gs_replay_peak_usage(&program));
+  }
+
+  gs_replay_cleanup(&program, backend, raw_slots);
+  if(backend == GS_REPLAY_BACKEND_GS)
+  {
+    for(unsigned long long i = 0; i < program.num_allocators; ++i)
+    {
+      free(program.p_allocators[i].region);
+    }
+  }
+  free(checkpoints);
+  free(raw_slots);
+  free(slots);
+  free(program.released.p_data);
+  free(program.p_allocators);
+  free(program.p_ops);
+  return 0;
+}
@@ -1,15 +1,112 @@
+// The implementation is included before any system header, so that its
+// feature macros apply to them (see gs_mem_alloc.h)
+#define GS_MEM_ALLOC_IMPLEMENTATION
+#define GS_MEM_ALLOC_ENABLE_STATS
+#define GS_MEM_ALLOC_ENABLE_TRACE
+// Leaves generations wider than 32 bits (see gs_handle_pool_test)
+#define GS_MEM_ALLOC_HANDLE_INDEX_BITS 24
+#include "gs_mem_alloc.h"
 
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define GS_MEM_ALLOC_IMPLEMENTATION
-#include "gs_mem_alloc.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 #define GS_STACK_TEST_SIZE 1024*1024
 #define GS_SCRATCH_TEST_SIZE 1024*1024
 #define GS_POOL_TEST_SIZE 1024*1024
+#define GS_TEST_NUM_THREADS 4
+
+typedef void (*GSTestThreadFunc)(void*);
+
+typedef struct GSTestThreadArgs
+{
+  GSTestThreadFunc func;
+  void*            arg;
+} GSTestThreadArgs;
+
+#ifdef _WIN32
+static DWORD WINAPI
+gs_test_thread_main(LPVOID arg)
+{
+  GSTestThreadArgs* args = (GSTestThreadArgs*)arg;
+  args->func(args->arg);
+  return 0;
+}
+#else
+static void*
+gs_test_thread_main(void* arg)
+{
+  GSTestThreadArgs* args = (GSTestThreadArgs*)arg;
+  args->func(args->arg);
+  return NULL;
+}
+#endif
+
+#ifndef _WIN32
+// Runs func(arg) in a child process, returning true if it aborted, as a failed
+// GS_ASSERT does
+bool
+gs_test_aborts(GSTestThreadFunc func, 
+               void* arg)
+{
+  fflush(stdout);
+  pid_t pid = fork();
+  if(pid == 0)
+  {
+    // The message of the failed assert is expected
+    if(freopen("/dev/null", "w", stdout) == NULL)
+      _exit(0);
+    func(arg);
+    _exit(0);
+  }
+  int status = 0;
+  if(pid < 0 || waitpid(pid, &status, 0) != pid)
+    return false;
+  return WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT;
+}
+#endif
+
+// Runs func in GS_TEST_NUM_THREADS threads, passing args[i] to the i-th thread
+void
+gs_test_run_threads(GSTestThreadFunc func, 
+                    void** args)
+{
+  GSTestThreadArgs thread_args[GS_TEST_NUM_THREADS];
+#ifdef _WIN32
+  HANDLE threads[GS_TEST_NUM_THREADS];
+#else
+  pthread_t threads[GS_TEST_NUM_THREADS];
+#endif
+  for(int i = 0; i < GS_TEST_NUM_THREADS; ++i)
+  {
+    thread_args[i].func = func;
+    thread_args[i].arg = args[i];
+#ifdef _WIN32
+    threads[i] = CreateThread(NULL, 0, gs_test_thread_main, &thread_args[i], 0, NULL);
+#else
+    pthread_create(&threads[i], NULL, gs_test_thread_main, &thread_args[i]);
+#endif
+  }
+  for(int i = 0; i < GS_TEST_NUM_THREADS; ++i)
+  {
+#ifdef _WIN32
+    WaitForSingleObject(threads[i], INFINITE);
+    CloseHandle(threads[i]);
+#else
+    pthread_join(threads[i], NULL);
+#endif
+  }
+}
 
 bool 
 gs_stack_test()
@@ -86,11 +183,269 @@ gs_stack_test()
   GS_STACK_FLUSH(&stack);
   GS_ASSERT(stack.p_current = stack.p_begin)
 
+  // Testing sized pushes interleaved with regular pushes
+  for(int i = 0; i < max_allocations; ++i)
+  {
+    unsigned long long next_size = allocation_sizes[i % count_sizes];
+    if(i % 3 == 0)
+    {
+      allocations[i] = GS_STACK_PUSH_ALIGNED_CHECKED(&stack, next_size, allocation_alignments[i % count_alignments]);
+    }
+    else
+    {
+      allocations[i] = GS_STACK_PUSH_SIZED_CHECKED(&stack, next_size);
+      GS_ASSERT((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)allocations[i] % GS_MEM_ALLOC_PTR_ALIGNMENT == 0);
+    }
+    memset(allocations[i], 0xff, next_size);
+  }
+  for(int i = max_allocations - 1; i >= 0; --i)
+  {
+    if(i % 3 == 0)
+    {
+      GS_STACK_POP(&stack, allocations[i]);
+    }
+    else
+    {
+      GS_STACK_POP_SIZED(&stack, allocations[i], allocation_sizes[i % count_sizes]);
+    }
+  }
+  GS_ASSERT(stack.p_current == stack.p_begin);
+
+  free(allocations);
+  free(ptr);
+  return true;
+}
+
+bool
+gs_compact_stack_test()
+{
+  void* ptr = malloc(GS_STACK_TEST_SIZE);
+  if(!ptr)
+    return false;
+
+  unsigned long long allocation_sizes[] = {4, 8, 12, 16, 20, 24, 30, 32, 48, 128, 500, 1024};
+  int count_sizes = sizeof(allocation_sizes) / sizeof(unsigned long long);
+  unsigned int allocation_alignments[] = {4, 8, 16, 32, 64};
+  int count_alignments = sizeof(allocation_alignments) / sizeof(unsigned int);
+  int max_allocations = 1024;
+  void** allocations = malloc(sizeof(void*)*max_allocations);
+  if(!allocations)
+    return false;
+
+  GSCompactStack stack = gs_compact_stack_init(ptr, GS_STACK_TEST_SIZE);
+  GS_ASSERT(stack.valid);
+
+  // Testing that small allocations only pay a 4-byte footer
+  void* first = GS_COMPACT_STACK_PUSH_ALIGNED_CHECKED(&stack, 12, 4);
+  void* second = GS_COMPACT_STACK_PUSH_ALIGNED_CHECKED(&stack, 12, 4);
+  GS_ASSERT((char*)second == (char*)first + 12 + GS_COMPACT_STACK_FOOTER_SIZE);
+  GS_COMPACT_STACK_POP(&stack, second);
+  GS_COMPACT_STACK_POP(&stack, first);
+  GS_ASSERT(stack.p_current == stack.p_begin);
+
+  // Testing mixed stack usage. The sequence is derived from the iteration so
+  // that the random state of the other tests is not altered
+  int count_allocations = 0;
+  for(int i = 0; i < 100000; ++i)
+  {
+    unsigned int hash = (unsigned int)i * 2654435761u;
+    bool push = (hash >> 16) % 2 == 0;
+    if((push && count_allocations < max_allocations) || count_allocations == 0)
+    {
+      unsigned long long next_size = allocation_sizes[(hash >> 8) % count_sizes];
+      unsigned int next_alignment = allocation_alignments[(hash >> 20) % count_alignments];
+      char* data = (char*)GS_COMPACT_STACK_PUSH_ALIGNED_CHECKED(&stack, next_size, next_alignment);
+      GS_ASSERT((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)data % next_alignment == 0);
+      memset(data, 0xff, next_size);
+      allocations[count_allocations++] = data;
+    }
+    else
+    {
+      GS_COMPACT_STACK_POP(&stack, allocations[--count_allocations]);
+    }
+  }
+  while(count_allocations > 0)
+  {
+    GS_COMPACT_STACK_POP(&stack, allocations[--count_allocations]);
+  }
+  GS_ASSERT(stack.p_current == stack.p_begin);
+
+  // Testing that a full stack fails and can be flushed
+  GSAlloc alloc = {};
+  do
+  {
+    alloc = GS_COMPACT_STACK_PUSH(&stack, 1024);
+  } while(!gs_alloc_is_null(&alloc));
+  GS_ASSERT((char*)stack.p_current <= (char*)stack.p_end);
+  GS_COMPACT_STACK_FLUSH(&stack);
+  GS_ASSERT(stack.p_current == stack.p_begin);
+
   free(allocations);
   free(ptr);
   return true;
 }
 
+typedef struct GSTestDoubleStackPop
+{
+  GSDoubleStack* stack;
+  void*          ptr;
+} GSTestDoubleStackPop;
+
+void
+gs_test_double_stack_pop_front(void* arg)
+{
+  GSTestDoubleStackPop* pop = (GSTestDoubleStackPop*)arg;
+  GS_DOUBLE_STACK_POP_FRONT(pop->stack, pop->ptr);
+}
+
+void
+gs_test_double_stack_pop_back(void* arg)
+{
+  GSTestDoubleStackPop* pop = (GSTestDoubleStackPop*)arg;
+  GS_DOUBLE_STACK_POP_BACK(pop->stack, pop->ptr);
+}
+
+bool
+gs_double_stack_test()
+{
+  void* ptr = malloc(GS_STACK_TEST_SIZE);
+  if(!ptr)
+    return false;
+
+  unsigned long long allocation_sizes[] = {0, 4, 8, 16, 20, 24, 30, 32, 48, 128, 160, 256, 500, 512, 720, 1024};
+  int count_sizes = sizeof(allocation_sizes) / sizeof(unsigned long long);
+  unsigned int allocation_alignments[] = {4, 8, 16, 32, 64};
+  int count_alignments = sizeof(allocation_alignments) / sizeof(unsigned int);
+  int max_allocations = 1024;
+  char** allocations[2];
+  unsigned long long* sizes[2];
+  int count_allocations[2] = {0, 0};
+  for(int end = 0; end < 2; ++end)
+  {
+    allocations[end] = malloc(sizeof(char*)*max_allocations);
+    sizes[end] = malloc(sizeof(unsigned long long)*max_allocations);
+    if(!allocations[end] || !sizes[end])
+      return false;
+  }
+
+  // Testing random usage of both ends. Each allocation is filled with a
+  // pattern checked on pop to detect overlaps between the ends
+  GSDoubleStack stack = gs_double_stack_init(ptr, 64*1024);
+  GS_ASSERT(stack.valid);
+  for(int i = 0; i < 200000; ++i)
+  {
+    int end = (unsigned int)rand() % 2;
+    bool push = (unsigned int)rand() % 2 == 0;
+    if(push && count_allocations[end] < max_allocations)
+    {
+      unsigned long long next_size = allocation_sizes[(unsigned int)rand() % count_sizes];
+      unsigned int next_alignment = allocation_alignments[(unsigned int)rand() % count_alignments];
+      GSAlloc alloc = end == 0 ? GS_DOUBLE_STACK_PUSH_FRONT_ALIGNED(&stack, next_size, next_alignment) 
+                               : GS_DOUBLE_STACK_PUSH_BACK_ALIGNED(&stack, next_size, next_alignment);
+      if(gs_alloc_is_null(&alloc))
+      {
+        GS_ASSERT(next_size + 2*next_alignment + 16 > (GS_PTR_DIFF(stack.p_back, stack.p_front)));
+        continue;
+      }
+      char* data = (char*)gs_alloc_ptr(&alloc);
+      GS_ASSERT((unsigned long long)data % next_alignment == 0);
+      GS_ASSERT((char*)stack.p_begin <= data && data + next_size <= (char*)stack.p_end);
+      memset(data, count_allocations[end] % 128 + end*128, next_size);
+      allocations[end][count_allocations[end]] = data;
+      sizes[end][count_allocations[end]++] = next_size;
+    }
+    else if(count_allocations[end] > 0)
+    {
+      int index = --count_allocations[end];
+      char* data = allocations[end][index];
+      for(unsigned long long j = 0; j < sizes[end][index]; ++j)
+      {
+        GS_ASSERT((unsigned char)data[j] == index % 128 + end*128);
+      }
+      if(end == 0)
+      {
+        GS_DOUBLE_STACK_POP_FRONT(&stack, data);
+      }
+      else
+      {
+        GS_DOUBLE_STACK_POP_BACK(&stack, data);
+      }
+    }
+  }
+  for(int end = 0; end < 2; ++end)
+  {
+    while(count_allocations[end] > 0)
+    {
+      char* data = allocations[end][--count_allocations[end]];
+      if(end == 0)
+      {
+        GS_DOUBLE_STACK_POP_FRONT(&stack, data);
+      }
+      else
+      {
+        GS_DOUBLE_STACK_POP_BACK(&stack, data);
+      }
+    }
+  }
+  GS_ASSERT(stack.p_front == stack.p_begin && stack.p_back == stack.p_end);
+
+  // Testing that the ends only fail when they meet
+  while(true)
+  {
+    GSAlloc front = GS_DOUBLE_STACK_PUSH_FRONT(&stack, 100);
+    GSAlloc back = GS_DOUBLE_STACK_PUSH_BACK(&stack, 100);
+    if(gs_alloc_is_null(&front) && gs_alloc_is_null(&back))
+      break;
+  }
+  GS_ASSERT((GS_PTR_DIFF(stack.p_back, stack.p_front)) < 100 + 2*GS_MEM_ALLOC_MIN_ALIGNMENT + 16);
+
+  // Testing that sizes close to the maximum fail instead of overflowing
+  GS_DOUBLE_STACK_FLUSH(&stack);
+  GSAlloc huge = GS_DOUBLE_STACK_PUSH_FRONT(&stack, ~0ull - 4);
+  GS_ASSERT(gs_alloc_is_null(&huge));
+  huge = GS_DOUBLE_STACK_PUSH_BACK(&stack, ~0ull - 4);
+  GS_ASSERT(gs_alloc_is_null(&huge));
+  GS_ASSERT(stack.p_front == stack.p_begin && stack.p_back == stack.p_end);
+
+  // Testing that checkpoints and flushes are independent for each end
+  void* back = GS_DOUBLE_STACK_PUSH_BACK_CHECKED(&stack, 1000);
+  GSDoubleStackCheckpoint front_checkpoint = GS_DOUBLE_STACK_CHECKPOINT_FRONT(&stack);
+  GSDoubleStackCheckpoint back_checkpoint = GS_DOUBLE_STACK_CHECKPOINT_BACK(&stack);
+  GS_DOUBLE_STACK_PUSH_FRONT_CHECKED(&stack, 1000);
+  GS_DOUBLE_STACK_PUSH_BACK_CHECKED(&stack, 1000);
+  GS_DOUBLE_STACK_RESTORE_FRONT(&stack, front_checkpoint);
+  GS_ASSERT(stack.p_front == stack.p_begin && stack.p_back != back_checkpoint);
+  GS_DOUBLE_STACK_RESTORE_BACK(&stack, back_checkpoint);
+  GS_DOUBLE_STACK_PUSH_FRONT_CHECKED(&stack, 1000);
+  GS_DOUBLE_STACK_FLUSH_FRONT(&stack);
+  GS_ASSERT(stack.p_front == stack.p_begin && stack.p_back == back_checkpoint);
+  GS_DOUBLE_STACK_POP_BACK(&stack, back);
+  GS_ASSERT(stack.p_back == stack.p_end);
+
+#if !defined(_WIN32) && !defined(GS_MEM_ALLOC_DISABLE_ASSERTS)
+  // Testing that popping an allocation of the other end is caught
+  GSTestDoubleStackPop pop;
+  pop.stack = &stack;
+  void* front = GS_DOUBLE_STACK_PUSH_FRONT_CHECKED(&stack, 1000);
+  back = GS_DOUBLE_STACK_PUSH_BACK_CHECKED(&stack, 1000);
+  pop.ptr = back;
+  GS_ASSERT(gs_test_aborts(gs_test_double_stack_pop_front, &pop));
+  pop.ptr = front;
+  GS_ASSERT(gs_test_aborts(gs_test_double_stack_pop_back, &pop));
+  GS_DOUBLE_STACK_POP_BACK(&stack, back);
+  GS_DOUBLE_STACK_POP_FRONT(&stack, front);
+  GS_ASSERT(stack.p_front == stack.p_begin && stack.p_back == stack.p_end);
+#endif
+
+  for(int end = 0; end < 2; ++end)
+  {
+    free(allocations[end]);
+    free(sizes[end]);
+  }
+  free(ptr);
+  return true;
+}
+
 bool
 gs_scratch_test()
 {
@@ -122,83 +477,1797 @@ gs_scratch_test()
 }
 
 bool
-gs_pool_test()
+gs_scratch_chained_test()
 {
-  void* ptr = malloc(GS_POOL_TEST_SIZE);
+  void* ptr = malloc(GS_SCRATCH_TEST_SIZE);
   if(!ptr)
     return false;
 
-  unsigned long long block_sizes[] = {8, 16, 20, 24, 30, 32, 48, 128, 160, 256, 500, 512, 720, 1024};
-  int count_sizes = sizeof(block_sizes) / sizeof(unsigned long long);
-  unsigned int block_alignments[] = {4, 8, 16, 32, 64};
-  int count_alignments = sizeof(block_alignments) / sizeof(unsigned int);
-  int max_allocations = 1024;
-  void** allocations = malloc(sizeof(void*)*max_allocations);
-  if(!allocations)
+  void* backing_ptr = malloc(GS_STACK_TEST_SIZE);
+  if(!backing_ptr)
     return false;
 
+  unsigned long long allocation_sizes[] = {4, 8, 16, 20, 24, 30, 32, 48, 128, 160, 256, 500, 512, 720, 1024};
+  int count_sizes = sizeof(allocation_sizes) / sizeof(unsigned long long);
+  unsigned int allocation_alignments[] = {4, 8, 16, 32, 64};
+  int count_alignments = sizeof(allocation_alignments) / sizeof(unsigned int);
 
+  GSStack backing_stack = gs_stack_init(backing_ptr, GS_STACK_TEST_SIZE);
+  GSScratch scratch = gs_scratch_init_chained(ptr, 
+                                              4096, 
+                                              gs_chunk_backing_stack(&backing_stack), 
+                                              4096);
 
-  for(int i = 0; i < count_sizes; ++i)
+  // Testing that the scratch grows beyond its first chunk
+  unsigned long long total_size = 0;
+  GSScratchCheckpoint checkpoint = GS_SCRATCH_CHECKPOINT(&scratch);
+  while(total_size < 64*1024)
   {
-    for (int j = 0; j < count_alignments; ++j) 
-    {
-      unsigned long long block_size = block_sizes[i];
-      unsigned int block_alignment = block_alignments[j];
-      GSPool pool = gs_pool_init(ptr, 
-                                 GS_POOL_TEST_SIZE, 
-                                 block_size,
-                                 block_alignment);
-      memset(allocations, 0, sizeof(void*)*max_allocations);
+    unsigned long long next_size = allocation_sizes[(unsigned int)rand() % count_sizes];
+    unsigned int next_alignment = allocation_alignments[(unsigned int)rand() % count_alignments];
+    char* data = (char*)GS_SCRATCH_PUSH_ALIGNED_CHECKED(&scratch, next_size, next_alignment);
+    GS_ASSERT((unsigned long long)data % next_alignment == 0);
+    memset(data, 0xff, next_size);
+    total_size += next_size;
+  }
+  GS_ASSERT(scratch.p_chunk != scratch.p_first);
 
-      for(int k = 0; k < max_allocations; ++k)
-      {
-        int index = (unsigned int)rand() % max_allocations;
-        if(allocations[index] == NULL)
-        {
-          GSAlloc alloc = GS_POOL_ALLOC_ALIGNED(&pool, 
-                                                block_size, 
-                                                block_alignment);
-          if(gs_alloc_is_null(&alloc))
-          {
-            allocations[index] = NULL;
-          }
-          allocations[index] = gs_alloc_ptr(&alloc);
-        }
-        else
-        {
-          GS_POOL_FREE(&pool, allocations[index]);
-          allocations[k] = NULL;
-        }
-      }
-      GS_POOL_FLUSH(&pool);
-      GS_ASSERT(pool.p_current = pool.p_begin)
-    }
+  // Testing that restoring reuses the acquired chunks
+  void* backing_current = backing_stack.p_current;
+  GS_SCRATCH_RESTORE(&scratch, checkpoint);
+  GS_ASSERT(scratch.p_chunk == scratch.p_first);
+  total_size = 0;
+  while(total_size < 64*1024)
+  {
+    GS_SCRATCH_PUSH_CHECKED(&scratch, 512);
+    total_size += 512;
   }
+  GS_ASSERT(backing_stack.p_current == backing_current);
+
+  // Testing allocations larger than the chunk size
+  GS_SCRATCH_PUSH_CHECKED(&scratch, 3*4096);
 
+  GS_SCRATCH_FLUSH(&scratch);
+  GS_ASSERT(scratch.p_chunk == scratch.p_first);
+  GS_ASSERT(scratch.p_current == scratch.p_begin);
+  gs_scratch_flush_release(&scratch);
+  GS_ASSERT(scratch.p_first->p_next == NULL);
+  GS_ASSERT(backing_stack.p_current == backing_stack.p_begin);
 
+  free(backing_ptr);
   free(ptr);
   return true;
 }
 
-int 
-main(int argc, char** argv)
+bool
+gs_frame_scratch_test()
 {
-  int EXIT_CODE = 0;
+  void* ptr = malloc(GS_SCRATCH_TEST_SIZE);
+  if(!ptr)
+    return false;
 
-  if(!gs_stack_test())
+  GSFrameScratch scratch = gs_frame_scratch_init(ptr, GS_SCRATCH_TEST_SIZE, 3);
+  GS_ASSERT(scratch.valid);
+
+  // Testing that allocations survive for as many frames as scratches
+  char* first = (char*)GS_FRAME_SCRATCH_PUSH_CHECKED(&scratch, 64);
+  memset(first, 0x11, 64);
+  unsigned long long usage = gs_frame_scratch_advance(&scratch);
+  GS_ASSERT(usage >= 64);
+  char* second = (char*)GS_FRAME_SCRATCH_PUSH_CHECKED(&scratch, 128);
+  memset(second, 0x22, 128);
+  gs_frame_scratch_advance(&scratch);
+  GS_ASSERT(gs_frame_scratch_frame_usage(&scratch, 0) == 0);
+  GS_ASSERT(gs_frame_scratch_frame_usage(&scratch, 1) >= 128);
+  GS_ASSERT(gs_frame_scratch_frame_usage(&scratch, 2) >= 64);
+  GS_ASSERT(first[63] == 0x11 && second[127] == 0x22);
+
+  // Testing that promoting keeps a block alive past its frame
+  GSAlloc promoted_alloc = GS_FRAME_SCRATCH_PROMOTE(&scratch, first, 64);
+  GS_ASSERT(!gs_alloc_is_null(&promoted_alloc));
+  char* promoted = (char*)gs_alloc_ptr(&promoted_alloc);
+  gs_frame_scratch_advance(&scratch);
+  GS_ASSERT(gs_frame_scratch_frame_usage(&scratch, 0) == 0);
+  for(int i = 0; i < 64; ++i)
   {
-    EXIT_CODE = 1;
-    goto exit;
+    GS_ASSERT(promoted[i] == 0x11);
   }
 
-  if(!gs_scratch_test())
+  // Testing that a frame cannot exceed its scratch
+  GSAlloc alloc = {};
+  do
   {
-    EXIT_CODE = 1;
-    goto exit;
+    alloc = GS_FRAME_SCRATCH_PUSH_ALIGNED(&scratch, 256, 64);
+  } while(!gs_alloc_is_null(&alloc));
+  usage = gs_frame_scratch_advance(&scratch);
+  GS_ASSERT(usage <= GS_SCRATCH_TEST_SIZE / 3);
+  GS_ASSERT(scratch.peak_frame_usage == usage);
+  GS_ASSERT(scratch.frame == 4);
+
+  // Testing that the number of frames is checked
+  scratch = gs_frame_scratch_init(ptr, GS_SCRATCH_TEST_SIZE, 0);
+  GS_ASSERT(!scratch.valid);
+  scratch = gs_frame_scratch_init(ptr, GS_SCRATCH_TEST_SIZE, GS_MEM_ALLOC_FRAME_SCRATCH_MAX_FRAMES + 1);
+  GS_ASSERT(!scratch.valid);
+
+  free(ptr);
+  return true;
+}
+
+bool
+gs_resize_test()
+{
+  void* ptr = malloc(GS_STACK_TEST_SIZE);
+  if(!ptr)
+    return false;
+
+  // Testing stack resizes
+  GSStack stack = gs_stack_init(ptr, GS_STACK_TEST_SIZE / 2);
+  bool resized = GS_STACK_RESIZE_TOP(&stack, ptr, 16);
+  GS_ASSERT(!resized);
+  char* bottom = (char*)GS_STACK_PUSH_CHECKED(&stack, 24);
+  char* top = (char*)GS_STACK_PUSH_CHECKED(&stack, 10);
+  memset(top, 0x11, 10);
+  resized = GS_STACK_RESIZE_TOP(&stack, bottom, 48);
+  GS_ASSERT(!resized);
+  resized = GS_STACK_RESIZE_TOP(&stack, top, 1000);
+  GS_ASSERT(resized);
+  for(int i = 0; i < 10; ++i)
+  {
+    GS_ASSERT(top[i] == 0x11);
   }
-  
-  if(!gs_pool_test())
+  memset(top, 0x22, 1000);
+  resized = GS_STACK_RESIZE_TOP(&stack, top, 4);
+  GS_ASSERT(resized);
+  resized = GS_STACK_RESIZE_TOP(&stack, top, GS_STACK_TEST_SIZE);
+  GS_ASSERT(!resized);
+  GS_ASSERT(top[3] == 0x22);
+  char* next = (char*)GS_STACK_PUSH_CHECKED(&stack, 8);
+  GS_ASSERT(next < top + 32);
+  GS_STACK_POP(&stack, next);
+  GS_STACK_POP(&stack, top);
+  GS_STACK_POP(&stack, bottom);
+  GS_ASSERT(stack.p_current == stack.p_begin);
+
+  // Testing scratch resizes
+  GSScratch scratch = gs_scratch_init((char*)ptr + GS_STACK_TEST_SIZE / 2, GS_STACK_TEST_SIZE / 2);
+  char* first = (char*)GS_SCRATCH_PUSH_CHECKED(&scratch, 16);
+  char* last = (char*)GS_SCRATCH_PUSH_CHECKED(&scratch, 16);
+  resized = GS_SCRATCH_RESIZE_LAST(&scratch, first, 16, 32);
+  GS_ASSERT(!resized);
+  unsigned long long size = 16;
+  while(size < 64*1024)
+  {
+    resized = GS_SCRATCH_RESIZE_LAST(&scratch, last, size, 2*size);
+    GS_ASSERT(resized);
+    size *= 2;
+    memset(last, 0x33, size);
+  }
+  resized = GS_SCRATCH_RESIZE_LAST(&scratch, last, size, GS_STACK_TEST_SIZE);
+  GS_ASSERT(!resized);
+  resized = GS_SCRATCH_RESIZE_LAST(&scratch, last, size, 8);
+  GS_ASSERT(resized);
+  GS_ASSERT((char*)scratch.p_current == last + 8);
+
+  free(ptr);
+  return true;
+}
+
+bool
+gs_virtual_test()
+{
+  unsigned long long reserve_size = 1024ull*1024ull*1024ull;
+  unsigned long long granularity = 64*1024;
+
+  // Testing a stack that grows on demand
+  GSStack stack = gs_stack_init_virtual(reserve_size, granularity, 2*granularity);
+  if(!stack.valid)
+    return false;
+
+  int max_allocations = 1024;
+  void** allocations = malloc(sizeof(void*)*max_allocations);
+  if(!allocations)
+    return false;
+
+  for(int i = 0; i < max_allocations; ++i)
+  {
+    char* data = (char*)GS_STACK_PUSH_CHECKED(&stack, 4096);
+    memset(data, 0xff, 4096);
+    allocations[i] = data;
+  }
+  GS_ASSERT((char*)stack.p_region->p_committed >= (char*)stack.p_current);
+  GS_ASSERT((char*)stack.p_region->p_committed < (char*)stack.p_end);
+  for(int i = max_allocations-1; i >= 0; --i)
+  {
+    GS_STACK_POP(&stack, allocations[i]);
+  }
+  GS_ASSERT(stack.p_current == stack.p_begin);
+  GS_STACK_FLUSH(&stack);
+  GS_ASSERT(GS_PTR_DIFF(stack.p_region->p_committed, stack.p_region) <= 3*granularity);
+  gs_stack_release_virtual(&stack);
+
+  // Testing a scratch that grows on demand
+  GSScratch scratch = gs_scratch_init_virtual(reserve_size, granularity, GS_MEM_ALLOC_NO_DECOMMIT);
+  if(!scratch.valid)
+    return false;
+
+  GSScratchCheckpoint checkpoint = GS_SCRATCH_CHECKPOINT(&scratch);
+  for(int i = 0; i < max_allocations; ++i)
+  {
+    char* data = (char*)GS_SCRATCH_PUSH_CHECKED(&scratch, 4096);
+    memset(data, 0xff, 4096);
+  }
+  void* committed = scratch.p_region->p_committed;
+  GS_SCRATCH_RESTORE(&scratch, checkpoint);
+  GS_ASSERT(scratch.p_region->p_committed == committed);
+  GS_SCRATCH_FLUSH(&scratch);
+  GS_ASSERT(scratch.p_region->p_committed == committed);
+  gs_scratch_release_virtual(&scratch);
+
+  free(allocations);
+  return true;
+}
+
+// Returns the bytes of the whole pages inside [begin, end)
+static unsigned long long
+gs_trim_test_pages(void* begin, 
+                   void* end)
+{
+  unsigned long long page_size = gs_vm_page_size();
+  unsigned long long first = ((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)begin + page_size - 1) & ~(page_size - 1);
+  unsigned long long last = (GS_MEM_ALLOC_PTR_NUMERIC_TYPE)end & ~(page_size - 1);
+  return first < last ? last - first : 0;
+}
+
+bool
+gs_trim_test()
+{
+  unsigned long long size = 4*1024*1024;
+  void* ptr = malloc(size);
+  if(!ptr)
+    return false;
+  memset(ptr, 0xff, size);
+
+  // Testing that the pages after the top of the stack are released, but the
+  // retained ones
+  GSStack stack = gs_stack_init(ptr, size);
+  char* kept = (char*)GS_STACK_PUSH_CHECKED(&stack, 10000);
+  memset(kept, 1, 10000);
+  char* peak = (char*)GS_STACK_PUSH_CHECKED(&stack, 2*1024*1024);
+  memset(peak, 2, 2*1024*1024);
+  GS_STACK_POP(&stack, peak);
+  unsigned long long retain = 64*1024;
+  unsigned long long released = gs_stack_trim(&stack, retain);
+  GS_ASSERT(released == gs_trim_test_pages((char*)stack.p_current + retain, stack.p_end));
+  released = gs_stack_trim(&stack, size);
+  GS_ASSERT(released == 0);
+  for(int i = 0; i < 10000; ++i)
+  {
+    GS_ASSERT(kept[i] == 1);
+  }
+  peak = (char*)GS_STACK_PUSH_CHECKED(&stack, 2*1024*1024);
+  memset(peak, 3, 2*1024*1024);
+
+  // Testing the same for a scratch
+  GSScratch scratch = gs_scratch_init(ptr, size);
+  kept = (char*)GS_SCRATCH_PUSH_CHECKED(&scratch, 10000);
+  memset(kept, 1, 10000);
+  released = gs_scratch_trim(&scratch, 0);
+  GS_ASSERT(released == gs_trim_test_pages(scratch.p_current, scratch.p_end));
+  for(int i = 0; i < 10000; ++i)
+  {
+    GS_ASSERT(kept[i] == 1);
+  }
+  GS_SCRATCH_FLUSH(&scratch);
+  released = gs_scratch_trim(&scratch, retain);
+  GS_ASSERT(released == gs_trim_test_pages((char*)scratch.p_begin + retain, scratch.p_end));
+
+  // Testing that a pool uncarves its free blocks at the end, and keeps the
+  // rest in address order
+  int max_allocations = 4096;
+  void** allocations = malloc(sizeof(void*)*max_allocations);
+  if(!allocations)
+    return false;
+  GSPool pool = gs_pool_init(ptr, size, 64, 16);
+  GS_POOL_ALLOC_N_CHECKED(&pool, max_allocations, allocations);
+  for(int i = max_allocations - 1; i >= 100; i -= 2)
+  {
+    GS_POOL_FREE(&pool, allocations[i]);
+  }
+  for(int i = 100; i < max_allocations; i += 2)
+  {
+    GS_POOL_FREE(&pool, allocations[i]);
+  }
+  GS_POOL_FREE(&pool, allocations[10]);
+  GS_POOL_FREE(&pool, allocations[5]);
+  released = gs_pool_trim(&pool);
+  GS_ASSERT(released == gs_trim_test_pages(allocations[100], pool.p_end));
+  GS_ASSERT(pool.p_current == allocations[100]);
+  void* block = gs_pool_alloc_CHECKED(&pool, 64, 16);
+  GS_ASSERT(block == allocations[5]);
+  block = gs_pool_alloc_CHECKED(&pool, 64, 16);
+  GS_ASSERT(block == allocations[10]);
+  block = gs_pool_alloc_CHECKED(&pool, 64, 16);
+  GS_ASSERT(block == allocations[100]);
+
+  // Testing that a pool with bitmap also releases the pages between live blocks
+  unsigned long long bitmap_size = gs_pool_bitmap_size(size, 64, 16);
+  void* bitmap_ptr = malloc(bitmap_size);
+  if(!bitmap_ptr)
+    return false;
+  pool = gs_pool_init_bitmap(ptr, size, 64, 16, bitmap_ptr, bitmap_size);
+  GS_POOL_ALLOC_N_CHECKED(&pool, max_allocations, allocations);
+  for(int i = 0; i < max_allocations; ++i)
+  {
+    *(int*)allocations[i] = i;
+  }
+  for(int i = 1000; i < max_allocations; ++i)
+  {
+    if(i != 2000)
+    {
+      GS_POOL_FREE(&pool, allocations[i]);
+    }
+  }
+  released = gs_pool_trim(&pool);
+  GS_ASSERT(pool.p_current == (char*)allocations[2000] + pool.stride);
+  GS_ASSERT(released == gs_trim_test_pages(allocations[1000], allocations[2000]) + 
+                        gs_trim_test_pages(pool.p_current, pool.p_end));
+  GS_ASSERT(gs_pool_count_live(&pool) == 1001);
+  for(int i = 0; i < 1000; ++i)
+  {
+    GS_ASSERT(*(int*)allocations[i] == i);
+  }
+  GS_ASSERT(*(int*)allocations[2000] == 2000);
+  block = gs_pool_alloc_CHECKED(&pool, 64, 16);
+  GS_ASSERT(block == allocations[1000]);
+
+  free(bitmap_ptr);
+  free(allocations);
+  free(ptr);
+  return true;
+}
+
+bool
+gs_huge_test()
+{
+  // The huge pages may not be available, in which case the mappings fall back
+  // to normal pages
+  unsigned long long size = 8*GS_VM_PAGE_SIZE_2MB;
+  unsigned long long page_sizes[] = {GS_VM_PAGE_SIZE_2MB, GS_VM_PAGE_SIZE_1GB};
+  for(int i = 0; i < 2; ++i)
+  {
+    GSVmMapping* mapping = gs_vm_map_pages(size, page_sizes[i]);
+    if(!mapping)
+      return false;
+    GS_ASSERT(mapping->size >= size);
+    GS_ASSERT(mapping->size % mapping->page_size == 0);
+    if(mapping->kind == GS_VM_PAGES_NORMAL)
+    {
+      GS_ASSERT(mapping->page_size == gs_vm_page_size());
+    }
+    else
+    {
+      GS_ASSERT(mapping->page_size <= page_sizes[i]);
+      GS_ASSERT(mapping->kind == GS_VM_PAGES_TRANSPARENT || mapping->page_size == page_sizes[i]);
+      GS_ASSERT((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)mapping % mapping->page_size == 0);
+    }
+    memset(GS_VM_MAPPING_BEGIN(mapping), 0xff, size - GS_VM_MAPPING_HEADER_SIZE);
+    gs_vm_unmap_pages(mapping);
+  }
+
+  // Testing allocators owning their mapping
+  GSStack stack = gs_stack_init_huge(size, GS_VM_PAGE_SIZE_2MB);
+  if(!stack.valid)
+    return false;
+  GS_ASSERT(stack.p_mapping != NULL);
+  // The header is carved from the mapping rather than costing an extra page
+  GS_ASSERT(stack.p_mapping->size == size);
+  GS_ASSERT(GS_PTR_DIFF(stack.p_end, stack.p_begin) == size - GS_VM_MAPPING_HEADER_SIZE);
+  char* data = (char*)GS_STACK_PUSH_CHECKED(&stack, size/2);
+  memset(data, 0xff, size/2);
+  GS_STACK_POP(&stack, data);
+  gs_stack_release_huge(&stack);
+  GS_ASSERT(!stack.valid && stack.p_mapping == NULL);
+
+  GSScratch scratch = gs_scratch_init_huge(size, GS_VM_PAGE_SIZE_2MB);
+  if(!scratch.valid)
+    return false;
+  GS_ASSERT(scratch.p_mapping != NULL);
+  GS_ASSERT(scratch.p_mapping->size == size);
+  GS_ASSERT(GS_PTR_DIFF(scratch.p_end, scratch.p_begin) == size - GS_VM_MAPPING_HEADER_SIZE);
+  data = (char*)GS_SCRATCH_PUSH_CHECKED(&scratch, size/2);
+  memset(data, 0xff, size/2);
+  gs_scratch_release_huge(&scratch);
+
+  GSPool pool = gs_pool_init_huge(size, 64, 64, GS_VM_PAGE_SIZE_2MB);
+  if(!pool.valid)
+    return false;
+  GS_ASSERT(pool.p_mapping != NULL && pool.p_mapping->size == size);
+  // The header and the alignment of the first block take one block, and the
+  // pool does not hand out the block ending at p_end
+  unsigned long long num_blocks = size / 64 - 2;
+  for(unsigned long long i = 0; i < num_blocks; ++i)
+  {
+    data = (char*)GS_POOL_ALLOC_ALIGNED_CHECKED(&pool, 64, 64);
+    GS_ASSERT((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)data % 64 == 0);
+    memset(data, 0xff, 64);
+  }
+  gs_pool_release_huge(&pool);
+  return true;
+}
+
+bool
+gs_node_set_test()
+{
+  // Binding may not be supported, in which case the memory is left unbound
+  unsigned int num_nodes = gs_vm_num_nodes();
+  GS_ASSERT(num_nodes >= 1 && num_nodes <= GS_MEM_ALLOC_MAX_NUMA_NODES);
+  GSVmMapping* mapping = gs_vm_map_pages(1024*1024, gs_vm_page_size());
+  if(!mapping)
+    return false;
+  if(gs_vm_bind_node(mapping, mapping->size, gs_vm_current_node()))
+  {
+    memset(GS_VM_MAPPING_BEGIN(mapping), 0xff, 1024*1024 - GS_VM_MAPPING_HEADER_SIZE);
+  }
+  gs_vm_unmap_pages(mapping);
+  if(gs_vm_prefer_node(gs_vm_current_node()))
+  {
+    GS_ASSERT(gs_vm_prefer_node(GS_VM_NO_NODE));
+  }
+
+  GSNodeSet set = gs_node_set_init(64*1024, 64*1024, 48, 16, gs_vm_page_size());
+  if(!set.valid)
+    return false;
+  GS_ASSERT(set.num_nodes == num_nodes);
+  for(unsigned int i = 0; i < set.num_nodes; ++i)
+  {
+    GSNodeArena* arena = gs_node_set_get(&set, i);
+    GS_ASSERT(arena == &set.nodes[i]);
+    GS_ASSERT(arena->scratch.valid && arena->pool.valid);
+    GS_ASSERT(GS_PTR_DIFF(arena->scratch.p_end, arena->scratch.p_begin) == 64*1024);
+    GS_ASSERT((char*)arena->pool.p_begin >= (char*)arena->scratch.p_end);
+  }
+  GS_ASSERT(gs_node_set_get(&set, set.num_nodes) == &set.nodes[0]);
+
+  GSNodeArena* local = gs_node_set_local(&set);
+  GS_ASSERT(local >= set.nodes && local < set.nodes + set.num_nodes);
+  char* data = (char*)GS_SCRATCH_PUSH_CHECKED(&local->scratch, 1024);
+  memset(data, 0xff, 1024);
+  int num_blocks = 0;
+  for(;;)
+  {
+    GSAlloc alloc = GS_ATOMIC_POOL_ALLOC_ALIGNED(&local->pool, 48, 16);
+    if(gs_alloc_is_null(&alloc))
+      break;
+    data = (char*)gs_alloc_ptr(&alloc);
+    GS_ASSERT((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)data % 16 == 0);
+    memset(data, 0xff, 48);
+    num_blocks++;
+  }
+  GS_ASSERT(num_blocks >= 64*1024/48);
+  gs_node_set_release(&set);
+  GS_ASSERT(!set.valid);
+
+  // Sets without scratches
+  set = gs_node_set_init(0, 64*1024, 64, 64, gs_vm_page_size());
+  if(!set.valid)
+    return false;
+  GS_ASSERT(!set.nodes[0].scratch.valid && set.nodes[0].pool.valid);
+  gs_node_set_release(&set);
+  return true;
+}
+
+bool
+gs_pool_test()
+{
+  void* ptr = malloc(GS_POOL_TEST_SIZE);
+  if(!ptr)
+    return false;
+
+  unsigned long long block_sizes[] = {8, 16, 20, 24, 30, 32, 48, 128, 160, 256, 500, 512, 720, 1024};
+  int count_sizes = sizeof(block_sizes) / sizeof(unsigned long long);
+  unsigned int block_alignments[] = {4, 8, 16, 32, 64};
+  int count_alignments = sizeof(block_alignments) / sizeof(unsigned int);
+  int max_allocations = 1024;
+  void** allocations = malloc(sizeof(void*)*max_allocations);
+  if(!allocations)
+    return false;
+
+
+
+  for(int i = 0; i < count_sizes; ++i)
+  {
+    for (int j = 0; j < count_alignments; ++j) 
+    {
+      unsigned long long block_size = block_sizes[i];
+      unsigned int block_alignment = block_alignments[j];
+      GSPool pool = gs_pool_init(ptr, 
+                                 GS_POOL_TEST_SIZE, 
+                                 block_size,
+                                 block_alignment);
+      memset(allocations, 0, sizeof(void*)*max_allocations);
+
+      for(int k = 0; k < max_allocations; ++k)
+      {
+        int index = (unsigned int)rand() % max_allocations;
+        if(allocations[index] == NULL)
+        {
+          GSAlloc alloc = GS_POOL_ALLOC_ALIGNED(&pool, 
+                                                block_size, 
+                                                block_alignment);
+          if(gs_alloc_is_null(&alloc))
+          {
+            allocations[index] = NULL;
+          }
+          allocations[index] = gs_alloc_ptr(&alloc);
+        }
+        else
+        {
+          GS_POOL_FREE(&pool, allocations[index]);
+          allocations[k] = NULL;
+        }
+      }
+      GS_POOL_FLUSH(&pool);
+      GS_ASSERT(pool.p_current = pool.p_begin)
+    }
+  }
+
+  // Testing batch alloc and free
+  GSPool pool = gs_pool_init(ptr, 
+                             GS_POOL_TEST_SIZE, 
+                             64, 
+                             16);
+  unsigned long long count = gs_pool_alloc_n(&pool, max_allocations, allocations);
+  GS_ASSERT(count == (unsigned long long)max_allocations);
+  for(int i = 1; i < max_allocations; ++i)
+  {
+    GS_ASSERT((char*)allocations[i] == (char*)allocations[i-1] + pool.stride);
+  }
+  GS_POOL_FREE_N(&pool, max_allocations / 2, allocations);
+  void* current = pool.p_current;
+  GS_POOL_ALLOC_N_CHECKED(&pool, max_allocations / 2, allocations);
+  GS_ASSERT(pool.p_current == current);
+  GS_POOL_FREE_N(&pool, max_allocations, allocations);
+  void** all_blocks = malloc(sizeof(void*)*(GS_POOL_TEST_SIZE / 64));
+  if(!all_blocks)
+    return false;
+  count = gs_pool_alloc_n(&pool, GS_POOL_TEST_SIZE / 64, all_blocks);
+  GS_ASSERT(count < GS_POOL_TEST_SIZE / 64 && count >= GS_POOL_TEST_SIZE / 64 - 2);
+  free(all_blocks);
+
+
+  free(ptr);
+  return true;
+}
+
+static void
+gs_pool_bitmap_test_visit(void* user_data, 
+                          void* ptr)
+{
+  void** last = (void**)user_data;
+  GS_ASSERT((char*)ptr > (char*)*last);
+  *last = ptr;
+}
+
+bool
+gs_pool_bitmap_test()
+{
+  void* ptr = malloc(GS_POOL_TEST_SIZE);
+  if(!ptr)
+    return false;
+
+  unsigned long long bitmap_size = gs_pool_bitmap_size(GS_POOL_TEST_SIZE, 48, 16);
+  void* bitmap_ptr = malloc(bitmap_size);
+  if(!bitmap_ptr)
+    return false;
+
+  int max_allocations = 1024;
+  void** allocations = malloc(sizeof(void*)*(GS_POOL_TEST_SIZE / 48));
+  if(!allocations)
+    return false;
+
+  GSPool pool = gs_pool_init_bitmap(ptr, GS_POOL_TEST_SIZE, 48, 16, bitmap_ptr, bitmap_size);
+  GS_ASSERT(pool.valid);
+  GS_POOL_ALLOC_N_CHECKED(&pool, max_allocations, allocations);
+
+  // Testing that freed blocks are skipped and visited in address order
+  for(int i = 0; i < max_allocations; i += 3)
+  {
+    GS_POOL_FREE(&pool, allocations[i]);
+    allocations[i] = NULL;
+  }
+  unsigned long long live = 0;
+  GS_POOL_FOR_EACH_LIVE(&pool, block)
+  {
+    while(allocations[live] == NULL)
+    {
+      live++;
+    }
+    GS_ASSERT(block == allocations[live]);
+    live++;
+  }
+  GS_ASSERT(gs_pool_count_live(&pool) == (unsigned long long)(max_allocations - (max_allocations + 2) / 3));
+  void* last = NULL;
+  gs_pool_for_each_live(&pool, gs_pool_bitmap_test_visit, &last);
+  GS_ASSERT(last == allocations[max_allocations - 2]);
+
+  // Testing that allocations take the lowest free block
+  void* current = pool.p_current;
+  for(int i = 0; i < max_allocations; i += 3)
+  {
+    void* block = GS_POOL_ALLOC_ALIGNED_CHECKED(&pool, 48, 16);
+    GS_ASSERT(block == (char*)pool.p_begin + i*pool.stride);
+  }
+  GS_ASSERT(pool.p_current == current);
+  GS_ASSERT(gs_pool_count_live(&pool) == (unsigned long long)max_allocations);
+
+  // Testing that the pool can be filled and flushed
+  unsigned long long count = gs_pool_alloc_n(&pool, GS_POOL_TEST_SIZE / 48, allocations);
+  GS_ASSERT(count < GS_POOL_TEST_SIZE / 48);
+  GS_POOL_FLUSH(&pool);
+  GS_ASSERT(gs_pool_next_live(&pool, NULL) == NULL);
+  GS_ASSERT(gs_pool_count_live(&pool) == 0);
+
+  free(allocations);
+  free(bitmap_ptr);
+  free(ptr);
+  return true;
+}
+
+typedef struct GSPoolCompactTestArgs
+{
+  void**  refs;                                                                 // The address of each block, indexed by the id stored in it
+  int     moves;
+} GSPoolCompactTestArgs;
+
+static void
+gs_pool_compact_test_relocate(void* user_data, 
+                              void* old_ptr, 
+                              void* new_ptr)
+{
+  GSPoolCompactTestArgs* args = (GSPoolCompactTestArgs*)user_data;
+  int id = *(int*)new_ptr;
+  GS_ASSERT(args->refs[id] == old_ptr);
+  args->refs[id] = new_ptr;
+  args->moves++;
+}
+
+bool
+gs_pool_compact_test()
+{
+  void* ptr = malloc(GS_POOL_TEST_SIZE);
+  if(!ptr)
+    return false;
+
+  unsigned long long bitmap_size = gs_pool_bitmap_size(GS_POOL_TEST_SIZE, 48, 16);
+  void* bitmap_ptr = malloc(bitmap_size);
+  if(!bitmap_ptr)
+    return false;
+
+  int max_allocations = 1000;
+  void** refs = malloc(sizeof(void*)*max_allocations);
+  if(!refs)
+    return false;
+
+  GSPool pool = gs_pool_init_bitmap(ptr, GS_POOL_TEST_SIZE, 48, 16, bitmap_ptr, bitmap_size);
+  GS_POOL_ALLOC_N_CHECKED(&pool, max_allocations, refs);
+  for(int i = 0; i < max_allocations; ++i)
+  {
+    *(int*)refs[i] = i;
+  }
+
+  // Freeing all the blocks but one every seven, and the first ones
+  int live = 0;
+  for(int i = 0; i < max_allocations; ++i)
+  {
+    if(i % 7 != 3 || i < 100)
+    {
+      GS_POOL_FREE(&pool, refs[i]);
+      refs[i] = NULL;
+    }
+    else
+    {
+      live++;
+    }
+  }
+
+  // Compacting incrementally, 10 blocks per call
+  GSPoolCompactTestArgs args;
+  args.refs = refs;
+  args.moves = 0;
+  int calls = 0;
+  unsigned long long moved = 0;
+  do
+  {
+    moved = gs_pool_compact(&pool, 10, gs_pool_compact_test_relocate, &args);
+    calls++;
+  } while(moved == 10);
+  GS_ASSERT(calls > 1);
+  GS_ASSERT(args.moves > 0);
+  GS_ASSERT(gs_pool_count_live(&pool) == (unsigned long long)live);
+  GS_ASSERT(pool.p_current == (char*)pool.p_begin + live*pool.stride);
+  GS_ASSERT(gs_pool_compact(&pool, 10, gs_pool_compact_test_relocate, &args) == 0);
+
+  // The references were updated and the blocks keep their contents
+  for(int i = 0; i < max_allocations; ++i)
+  {
+    if(refs[i] != NULL)
+    {
+      GS_ASSERT(*(int*)refs[i] == i);
+      GS_ASSERT((char*)refs[i] < (char*)pool.p_current);
+    }
+  }
+
+  // Allocations continue after the live blocks
+  void* block = GS_POOL_ALLOC_ALIGNED_CHECKED(&pool, 48, 16);
+  GS_ASSERT(block == (char*)pool.p_begin + live*pool.stride);
+  GS_POOL_FREE(&pool, block);
+
+  // Compacting a pool whose blocks are all free releases them
+  for(int i = 0; i < max_allocations; ++i)
+  {
+    if(refs[i] != NULL)
+    {
+      GS_POOL_FREE(&pool, refs[i]);
+    }
+  }
+  GS_ASSERT(gs_pool_compact(&pool, 10, gs_pool_compact_test_relocate, &args) == 0);
+  GS_ASSERT(pool.p_current == pool.p_begin);
+
+  free(refs);
+  free(bitmap_ptr);
+  free(ptr);
+  return true;
+}
+
+typedef struct GSTestParticle
+{
+  float position[3];
+  float velocity[3];
+  int   id;
+} GSTestParticle;
+
+GS_TYPED_POOL_DEFINE(GSTestParticlePool, GSTestParticle, 16)
+GS_TYPED_POOL_DEFINE(GSTestBytePool, char, 1)
+
+bool
+gs_typed_pool_test()
+{
+  void* ptr = malloc(GS_POOL_TEST_SIZE);
+  if(!ptr)
+    return false;
+
+  GS_ASSERT(GS_TYPED_POOL_STRIDE(sizeof(GSTestParticle), 16) == 32);
+  GS_ASSERT(GS_TYPED_POOL_STRIDE(sizeof(char), 1) == GS_MEM_ALLOC_PTR_ALIGNMENT);
+
+  int max_allocations = 1024;
+  GSTestParticle** allocations = (GSTestParticle**)malloc(sizeof(GSTestParticle*)*max_allocations);
+  if(!allocations)
+    return false;
+
+  // Misaligning the memory checks that the blocks are aligned on init
+  GSTestParticlePool pool = GSTestParticlePool_init((char*)ptr + 4, 32*max_allocations);
+  GS_ASSERT(pool.base.valid);
+  int count_allocations = 0;
+  for(;;)
+  {
+    GSTestParticle* particle = GSTestParticlePool_alloc(&pool);
+    if(particle == NULL)
+      break;
+    GS_ASSERT((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)particle % 16 == 0);
+    particle->id = count_allocations;
+    allocations[count_allocations++] = particle;
+  }
+  GS_ASSERT(count_allocations == max_allocations - 1);
+  for(int i = 0; i < count_allocations; ++i)
+  {
+    GS_ASSERT(allocations[i]->id == i);
+  }
+
+  // Freed blocks are reused in LIFO order
+  GSTestParticlePool_free(&pool, allocations[10]);
+  GSTestParticlePool_free(&pool, allocations[20]);
+  GSTestParticle* particle = GSTestParticlePool_alloc(&pool);
+  GS_ASSERT(particle == allocations[20]);
+  particle = GSTestParticlePool_alloc(&pool);
+  GS_ASSERT(particle == allocations[10]);
+  particle = GSTestParticlePool_alloc(&pool);
+  GS_ASSERT(particle == NULL);
+
+  GSTestParticlePool_flush(&pool);
+  particle = GSTestParticlePool_alloc(&pool);
+  GS_ASSERT(particle == allocations[0]);
+
+  // Blocks smaller than a pointer still hold the free list links
+  GSTestBytePool byte_pool = GSTestBytePool_init(ptr, GS_POOL_TEST_SIZE);
+  char* a = GSTestBytePool_alloc(&byte_pool);
+  char* b = GSTestBytePool_alloc(&byte_pool);
+  GS_ASSERT(b - a == GS_MEM_ALLOC_PTR_ALIGNMENT);
+  GSTestBytePool_free(&byte_pool, a);
+  GSTestBytePool_free(&byte_pool, b);
+  char* reused = GSTestBytePool_alloc(&byte_pool);
+  GS_ASSERT(reused == b);
+  reused = GSTestBytePool_alloc(&byte_pool);
+  GS_ASSERT(reused == a);
+
+  free(allocations);
+  free(ptr);
+  return true;
+}
+
+bool
+gs_handle_pool_test()
+{
+  void* ptr = malloc(GS_POOL_TEST_SIZE);
+  if(!ptr)
+    return false;
+
+  unsigned long long metadata_size = gs_handle_pool_metadata_size(GS_POOL_TEST_SIZE, 64, 16);
+  void* metadata_ptr = malloc(metadata_size);
+  if(!metadata_ptr)
+    return false;
+
+  int max_allocations = 1024;
+  GSHandle* handles = malloc(sizeof(GSHandle)*max_allocations);
+  if(!handles)
+    return false;
+
+  GSHandlePool pool = gs_handle_pool_init(ptr, GS_POOL_TEST_SIZE, 64, 16, metadata_ptr, metadata_size);
+  GS_ASSERT(pool.valid);
+  GS_ASSERT(!gs_handle_pool_valid(&pool, GS_HANDLE_NULL));
+
+  for(int i = 0; i < max_allocations; ++i)
+  {
+    handles[i] = GS_HANDLE_POOL_ALLOC_CHECKED(&pool);
+    int* data = (int*)GS_HANDLE_POOL_GET(&pool, handles[i]);
+    GS_ASSERT(data != NULL);
+    GS_ASSERT(gs_handle_pool_handle(&pool, data) == handles[i]);
+    *data = i;
+  }
+
+  // Testing that freed handles become stale and their blocks are reused
+  GSHandle stale = handles[10];
+  GS_HANDLE_POOL_FREE(&pool, stale);
+  GS_ASSERT(!gs_handle_pool_valid(&pool, stale));
+  GS_ASSERT(GS_HANDLE_POOL_GET(&pool, stale) == NULL);
+  handles[10] = GS_HANDLE_POOL_ALLOC_CHECKED(&pool);
+  GS_ASSERT(GS_HANDLE_INDEX(handles[10]) == GS_HANDLE_INDEX(stale));
+  GS_ASSERT(GS_HANDLE_GENERATION(handles[10]) != GS_HANDLE_GENERATION(stale));
+  GS_ASSERT(GS_HANDLE_POOL_GET(&pool, stale) == NULL);
+  *(int*)GS_HANDLE_POOL_GET(&pool, handles[10]) = 10;
+  for(int i = 0; i < max_allocations; ++i)
+  {
+    GS_ASSERT(*(int*)GS_HANDLE_POOL_GET(&pool, handles[i]) == i);
+  }
+
+  // Testing that flushing invalidates all the handles
+  GS_HANDLE_POOL_FLUSH(&pool);
+  for(int i = 0; i < max_allocations; ++i)
+  {
+    GS_ASSERT(!gs_handle_pool_valid(&pool, handles[i]));
+  }
+
+  // Testing that a full pool returns the null handle
+  unsigned long long count = 0;
+  while(GS_HANDLE_POOL_ALLOC(&pool) != GS_HANDLE_NULL)
+  {
+    count++;
+  }
+  GS_ASSERT(count <= pool.num_blocks && count >= pool.num_blocks - 2);
+
+  // Testing that generations wrap without producing the null handle
+  GS_HANDLE_POOL_FLUSH(&pool);
+  GSHandle handle = GS_HANDLE_POOL_ALLOC_CHECKED(&pool);
+  pool.p_generations[GS_HANDLE_INDEX(handle)] = (unsigned int)GS_HANDLE_GENERATION_LIMIT;
+  handle = GS_HANDLE_MAKE(GS_HANDLE_INDEX(handle), GS_HANDLE_GENERATION_LIMIT);
+  GS_HANDLE_POOL_FREE(&pool, handle);
+  GSHandle wrapped = GS_HANDLE_POOL_ALLOC_CHECKED(&pool);
+  GS_ASSERT(GS_HANDLE_INDEX(wrapped) == GS_HANDLE_INDEX(handle));
+  GS_ASSERT(GS_HANDLE_GENERATION(wrapped) == 1);
+  GS_ASSERT(wrapped != GS_HANDLE_NULL && gs_handle_pool_valid(&pool, wrapped));
+  GS_ASSERT(!gs_handle_pool_valid(&pool, handle));
+
+  // Testing that a metadata buffer too small is rejected without writing it
+  unsigned long long small_metadata[2] = {~0ull, ~0ull};
+  GSHandlePool small = gs_handle_pool_init(ptr, GS_POOL_TEST_SIZE, 16, 16, small_metadata, sizeof(small_metadata));
+  GS_ASSERT(!small.valid && !small.pool.valid);
+  GS_ASSERT(small_metadata[0] == ~0ull && small_metadata[1] == ~0ull);
+
+  free(handles);
+  free(metadata_ptr);
+  free(ptr);
+  return true;
+}
+
+typedef struct GSAtomicPoolTestArgs
+{
+  GSAtomicPool* pool;
+  int           id;
+  bool          success;
+} GSAtomicPoolTestArgs;
+
+void
+gs_atomic_pool_test_thread(void* arg)
+{
+  GSAtomicPoolTestArgs* args = (GSAtomicPoolTestArgs*)arg;
+  int max_allocations = 256;
+  int* allocations[256];
+  args->success = true;
+  for(int iteration = 0; iteration < 1000; ++iteration)
+  {
+    int count_allocations = 0;
+    for(int k = 0; k < max_allocations; ++k)
+    {
+      GSAlloc alloc = GS_ATOMIC_POOL_ALLOC_ALIGNED(args->pool, 
+                                                   sizeof(int)*4, 
+                                                   GS_MEM_ALLOC_MIN_ALIGNMENT);
+      if(gs_alloc_is_null(&alloc))
+        break;
+      int* block = (int*)gs_alloc_ptr(&alloc);
+      block[1] = args->id;
+      block[2] = k;
+      allocations[count_allocations++] = block;
+    }
+
+    // Blocks cannot be shared with other threads while they are alive
+    for(int k = 0; k < count_allocations; ++k)
+    {
+      if(allocations[k][1] != args->id || allocations[k][2] != k)
+      {
+        args->success = false;
+      }
+      GS_ATOMIC_POOL_FREE(args->pool, allocations[k]);
+    }
+  }
+}
+
+bool
+gs_atomic_pool_test()
+{
+  void* ptr = malloc(GS_POOL_TEST_SIZE);
+  if(!ptr)
+    return false;
+
+  unsigned long long block_size = 64;
+  unsigned int block_alignment = 16;
+  GSAtomicPool pool = gs_atomic_pool_init(ptr, 
+                                          GS_POOL_TEST_SIZE, 
+                                          block_size, 
+                                          block_alignment);
+
+  // Testing single threaded exhaustion and reuse
+  unsigned long long max_blocks = GS_POOL_TEST_SIZE / block_size;
+  unsigned long long count_blocks = 0;
+  void* last = NULL;
+  while(true)
+  {
+    GSAlloc alloc = GS_ATOMIC_POOL_ALLOC_ALIGNED(&pool, block_size, block_alignment);
+    if(gs_alloc_is_null(&alloc))
+      break;
+    last = gs_alloc_ptr(&alloc);
+    count_blocks++;
+  }
+  GS_ASSERT(count_blocks > 0 && count_blocks <= max_blocks);
+  GS_ATOMIC_POOL_FREE(&pool, last);
+  void* reused = GS_ATOMIC_POOL_ALLOC_ALIGNED_CHECKED(&pool, block_size, block_alignment);
+  GS_ASSERT(reused == last);
+  GS_ATOMIC_POOL_FLUSH(&pool);
+  GS_ASSERT(pool.p_current == pool.p_begin);
+
+  // Testing concurrent alloc and free
+  pool = gs_atomic_pool_init(ptr, 
+                             GS_POOL_TEST_SIZE, 
+                             sizeof(int)*4, 
+                             GS_MEM_ALLOC_MIN_ALIGNMENT);
+  GSAtomicPoolTestArgs args[GS_TEST_NUM_THREADS];
+  void* thread_args[GS_TEST_NUM_THREADS];
+  for(int i = 0; i < GS_TEST_NUM_THREADS; ++i)
+  {
+    args[i].pool = &pool;
+    args[i].id = i;
+    thread_args[i] = &args[i];
+  }
+  gs_test_run_threads(gs_atomic_pool_test_thread, thread_args);
+
+  bool success = true;
+  for(int i = 0; i < GS_TEST_NUM_THREADS; ++i)
+  {
+    success = success && args[i].success;
+  }
+
+  free(ptr);
+  return success;
+}
+
+#define GS_ATOMIC_SCRATCH_TEST_MAX_BLOCKS 1024
+#define GS_ATOMIC_SCRATCH_TEST_BLOCK_INTS 12
+
+typedef struct GSAtomicScratchTestArgs
+{
+  GSAtomicScratch*  scratch;
+  int               id;
+  bool              claim;                                                      // Whether to push into claimed sub-blocks
+  int               count;
+  int*              blocks[GS_ATOMIC_SCRATCH_TEST_MAX_BLOCKS];
+} GSAtomicScratchTestArgs;
+
+void
+gs_atomic_scratch_test_thread(void* arg)
+{
+  GSAtomicScratchTestArgs* args = (GSAtomicScratchTestArgs*)arg;
+  GSScratch local = gs_atomic_scratch_claim(args->scratch, 1024);
+  args->count = 0;
+  while(args->count < GS_ATOMIC_SCRATCH_TEST_MAX_BLOCKS)
+  {
+    unsigned int alignment = args->count % 4 == 0 ? 64 : GS_MEM_ALLOC_MIN_ALIGNMENT;
+    GSAlloc alloc;
+    if(args->claim)
+    {
+      if(!local.valid)
+        break;
+      alloc = GS_SCRATCH_PUSH_ALIGNED(&local, sizeof(int)*GS_ATOMIC_SCRATCH_TEST_BLOCK_INTS, alignment);
+      if(gs_alloc_is_null(&alloc))
+      {
+        local = gs_atomic_scratch_claim(args->scratch, 1024);
+        continue;
+      }
+    }
+    else
+    {
+      alloc = GS_ATOMIC_SCRATCH_PUSH_ALIGNED(args->scratch, sizeof(int)*GS_ATOMIC_SCRATCH_TEST_BLOCK_INTS, alignment);
+      if(gs_alloc_is_null(&alloc))
+        break;
+    }
+    int* block = (int*)gs_alloc_ptr(&alloc);
+    for(int k = 0; k < GS_ATOMIC_SCRATCH_TEST_BLOCK_INTS; ++k)
+    {
+      block[k] = args->id;
+    }
+    args->blocks[args->count++] = block;
+  }
+}
+
+// Checks that the blocks pushed by all threads are aligned, inside the scratch
+// and were not overwritten by other threads
+bool
+gs_atomic_scratch_test_check(GSAtomicScratch* scratch, 
+                             GSAtomicScratchTestArgs* args)
+{
+  unsigned long long pushed = 0;
+  for(int i = 0; i < GS_TEST_NUM_THREADS; ++i)
+  {
+    for(int j = 0; j < args[i].count; ++j)
+    {
+      int* block = args[i].blocks[j];
+      unsigned int alignment = j % 4 == 0 ? 64 : GS_MEM_ALLOC_MIN_ALIGNMENT;
+      if((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)block % alignment != 0 ||
+         (char*)block < (char*)scratch->p_begin || 
+         (char*)(block + GS_ATOMIC_SCRATCH_TEST_BLOCK_INTS) > (char*)scratch->p_end)
+        return false;
+      for(int k = 0; k < GS_ATOMIC_SCRATCH_TEST_BLOCK_INTS; ++k)
+      {
+        if(block[k] != args[i].id)
+          return false;
+      }
+    }
+    pushed += args[i].count*sizeof(int)*GS_ATOMIC_SCRATCH_TEST_BLOCK_INTS;
+  }
+  return pushed > 0 && pushed <= gs_atomic_scratch_usage(scratch);
+}
+
+bool
+gs_atomic_scratch_test()
+{
+  void* ptr = malloc(GS_SCRATCH_TEST_SIZE);
+  if(!ptr)
+    return false;
+
+  GSAtomicScratch scratch = gs_atomic_scratch_init(ptr, GS_SCRATCH_TEST_SIZE);
+  GS_ASSERT(scratch.valid);
+
+  // Testing single threaded pushes, with and without alignment padding
+  char* a = (char*)GS_ATOMIC_SCRATCH_PUSH_CHECKED(&scratch, 20);
+  GS_ASSERT(a == (char*)scratch.p_begin);
+  char* b = (char*)GS_ATOMIC_SCRATCH_PUSH_ALIGNED_CHECKED(&scratch, 8, 256);
+  GS_ASSERT((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)b % 256 == 0 && b >= a + 20);
+  char* c = (char*)GS_ATOMIC_SCRATCH_PUSH_CHECKED(&scratch, 1);
+  GS_ASSERT(c == b + GS_MEM_ALLOC_MIN_ALIGNMENT);
+  GS_ASSERT(gs_atomic_scratch_usage(&scratch) == GS_PTR_DIFF(c + GS_MEM_ALLOC_MIN_ALIGNMENT, scratch.p_begin));
+
+  // Checkpoints release the blocks pushed after them
+  GSAtomicScratchCheckpoint checkpoint = GS_ATOMIC_SCRATCH_CHECKPOINT(&scratch);
+  GS_ATOMIC_SCRATCH_PUSH_CHECKED(&scratch, 1000);
+  GS_ATOMIC_SCRATCH_RESTORE(&scratch, checkpoint);
+  char* d = (char*)GS_ATOMIC_SCRATCH_PUSH_CHECKED(&scratch, 16);
+  GS_ASSERT(d == c + GS_MEM_ALLOC_MIN_ALIGNMENT);
+
+  // Testing exhaustion, requests that would overflow the offset fail
+  GSAlloc alloc = GS_ATOMIC_SCRATCH_PUSH(&scratch, 0xffffffffffffff00ull);
+  GS_ASSERT(gs_alloc_is_null(&alloc));
+  alloc = GS_ATOMIC_SCRATCH_PUSH(&scratch, GS_SCRATCH_TEST_SIZE);
+  GS_ASSERT(gs_alloc_is_null(&alloc));
+  GSScratch local = gs_atomic_scratch_claim(&scratch, GS_SCRATCH_TEST_SIZE);
+  GS_ASSERT(!local.valid);
+  GS_ATOMIC_SCRATCH_FLUSH(&scratch);
+  GS_ASSERT(gs_atomic_scratch_usage(&scratch) == 0);
+  alloc = GS_ATOMIC_SCRATCH_PUSH(&scratch, GS_SCRATCH_TEST_SIZE);
+  GS_ASSERT(!gs_alloc_is_null(&alloc));
+  GS_ASSERT(gs_atomic_scratch_usage(&scratch) == GS_SCRATCH_TEST_SIZE);
+  alloc = GS_ATOMIC_SCRATCH_PUSH(&scratch, 1);
+  GS_ASSERT(gs_alloc_is_null(&alloc));
+  GS_ATOMIC_SCRATCH_FLUSH(&scratch);
+
+  // Testing concurrent pushes until the scratch is exhausted, directly and
+  // through claimed sub-blocks
+  GSAtomicScratchTestArgs* args = (GSAtomicScratchTestArgs*)malloc(sizeof(GSAtomicScratchTestArgs)*GS_TEST_NUM_THREADS);
+  if(!args)
+    return false;
+  void* thread_args[GS_TEST_NUM_THREADS];
+  bool success = true;
+  for(int claim = 0; claim < 2; ++claim)
+  {
+    scratch = gs_atomic_scratch_init(ptr, 64*1024);
+    for(int i = 0; i < GS_TEST_NUM_THREADS; ++i)
+    {
+      args[i].scratch = &scratch;
+      args[i].id = i;
+      args[i].claim = claim == 1;
+      thread_args[i] = &args[i];
+    }
+    gs_test_run_threads(gs_atomic_scratch_test_thread, thread_args);
+    success = success && gs_atomic_scratch_test_check(&scratch, args);
+  }
+
+  free(args);
+  free(ptr);
+  return success;
+}
+
+typedef struct GSPoolCacheTestArgs
+{
+  GSPoolDepot*  depot;
+  int           id;
+  bool          success;
+} GSPoolCacheTestArgs;
+
+void
+gs_pool_cache_test_thread(void* arg)
+{
+  GSPoolCacheTestArgs* args = (GSPoolCacheTestArgs*)arg;
+  int max_allocations = 256;
+  int* allocations[256];
+  GSPoolCache cache = gs_pool_cache_init(args->depot);
+  args->success = cache.valid;
+  if(!cache.valid)
+    return;
+
+  for(int iteration = 0; iteration < 1000; ++iteration)
+  {
+    int count_allocations = (unsigned int)rand() % max_allocations;
+    for(int k = 0; k < count_allocations; ++k)
+    {
+      int* block = (int*)GS_POOL_CACHE_ALLOC_ALIGNED_CHECKED(&cache, 
+                                                             sizeof(int)*4, 
+                                                             GS_MEM_ALLOC_MIN_ALIGNMENT);
+      block[1] = args->id;
+      block[2] = k;
+      allocations[k] = block;
+    }
+
+    for(int k = 0; k < count_allocations; ++k)
+    {
+      if(allocations[k][1] != args->id || allocations[k][2] != k)
+      {
+        args->success = false;
+      }
+      GS_POOL_CACHE_FREE(&cache, allocations[k]);
+    }
+  }
+  gs_pool_cache_release(&cache);
+}
+
+bool
+gs_pool_cache_test()
+{
+  void* ptr = malloc(GS_POOL_TEST_SIZE);
+  if(!ptr)
+    return false;
+
+  unsigned long long depot_size = 64*1024;
+  void* depot_ptr = malloc(depot_size);
+  if(!depot_ptr)
+    return false;
+
+  GSPool pool = gs_pool_init(ptr, 
+                             GS_POOL_TEST_SIZE, 
+                             sizeof(int)*4, 
+                             GS_MEM_ALLOC_MIN_ALIGNMENT);
+  GSPoolDepot depot = gs_pool_depot_init(&pool, depot_ptr, depot_size, 32);
+  GS_ASSERT(depot.valid);
+
+  // Testing single threaded magazine exchanges 
+  GSPoolCache cache = gs_pool_cache_init(&depot);
+  GS_ASSERT(cache.valid);
+  void* allocations[1024];
+  for(int i = 0; i < 1024; ++i)
+  {
+    allocations[i] = GS_POOL_CACHE_ALLOC_ALIGNED_CHECKED(&cache, sizeof(int)*4, GS_MEM_ALLOC_MIN_ALIGNMENT);
+  }
+  for(int i = 0; i < 1024; ++i)
+  {
+    GS_POOL_CACHE_FREE(&cache, allocations[i]);
+  }
+  GS_ASSERT(depot.p_full != NULL);
+  gs_pool_cache_release(&cache);
+  gs_pool_depot_drain(&depot);
+  GS_ASSERT(depot.p_full == NULL);
+
+  // All blocks must be back in the pool
+  unsigned long long count_free = 0;
+  for(void* next = pool.p_next_free; next != NULL; next = *(void**)next)
+  {
+    count_free++;
+  }
+  GS_ASSERT(count_free == (GS_PTR_DIFF(pool.p_current, pool.p_begin)) / pool.stride);
+
+  // Testing concurrent usage of several caches
+  GSPoolCacheTestArgs args[GS_TEST_NUM_THREADS];
+  void* thread_args[GS_TEST_NUM_THREADS];
+  for(int i = 0; i < GS_TEST_NUM_THREADS; ++i)
+  {
+    args[i].depot = &depot;
+    args[i].id = i;
+    thread_args[i] = &args[i];
+  }
+  gs_test_run_threads(gs_pool_cache_test_thread, thread_args);
+
+  bool success = true;
+  for(int i = 0; i < GS_TEST_NUM_THREADS; ++i)
+  {
+    success = success && args[i].success;
+  }
+
+  free(depot_ptr);
+  free(ptr);
+  return success;
+}
+
+bool
+gs_slab_pool_test()
+{
+  unsigned long long slab_size = 16*1024;
+  unsigned long long bsize = 1000;
+  GSSlabPool pool = gs_slab_pool_init(bsize, 
+                                      GS_MEM_ALLOC_MIN_ALIGNMENT, 
+                                      slab_size, 
+                                      1, 
+                                      gs_chunk_backing_vm(slab_size));
+  GS_ASSERT(pool.valid);
+  GS_ASSERT(pool.blocks_per_slab == 16);
+  GS_ASSERT(pool.num_colors > 1);
+
+  // Testing that the pool grows slab by slab
+  void* allocations[4*16];
+  for(int i = 0; i < 4*16; ++i)
+  {
+    allocations[i] = GS_SLAB_POOL_ALLOC_ALIGNED_CHECKED(&pool, bsize, GS_MEM_ALLOC_MIN_ALIGNMENT);
+    GS_ASSERT((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)allocations[i] % GS_MEM_ALLOC_MIN_ALIGNMENT == 0);
+    memset(allocations[i], i, bsize);
+  }
+  GS_ASSERT(pool.num_slabs == 4);
+
+  // Testing that consecutive slabs are colored differently
+  for(int i = 0; i < 4; ++i)
+  {
+    GSSlab* slab = (GSSlab*)((GS_MEM_ALLOC_PTR_NUMERIC_TYPE)allocations[i*16] & ~(slab_size - 1));
+    GS_ASSERT(slab->color == (i % pool.num_colors)*pool.color_step);
+    GS_ASSERT(GS_PTR_DIFF(allocations[i*16], slab) == pool.first_block_offset + slab->color);
+    GS_ASSERT((char*)allocations[i*16 + 15] + bsize <= (char*)slab + slab_size);
+  }
+  for(int i = 0; i < 4*16; ++i)
+  {
+    GS_ASSERT(*(unsigned char*)allocations[i] == (unsigned char)i);
+  }
+
+  // Testing that allocations are served from the fullest partial slab
+  for(int i = 0; i < 10; ++i)
+  {
+    GS_SLAB_POOL_FREE(&pool, allocations[i]);
+  }
+  GS_SLAB_POOL_FREE(&pool, allocations[16]);
+  GS_SLAB_POOL_FREE(&pool, allocations[17]);
+  void* block = GS_SLAB_POOL_ALLOC_ALIGNED_CHECKED(&pool, bsize, GS_MEM_ALLOC_MIN_ALIGNMENT);
+  GS_ASSERT(block == allocations[17]);
+  block = GS_SLAB_POOL_ALLOC_ALIGNED_CHECKED(&pool, bsize, GS_MEM_ALLOC_MIN_ALIGNMENT);
+  GS_ASSERT(block == allocations[16]);
+  block = GS_SLAB_POOL_ALLOC_ALIGNED_CHECKED(&pool, bsize, GS_MEM_ALLOC_MIN_ALIGNMENT);
+  GS_ASSERT(block == allocations[9]);
+
+  // Testing that empty slabs past the threshold are released. The current
+  // slab is kept even if it becomes empty
+  GS_SLAB_POOL_FREE(&pool, block);
+  for(int i = 10; i < 16; ++i)
+  {
+    GS_SLAB_POOL_FREE(&pool, allocations[i]);
+  }
+  GS_ASSERT(pool.num_empty == 0 && pool.num_slabs == 4);
+  for(int i = 32; i < 48; ++i)
+  {
+    GS_SLAB_POOL_FREE(&pool, allocations[i]);
+  }
+  GS_ASSERT(pool.num_empty == 1 && pool.num_slabs == 4);
+  for(int i = 48; i < 64; ++i)
+  {
+    GS_SLAB_POOL_FREE(&pool, allocations[i]);
+  }
+  GS_ASSERT(pool.num_empty == 1 && pool.num_slabs == 3);
+
+  // Testing that empty slabs are reused
+  for(int i = 0; i < 17; ++i)
+  {
+    allocations[i] = GS_SLAB_POOL_ALLOC_ALIGNED_CHECKED(&pool, bsize, GS_MEM_ALLOC_MIN_ALIGNMENT);
+  }
+  GS_ASSERT(pool.num_empty == 0 && pool.num_slabs == 3);
+
+  GS_SLAB_POOL_FLUSH(&pool);
+  GS_ASSERT(pool.num_empty == 1 && pool.num_slabs == 1);
+  GS_ASSERT(pool.p_current == NULL && pool.p_partial == NULL && pool.p_full == NULL);
+  block = GS_SLAB_POOL_ALLOC_ALIGNED_CHECKED(&pool, bsize, GS_MEM_ALLOC_MIN_ALIGNMENT);
+  GS_ASSERT(GS_PTR_DIFF(block, pool.p_current) == pool.first_block_offset + pool.p_current->color);
+  gs_slab_pool_release(&pool);
+
+  // Testing invalid slab sizes
+  pool = gs_slab_pool_init(bsize, GS_MEM_ALLOC_MIN_ALIGNMENT, 3*1024, 1, gs_chunk_backing_vm(4096));
+  GS_ASSERT(!pool.valid);
+  pool = gs_slab_pool_init(bsize, GS_MEM_ALLOC_MIN_ALIGNMENT, 512, 1, gs_chunk_backing_vm(4096));
+  GS_ASSERT(!pool.valid);
+  return true;
+}
+
+static void*
+gs_test_malloc_chunk(void* user_data, 
+                     unsigned long long size)
+{
+  (*(int*)user_data)++;
+  return malloc(size);
+}
+
+static void
+gs_test_free_chunk(void* user_data, 
+                   void* ptr, 
+                   unsigned long long size)
+{
+  (void)size;
+  (*(int*)user_data)--;
+  free(ptr);
+}
+
+bool
+gs_size_class_test()
+{
+  void* ptr = malloc(GS_POOL_TEST_SIZE);
+  if(!ptr)
+    return false;
+
+  unsigned long long allocation_sizes[] = {1, 4, 8, 12, 16, 20, 24, 30, 32, 48, 100, 128, 160, 256, 500, 512, 720, 1024, 3000, 4096, 5000, 20000};
+  int count_sizes = sizeof(allocation_sizes) / sizeof(unsigned long long);
+  unsigned int allocation_alignments[] = {4, 8, 16, 32, 64};
+  int count_alignments = sizeof(allocation_alignments) / sizeof(unsigned int);
+  int max_allocations = 1024;
+  void** allocations = malloc(sizeof(void*)*max_allocations);
+  unsigned long long* sizes = malloc(sizeof(unsigned long long)*max_allocations);
+  if(!allocations || !sizes)
+    return false;
+  memset(allocations, 0, sizeof(void*)*max_allocations);
+
+  int live_fallback_chunks = 0;
+  GSChunkBacking fallback;
+  fallback.alloc = gs_test_malloc_chunk;
+  fallback.free = gs_test_free_chunk;
+  fallback.user_data = &live_fallback_chunks;
+  GSSizeClassAllocator allocator = gs_size_class_init(ptr, GS_POOL_TEST_SIZE, fallback);
+  GS_ASSERT(allocator.valid);
+
+  for(int k = 0; k < 100000; ++k)
+  {
+    int index = (unsigned int)rand() % max_allocations;
+    if(allocations[index] == NULL)
+    {
+      unsigned long long next_size = allocation_sizes[(unsigned int)rand() % count_sizes];
+      unsigned int next_alignment = allocation_alignments[(unsigned int)rand() % count_alignments];
+      unsigned char* data = (unsigned char*)GS_SIZE_CLASS_ALLOC_ALIGNED_CHECKED(&allocator, next_size, next_alignment);
+      GS_ASSERT((unsigned long long)data % next_alignment == 0);
+      memset(data, index & 0xff, next_size);
+      allocations[index] = data;
+      sizes[index] = next_size;
+    }
+    else
+    {
+      // Blocks cannot overlap, so their contents must be intact
+      unsigned char* data = (unsigned char*)allocations[index];
+      for(unsigned long long i = 0; i < sizes[index]; ++i)
+      {
+        GS_ASSERT(data[i] == (index & 0xff));
+      }
+      GS_SIZE_CLASS_FREE(&allocator, data);
+      allocations[index] = NULL;
+    }
+  }
+
+  for(int i = 0; i < max_allocations; ++i)
+  {
+    if(allocations[i] != NULL)
+    {
+      GS_SIZE_CLASS_FREE(&allocator, allocations[i]);
+    }
+  }
+  GS_ASSERT(live_fallback_chunks == 0);
+  GS_SIZE_CLASS_FLUSH(&allocator);
+  GS_ASSERT(allocator.p_next_page == allocator.p_begin);
+
+  free(sizes);
+  free(allocations);
+  free(ptr);
+  return true;
+}
+
+bool
+gs_tlsf_test()
+{
+  void* ptr = malloc(GS_POOL_TEST_SIZE);
+  if(!ptr)
+    return false;
+
+  unsigned long long allocation_sizes[] = {1, 4, 8, 16, 20, 24, 30, 32, 48, 128, 160, 256, 500, 512, 720, 1024, 4000, 16000};
+  int count_sizes = sizeof(allocation_sizes) / sizeof(unsigned long long);
+  unsigned int allocation_alignments[] = {4, 8, 16, 32, 64, 256};
+  int count_alignments = sizeof(allocation_alignments) / sizeof(unsigned int);
+  int max_allocations = 1024;
+  void** allocations = malloc(sizeof(void*)*max_allocations);
+  unsigned long long* sizes = malloc(sizeof(unsigned long long)*max_allocations);
+  if(!allocations || !sizes)
+    return false;
+  memset(allocations, 0, sizeof(void*)*max_allocations);
+
+  GSTlsf tlsf = gs_tlsf_init(ptr, GS_POOL_TEST_SIZE);
+  GS_ASSERT(tlsf.valid);
+
+  // Testing random alloc and free order
+  for(int k = 0; k < 200000; ++k)
+  {
+    int index = (unsigned int)rand() % max_allocations;
+    if(allocations[index] == NULL)
+    {
+      unsigned long long next_size = allocation_sizes[(unsigned int)rand() % count_sizes];
+      unsigned int next_alignment = allocation_alignments[(unsigned int)rand() % count_alignments];
+      GSAlloc alloc = GS_TLSF_ALLOC_ALIGNED(&tlsf, next_size, next_alignment);
+      if(gs_alloc_is_null(&alloc))
+        continue;
+      unsigned char* data = (unsigned char*)gs_alloc_ptr(&alloc);
+      GS_ASSERT((unsigned long long)data % next_alignment == 0);
+      memset(data, index & 0xff, next_size);
+      allocations[index] = data;
+      sizes[index] = next_size;
+    }
+    else
+    {
+      // Blocks cannot overlap, so their contents must be intact
+      unsigned char* data = (unsigned char*)allocations[index];
+      for(unsigned long long i = 0; i < sizes[index]; ++i)
+      {
+        GS_ASSERT(data[i] == (index & 0xff));
+      }
+      GS_TLSF_FREE(&tlsf, data);
+      allocations[index] = NULL;
+    }
+  }
+
+  for(int i = 0; i < max_allocations; ++i)
+  {
+    if(allocations[i] != NULL)
+    {
+      GS_TLSF_FREE(&tlsf, allocations[i]);
+    }
+  }
+
+  // Testing that all the free blocks have been coalesced back into one 
+  unsigned long long free_size = GS_PTR_DIFF(tlsf.p_end, tlsf.p_begin);
+  void* whole = GS_TLSF_ALLOC_CHECKED(&tlsf, free_size / 2);
+  GS_TLSF_FREE(&tlsf, whole);
+  GS_TLSF_FLUSH(&tlsf);
+  whole = GS_TLSF_ALLOC_CHECKED(&tlsf, free_size / 2);
+
+  free(sizes);
+  free(allocations);
+  free(ptr);
+  return true;
+}
+
+bool
+gs_stats_test()
+{
+  void* ptr = malloc(GS_STACK_TEST_SIZE);
+  if(!ptr)
+    return false;
+
+  // Testing stack stats
+  GSStack stack = gs_stack_init(ptr, 4096);
+  void* data = GS_STACK_PUSH_ALIGNED_CHECKED(&stack, 10, 16);
+  GSAllocStats stats = gs_stack_get_stats(&stack);
+  GS_ASSERT(stats.num_allocs == 1);
+  GS_ASSERT(stats.bytes_in_use == (GS_PTR_DIFF(stack.p_current, stack.p_begin)));
+  GS_ASSERT(stats.bytes_in_use == 10 + stats.padding_bytes + stats.overhead_bytes);
+  GS_ASSERT(stats.overhead_bytes >= GS_MEM_ALLOC_PTR_ALIGNMENT);
+  GSStackCheckpoint stack_checkpoint = GS_STACK_CHECKPOINT(&stack);
+  GS_STACK_PUSH_CHECKED(&stack, 1000);
+  GS_STACK_RESTORE(&stack, stack_checkpoint);
+  GSAlloc alloc = GS_STACK_PUSH(&stack, 8192);
+  GS_ASSERT(gs_alloc_is_null(&alloc));
+  GS_STACK_POP(&stack, data);
+  stats = gs_stack_get_stats(&stack);
+  GS_ASSERT(stats.num_allocs == 2);
+  GS_ASSERT(stats.num_frees == 1);
+  GS_ASSERT(stats.num_failed_allocs == 1);
+  GS_ASSERT(stats.bytes_in_use == 0);
+  GS_ASSERT(stats.high_water_mark > 1000);
+
+  // Testing chained scratch stats
+  int num_chunks = 0;
+  GSChunkBacking backing;
+  backing.alloc = gs_test_malloc_chunk;
+  backing.free = gs_test_free_chunk;
+  backing.user_data = &num_chunks;
+  GSScratch scratch = gs_scratch_init_chained(ptr, 4096, backing, 4096);
+  for(int i = 0; i < 16; ++i)
+  {
+    GS_SCRATCH_PUSH_ALIGNED_CHECKED(&scratch, 1000, 64);
+  }
+  stats = gs_scratch_get_stats(&scratch);
+  GS_ASSERT(num_chunks > 0);
+  GS_ASSERT(stats.num_allocs == 16);
+  GS_ASSERT(stats.bytes_in_use >= 16*1000 + stats.padding_bytes);
+  GS_ASSERT(stats.high_water_mark == stats.bytes_in_use);
+  gs_scratch_flush_release(&scratch);
+  stats = gs_scratch_get_stats(&scratch);
+  GS_ASSERT(stats.bytes_in_use == 0);
+  GS_ASSERT(stats.num_allocs == 16);
+  GS_ASSERT(num_chunks == 0);
+
+  // Testing pool stats
+  GSPool pool = gs_pool_init(ptr, 4096, 24, 16);
+  void* blocks[4];
+  for(int i = 0; i < 4; ++i)
+  {
+    blocks[i] = GS_POOL_ALLOC_ALIGNED_CHECKED(&pool, 24, 16);
+  }
+  GS_POOL_FREE(&pool, blocks[1]);
+  GS_POOL_FREE(&pool, blocks[2]);
+  stats = gs_pool_get_stats(&pool);
+  GS_ASSERT(stats.live_blocks == 2);
+  GS_ASSERT(stats.free_list_length == 2);
+  GS_ASSERT(stats.bytes_in_use == 2*pool.stride);
+  GS_ASSERT(stats.high_water_mark == 4*pool.stride);
+  GS_ASSERT(stats.padding_bytes == 4*(pool.stride - 24));
+  unsigned long long allocated = gs_pool_alloc_n(&pool, 3, blocks);
+  GS_ASSERT(allocated == 3);
+  stats = gs_pool_get_stats(&pool);
+  GS_ASSERT(stats.num_allocs == 7);
+  GS_ASSERT(stats.num_frees == 2);
+  GS_ASSERT(stats.live_blocks == 5);
+  GS_ASSERT(stats.free_list_length == 0);
+  GS_POOL_FLUSH(&pool);
+  stats = gs_pool_get_stats(&pool);
+  GS_ASSERT(stats.live_blocks == 0);
+  GS_ASSERT(stats.bytes_in_use == 0);
+
+  free(ptr);
+  return true;
+}
+
+bool
+gs_trace_test()
+{
+  void* ptr = malloc(GS_STACK_TEST_SIZE);
+  if(!ptr)
+    return false;
+  GSTraceEvent events[16];
+
+  // Testing that operations are recorded in order
+  GSTrace trace = gs_trace_init(events, sizeof(events));
+  GS_ASSERT(trace.valid && trace.capacity == 16);
+  gs_trace_begin(&trace);
+  GSStack stack = gs_stack_init(ptr, 4096);
+  void* data = GS_STACK_PUSH_ALIGNED_CHECKED(&stack, 100, 32);
+  GSStackCheckpoint checkpoint = GS_STACK_CHECKPOINT(&stack);
+  GS_STACK_PUSH_CHECKED(&stack, 200);
+  GS_STACK_RESTORE(&stack, checkpoint);
+  GS_STACK_POP(&stack, data);
+  GSPool pool = gs_pool_init((char*)ptr + 4096, 4096, 32, 16);
+  void* block = GS_POOL_ALLOC_ALIGNED_CHECKED(&pool, 32, 16);
+  GS_POOL_FREE(&pool, block);
+  gs_trace_end();
+  GS_STACK_FLUSH(&stack);
+
+  GS_ASSERT(trace.count == 9);
+  GS_ASSERT(events[0].op == GS_TRACE_OP_INIT && events[0].allocator == GS_TRACE_STACK && events[0].size == 4096);
+  GS_ASSERT(events[1].op == GS_TRACE_OP_ALLOC && events[1].ptr == (unsigned long long)data && events[1].size == 100 && events[1].alignment == 32);
+  GS_ASSERT(events[2].op == GS_TRACE_OP_CHECKPOINT && events[4].op == GS_TRACE_OP_RESTORE && events[2].ptr == events[4].ptr);
+  GS_ASSERT(events[5].op == GS_TRACE_OP_FREE && events[5].ptr == (unsigned long long)data);
+  GS_ASSERT(events[6].op == GS_TRACE_OP_INIT && events[6].allocator == GS_TRACE_POOL && events[6].ptr == 32);
+  GS_ASSERT(events[6].id != events[0].id && events[8].id == events[6].id && events[8].op == GS_TRACE_OP_FREE);
+
+  // Testing that the ring buffer keeps the latest events and dumps them in order
+  gs_trace_begin(&trace);
+  for(int i = 0; i < 20; ++i)
+  {
+    GS_STACK_PUSH_CHECKED(&stack, i + 1);
+  }
+  gs_trace_end();
+  const char* path = "gs_mem_alloc_test.trace";
+  GS_ASSERT(gs_trace_dump(&trace, path));
+  FILE* file = fopen(path, "rb");
+  GS_ASSERT(file != NULL);
+  GSTraceFileHeader header;
+  GS_ASSERT(fread(&header, sizeof(header), 1, file) == 1);
+  GS_ASSERT(header.magic == GS_TRACE_FILE_MAGIC && header.event_size == sizeof(GSTraceEvent));
+  GS_ASSERT(header.num_events == 16 && header.num_dropped == 13);
+  for(int i = 0; i < 16; ++i)
+  {
+    GSTraceEvent event;
+    GS_ASSERT(fread(&event, sizeof(event), 1, file) == 1);
+    GS_ASSERT(event.op == GS_TRACE_OP_ALLOC && event.size == (unsigned long long)i + 5);
+  }
+  fclose(file);
+  remove(path);
+
+  free(ptr);
+  return true;
+}
+
+int 
+main(int argc, char** argv)
+{
+  int EXIT_CODE = 0;
+
+  if(!gs_stack_test())
+  {
+    EXIT_CODE = 1;
+    goto exit;
+  }
+
+  if(!gs_compact_stack_test())
+  {
+    EXIT_CODE = 1;
+    goto exit;
+  }
+
+  if(!gs_double_stack_test())
+  {
+    EXIT_CODE = 1;
+    goto exit;
+  }
+
+  if(!gs_scratch_test())
+  {
+    EXIT_CODE = 1;
+    goto exit;
+  }
+  
+  if(!gs_scratch_chained_test())
+  {
+    EXIT_CODE = 1;
+    goto exit;
+  }
+
+  if(!gs_frame_scratch_test())
+  {
+    EXIT_CODE = 1;
+    goto exit;
+  }
+
+  if(!gs_resize_test())
+  {
+    EXIT_CODE = 1;
+    goto exit;
+  }
+
+  if(!gs_virtual_test())
+  {
+    EXIT_CODE = 1;
+    goto exit;
+  }
+
+  if(!gs_trim_test())
+  {
+    EXIT_CODE = 1;
+    goto exit;
+  }
+
+  if(!gs_huge_test())
+  {
+    EXIT_CODE = 1;
+    goto exit;
+  }
+
+  if(!gs_node_set_test())
+  {
+    EXIT_CODE = 1;
+    goto exit;
+  }
+
+  if(!gs_pool_test())
+  {
+    EXIT_CODE = 1;
+    goto exit;
+  }
+
+  if(!gs_pool_bitmap_test())
+  {
+    EXIT_CODE = 1;
+    goto exit;
+  }
+
+  if(!gs_pool_compact_test())
+  {
+    EXIT_CODE = 1;
+    goto exit;
+  }
+
+  if(!gs_typed_pool_test())
+  {
+    EXIT_CODE = 1;
+    goto exit;
+  }
+
+  if(!gs_handle_pool_test())
+  {
+    EXIT_CODE = 1;
+    goto exit;
+  }
+
+  if(!gs_atomic_pool_test())
+  {
+    EXIT_CODE = 1;
+    goto exit;
+  }
+
+  if(!gs_atomic_scratch_test())
+  {
+    EXIT_CODE = 1;
+    goto exit;
+  }
+
+  if(!gs_pool_cache_test())
+  {
+    EXIT_CODE = 1;
+    goto exit;
+  }
+
+  if(!gs_slab_pool_test())
+  {
+    EXIT_CODE = 1;
+    goto exit;
+  }
+
+  if(!gs_size_class_test())
+  {
+    EXIT_CODE = 1;
+    goto exit;
+  }
+
+  if(!gs_tlsf_test())
+  {
+    EXIT_CODE = 1;
+    goto exit;
+  }
+
+  if(!gs_stats_test())
+  {
+    EXIT_CODE = 1;
+    goto exit;
+  }
+
+  if(!gs_trace_test())
   {
     EXIT_CODE = 1;
     goto exit;
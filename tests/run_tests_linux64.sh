@@ -29,7 +29,7 @@ fi
 echo "RUNNING TESTS WITH TARGET ${TARGET}"
 
 BUILD_DIR="build_linux64_${TARGET}"
-TESTS="gs_mem_alloc_test"
+TESTS="gs_mem_alloc_test gs_mem_alloc_cpp_test"
 
 for a in ${TESTS} 
 do
@@ -27,7 +27,7 @@ ECHO "RUNNING TESTS WITH TARGET %TARGET%"
 SET BUILD_DIR=build_win64_%TARGET%
 MKDIR %BUILD_DIR%
 
-SET TESTS=gs_mem_alloc_test
+SET TESTS=gs_mem_alloc_test gs_mem_alloc_cpp_test
 
 FOR %%a in (%TESTS%) do (
   ECHO Executing %%a test